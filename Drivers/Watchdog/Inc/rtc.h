@@ -1,16 +1,26 @@
 #ifndef RTC_H
 #define RTC_H
 
+/* Personal Includes */
+#include "datetime.h"
+
 /* Public Macros */
 #define RTC_DATE_TIME_CHAR_LENGTH 20
 
 /**
- * @brief Requests the time from the real time clock, formats
- * the time into dd/mm/yy hh:mm format and then stores that as
- * a string into the given char array.
+ * @brief Sets the system clock to the given datetime. The clock keeps
+ * counting from there until it is set again
+ *
+ * @param datetime The datetime read from the real time clock
+ */
+void rtc_set_date_time(dt_datetime_t* datetime);
+
+/**
+ * @brief Reads the system clock, formats the time into dd/mm/yyyy hh:mm:ss
+ * format and then stores that as a string into the given char array.
  *
  * @param str The array for the formatted time to be stored in.
- * Ensure that this array is at least 15 characters long
+ * Ensure that this array is at least RTC_DATE_TIME_CHAR_LENGTH characters long
  */
 void rtc_get_formatted_date_time(char* str);
 
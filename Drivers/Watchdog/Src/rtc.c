@@ -1,24 +1,39 @@
 /* Public Includes */
 #include <stdio.h> // Required for sprintf() function
+#include <sys/time.h>
+#include <time.h>
 
 /* Private Includes */
 #include "rtc.h"
-#include <time.h> // Dummy time for the moment until rtc is connected
 
-void rtc_get_formatted_date_time(char* str) {
+void rtc_set_date_time(dt_datetime_t* datetime) {
+
+    // The ESP32 has no battery backed clock so the system clock is set from the
+    // datetime the STM32 reads from its RTC and then keeps counting on its own
+    struct tm tm = {
+        .tm_sec   = datetime->time.second,
+        .tm_min   = datetime->time.minute,
+        .tm_hour  = datetime->time.hour,
+        .tm_mday  = datetime->date.day,
+        .tm_mon   = datetime->date.month - 1,
+        .tm_year  = datetime->date.year - 1900,
+        .tm_isdst = 0,
+    };
 
-    // TODO: Read the time from the real time clock
+    struct timeval now = {
+        .tv_sec  = mktime(&tm),
+        .tv_usec = 0,
+    };
 
-    // Store the time into the given string
-    int day   = 1;
-    int month = 1;
-    int year  = 2023;
-    // int minute       = 30;
-    // int hour12hrTime = 9;
-    // int am           = 1;
+    settimeofday(&now, NULL);
+}
+
+void rtc_get_formatted_date_time(char* str) {
 
-    // sprintf(str, "%d/%d/%d %d:%d%s", day, month, year, hour12hrTime, minute, am == 1 ? "am" :
-    // "pm");
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
 
-    sprintf(str, "%d/%d/%d %ld", day, month, year, time(NULL));
-}
\ No newline at end of file
+    sprintf(str, "%02d/%02d/%04d %02d:%02d:%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900, tm.tm_hour, tm.tm_min,
+            tm.tm_sec);
+}
@@ -0,0 +1,216 @@
+/**
+ * @file bpacket_bench.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the bpacket code on the host and sends a JPEG the way the ESP32
+ * does with legacy, extended and checked framing. Prints the bytes each one puts
+ * on the wire, how long that takes at 115200 baud and how many bpackets a second
+ * the host can encode and parse, e.g. ./build/bpacket_bench picture.jpeg 100
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Personal Includes */
+#include "bpacket.h"
+#include "bpacket_parser.h"
+#include "utilities.h"
+
+#define DEFAULT_JPEG_PATH "../../Drivers/ESP32_Camera/test/pictures/test_outside.jpeg"
+#define DEFAULT_NUM_RUNS  100
+#define BAUD_RATE         115200
+#define BITS_PER_BYTE     10 // A start and stop bit are sent with every byte
+#define BENCH_REQUEST     BPACKET_SPECIFIC_R_OFFSET
+
+#define BENCH_LEGACY   0
+#define BENCH_EXTENDED 1
+#define BENCH_CHECKED  2
+
+/* Private Variables */
+
+// Everything the ESP32 would have put on the UART
+static uint8_t* wire;
+static uint32_t wireNumBytes;
+static uint32_t wireNumWrites;
+
+// Everything Maple would have written to the file
+static uint8_t* received;
+static uint32_t receivedNumBytes;
+static uint32_t numBpacketsReceived;
+static uint32_t numCrcFailures;
+
+static double bench_get_time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000.0) + (now.tv_nsec / 1000000.0);
+}
+
+static void bench_transmit(uint8_t* data, uint16_t bufferNumBytes) {
+    memcpy(&wire[wireNumBytes], data, bufferNumBytes);
+    wireNumBytes += bufferNumBytes;
+    wireNumWrites++;
+}
+
+static void bench_bpacket_received(uint8_t id, bpacket_t* bpacket) {
+
+    if (bpacket->crcStatus == BPACKET_CRC_FAILED) {
+        numCrcFailures++;
+    }
+
+    memcpy(&received[receivedNumBytes], bpacket->bytes, bpacket->numBytes);
+    receivedNumBytes += bpacket->numBytes;
+    numBpacketsReceived++;
+}
+
+static void bench_set_framing(uint8_t framing) {
+
+    // Negotiated the same way the ESP32 does when Maple sends BPACKET_GEN_R_EXT_FRAMING
+    bpacket_t request = {.numBytes = 0};
+
+    if (framing != BENCH_LEGACY) {
+        request.numBytes = 3;
+        request.bytes[0] = (BPACKET_EXT_MAX_NUM_DATA_BYTES >> 8) & 0xFF;
+        request.bytes[1] = BPACKET_EXT_MAX_NUM_DATA_BYTES & 0xFF;
+        request.bytes[2] = (framing == BENCH_CHECKED) ? BPACKET_EXT_FLAG_CRC : 0;
+    }
+
+    bpacket_negotiate_ext_framing(&request);
+}
+
+static void bench_parse_wire(void) {
+
+    static bpacket_t bpacket;
+    bpacket_parser_t parser;
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_MAPLE, &bpacket, bench_bpacket_received);
+
+    receivedNumBytes    = 0;
+    numBpacketsReceived = 0;
+
+    uint32_t numBytesParsed = 0;
+    while (numBytesParsed < wireNumBytes) {
+        numBytesParsed += bpacket_parser_parse(&parser, &wire[numBytesParsed], wireNumBytes - numBytesParsed);
+    }
+}
+
+static uint8_t bench_framing(char* name, uint8_t framing, uint8_t* image, uint32_t imageNumBytes, uint32_t numRuns) {
+
+    bench_set_framing(framing);
+
+    // Send once to check the image gets through untouched
+    wireNumBytes  = 0;
+    wireNumWrites = 0;
+    bpacket_send_data(bench_transmit, BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_ESP32, BENCH_REQUEST, image,
+                      imageNumBytes);
+    bench_parse_wire();
+
+    if ((receivedNumBytes != imageNumBytes) || (memcmp(received, image, imageNumBytes) != 0) ||
+        (numCrcFailures != 0)) {
+        printf("%s: the image was not received correctly\r\n", name);
+        return FALSE;
+    }
+
+    uint32_t numBpackets = numBpacketsReceived;
+
+    double startMs = bench_get_time_ms();
+    for (uint32_t i = 0; i < numRuns; i++) {
+        wireNumBytes  = 0;
+        wireNumWrites = 0;
+        bpacket_send_data(bench_transmit, BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_ESP32, BENCH_REQUEST, image,
+                          imageNumBytes);
+    }
+    double encodeMs = bench_get_time_ms() - startMs;
+
+    startMs = bench_get_time_ms();
+    for (uint32_t i = 0; i < numRuns; i++) {
+        bench_parse_wire();
+    }
+    double parseMs = bench_get_time_ms() - startMs;
+
+    double wireSeconds = ((double)wireNumBytes * BITS_PER_BYTE) / BAUD_RATE;
+
+    printf("%-9s %9u %11u %8.2f%% %8u %9.2f s %9.1f %14.0f %14.0f\r\n", name, numBpackets, wireNumBytes,
+           ((wireNumBytes - imageNumBytes) * 100.0) / imageNumBytes, wireNumWrites, wireSeconds,
+           numBpackets / wireSeconds, (numBpackets * numRuns) / (encodeMs / 1000.0),
+           (numBpackets * numRuns) / (parseMs / 1000.0));
+
+    return TRUE;
+}
+
+static void bench_print_dimensions(uint8_t* image, uint32_t numBytes) {
+
+    // The width and height are in the start of frame segment (0xFFC0 - 0xFFC2)
+    uint32_t i = 2;
+    while ((i + 9) < numBytes) {
+
+        if (image[i] != 0xFF) {
+            break;
+        }
+
+        uint8_t marker   = image[i + 1];
+        uint16_t segSize = (image[i + 2] << 8) | image[i + 3];
+
+        if ((marker >= 0xC0) && (marker <= 0xC2)) {
+            printf("%ux%u, ", (image[i + 7] << 8) | image[i + 8], (image[i + 5] << 8) | image[i + 6]);
+            return;
+        }
+
+        i += 2 + segSize;
+    }
+
+    printf("unknown size, ");
+}
+
+int main(int argc, char** argv) {
+
+    char* jpegPath   = (argc > 1) ? argv[1] : DEFAULT_JPEG_PATH;
+    uint32_t numRuns = (argc > 2) ? atoi(argv[2]) : DEFAULT_NUM_RUNS;
+
+    FILE* file = fopen(jpegPath, "rb");
+    if ((file == NULL) || (numRuns == 0)) {
+        printf("Usage: bpacket_bench [jpeg] [number of runs]\r\n");
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    uint32_t imageNumBytes = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // Legacy framing adds the most, 9 bytes to every 255, so twice the image is plenty for the wire
+    uint8_t* image = malloc(imageNumBytes);
+    wire           = malloc((imageNumBytes * 2) + BPACKET_CRC_NUM_NON_DATA_BYTES);
+    received       = malloc(imageNumBytes);
+
+    if ((image == NULL) || (wire == NULL) || (received == NULL) ||
+        (fread(image, 1, imageNumBytes, file) != imageNumBytes)) {
+        printf("Could not read %s\r\n", jpegPath);
+        return 1;
+    }
+
+    fclose(file);
+
+    printf("Image: %s (", jpegPath);
+    bench_print_dimensions(image, imageNumBytes);
+    printf("%u bytes)\r\n", imageNumBytes);
+
+    printf("%-9s %9s %11s %9s %8s %11s %9s %14s %14s\r\n", "Framing", "Bpackets", "Wire bytes", "Overhead",
+           "Writes", "@115200", "Bpk/s", "Encode bpk/s", "Parse bpk/s");
+
+    if ((bench_framing("Legacy", BENCH_LEGACY, image, imageNumBytes, numRuns) != TRUE) ||
+        (bench_framing("Extended", BENCH_EXTENDED, image, imageNumBytes, numRuns) != TRUE) ||
+        (bench_framing("Checked", BENCH_CHECKED, image, imageNumBytes, numRuns) != TRUE)) {
+        return 1;
+    }
+
+    free(image);
+    free(wire);
+    free(received);
+
+    return 0;
+}
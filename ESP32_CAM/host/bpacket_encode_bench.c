@@ -0,0 +1,134 @@
+/**
+ * @file bpacket_encode_bench.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the bpacket code on the host and times sending a bpacket by copying
+ * it into a bpacket_buffer_t with bpacket_to_buffer() against sending it as a frame
+ * with bpacket_encode_frame() and bpacket_transmit_frame(), for a range of sizes,
+ * e.g. ./build/bpacket_encode_bench 100000
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Personal Includes */
+#include "bpacket.h"
+#include "utilities.h"
+
+#define DEFAULT_NUM_RUNS 100000
+#define NUM_SIZES        6
+#define BENCH_REQUEST    BPACKET_SPECIFIC_R_OFFSET
+
+/* Private Variables */
+static const uint16_t sizes[NUM_SIZES] = {0, 16, 64, 255, 1024, BPACKET_EXT_MAX_NUM_DATA_BYTES};
+
+// Stands in for the UART. Touches every byte so the work is not optimised away
+static uint32_t checksum;
+static uint32_t numBytesSent;
+
+static double bench_get_time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000.0) + (now.tv_nsec / 1000000.0);
+}
+
+static void bench_transmit(uint8_t* data, uint16_t bufferNumBytes) {
+
+    for (uint32_t i = 0; i < bufferNumBytes; i++) {
+        checksum += data[i];
+    }
+
+    numBytesSent += bufferNumBytes;
+}
+
+static double bench_buffer(bpacket_t* bpacket, uint8_t checked, uint32_t numRuns) {
+
+    static bpacket_buffer_t buffer;
+
+    double startMs = bench_get_time_ms();
+    for (uint32_t i = 0; i < numRuns; i++) {
+
+        if (checked == TRUE) {
+            bpacket_to_checked_buffer(bpacket, &buffer);
+        } else {
+            bpacket_to_buffer(bpacket, &buffer);
+        }
+
+        bench_transmit(buffer.buffer, buffer.numBytes);
+    }
+
+    return bench_get_time_ms() - startMs;
+}
+
+static double bench_frame(bpacket_t* bpacket, uint8_t checked, uint32_t numRuns) {
+
+    bpacket_frame_t frame;
+
+    double startMs = bench_get_time_ms();
+    for (uint32_t i = 0; i < numRuns; i++) {
+        bpacket_encode_frame(&frame, bpacket->receiver, bpacket->sender, bpacket->request, bpacket->code,
+                             bpacket->bytes, bpacket->numBytes, checked, bpacket->sequence);
+        bpacket_transmit_frame(bench_transmit, &frame);
+    }
+
+    return bench_get_time_ms() - startMs;
+}
+
+int main(int argc, char** argv) {
+
+    uint32_t numRuns = (argc > 1) ? atoi(argv[1]) : DEFAULT_NUM_RUNS;
+
+    if (numRuns == 0) {
+        printf("Usage: bpacket_encode_bench [number of runs]\r\n");
+        return 1;
+    }
+
+    static bpacket_t bpacket;
+
+    printf("%-8s %6s %16s %16s %8s\r\n", "Framing", "Bytes", "Buffer ns/bpk", "Frame ns/bpk", "Speedup");
+
+    for (uint8_t checked = FALSE; checked <= TRUE; checked++) {
+        for (uint8_t i = 0; i < NUM_SIZES; i++) {
+
+            bpacket.receiver = BPACKET_ADDRESS_MAPLE;
+            bpacket.sender   = BPACKET_ADDRESS_ESP32;
+            bpacket.request  = BENCH_REQUEST;
+            bpacket.code     = BPACKET_CODE_SUCCESS;
+            bpacket.sequence = i;
+            bpacket.numBytes = sizes[i];
+
+            for (uint32_t j = 0; j < sizes[i]; j++) {
+                bpacket.bytes[j] = j & 0xFF;
+            }
+
+            // Both ways of sending have to put the same bytes on the wire
+            checksum            = 0;
+            numBytesSent        = 0;
+            double bufferMs     = bench_buffer(&bpacket, checked, numRuns);
+            uint32_t bufferSum  = checksum;
+            uint32_t bufferSent = numBytesSent;
+
+            checksum       = 0;
+            numBytesSent   = 0;
+            double frameMs = bench_frame(&bpacket, checked, numRuns);
+
+            if ((checksum != bufferSum) || (numBytesSent != bufferSent)) {
+                printf("%u bytes: the frame did not match the buffer\r\n", sizes[i]);
+                return 1;
+            }
+
+            printf("%-8s %6u %16.1f %16.1f %7.2fx\r\n", (checked == TRUE) ? "Checked" : "Plain", sizes[i],
+                   (bufferMs * 1000000.0) / numRuns, (frameMs * 1000000.0) / numRuns,
+                   (frameMs > 0) ? bufferMs / frameMs : 0.0);
+        }
+    }
+
+    return 0;
+}
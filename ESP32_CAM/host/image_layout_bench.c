@@ -0,0 +1,196 @@
+/**
+ * @file image_layout_bench.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the image layout code on the host and times how long it takes to
+ * save and find images as the data folder fills up, for the flat layout and the
+ * date folder layout. Point it at an empty folder on the filesystem to be measured,
+ * e.g. ./build/image_layout_bench /mnt/sdcard/bench 10000
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Personal Includes */
+#include "sd_card_layout.h"
+#include "utilities.h"
+
+#define DEFAULT_FOLDER_PATH    "image_layout_bench"
+#define DEFAULT_NUM_IMAGES     10000
+#define DEFAULT_IMAGES_PER_DAY 48
+#define NUM_IMAGES_PER_SAMPLE  1000 // The save time is averaged over this many images
+#define IMAGE_NUM_BYTES        1024 // Large enough that every image takes up a cluster
+
+static double bench_get_time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000.0) + (now.tv_nsec / 1000000.0);
+}
+
+static void bench_next_datetime(dt_datetime_t* datetime, uint16_t minutes) {
+
+    static const uint8_t daysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    uint16_t minute       = datetime->time.minute + minutes;
+    uint16_t hour         = datetime->time.hour + (minute / 60);
+    datetime->time.minute = minute % 60;
+    datetime->time.hour   = hour % 24;
+    datetime->date.day += hour / 24;
+
+    uint8_t leapDay = ((datetime->date.month == 2) && ((datetime->date.year % 4) == 0)) ? 1 : 0;
+    if (datetime->date.day > (daysInMonth[datetime->date.month - 1] + leapDay)) {
+        datetime->date.day = 1;
+        datetime->date.month++;
+    }
+
+    if (datetime->date.month > 12) {
+        datetime->date.month = 1;
+        datetime->date.year++;
+    }
+}
+
+static uint8_t bench_count_image(char* filePath, char* imagePath, void* arg) {
+    (*(uint32_t*)arg)++;
+    return TRUE;
+}
+
+static uint8_t bench_remove_image(char* filePath, char* imagePath, void* arg) {
+    remove(filePath);
+    return TRUE;
+}
+
+static uint8_t bench_layout(char* dataFolder, uint8_t layout, uint32_t numImages, uint16_t imagesPerDay) {
+
+    char* names[] = {"flat", "year", "month", "day"};
+    printf("Layout: %s\r\n", names[layout]);
+
+    if ((mkdir(dataFolder, 0700) != 0) && (access(dataFolder, F_OK) != 0)) {
+        printf("Could not create %s\r\n", dataFolder);
+        return FALSE;
+    }
+
+    uint8_t image[IMAGE_NUM_BYTES] = {0};
+    char folder[16]                = {0};
+    char lastFolder[16]            = {0};
+    char imagePath[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    char filePath[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    dt_datetime_t datetime = {.date.year = 2023, .date.month = 1, .date.day = 1};
+    double sampleStartMs   = bench_get_time_ms();
+
+    // Save the images the way sd_card_save_image() does, creating the date folder when the day changes
+    for (uint32_t i = 0; i < numImages; i++) {
+
+        sd_card_layout_get_folder(folder, &datetime, layout);
+        if ((i == 0) || (strcmp(folder, lastFolder) != 0)) {
+            if (snprintf(filePath, sizeof(filePath), "%s/%s/", dataFolder, folder) >= sizeof(filePath)) {
+                printf("Folder path is too long\r\n");
+                return FALSE;
+            }
+
+            char* slash = strchr(&filePath[strlen(dataFolder) + 1], '/');
+            while (slash != NULL) {
+                *slash = '\0';
+                mkdir(filePath, 0700);
+                *slash = '/';
+                slash  = strchr(slash + 1, '/');
+            }
+
+            strcpy(lastFolder, folder);
+        }
+
+        sd_card_layout_get_image_path(imagePath, i, &datetime, layout);
+        int pathLength = snprintf(filePath, sizeof(filePath), "%s/%s", dataFolder, imagePath);
+
+        FILE* file = (pathLength < sizeof(filePath)) ? fopen(filePath, "wb") : NULL;
+        if (file == NULL) {
+            printf("Could not create %s\r\n", filePath);
+            return FALSE;
+        }
+
+        fwrite(image, 1, IMAGE_NUM_BYTES, file);
+        fclose(file);
+
+        if (((i + 1) % NUM_IMAGES_PER_SAMPLE) == 0) {
+            double timeMs = bench_get_time_ms() - sampleStartMs;
+            printf("  %7u images: %8.3f ms per image saved\r\n", i + 1, timeMs / NUM_IMAGES_PER_SAMPLE);
+            sampleStartMs = bench_get_time_ms();
+        }
+
+        bench_next_datetime(&datetime, (24 * 60) / imagesPerDay);
+    }
+
+    // Open the newest image by its path the way sd_card_copy_file() does
+    double startMs = bench_get_time_ms();
+    FILE* file     = fopen(filePath, "rb");
+    if (file == NULL) {
+        printf("Could not open %s\r\n", filePath);
+        return FALSE;
+    }
+    fclose(file);
+    printf("  Open newest image:      %8.3f ms\r\n", bench_get_time_ms() - startMs);
+
+    // List the folder holding the newest image the way sd_card_list_directory() does
+    *strrchr(filePath, '/') = '\0';
+    uint32_t numListed      = 0;
+    startMs                 = bench_get_time_ms();
+    DIR* directory          = opendir(filePath);
+    while (readdir(directory) != NULL) {
+        numListed++;
+    }
+    closedir(directory);
+    printf("  List newest folder:     %8.3f ms (%u entries)\r\n", bench_get_time_ms() - startMs, numListed);
+
+    // Find every image the way sd_card_index_rebuild() does
+    uint32_t numFound = 0;
+    startMs           = bench_get_time_ms();
+    sd_card_layout_for_each_image(dataFolder, bench_count_image, &numFound);
+    printf("  Find every image:       %8.3f ms (%u images)\r\n", bench_get_time_ms() - startMs, numFound);
+
+    sd_card_layout_for_each_image(dataFolder, bench_remove_image, NULL);
+    sd_card_layout_remove_empty_folders(dataFolder);
+    rmdir(dataFolder);
+
+    return (numFound == numImages) ? TRUE : FALSE;
+}
+
+int main(int argc, char** argv) {
+
+    char* folderPath      = (argc > 1) ? argv[1] : DEFAULT_FOLDER_PATH;
+    uint32_t numImages    = (argc > 2) ? atoi(argv[2]) : DEFAULT_NUM_IMAGES;
+    uint16_t imagesPerDay = (argc > 3) ? atoi(argv[3]) : DEFAULT_IMAGES_PER_DAY;
+
+    if ((numImages == 0) || (imagesPerDay == 0) || (imagesPerDay > (24 * 60))) {
+        printf("Usage: image_layout_bench [folder] [number of images] [images per day]\r\n");
+        return 1;
+    }
+
+    if ((mkdir(folderPath, 0700) != 0) && (access(folderPath, F_OK) != 0)) {
+        printf("Could not create %s\r\n", folderPath);
+        return 1;
+    }
+
+    char dataFolder[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    uint8_t layouts[] = {SD_CARD_LAYOUT_FLAT, SD_CARD_LAYOUT_DAY};
+
+    for (uint8_t i = 0; i < sizeof(layouts); i++) {
+        snprintf(dataFolder, sizeof(dataFolder), "%s/data%i", folderPath, layouts[i]);
+
+        if (bench_layout(dataFolder, layouts[i], numImages, imagesPerDay) != TRUE) {
+            return 1;
+        }
+    }
+
+    rmdir(folderPath);
+
+    return 0;
+}
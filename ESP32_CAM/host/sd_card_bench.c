@@ -0,0 +1,131 @@
+/**
+ * @file sd_card_bench.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the SD card block code on the host and times it against the
+ * per byte fputc()/fgetc() loops it replaced. Point it at a file on the
+ * filesystem to be measured, e.g. ./build/sd_card_bench /mnt/sdcard/bench.bin 8
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Personal Includes */
+#include "sd_card_block.h"
+#include "utilities.h"
+
+#define DEFAULT_FILE_PATH "sd_card_bench.bin"
+#define DEFAULT_NUM_MB    8
+
+// Stands in for the UART. Touches every byte so the work is not optimised away
+#define SEND_BYTES(data, numBytes, checksum)    \
+    for (uint32_t j = 0; j < (numBytes); j++) { \
+        checksum += (data)[j];                  \
+    }
+
+static double bench_get_time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000.0) + (now.tv_nsec / 1000000.0);
+}
+
+static void bench_print(char* name, double startMs, uint32_t numBytes) {
+    double timeMs = bench_get_time_ms() - startMs;
+    printf("%-28s %9.1f ms %9.1f KB/s\r\n", name, timeMs, (numBytes / 1024.0) / (timeMs / 1000.0));
+}
+
+int main(int argc, char** argv) {
+
+    char* filePath    = (argc > 1) ? argv[1] : DEFAULT_FILE_PATH;
+    uint32_t numBytes = ((argc > 2) ? atoi(argv[2]) : DEFAULT_NUM_MB) * 1024 * 1024;
+
+    uint8_t* data = malloc(numBytes);
+    if (data == NULL) {
+        printf("Could not allocate %u bytes\r\n", numBytes);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < numBytes; i++) {
+        data[i] = i & 0xFF;
+    }
+
+    FILE* file;
+    double startMs;
+    uint32_t checksum = 0;
+
+    // Per byte writes, the way sd_card_save_image() used to save images
+    startMs = bench_get_time_ms();
+    if ((file = fopen(filePath, "wb")) == NULL) {
+        printf("Could not open %s\r\n", filePath);
+        return 1;
+    }
+    for (uint32_t i = 0; i < numBytes; i++) {
+        fputc(data[i], file);
+    }
+    fclose(file);
+    bench_print("fputc() write", startMs, numBytes);
+
+    startMs = bench_get_time_ms();
+    file    = fopen(filePath, "wb");
+    if (sd_card_block_write(file, data, numBytes) != TRUE) {
+        printf("Block write failed\r\n");
+        return 1;
+    }
+    fclose(file);
+    bench_print("Block write", startMs, numBytes);
+
+    // Per byte reads, the way sd_card_copy_file() used to read files
+    startMs = bench_get_time_ms();
+    file    = fopen(filePath, "rb");
+    for (uint32_t i = 0; i < numBytes; i++) {
+        checksum += (uint8_t)fgetc(file);
+    }
+    fclose(file);
+    bench_print("fgetc() read", startMs, numBytes);
+
+    startMs = bench_get_time_ms();
+    file    = fopen(filePath, "rb");
+    if (sd_card_block_read(file, data, numBytes) != TRUE) {
+        printf("Block read failed\r\n");
+        return 1;
+    }
+    SEND_BYTES(data, numBytes, checksum);
+    fclose(file);
+    bench_print("Block read", startMs, numBytes);
+
+    // Double buffered reads while the previous block is being sent
+    sd_card_block_reader_t reader;
+    uint32_t numBytesRead = 0;
+    uint32_t blockNumBytes;
+    uint8_t* block;
+
+    startMs = bench_get_time_ms();
+    file    = fopen(filePath, "rb");
+    if (sd_card_block_reader_open(&reader, file) != TRUE) {
+        printf("Block reader failed to open\r\n");
+        return 1;
+    }
+    while ((blockNumBytes = sd_card_block_reader_next(&reader, &block)) > 0) {
+        SEND_BYTES(block, blockNumBytes, checksum);
+        numBytesRead += blockNumBytes;
+    }
+    if ((sd_card_block_reader_close(&reader) != TRUE) || (numBytesRead != numBytes)) {
+        printf("Block reader read %u of %u bytes\r\n", numBytesRead, numBytes);
+        return 1;
+    }
+    fclose(file);
+    bench_print("Double buffered block read", startMs, numBytes);
+
+    printf("Checksum: %u\r\n", checksum);
+
+    remove(filePath);
+    free(data);
+
+    return 0;
+}
@@ -14,6 +14,7 @@
 #define HC_UART_COMMS_TX_PIN     GPIO_NUM_1
 #define HC_UART_COMMS_RX_PIN     GPIO_NUM_3
 #define HC_UART_COMMS_UART_NUM   UART_NUM_0
+#define HC_UART_COMMS_BAUD_RATE  115200 // Rate at start up. Maple can raise it with BPACKET_GEN_R_SET_BAUD
 #define RX_RING_BUFFER_BYTE_SIZE 1048
 
 /* Public Marcros for Camera */
@@ -24,16 +24,74 @@
 /* Private Includes */
 #include "bpacket.h"
 
+// With more than one frame buffer the camera can take the next frame while the last one is saved
+#define CAMERA_NUM_FRAME_BUFFERS 2
+
+// The number of photos taken for each TAKE_PHOTO request and the time between them
+#ifndef CAMERA_BURST_NUM_FRAMES
+#define CAMERA_BURST_NUM_FRAMES 1
+#endif
+
+#ifndef CAMERA_BURST_INTERVAL_MS
+#define CAMERA_BURST_INTERVAL_MS 0
+#endif
+
+// A stream session ends if no frame has been asked for in this long
+#define CAMERA_STREAM_IDLE_TIMEOUT_MS 3000
+
+// Streamed frames are only for the camera view in Maple so they are taken at a lower resolution
+// and quality than saved photos. The camera goes back to the saved photo settings once the
+// stream session ends
+#define CAMERA_PREVIEW_FRAME_SIZE   FRAMESIZE_QVGA
+#define CAMERA_PREVIEW_JPEG_QUALITY 20 // 0-63, higher numbers give smaller frames
+
+#ifndef CAMERA_PREVIEW_GRAYSCALE
+#define CAMERA_PREVIEW_GRAYSCALE 0
+#endif
+
+#define CAMERA_EFFECT_NONE      0
+#define CAMERA_EFFECT_GRAYSCALE 2
+
 uint8_t camera_init(void);
 
 void camera_capture_and_save_image(bpacket_t* bpacket);
 
+/**
+ * @brief Takes the number of photos asked for in a TAKE_BURST request and saves them
+ * all in one SD card session. The success response holds the frames saved per second
+ * and the time taken to save each frame
+ *
+ */
+void camera_capture_burst(bpacket_t* bpacket);
+
 uint8_t camera_get_resolution(void);
 
 // This function changes the camera resolution, possible inputs are
 // the FRAMESIZE_SETTINGS, the settings are QVGA, CIF, VGA, SVGA, XGA, SXGA, UXGA, WQXGA
 uint8_t camera_set_resolution(uint8_t cam_res);
 
+/**
+ * @brief Sends one frame to the sender of the bpacket. The first frame starts a stream
+ * session which keeps the camera running so each frame after it only waits for the
+ * camera to fill a frame buffer
+ *
+ */
 void camera_stream_image(bpacket_t* bpacket);
 
+/**
+ * @brief Ends the stream session and replies with the number of frames sent and the
+ * frames sent per second
+ *
+ */
+void camera_stop_stream(bpacket_t* bpacket);
+
+/**
+ * @brief Ends the stream session if no frame has been asked for in
+ * CAMERA_STREAM_IDLE_TIMEOUT_MS. Call regularly from the main loop
+ *
+ */
+void camera_stream_update(void);
+
+uint8_t camera_stream_active(void);
+
 #endif // CAMERA_H
\ No newline at end of file
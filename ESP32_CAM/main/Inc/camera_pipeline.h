@@ -0,0 +1,74 @@
+/**
+ * @file camera_pipeline.h
+ * @author Gian Barta-Dougall
+ * @brief Takes photos and saves them to the SD card at the same time. The calling
+ * task takes each frame from the camera and hands it to a writer task that saves
+ * it while the camera fills the next frame buffer, so the camera is never left
+ * waiting for the SD card to finish a write
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef CAMERA_PIPELINE_H
+#define CAMERA_PIPELINE_H
+
+/* Public Includes */
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_camera.h"
+
+/* Personal Includes */
+#include "bpacket.h"
+#include "watchdog_defines.h"
+
+#define CAMERA_PIPELINE_WRITER_STACK_SIZE 6144
+#define CAMERA_PIPELINE_WRITER_PRIORITY   (tskIDLE_PRIORITY + 1)
+#define CAMERA_PIPELINE_WRITER_CORE       1 // app_main() runs on core 0
+
+#define CAMERA_PIPELINE_NUM_TIMED_FRAMES WD_BURST_MAX_NUM_FRAMES // Save times are kept for this many frames
+
+typedef struct camera_pipeline_config_t {
+    uint16_t numFrames;
+    uint32_t intervalMs; // The time between the start of each frame. 0 takes them as fast as possible
+    uint8_t aeLevelStep; // 0 turns bracketing off. Otherwise frames cycle through AE levels -step, 0 and +step
+} camera_pipeline_config_t;
+
+typedef struct camera_pipeline_stats_t {
+    uint32_t numCaptured;
+    uint32_t numSaved;
+    uint32_t numBytesSaved;
+    uint64_t captureTimeUs; // Total time spent waiting for the camera to give a frame
+    uint64_t queueTimeUs;   // Total time the camera waited for the writer to take a frame
+    uint64_t saveTimeUs;    // Total time spent saving frames
+    uint32_t maxSaveTimeUs; // The longest time taken to save one frame
+    uint64_t totalTimeUs;
+    uint32_t frameSaveTimeUs[CAMERA_PIPELINE_NUM_TIMED_FRAMES];
+} camera_pipeline_stats_t;
+
+/**
+ * @brief Creates the writer task. Does nothing if it has already been created
+ *
+ * @return uint8_t TRUE if the writer task is running else FALSE
+ */
+uint8_t camera_pipeline_init(void);
+
+/**
+ * @brief Takes the frames in the config and saves each to the SD card with the
+ * photo data in the TAKE_PHOTO or TAKE_BURST bpacket. Returns once every frame
+ * taken has been saved. The camera must be initialised and nothing else may use
+ * the SD card until this returns
+ *
+ * @param bpacket The TAKE_PHOTO or TAKE_BURST request. Saving stops at the first frame
+ * that fails to save and the error response is sent to the sender of the bpacket
+ * @param config The number of frames, the time between them and the exposure bracketing
+ * @param stats Set to the counts and stage timings of the frames taken
+ * @return uint8_t TRUE if every frame was taken and saved else FALSE
+ */
+uint8_t camera_pipeline_run(bpacket_t* bpacket, camera_pipeline_config_t* config, camera_pipeline_stats_t* stats);
+
+#endif // CAMERA_PIPELINE_H
@@ -14,12 +14,71 @@
 /* Personal Includes */
 #include "bpacket.h"
 
+/**
+ * @brief Initialises the parser bpackets are read with. Must be called before
+ * any bpackets are read
+ */
+void esp32_uart_init(void);
+
 void esp32_uart_send_bpacket(bpacket_t* bpacket);
 
 void esp32_uart_send_data(uint8_t* data, uint16_t numBytes);
 
 void esp32_uart_send_string(char* string);
 
-int esp32_uart_read_bpacket(uint8_t bpacketBuffer[BPACKET_BUFFER_LENGTH_BYTES]);
+/**
+ * @brief Reads bytes from the UART until a bpacket has been received. Bytes that
+ * arrive after the bpacket are kept for the next call
+ *
+ * @return uint8_t TRUE if a bpacket was received, FALSE if the UART went quiet
+ * first
+ */
+uint8_t esp32_uart_read_bpacket(bpacket_t* bpacket);
+
+void esp32_uart_send_checked_bpacket(bpacket_t* bpacket);
+
+/**
+ * @brief Waits for the receiver of a checked transfer to NACK the bpackets it
+ * did not receive. Any other bpackets received while waiting are discarded
+ *
+ * @param bpacket Set to the NACK if one was received
+ * @return uint8_t TRUE if the NACK lists bpackets to resend. FALSE if the
+ * receiver confirmed the transfer or no NACK arrived before the timeout
+ */
+uint8_t esp32_uart_get_nack(bpacket_t* bpacket);
+
+/**
+ * @brief Waits for a BPACKET_GEN_R_ACK. Used by bpacket_send_data() when flow
+ * control has been negotiated
+ *
+ * @param numBpacketsReceived Set to the highest number of bpackets acknowledged
+ * @return uint8_t TRUE if an ACK was received, FALSE on timeout
+ */
+uint8_t esp32_uart_get_ack(uint16_t* numBpacketsReceived);
+
+/**
+ * @brief Sends a block of data with bpacket_send_data(). If CRCs are enabled without
+ * a window, any bpackets the receiver NACKs are then resent. The data must stay
+ * valid until this returns
+ *
+ * @return uint8_t TRUE if the data was sent, FALSE otherwise
+ */
+uint8_t esp32_uart_send_transfer(uint8_t receiver, uint8_t sender, uint8_t request, uint8_t* data,
+                                 uint32_t numBytes);
+
+/**
+ * @brief Handles a BPACKET_GEN_R_SET_BAUD request. Replies at the current baud rate,
+ * changes to the new one and then waits for a ping. Goes back to the previous baud
+ * rate if no ping arrives within BPACKET_BAUD_CONFIRM_TIMEOUT_MS
+ *
+ * @return uint8_t TRUE if the baud rate was changed
+ */
+uint8_t esp32_uart_set_baud_rate(bpacket_t* bpacket);
+
+/**
+ * @brief Handles a WATCHDOG_BPK_R_BENCHMARK request by sending the number of bytes
+ * asked for as a transfer, the same way an image is sent
+ */
+void esp32_uart_send_benchmark(bpacket_t* bpacket);
 
 #endif // ESP32_UART_H
\ No newline at end of file
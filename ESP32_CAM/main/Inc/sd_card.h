@@ -35,6 +35,16 @@
 #define SD_CARD_ERROR_IO_ERROR           (LOG_ERR_OFFSET + 3)
 #define SD_CARD_NOT_MOUNTED              (LOG_ERR_OFFSET + 4)
 
+// How long the card stays mounted after the last session using it is closed
+#define SD_CARD_IDLE_UNMOUNT_MS 2000
+
+typedef struct sd_card_mount_stats_t {
+    uint32_t numMounts;     // Number of times the card was mounted
+    uint32_t numReuses;     // Number of sessions that found the card still mounted
+    uint64_t mountTimeUs;   // Total time spent mounting the card
+    uint64_t unmountTimeUs; // Total time spent unmounting the card
+} sd_card_mount_stats_t;
+
 /**
  * @brief Creates the given folderpath on the SD card. The folder
  * path can end in a folder or a file. If the path already exits
@@ -54,17 +64,14 @@
 uint8_t sd_card_create_path(char* folderPath, bpacket_t* bpacket);
 
 /**
- * @brief Lists all folders and files in a given directory
+ * @brief Sends a page of the folders and files in the folder given by the
+ * wd_list_dir_request_t in the bpacket. The folder is read once, only as far
+ * as the end of the page, and each entry is sent with its size and modified time
  *
- * @param folderPath The path the directory to be listed. E.g
- * folder/data
- * @param response If the folders/file could be created the
- * request of the response packet will be SUCCESS else it will
- * be ERROR and the instruction/data parts of the response packet
- * may contain information about why it failed
- * @return uint8_t WD_SUCCESS if there were no problems else WD_ERROR
+ * @param bpacket The WATCHDOG_BPK_R_LIST_DIR request. Reused for the response
+ * @return uint8_t TRUE if there were no problems else FALSE
  */
-uint8_t sd_card_list_directory(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray);
+uint8_t sd_card_list_directory(bpacket_t* bpacket);
 
 /**
  * @brief Appends a string to the given file
@@ -94,8 +101,8 @@ uint8_t sd_card_write_to_file(char* filePath, char* string, bpacket_t* bpacket);
 uint8_t sd_card_save_image(uint8_t* imageData, int imageLength, bpacket_t* bpacket);
 
 /**
- * @brief Finds all the images saved on the SD card in the image data folder and
- * returns the number of images that were found
+ * @brief Gets the number of images saved on the SD card from the number of records
+ * in the image index
  *
  * @param numImages A pointer to an int where the number of images found can be
  * stored
@@ -105,11 +112,13 @@ uint8_t sd_card_save_image(uint8_t* imageData, int imageLength, bpacket_t* bpack
  * may contain information about why it failed
  * @return uint8_t WD_SUCCESS if there were no problems else WD_ERROR
  */
-uint8_t sd_card_search_num_images(uint16_t* numImages, bpacket_t* bpacket);
+uint8_t sd_card_search_num_images(uint32_t* numImages, bpacket_t* bpacket);
 
 /**
- * @brief Searches the SD card for all the images on the card and updates the
- * internal image number
+ * @brief Creates the image data folder and reads the next image number from the last
+ * record in the image index. The data folder is only scanned to rebuild the index
+ * if the index is missing. If SD_CARD_LAYOUT has changed since the last boot the
+ * images already on the card are first moved to the new layout
  *
  * @param response If the folders/file could be created the
  * request of the response packet will be SUCCESS else it will
@@ -119,31 +128,94 @@ uint8_t sd_card_search_num_images(uint16_t* numImages, bpacket_t* bpacket);
  */
 uint8_t sd_card_init(bpacket_t* bpacket);
 
+/**
+ * @brief Gets the camera settings from the settings kept in RAM
+ *
+ */
 uint8_t sd_card_get_camera_settings(wd_camera_settings_t* cameraSettings);
 
 uint8_t sd_card_format_sd_card(bpacket_t* bpacket);
 
+/**
+ * @brief Sends the file at the path in the bpacket to its sender. If the path is followed
+ * by a null character and a WD_COPY_FILE_START_NUM_BYTES start byte, only the bytes from
+ * the start byte onwards are sent
+ *
+ */
 void sd_card_copy_file(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray);
 
 /**
- * @brief Mounts the SD Card for reading and writing
+ * @brief Sends a file on the SD card to the sender of the bpacket, starting from the
+ * given byte. The caller must have the SD card open
+ *
+ */
+void sd_card_send_file(bpacket_t* bpacket, char* filePath, uint32_t startByte);
+
+/**
+ * @brief Sends the image index. If the bpacket holds a 4 byte record number only the
+ * records from that one onwards are sent. Each record is WD_IMAGE_RECORD_NUM_BYTES long
+ *
+ */
+void sd_card_send_image_index(bpacket_t* bpacket);
+
+/**
+ * @brief Opens a session on the SD card. The card is only mounted if it is not
+ * still mounted from an earlier session. Every successful call must be matched
+ * by a call to sd_card_close()
  *
  */
 uint8_t sd_card_open(void);
 
 /**
- * @brief Unmounts the SD card so it can no longer be accessed
+ * @brief Closes a session on the SD card. The card stays mounted so the next
+ * session can reuse it until sd_card_unmount_if_idle() unmounts it
  *
  */
 void sd_card_close(void);
 
+/**
+ * @brief Unmounts the SD card if no session has had it open for
+ * SD_CARD_IDLE_UNMOUNT_MS. Call regularly from the main loop
+ *
+ */
+void sd_card_unmount_if_idle(void);
+
+/**
+ * @brief Unmounts the SD card straight away, even if sessions still have it
+ * open. Call before the ESP32 is powered down
+ *
+ */
+void sd_card_unmount(void);
+
+void sd_card_get_mount_stats(sd_card_mount_stats_t* stats);
+
+/**
+ * @brief Saves the camera or capture time settings in the bpacket. The settings file
+ * is only written if the settings changed. The new settings are written to a temporary
+ * file which then replaces the settings file so losing power part way through leaves
+ * either the old or the new settings on the card
+ *
+ * @param bpacket The SET_CAMERA_SETTINGS or SET_CAPTURE_TIME_SETTINGS request. Set to
+ * the success response if the settings were saved
+ * @return uint8_t TRUE if the settings were saved else FALSE
+ */
 uint8_t sd_card_write_settings(bpacket_t* bpacket);
 
+/**
+ * @brief Puts the camera or capture time settings into the bpacket. The settings are
+ * read from the SD card the first time and from RAM after that
+ *
+ * @param bpacket The GET_CAMERA_SETTINGS or GET_CAPTURE_TIME_SETTINGS request. Reused
+ * for the response
+ * @return uint8_t TRUE if there were no problems else FALSE
+ */
 uint8_t sd_card_read_settings(bpacket_t* bpacket);
 
 /**
- * @brief Mounts the SD card and writes a message to a given log file. If the
- * given log file doesn't exit it will create that file
+ * @brief Writes a message to a given log file with the time from the system clock.
+ * Messages to the system log are kept in RAM and written to the SD card together once
+ * enough have built up, once the oldest has waited too long or when the card is unmounted.
+ * Messages to any other log file are written straight away
  *
  * @param fileName The file name where the message is to be logged to. The path to reach the
  * given file in the Log folder of the SD card is handled by the function
@@ -152,6 +224,19 @@ uint8_t sd_card_read_settings(bpacket_t* bpacket);
  */
 uint8_t sd_card_log(char* fileName, char* message);
 
+/**
+ * @brief Writes every buffered system log message to the SD card in one append
+ *
+ */
+uint8_t sd_card_log_flush(void);
+
+/**
+ * @brief Flushes the buffered system log messages if the oldest one has waited too
+ * long. Call regularly from the main loop
+ *
+ */
+void sd_card_log_update(void);
+
 /**
  * @brief Mounts the SD card and writes a message to a given file. If the
  * given file doesn't exit it will attempty to create that file
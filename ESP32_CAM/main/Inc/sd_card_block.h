@@ -0,0 +1,83 @@
+/**
+ * @file sd_card_block.h
+ * @author Gian Barta-Dougall
+ * @brief Block sized reads and writes for files on the SD card. Files are read
+ * and written in SD_CARD_BLOCK_SIZE pieces with stdio buffering turned off so
+ * each block goes straight to FATFS as whole clusters. The block reader fills
+ * the next block on its own thread while the caller is sending the previous
+ * one. Only stdio and pthreads are used so the same code runs on the host
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef SD_CARD_BLOCK_H
+#define SD_CARD_BLOCK_H
+
+/* C Library Includes */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Matches the allocation unit the SD card is mounted with so every block read or
+// written from the start of a file covers whole clusters
+#define SD_CARD_BLOCK_SIZE (16 * 1024)
+
+#define SD_CARD_BLOCK_NUM_BUFFERS 2
+
+typedef struct sd_card_block_reader_t {
+    FILE* file;
+    uint8_t* blocks[SD_CARD_BLOCK_NUM_BUFFERS];
+    uint32_t numBytes[SD_CARD_BLOCK_NUM_BUFFERS];
+    uint8_t full[SD_CARD_BLOCK_NUM_BUFFERS]; // TRUE once a block has been read and until it is released
+    uint8_t readIndex;                       // The next block handed to the caller
+    uint8_t holding;                         // TRUE while the caller has the block at the read index
+    uint8_t finished;                        // TRUE once the end of the file has been read
+    uint8_t failed;                          // TRUE if a read failed before the end of the file
+    uint8_t stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} sd_card_block_reader_t;
+
+/**
+ * @brief Reads numBytes from the file in block sized reads
+ *
+ * @return uint8_t TRUE if all the bytes were read else FALSE
+ */
+uint8_t sd_card_block_read(FILE* file, uint8_t* data, uint32_t numBytes);
+
+/**
+ * @brief Writes numBytes to the file in block sized writes
+ *
+ * @return uint8_t TRUE if all the bytes were written else FALSE
+ */
+uint8_t sd_card_block_write(FILE* file, uint8_t* data, uint32_t numBytes);
+
+/**
+ * @brief Allocates the two blocks and starts reading the first one in the
+ * background. The file must stay open until sd_card_block_reader_close() is called
+ *
+ * @return uint8_t TRUE if the reader was started else FALSE
+ */
+uint8_t sd_card_block_reader_open(sd_card_block_reader_t* reader, FILE* file);
+
+/**
+ * @brief Releases the block returned by the previous call so it can be filled
+ * again and waits for the next block to be read
+ *
+ * @param block Set to the next block of the file. Only valid until the next call
+ * @return uint32_t The number of bytes in the block. 0 once the whole file has
+ * been read or if a read failed
+ */
+uint32_t sd_card_block_reader_next(sd_card_block_reader_t* reader, uint8_t** block);
+
+/**
+ * @brief Stops the reader and frees the blocks. Does not close the file
+ *
+ * @return uint8_t FALSE if a read failed before the end of the file else TRUE
+ */
+uint8_t sd_card_block_reader_close(sd_card_block_reader_t* reader);
+
+#endif // SD_CARD_BLOCK_H
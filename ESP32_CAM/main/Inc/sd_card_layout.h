@@ -0,0 +1,91 @@
+/**
+ * @file sd_card_layout.h
+ * @author Gian Barta-Dougall
+ * @brief Where images are kept inside the data folder. FAT looks up names by
+ * reading a directory from the start so one flat folder gets slower with every
+ * image saved. Images are instead spread over folders by the date they were
+ * taken, e.g. data/2023/03/02/img000123_230302_1015.jpg, which keeps every
+ * folder small. Only stdio and dirent are used so the same code runs on the host
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef SD_CARD_LAYOUT_H
+#define SD_CARD_LAYOUT_H
+
+/* C Library Includes */
+#include <stdint.h>
+
+/* Personal Includes */
+#include "datetime.h"
+
+#define SD_CARD_LAYOUT_FLAT  0 // data/img000123_230302_1015.jpg
+#define SD_CARD_LAYOUT_YEAR  1 // data/2023/img000123_230302_1015.jpg
+#define SD_CARD_LAYOUT_MONTH 2 // data/2023/03/img000123_230302_1015.jpg
+#define SD_CARD_LAYOUT_DAY   3 // data/2023/03/02/img000123_230302_1015.jpg
+
+// The layout new images are saved in. Images already on the card are moved to it at boot
+#ifndef SD_CARD_LAYOUT
+#define SD_CARD_LAYOUT SD_CARD_LAYOUT_DAY
+#endif
+
+#define SD_CARD_LAYOUT_IMAGE_NUM_DIGITS 6   // Image numbers are padded to this many digits
+#define SD_CARD_LAYOUT_MAX_PATH_LENGTH  280 // Includes the data folder
+
+/**
+ * @brief Called for every image found in the data folder
+ *
+ * @param filePath The full path to the image including the data folder
+ * @param imagePath The path to the image from the data folder
+ * @return uint8_t TRUE to keep going else FALSE to stop
+ */
+typedef uint8_t (*sd_card_layout_callback_t)(char* filePath, char* imagePath, void* arg);
+
+/**
+ * @brief Gets the folder an image taken at the given time is saved in, relative to
+ * the data folder. Empty for the flat layout
+ *
+ */
+void sd_card_layout_get_folder(char* folder, dt_datetime_t* datetime, uint8_t layout);
+
+/**
+ * @brief Gets the path of an image relative to the data folder
+ *
+ */
+void sd_card_layout_get_image_path(char* imagePath, uint32_t imageNumber, dt_datetime_t* datetime, uint8_t layout);
+
+/**
+ * @brief Reads the image number and the time the image was taken from the name of an image.
+ * Works for the 3 digit image numbers of older images as well. Seconds are always 0
+ *
+ * @return uint8_t TRUE if the name is the name of an image else FALSE
+ */
+uint8_t sd_card_layout_parse_image_name(char* fileName, uint32_t* imageNumber, dt_datetime_t* datetime);
+
+/**
+ * @brief Calls the callback for every image in the data folder and the date folders
+ * inside it, whatever layout they were saved in. Images are not visited in order
+ *
+ * @return uint8_t FALSE if the data folder could not be opened or the callback
+ * stopped the search else TRUE
+ */
+uint8_t sd_card_layout_for_each_image(char* dataFolder, sd_card_layout_callback_t callback, void* arg);
+
+/**
+ * @brief Moves every image in the data folder to where it belongs in the given layout.
+ * Images saved with 3 digit image numbers are renamed to the wider image number
+ *
+ * @param numMoved Set to the number of images that were moved
+ * @return uint8_t FALSE if an image could not be moved else TRUE
+ */
+uint8_t sd_card_layout_move_images(char* dataFolder, uint8_t layout, uint32_t* numMoved);
+
+/**
+ * @brief Removes the date folders inside the data folder that have nothing in them
+ *
+ */
+void sd_card_layout_remove_empty_folders(char* dataFolder);
+
+#endif // SD_CARD_LAYOUT_H
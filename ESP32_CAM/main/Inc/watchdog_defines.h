@@ -18,6 +18,7 @@
 #include "datetime.h"
 #include "ds18b20.h"
 #include <stdio.h>
+#include <string.h>
 
 #define MOUNT_POINT_PATH ("/sdcard")
 
@@ -41,6 +42,10 @@
 #define SETTINGS_FILE_NAME_PATH          ("/watchdog/settings/s.wd")
 #define SETTINGS_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/settings/s.wd")
 
+#define SETTINGS_TEMP_FILE_NAME               ("s.tmp")
+#define SETTINGS_TEMP_FILE_NAME_PATH          ("/watchdog/settings/s.tmp")
+#define SETTINGS_TEMP_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/settings/s.tmp")
+
 #define DATA_FILE_NAME               ("data.txt")
 #define DATA_FILE_NAME_PATH          ("/watchdog/data/data.txt")
 #define DATA_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/data/data.txt")
@@ -49,6 +54,14 @@
 #define LOG_FILE_NAME_PATH          ("/watchdog/logs/logs.txt")
 #define LOG_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/logs/logs.txt")
 
+#define IMAGE_INDEX_FILE_NAME               ("index.wd")
+#define IMAGE_INDEX_FILE_NAME_PATH          ("/watchdog/data/index.wd")
+#define IMAGE_INDEX_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/data/index.wd")
+
+#define IMAGE_LAYOUT_FILE_NAME               ("layout.wd")
+#define IMAGE_LAYOUT_FILE_NAME_PATH          ("/watchdog/data/layout.wd")
+#define IMAGE_LAYOUT_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/data/layout.wd")
+
 #define ERROR_FILE_NAME               ("err.txt")
 #define ERROR_FILE_NAME_PATH          ("/err.txts")
 #define ERROR_FILE_PATH_START_AT_ROOT ("/sdcard/watchdog/logs/err.txt")
@@ -91,7 +104,14 @@
 #define WATCHDOG_BPK_R_STREAM_IMAGE              (BPACKET_SPECIFIC_R_OFFSET + 18)
 #define WATCHDOG_BPK_R_TURN_ON                   (BPACKET_SPECIFIC_R_OFFSET + 19)
 #define WATCHDOG_BPK_R_TURN_OFF                  (BPACKET_SPECIFIC_R_OFFSET + 20)
-#define WATCHDOG_BPK_OFFSET                      (BPACKET_SPECIFIC_R_OFFSET + 21)
+#define WATCHDOG_BPK_R_BENCHMARK                 (BPACKET_SPECIFIC_R_OFFSET + 21)
+#define WATCHDOG_BPK_R_GET_IMAGE_INDEX           (BPACKET_SPECIFIC_R_OFFSET + 22)
+#define WATCHDOG_BPK_R_TAKE_BURST                (BPACKET_SPECIFIC_R_OFFSET + 23)
+#define WATCHDOG_BPK_R_STOP_STREAM               (BPACKET_SPECIFIC_R_OFFSET + 24)
+#define WATCHDOG_BPK_OFFSET                      (BPACKET_SPECIFIC_R_OFFSET + 25)
+
+// Max number of bytes the ESP32 sends for one WATCHDOG_BPK_R_BENCHMARK request
+#define WATCHDOG_BENCHMARK_MAX_NUM_BYTES 131072
 
 #define WATCHDOG_PING_CODE_ESP32 23
 #define WATCHDOG_PING_CODE_STM32 47
@@ -105,6 +125,7 @@
 #define WATCHDOG_INVALID_DATE              (WATCHDOG_ERROR_OFFSET + 5)
 #define WATCHDOG_INVALID_BPACKET_SIZE      (WATCHDOG_ERROR_OFFSET + 6)
 #define WATCHDOG_INVALID_YEAR              (WATCHDOG_ERROR_OFFSET + 7)
+#define WATCHDOG_INVALID_BURST             (WATCHDOG_ERROR_OFFSET + 8)
 
 /* Public Enumerations */
 
@@ -131,6 +152,82 @@ typedef struct wd_settings_t {
     wd_camera_capture_time_settings_t captureTime;
 } wd_settings_t;
 
+// Every image saved adds one record of this many bytes to the end of the image index
+#define WD_IMAGE_RECORD_NUM_BYTES      64
+#define WD_IMAGE_RECORD_FILE_NAME_SIZE 40 // Includes the null character
+
+typedef struct wd_image_record_t {
+    uint32_t imageNumber;
+    uint32_t numBytes;
+    dt_datetime_t datetime;
+    ds18b20_temp_t temp1;
+    ds18b20_temp_t temp2;
+    char fileName[WD_IMAGE_RECORD_FILE_NAME_SIZE]; // Path of the image from the data folder
+} wd_image_record_t;
+
+// WATCHDOG_BPK_R_LIST_DIR asks for a page of the entries in a folder. Each entry is sent as a
+// header of WD_DIR_ENTRY_HEADER_NUM_BYTES followed by its null terminated name. Entries are
+// never split across bpackets. The last bpacket holds the number of entries sent (4 bytes)
+// and whether the folder has more entries after them (1 byte)
+#define WD_LIST_DIR_PATH_SIZE         160 // Includes the null character
+#define WD_LIST_DIR_PATTERN_SIZE      64  // Includes the null character
+#define WD_LIST_DIR_HEADER_NUM_BYTES  14
+#define WD_LIST_DIR_SUMMARY_NUM_BYTES 5
+#define WD_DIR_ENTRY_HEADER_NUM_BYTES 12
+#define WD_DIR_ENTRY_NAME_SIZE        240 // Includes the null character. Keeps an entry within a legacy bpacket
+#define WD_DIR_ENTRY_TYPE_FILE        0
+#define WD_DIR_ENTRY_TYPE_FOLDER      1
+
+typedef struct wd_list_dir_request_t {
+    uint32_t offset;                        // Number of matching entries to skip
+    uint16_t limit;                         // Max number of entries to send. 0 sends every entry
+    dt_date_t from;                         // Only entries modified on or after this date. Off if the year is 0
+    dt_date_t to;                           // Only entries modified on or before this date. Off if the year is 0
+    char path[WD_LIST_DIR_PATH_SIZE];       // Folder from the root of the SD card
+    char pattern[WD_LIST_DIR_PATTERN_SIZE]; // Names must match this. '*' and '?' wildcards. Empty matches all
+} wd_list_dir_request_t;
+
+typedef struct wd_dir_entry_t {
+    uint8_t type;
+    uint32_t numBytes;
+    dt_datetime_t modified;
+    char name[WD_DIR_ENTRY_NAME_SIZE];
+} wd_dir_entry_t;
+
+// The date, time and temperatures saved with each photo
+#define WD_PHOTO_DATA_NUM_BYTES 14
+
+// WATCHDOG_BPK_R_COPY_FILE holds the path of the file from the root of the SD card. A null
+// character and the byte to start from can follow the path to carry on a copy that was cut short
+#define WD_COPY_FILE_START_NUM_BYTES 4
+
+// The first WATCHDOG_BPK_R_STREAM_IMAGE starts a stream session that keeps the camera running
+// between frames. The session ends with WATCHDOG_BPK_R_STOP_STREAM or once no frame has been
+// asked for in a while. The stop response holds the number of frames sent (2 bytes) and the
+// frames sent per second x 100 (2 bytes)
+#define WD_STREAM_RESULT_NUM_BYTES 4
+
+// WATCHDOG_BPK_R_TAKE_BURST takes several photos for one request. Maple sends the burst
+// settings to the STM32, which puts the photo data in front of them and sends them on to
+// the ESP32. The success response holds the number of frames saved (1 byte), the frames
+// saved per second x 100 (2 bytes) and the time taken to save each frame in ms (2 bytes each)
+#define WD_BURST_NUM_BYTES               4
+#define WD_BURST_MAX_NUM_FRAMES          32
+#define WD_BURST_MAX_AE_LEVEL_STEP       2 // AE levels go from -2 to 2
+#define WD_BURST_RESULT_HEADER_NUM_BYTES 3
+
+typedef struct wd_burst_t {
+    uint8_t numFrames;
+    uint16_t intervalMs; // Time between the start of each frame. 0 takes them as fast as possible
+    uint8_t aeLevelStep; // 0 turns bracketing off. Otherwise frames cycle through AE levels -step, 0 and +step
+} wd_burst_t;
+
+typedef struct wd_burst_result_t {
+    uint8_t numSaved;
+    uint16_t fpsX100; // Frames saved per second x 100
+    uint16_t saveTimeMs[WD_BURST_MAX_NUM_FRAMES];
+} wd_burst_result_t;
+
 #define WD_ASSERT_VALID_CAMERA_RESOLUTION(resolution)            \
     do {                                                         \
         if (wd_camera_resolution_is_valid(resolution) != TRUE) { \
@@ -163,6 +260,40 @@ uint8_t wd_bpacket_to_photo_data(bpacket_t* bpacket, dt_datetime_t* datetime, ds
 uint8_t wd_photo_data_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
                                  dt_datetime_t* datetime, ds18b20_temp_t* temp1, ds18b20_temp_t* temp2);
 
+void wd_image_record_to_bytes(wd_image_record_t* record, uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES]);
+void wd_bytes_to_image_record(uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES], wd_image_record_t* record);
+
+uint8_t wd_burst_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t code, wd_burst_t* burst);
+
+/**
+ * @brief Reads the burst settings from a TAKE_BURST bpacket, either on their own or
+ * following the photo data
+ *
+ */
+uint8_t wd_bpacket_to_burst(bpacket_t* bpacket, wd_burst_t* burst);
+
+uint8_t wd_burst_result_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t code,
+                                   wd_burst_result_t* result);
+uint8_t wd_bpacket_to_burst_result(bpacket_t* bpacket, wd_burst_result_t* result);
+
+uint8_t wd_list_dir_request_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t code,
+                                       wd_list_dir_request_t* listDir);
+uint8_t wd_bpacket_to_list_dir_request(bpacket_t* bpacket, wd_list_dir_request_t* listDir);
+
+/**
+ * @brief Writes a folder entry to the given bytes
+ *
+ * @return uint16_t The number of bytes written
+ */
+uint16_t wd_dir_entry_to_bytes(wd_dir_entry_t* entry, uint8_t* bytes);
+
+/**
+ * @brief Reads a folder entry from the given bytes
+ *
+ * @return uint16_t The number of bytes read. 0 if the bytes do not hold a whole entry
+ */
+uint16_t wd_bytes_to_dir_entry(uint8_t* bytes, uint16_t numBytes, wd_dir_entry_t* entry);
+
 void wd_get_error(uint8_t wdError, char* errorMsg);
 
 #ifdef WATCHDOG_FUNCTIONS
@@ -170,8 +301,8 @@ void wd_get_error(uint8_t wdError, char* errorMsg);
 uint8_t wd_photo_data_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
                                  dt_datetime_t* datetime, ds18b20_temp_t* temp1, ds18b20_temp_t* temp2) {
 
-    // Confirm the bpacket has the correct request
-    if (request != WATCHDOG_BPK_R_TAKE_PHOTO) {
+    // Confirm the bpacket has the correct request. A burst puts its settings after the photo data
+    if ((request != WATCHDOG_BPK_R_TAKE_PHOTO) && (request != WATCHDOG_BPK_R_TAKE_BURST)) {
         return WATCHDOG_INVALID_REQUEST;
     }
 
@@ -192,7 +323,7 @@ uint8_t wd_photo_data_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t s
     bpacket->sender    = sender;
     bpacket->request   = request;
     bpacket->code      = code;
-    bpacket->numBytes  = 14;
+    bpacket->numBytes  = WD_PHOTO_DATA_NUM_BYTES;
     bpacket->bytes[0]  = datetime->time.second;
     bpacket->bytes[1]  = datetime->time.minute;
     bpacket->bytes[2]  = datetime->time.hour;
@@ -214,16 +345,19 @@ uint8_t wd_photo_data_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t s
 uint8_t wd_bpacket_to_photo_data(bpacket_t* bpacket, dt_datetime_t* datetime, ds18b20_temp_t* temp1,
                                  ds18b20_temp_t* temp2) {
 
-    // Assert the request is valid
-    if (bpacket->request != WATCHDOG_BPK_R_TAKE_PHOTO) {
+    // Assert the request and bpacket length are valid
+    if (bpacket->request == WATCHDOG_BPK_R_TAKE_PHOTO) {
+        if (bpacket->numBytes != WD_PHOTO_DATA_NUM_BYTES) {
+            return WATCHDOG_INVALID_BPACKET_SIZE;
+        }
+    } else if (bpacket->request == WATCHDOG_BPK_R_TAKE_BURST) {
+        if (bpacket->numBytes != (WD_PHOTO_DATA_NUM_BYTES + WD_BURST_NUM_BYTES)) {
+            return WATCHDOG_INVALID_BPACKET_SIZE;
+        }
+    } else {
         return WATCHDOG_INVALID_REQUEST;
     }
 
-    // Assert the bpacket length is valid
-    if (bpacket->numBytes != 14) {
-        return WATCHDOG_INVALID_BPACKET_SIZE;
-    }
-
     // Assert the time is valid
     if (dt_time_valid(bpacket->bytes[0], bpacket->bytes[1], bpacket->bytes[2]) != TRUE) {
         return WATCHDOG_INVALID_START_TIME;
@@ -494,6 +628,288 @@ uint8_t wd_bpacket_to_status(bpacket_t* bpacket, wd_status_t* status) {
     return TRUE;
 }
 
+void wd_image_record_to_bytes(wd_image_record_t* record, uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES]) {
+
+    // Values are written upper byte first so the index reads the same on every node
+    bytes[0]  = (record->imageNumber >> 24) & 0xFF;
+    bytes[1]  = (record->imageNumber >> 16) & 0xFF;
+    bytes[2]  = (record->imageNumber >> 8) & 0xFF;
+    bytes[3]  = record->imageNumber & 0xFF;
+    bytes[4]  = (record->numBytes >> 24) & 0xFF;
+    bytes[5]  = (record->numBytes >> 16) & 0xFF;
+    bytes[6]  = (record->numBytes >> 8) & 0xFF;
+    bytes[7]  = record->numBytes & 0xFF;
+    bytes[8]  = record->datetime.time.second;
+    bytes[9]  = record->datetime.time.minute;
+    bytes[10] = record->datetime.time.hour;
+    bytes[11] = record->datetime.date.day;
+    bytes[12] = record->datetime.date.month;
+    bytes[13] = (record->datetime.date.year >> 8) & 0xFF;
+    bytes[14] = record->datetime.date.year & 0xFF;
+    bytes[15] = record->temp1.sign;
+    bytes[16] = record->temp1.decimal;
+    bytes[17] = (record->temp1.fraction >> 8) & 0xFF;
+    bytes[18] = record->temp1.fraction & 0xFF;
+    bytes[19] = record->temp2.sign;
+    bytes[20] = record->temp2.decimal;
+    bytes[21] = (record->temp2.fraction >> 8) & 0xFF;
+    bytes[22] = record->temp2.fraction & 0xFF;
+    bytes[23] = 0;
+
+    strncpy((char*)&bytes[24], record->fileName, WD_IMAGE_RECORD_FILE_NAME_SIZE);
+    bytes[WD_IMAGE_RECORD_NUM_BYTES - 1] = '\0';
+}
+
+void wd_bytes_to_image_record(uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES], wd_image_record_t* record) {
+
+    record->imageNumber          = (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    record->numBytes             = (bytes[4] << 24) | (bytes[5] << 16) | (bytes[6] << 8) | bytes[7];
+    record->datetime.time.second = bytes[8];
+    record->datetime.time.minute = bytes[9];
+    record->datetime.time.hour   = bytes[10];
+    record->datetime.date.day    = bytes[11];
+    record->datetime.date.month  = bytes[12];
+    record->datetime.date.year   = (bytes[13] << 8) | bytes[14];
+    record->temp1.sign           = bytes[15];
+    record->temp1.decimal        = bytes[16];
+    record->temp1.fraction       = (bytes[17] << 8) | bytes[18];
+    record->temp2.sign           = bytes[19];
+    record->temp2.decimal        = bytes[20];
+    record->temp2.fraction       = (bytes[21] << 8) | bytes[22];
+
+    memcpy(record->fileName, &bytes[24], WD_IMAGE_RECORD_FILE_NAME_SIZE);
+    record->fileName[WD_IMAGE_RECORD_FILE_NAME_SIZE - 1] = '\0';
+}
+
+uint8_t wd_burst_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t code, wd_burst_t* burst) {
+
+    BPACKET_ASSERT_VALID_RECEIVER(receiver);
+    BPACKET_ASSERT_VALID_SENDER(sender);
+    BPACKET_ASSERT_VALID_CODE(code);
+
+    if ((burst->numFrames == 0) || (burst->numFrames > WD_BURST_MAX_NUM_FRAMES) ||
+        (burst->aeLevelStep > WD_BURST_MAX_AE_LEVEL_STEP)) {
+        return WATCHDOG_INVALID_BURST;
+    }
+
+    bpacket->receiver = receiver;
+    bpacket->sender   = sender;
+    bpacket->request  = WATCHDOG_BPK_R_TAKE_BURST;
+    bpacket->code     = code;
+    bpacket->numBytes = WD_BURST_NUM_BYTES;
+    bpacket->bytes[0] = burst->numFrames;
+    bpacket->bytes[1] = (burst->intervalMs >> 8) & 0xFF;
+    bpacket->bytes[2] = burst->intervalMs & 0xFF;
+    bpacket->bytes[3] = burst->aeLevelStep;
+
+    return TRUE;
+}
+
+uint8_t wd_bpacket_to_burst(bpacket_t* bpacket, wd_burst_t* burst) {
+
+    if (bpacket->request != WATCHDOG_BPK_R_TAKE_BURST) {
+        return WATCHDOG_INVALID_REQUEST;
+    }
+
+    if ((bpacket->numBytes != WD_BURST_NUM_BYTES) &&
+        (bpacket->numBytes != (WD_PHOTO_DATA_NUM_BYTES + WD_BURST_NUM_BYTES))) {
+        return WATCHDOG_INVALID_BPACKET_SIZE;
+    }
+
+    // The burst settings are always the last bytes
+    uint8_t* bytes = &bpacket->bytes[bpacket->numBytes - WD_BURST_NUM_BYTES];
+
+    burst->numFrames   = bytes[0];
+    burst->intervalMs  = (bytes[1] << 8) | bytes[2];
+    burst->aeLevelStep = bytes[3];
+
+    if ((burst->numFrames == 0) || (burst->numFrames > WD_BURST_MAX_NUM_FRAMES) ||
+        (burst->aeLevelStep > WD_BURST_MAX_AE_LEVEL_STEP)) {
+        return WATCHDOG_INVALID_BURST;
+    }
+
+    return TRUE;
+}
+
+uint8_t wd_burst_result_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t code,
+                                   wd_burst_result_t* result) {
+
+    BPACKET_ASSERT_VALID_RECEIVER(receiver);
+    BPACKET_ASSERT_VALID_SENDER(sender);
+    BPACKET_ASSERT_VALID_CODE(code);
+
+    if (result->numSaved > WD_BURST_MAX_NUM_FRAMES) {
+        return WATCHDOG_INVALID_BURST;
+    }
+
+    bpacket->receiver = receiver;
+    bpacket->sender   = sender;
+    bpacket->request  = WATCHDOG_BPK_R_TAKE_BURST;
+    bpacket->code     = code;
+    bpacket->numBytes = WD_BURST_RESULT_HEADER_NUM_BYTES + (result->numSaved * 2);
+    bpacket->bytes[0] = result->numSaved;
+    bpacket->bytes[1] = (result->fpsX100 >> 8) & 0xFF;
+    bpacket->bytes[2] = result->fpsX100 & 0xFF;
+
+    for (uint8_t i = 0; i < result->numSaved; i++) {
+        bpacket->bytes[WD_BURST_RESULT_HEADER_NUM_BYTES + (i * 2)]     = (result->saveTimeMs[i] >> 8) & 0xFF;
+        bpacket->bytes[WD_BURST_RESULT_HEADER_NUM_BYTES + (i * 2) + 1] = result->saveTimeMs[i] & 0xFF;
+    }
+
+    return TRUE;
+}
+
+uint8_t wd_bpacket_to_burst_result(bpacket_t* bpacket, wd_burst_result_t* result) {
+
+    if (bpacket->request != WATCHDOG_BPK_R_TAKE_BURST) {
+        return WATCHDOG_INVALID_REQUEST;
+    }
+
+    if ((bpacket->numBytes < WD_BURST_RESULT_HEADER_NUM_BYTES) || (bpacket->bytes[0] > WD_BURST_MAX_NUM_FRAMES) ||
+        (bpacket->numBytes != (WD_BURST_RESULT_HEADER_NUM_BYTES + (bpacket->bytes[0] * 2)))) {
+        return WATCHDOG_INVALID_BPACKET_SIZE;
+    }
+
+    result->numSaved = bpacket->bytes[0];
+    result->fpsX100  = (bpacket->bytes[1] << 8) | bpacket->bytes[2];
+
+    for (uint8_t i = 0; i < result->numSaved; i++) {
+        result->saveTimeMs[i] = (bpacket->bytes[WD_BURST_RESULT_HEADER_NUM_BYTES + (i * 2)] << 8) |
+                                bpacket->bytes[WD_BURST_RESULT_HEADER_NUM_BYTES + (i * 2) + 1];
+    }
+
+    return TRUE;
+}
+
+uint8_t wd_list_dir_request_to_bpacket(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t code,
+                                       wd_list_dir_request_t* listDir) {
+
+    BPACKET_ASSERT_VALID_RECEIVER(receiver);
+    BPACKET_ASSERT_VALID_SENDER(sender);
+    BPACKET_ASSERT_VALID_CODE(code);
+
+    uint16_t pathNumBytes    = strnlen(listDir->path, WD_LIST_DIR_PATH_SIZE);
+    uint16_t patternNumBytes = strnlen(listDir->pattern, WD_LIST_DIR_PATTERN_SIZE);
+    if ((pathNumBytes == WD_LIST_DIR_PATH_SIZE) || (patternNumBytes == WD_LIST_DIR_PATTERN_SIZE)) {
+        return WATCHDOG_INVALID_BPACKET_SIZE;
+    }
+
+    bpacket->receiver  = receiver;
+    bpacket->sender    = sender;
+    bpacket->request   = WATCHDOG_BPK_R_LIST_DIR;
+    bpacket->code      = code;
+    bpacket->numBytes  = WD_LIST_DIR_HEADER_NUM_BYTES + pathNumBytes + 1 + patternNumBytes + 1;
+    bpacket->bytes[0]  = (listDir->offset >> 24) & 0xFF;
+    bpacket->bytes[1]  = (listDir->offset >> 16) & 0xFF;
+    bpacket->bytes[2]  = (listDir->offset >> 8) & 0xFF;
+    bpacket->bytes[3]  = listDir->offset & 0xFF;
+    bpacket->bytes[4]  = (listDir->limit >> 8) & 0xFF;
+    bpacket->bytes[5]  = listDir->limit & 0xFF;
+    bpacket->bytes[6]  = listDir->from.day;
+    bpacket->bytes[7]  = listDir->from.month;
+    bpacket->bytes[8]  = (listDir->from.year >> 8) & 0xFF;
+    bpacket->bytes[9]  = listDir->from.year & 0xFF;
+    bpacket->bytes[10] = listDir->to.day;
+    bpacket->bytes[11] = listDir->to.month;
+    bpacket->bytes[12] = (listDir->to.year >> 8) & 0xFF;
+    bpacket->bytes[13] = listDir->to.year & 0xFF;
+
+    memcpy(&bpacket->bytes[WD_LIST_DIR_HEADER_NUM_BYTES], listDir->path, pathNumBytes + 1);
+    memcpy(&bpacket->bytes[WD_LIST_DIR_HEADER_NUM_BYTES + pathNumBytes + 1], listDir->pattern, patternNumBytes + 1);
+
+    return TRUE;
+}
+
+uint8_t wd_bpacket_to_list_dir_request(bpacket_t* bpacket, wd_list_dir_request_t* listDir) {
+
+    if (bpacket->request != WATCHDOG_BPK_R_LIST_DIR) {
+        return WATCHDOG_INVALID_REQUEST;
+    }
+
+    if (bpacket->numBytes < (WD_LIST_DIR_HEADER_NUM_BYTES + 2)) {
+        return WATCHDOG_INVALID_BPACKET_SIZE;
+    }
+
+    // The path and the pattern must both be null terminated within the bpacket
+    char* path               = (char*)&bpacket->bytes[WD_LIST_DIR_HEADER_NUM_BYTES];
+    uint16_t pathNumBytes    = strnlen(path, bpacket->numBytes - WD_LIST_DIR_HEADER_NUM_BYTES);
+    char* pattern            = path + pathNumBytes + 1;
+    uint16_t patternNumBytes = strnlen(pattern, bpacket->numBytes - WD_LIST_DIR_HEADER_NUM_BYTES - pathNumBytes - 1);
+
+    if ((WD_LIST_DIR_HEADER_NUM_BYTES + pathNumBytes + 1 + patternNumBytes + 1) > bpacket->numBytes) {
+        return WATCHDOG_INVALID_BPACKET_SIZE;
+    }
+
+    if ((pathNumBytes >= WD_LIST_DIR_PATH_SIZE) || (patternNumBytes >= WD_LIST_DIR_PATTERN_SIZE)) {
+        return WATCHDOG_INVALID_BPACKET_SIZE;
+    }
+
+    listDir->offset =
+        ((uint32_t)bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) | bpacket->bytes[3];
+    listDir->limit      = (bpacket->bytes[4] << 8) | bpacket->bytes[5];
+    listDir->from.day   = bpacket->bytes[6];
+    listDir->from.month = bpacket->bytes[7];
+    listDir->from.year  = (bpacket->bytes[8] << 8) | bpacket->bytes[9];
+    listDir->to.day     = bpacket->bytes[10];
+    listDir->to.month   = bpacket->bytes[11];
+    listDir->to.year    = (bpacket->bytes[12] << 8) | bpacket->bytes[13];
+
+    memcpy(listDir->path, path, pathNumBytes + 1);
+    memcpy(listDir->pattern, pattern, patternNumBytes + 1);
+
+    return TRUE;
+}
+
+uint16_t wd_dir_entry_to_bytes(wd_dir_entry_t* entry, uint8_t* bytes) {
+
+    uint16_t nameNumBytes = strnlen(entry->name, WD_DIR_ENTRY_NAME_SIZE - 1);
+
+    bytes[0]  = entry->type;
+    bytes[1]  = (entry->numBytes >> 24) & 0xFF;
+    bytes[2]  = (entry->numBytes >> 16) & 0xFF;
+    bytes[3]  = (entry->numBytes >> 8) & 0xFF;
+    bytes[4]  = entry->numBytes & 0xFF;
+    bytes[5]  = entry->modified.time.second;
+    bytes[6]  = entry->modified.time.minute;
+    bytes[7]  = entry->modified.time.hour;
+    bytes[8]  = entry->modified.date.day;
+    bytes[9]  = entry->modified.date.month;
+    bytes[10] = (entry->modified.date.year >> 8) & 0xFF;
+    bytes[11] = entry->modified.date.year & 0xFF;
+
+    memcpy(&bytes[WD_DIR_ENTRY_HEADER_NUM_BYTES], entry->name, nameNumBytes);
+    bytes[WD_DIR_ENTRY_HEADER_NUM_BYTES + nameNumBytes] = '\0';
+
+    return WD_DIR_ENTRY_HEADER_NUM_BYTES + nameNumBytes + 1;
+}
+
+uint16_t wd_bytes_to_dir_entry(uint8_t* bytes, uint16_t numBytes, wd_dir_entry_t* entry) {
+
+    if (numBytes <= WD_DIR_ENTRY_HEADER_NUM_BYTES) {
+        return 0;
+    }
+
+    char* name            = (char*)&bytes[WD_DIR_ENTRY_HEADER_NUM_BYTES];
+    uint16_t nameNumBytes = strnlen(name, numBytes - WD_DIR_ENTRY_HEADER_NUM_BYTES);
+
+    if (((WD_DIR_ENTRY_HEADER_NUM_BYTES + nameNumBytes) == numBytes) || (nameNumBytes >= WD_DIR_ENTRY_NAME_SIZE)) {
+        return 0;
+    }
+
+    entry->type                 = bytes[0];
+    entry->numBytes             = ((uint32_t)bytes[1] << 24) | (bytes[2] << 16) | (bytes[3] << 8) | bytes[4];
+    entry->modified.time.second = bytes[5];
+    entry->modified.time.minute = bytes[6];
+    entry->modified.time.hour   = bytes[7];
+    entry->modified.date.day    = bytes[8];
+    entry->modified.date.month  = bytes[9];
+    entry->modified.date.year   = (bytes[10] << 8) | bytes[11];
+
+    memcpy(entry->name, name, nameNumBytes + 1);
+
+    return WD_DIR_ENTRY_HEADER_NUM_BYTES + nameNumBytes + 1;
+}
+
 void wd_get_error(uint8_t wdError, char* errorMsg) {
 
     switch (wdError) {
@@ -530,6 +946,10 @@ void wd_get_error(uint8_t wdError, char* errorMsg) {
             sprintf(errorMsg, "WD def err: Invalid year\r\n");
             break;
 
+        case WATCHDOG_INVALID_BURST:
+            sprintf(errorMsg, "WD def err: Invalid burst\r\n");
+            break;
+
         default:
             sprintf(errorMsg, "WD def err: Unknown WD error code %i\r\n", wdError);
             break;
@@ -9,8 +9,12 @@
  *
  */
 
+/* Library Includes */
+#include "esp_timer.h"
+
 /* Personal Includes */
 #include "camera.h"
+#include "camera_pipeline.h"
 #include "sd_card.h"
 #include "esp32_uart.h"
 #include "utilities.h"
@@ -80,14 +84,28 @@ static camera_config_t camera_config = {
                         // the ESP32-S series has improved a lot, but JPEG mode always gives better frame rates.
 
     .jpeg_quality = 8, // 0-63, for OV series camera sensors, lower number means higher quality
-    .fb_count     = 1, // When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode.
-    .grab_mode    = CAMERA_GRAB_WHEN_EMPTY,
+    .fb_count     = CAMERA_NUM_FRAME_BUFFERS, // When jpeg mode is used, if fb_count more than one, the driver will
+                                              // work in continuous mode.
+    .grab_mode    = CAMERA_GRAB_LATEST, // Frames left over from before a photo was asked for are not used
 };
 
 int cameraInitalised = 0;
+framesize_t initFrameSize; // The frame buffers are sized for this resolution
+
+// Stream session
+uint8_t streamActive            = FALSE;
+uint8_t streamInitialisedCamera = FALSE; // The camera is deinitialised when the session ends
+uint32_t streamNumFrames        = 0;
+int64_t streamStartUs           = 0;
+int64_t streamLastFrameUs       = 0;
 
 /* Function Prototypes */
-uint8_t camera_capture_image(camera_fb_t** image);
+uint8_t camera_use_photo_profile(void);
+uint8_t camera_use_preview_profile(void);
+void camera_drop_stale_frames(void);
+uint32_t camera_stream_get_fps_x100(void);
+void camera_stream_end(void);
+uint8_t camera_save_frames(bpacket_t* bpacket, camera_pipeline_config_t* config, camera_pipeline_stats_t* stats);
 
 uint8_t camera_init(void) {
 
@@ -98,6 +116,7 @@ uint8_t camera_init(void) {
     }
 
     cameraInitalised = TRUE;
+    initFrameSize    = camera_config.frame_size;
     return TRUE;
 }
 
@@ -135,31 +154,209 @@ uint8_t camera_set_resolution(uint8_t camRes) {
             return FALSE;
     }
 
-    // Successfully changed the camera resolution
+    // A stream session puts the new resolution in place when it ends
+    if ((cameraInitalised != TRUE) || (streamActive == TRUE)) {
+        return TRUE;
+    }
+
+    return camera_use_photo_profile();
+}
+
+uint8_t camera_use_photo_profile(void) {
+
+    // The frame buffers are only big enough for the resolution the camera was initialised
+    // with so larger ones need a new init
+    if (camera_config.frame_size > initFrameSize) {
+        esp_camera_deinit();
+        return camera_init();
+    }
+
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (sensor == NULL) {
+        return FALSE;
+    }
+
+    sensor->set_special_effect(sensor, CAMERA_EFFECT_NONE);
+
+    if (sensor->set_framesize(sensor, camera_config.frame_size) != 0) {
+        return FALSE;
+    }
+
+    if (sensor->set_quality(sensor, camera_config.jpeg_quality) != 0) {
+        return FALSE;
+    }
+
+    camera_drop_stale_frames();
+
+    return TRUE;
+}
+
+uint8_t camera_use_preview_profile(void) {
+
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (sensor == NULL) {
+        return FALSE;
+    }
+
+    // The preview is never larger than the frame buffers
+    framesize_t frameSize = (CAMERA_PREVIEW_FRAME_SIZE < initFrameSize) ? CAMERA_PREVIEW_FRAME_SIZE : initFrameSize;
+
+    if (sensor->set_framesize(sensor, frameSize) != 0) {
+        return FALSE;
+    }
+
+    if (sensor->set_quality(sensor, CAMERA_PREVIEW_JPEG_QUALITY) != 0) {
+        return FALSE;
+    }
+
+    sensor->set_special_effect(sensor, (CAMERA_PREVIEW_GRAYSCALE != 0) ? CAMERA_EFFECT_GRAYSCALE : CAMERA_EFFECT_NONE);
+    camera_drop_stale_frames();
+
     return TRUE;
 }
 
+void camera_drop_stale_frames(void) {
+
+    // The frame buffers were filled before the settings changed. The frames still get the new
+    // size in their camera_fb_t so they can only be told apart by throwing the first ones away
+    for (uint8_t i = 0; i < CAMERA_NUM_FRAME_BUFFERS; i++) {
+        camera_fb_t* frame = esp_camera_fb_get();
+        if (frame != NULL) {
+            esp_camera_fb_return(frame);
+        }
+    }
+}
+
 void camera_stream_image(bpacket_t* bpacket) {
 
-    camera_fb_t* image = NULL;
+    // Save the address
+    uint8_t request  = bpacket->request;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
 
-    if (camera_capture_image(&image) != TRUE) {
-        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                          "Camera could not taken photo\r\n\0");
+    // The camera is only initialised when the session starts. After that it keeps filling
+    // its frame buffers so each frame is ready as soon as it is asked for
+    if (streamActive != TRUE) {
+
+        streamInitialisedCamera = FALSE;
+        if (cameraInitalised != TRUE) {
+            if (camera_init() != TRUE) {
+                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
+                                  "Camera failed to initialise\r\n\0");
+                esp32_uart_send_bpacket(bpacket);
+                return;
+            }
+
+            streamInitialisedCamera = TRUE;
+        }
+
+        // Switched on the running sensor so the camera does not need to be initialised again
+        if (camera_use_preview_profile() != TRUE) {
+            camera_use_photo_profile();
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
+                              "Camera could not change to preview settings\r\n\0");
+            esp32_uart_send_bpacket(bpacket);
+            return;
+        }
+
+        streamActive    = TRUE;
+        streamNumFrames = 0;
+        streamStartUs   = esp_timer_get_time();
+    }
+
+    camera_fb_t* image = esp_camera_fb_get();
+
+    if (image == NULL) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Camera could not taken photo\r\n\0");
         esp32_uart_send_bpacket(bpacket);
         return;
     }
 
     // Image was able to be taken. Send image back to sender
-    if (bpacket_send_data(esp32_uart_send_data, bpacket->sender, bpacket->receiver, bpacket->request, image->buf,
-                          image->len) != TRUE) {
-        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                          "Failed to send image\r\n\0");
+    if (esp32_uart_send_transfer(sender, receiver, request, image->buf, image->len) != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to send image\r\n\0");
         esp32_uart_send_bpacket(bpacket);
+    } else {
+        streamNumFrames++;
     }
 
-    // Free the image
+    // Hand the frame buffer back to the camera
     esp_camera_fb_return(image);
+
+    // The idle timeout starts once the frame has been sent
+    streamLastFrameUs = esp_timer_get_time();
+}
+
+void camera_stop_stream(bpacket_t* bpacket) {
+
+    uint32_t numFrames = 0;
+    uint32_t fpsX100   = 0;
+
+    if (streamActive == TRUE) {
+        numFrames = streamNumFrames;
+        fpsX100   = camera_stream_get_fps_x100();
+        camera_stream_end();
+    }
+
+    numFrames = (numFrames > 0xFFFF) ? 0xFFFF : numFrames;
+    fpsX100   = (fpsX100 > 0xFFFF) ? 0xFFFF : fpsX100;
+
+    uint8_t result[WD_STREAM_RESULT_NUM_BYTES] = {(numFrames >> 8) & 0xFF, numFrames & 0xFF, (fpsX100 >> 8) & 0xFF,
+                                                  fpsX100 & 0xFF};
+    bpacket_create_p(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_SUCCESS,
+                     WD_STREAM_RESULT_NUM_BYTES, result);
+    esp32_uart_send_bpacket(bpacket);
+}
+
+void camera_stream_update(void) {
+
+    if (streamActive != TRUE) {
+        return;
+    }
+
+    if ((esp_timer_get_time() - streamLastFrameUs) >= ((int64_t)CAMERA_STREAM_IDLE_TIMEOUT_MS * 1000)) {
+        camera_stream_end();
+    }
+}
+
+uint8_t camera_stream_active(void) {
+    return streamActive;
+}
+
+uint32_t camera_stream_get_fps_x100(void) {
+
+    int64_t timeUs = streamLastFrameUs - streamStartUs;
+
+    if (timeUs <= 0) {
+        return 0;
+    }
+
+    return (uint32_t)(((uint64_t)streamNumFrames * 100000000) / timeUs);
+}
+
+void camera_stream_end(void) {
+
+    uint32_t fpsX100 = camera_stream_get_fps_x100();
+
+    char msg[80];
+    sprintf(msg, "Stream ended: %lu frames at %lu.%02lu fps", (unsigned long)streamNumFrames,
+            (unsigned long)(fpsX100 / 100), (unsigned long)(fpsX100 % 100));
+
+    if (sd_card_open() == TRUE) {
+        sd_card_log(SYSTEM_LOG_FILE, msg);
+        sd_card_close();
+    }
+
+    streamActive = FALSE;
+
+    if (streamInitialisedCamera == TRUE) {
+        esp_camera_deinit();
+        cameraInitalised = FALSE;
+    } else {
+        camera_use_photo_profile();
+    }
+
+    streamInitialisedCamera = FALSE;
 }
 
 void camera_capture_and_save_image(bpacket_t* bpacket) {
@@ -169,62 +366,138 @@ void camera_capture_and_save_image(bpacket_t* bpacket) {
     uint8_t receiver = bpacket->receiver;
     uint8_t sender   = bpacket->sender;
 
-    // Confirm camera has been initialised
-    if (cameraInitalised != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Camera was unitailised\0");
-        esp32_uart_send_bpacket(bpacket);
+    camera_pipeline_config_t config = {
+        .numFrames   = CAMERA_BURST_NUM_FRAMES,
+        .intervalMs  = CAMERA_BURST_INTERVAL_MS,
+        .aeLevelStep = 0,
+    };
+
+    camera_pipeline_stats_t stats;
+    if (camera_save_frames(bpacket, &config, &stats) != TRUE) {
         return;
     }
 
-    // Confirm the SD card can be mounted
-    if (sd_card_open() != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card could not open\0");
+    char msg[50];
+    sprintf(msg, "Saved %lu images, %lu bytes", (unsigned long)stats.numSaved, (unsigned long)stats.numBytesSaved);
+    bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, msg);
+    esp32_uart_send_bpacket(bpacket);
+}
+
+void camera_capture_burst(bpacket_t* bpacket) {
+
+    // Save the address
+    uint8_t request  = bpacket->request;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
+
+    wd_burst_t burst;
+    uint8_t result = wd_bpacket_to_burst(bpacket, &burst);
+    if (result != TRUE) {
+        char errMsg[50];
+        wd_get_error(result, errMsg);
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
         esp32_uart_send_bpacket(bpacket);
         return;
     }
 
-    // Take a photo
-    sd_card_log(SYSTEM_LOG_FILE, "Taking image");
-    camera_fb_t* pic = esp_camera_fb_get();
+    camera_pipeline_config_t config = {
+        .numFrames   = burst.numFrames,
+        .intervalMs  = burst.intervalMs,
+        .aeLevelStep = burst.aeLevelStep,
+    };
 
-    // Return error if picture could not be taken
-    if (pic == NULL) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to take a photo\0");
-        esp32_uart_send_bpacket(bpacket);
-        sd_card_log(SYSTEM_LOG_FILE, "Camera failed to take image");
-    } else if (sd_card_save_image(pic->buf, pic->len, bpacket) != TRUE) {
-        sd_card_log(SYSTEM_LOG_FILE, "Image could not be saved");
-    } else {
-        char msg[100];
-        sprintf(msg, "Image was %zu bytes", pic->len);
-        sd_card_log(SYSTEM_LOG_FILE, msg);
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, msg);
-        esp32_uart_send_bpacket(bpacket);
+    camera_pipeline_stats_t stats;
+    if (camera_save_frames(bpacket, &config, &stats) != TRUE) {
+        return;
     }
 
-    esp_camera_fb_return(pic);
+    // Send back how quickly the frames were taken and how long each took to save
+    wd_burst_result_t burstResult;
+    burstResult.numSaved = stats.numSaved;
+    burstResult.fpsX100  = (stats.totalTimeUs == 0) ? 0 : ((uint64_t)stats.numSaved * 100000000) / stats.totalTimeUs;
 
-    sd_card_close();
+    for (uint8_t i = 0; i < burstResult.numSaved; i++) {
+        uint32_t saveTimeMs       = stats.frameSaveTimeUs[i] / 1000;
+        burstResult.saveTimeMs[i] = (saveTimeMs > 0xFFFF) ? 0xFFFF : saveTimeMs;
+    }
+
+    result = wd_burst_result_to_bpacket(bpacket, sender, receiver, BPACKET_CODE_SUCCESS, &burstResult);
+    if (result != TRUE) {
+        char errMsg[50];
+        wd_get_error(result, errMsg);
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
+    }
+
+    esp32_uart_send_bpacket(bpacket);
 }
 
-uint8_t camera_capture_image(camera_fb_t** image) {
+uint8_t camera_save_frames(bpacket_t* bpacket, camera_pipeline_config_t* config, camera_pipeline_stats_t* stats) {
 
-    // Initialise the camera
-    if (camera_init() != TRUE) {
+    // Save the address
+    uint8_t request  = bpacket->request;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
+
+    // Photos are taken with the photo settings so a stream session running from Maple is ended first
+    if (streamActive == TRUE) {
+        camera_stream_end();
+    }
+
+    // Confirm camera has been initialised. A stream session that had to initialise it leaves it deinitialised
+    if ((cameraInitalised != TRUE) && (camera_init() != TRUE)) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Camera failed to initialise\0");
+        esp32_uart_send_bpacket(bpacket);
         return FALSE;
     }
 
-    *image = esp_camera_fb_get();
+    sd_card_mount_stats_t startStats, endStats;
+    sd_card_get_mount_stats(&startStats);
 
-    if (*image == NULL) {
-        esp_camera_fb_return(*image);
+    // Confirm the SD card can be mounted. Every frame is saved in the one session
+    if (sd_card_open() != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card could not open\0");
+        esp32_uart_send_bpacket(bpacket);
         return FALSE;
     }
 
-    // Deinitialise the camera
-    if (esp_camera_deinit() != ESP_OK) {
-        return FALSE;
+    // Take the photos. The camera takes the next frame while the last one is being saved
+    sd_card_log(SYSTEM_LOG_FILE, "Taking image");
+    uint8_t result = camera_pipeline_run(bpacket, config, stats);
+
+    char msg[100];
+
+    // A frame that failed to save has already sent its error back
+    if (stats->numSaved < stats->numCaptured) {
+        sd_card_log(SYSTEM_LOG_FILE, "Image could not be saved");
+    } else if (result != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to take a photo\0");
+        esp32_uart_send_bpacket(bpacket);
+        sd_card_log(SYSTEM_LOG_FILE, "Camera failed to take image");
+    } else {
+        sprintf(msg, "Saved %lu images, %lu bytes", (unsigned long)stats->numSaved,
+                (unsigned long)stats->numBytesSaved);
+        sd_card_log(SYSTEM_LOG_FILE, msg);
     }
 
-    return TRUE;
-}
\ No newline at end of file
+    // Time spent in each stage. Capture and save overlap so together they can be longer than the total
+    sprintf(msg, "Capture: %lu ms wait: %lu ms save: %lu ms (max %lu ms) total: %lu ms",
+            (unsigned long)(stats->captureTimeUs / 1000), (unsigned long)(stats->queueTimeUs / 1000),
+            (unsigned long)(stats->saveTimeUs / 1000), (unsigned long)(stats->maxSaveTimeUs / 1000),
+            (unsigned long)(stats->totalTimeUs / 1000));
+    sd_card_log(SYSTEM_LOG_FILE, msg);
+
+    // Every session that reused the mount would have mounted and unmounted the card again
+    sd_card_get_mount_stats(&endStats);
+    if (endStats.numMounts > 0) {
+        uint32_t numReuses = endStats.numReuses - startStats.numReuses;
+        uint64_t cycleUs   = (endStats.mountTimeUs + endStats.unmountTimeUs) / endStats.numMounts;
+        sprintf(msg, "Capture mounts: %lu reused: %lu saved: %lu ms",
+                (unsigned long)(endStats.numMounts - startStats.numMounts), (unsigned long)numReuses,
+                (unsigned long)((numReuses * cycleUs) / 1000));
+        sd_card_log(SYSTEM_LOG_FILE, msg);
+    }
+
+    sd_card_close();
+
+    return result;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file camera_pipeline.c
+ * @author Gian Barta-Dougall
+ * @brief Takes photos and saves them to the SD card at the same time
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* Library Includes */
+#include <string.h>
+#include "esp_timer.h"
+
+/* Personal Includes */
+#include "camera.h"
+#include "camera_pipeline.h"
+#include "sd_card.h"
+#include "utilities.h"
+
+/* Private Variables */
+QueueHandle_t frameQueue          = NULL; // Frames waiting to be saved. A NULL frame ends the run
+SemaphoreHandle_t writerDone      = NULL; // Given by the writer once every frame in the run is saved
+TaskHandle_t writerTask           = NULL;
+camera_pipeline_stats_t* runStats = NULL;
+volatile uint8_t saveFailed       = FALSE; // Set by the writer, stops the camera taking more frames
+
+// sd_card_save_image() overwrites the bpacket it is given when it fails so each
+// frame is saved with its own copy of the request
+bpacket_t runRequest;
+bpacket_t frameRequest;
+
+/* Function Prototypes */
+static void camera_pipeline_writer(void* arg);
+
+uint8_t camera_pipeline_init(void) {
+
+    if (writerTask != NULL) {
+        return TRUE;
+    }
+
+    // Every frame buffer can be waiting to be saved at once
+    if ((frameQueue = xQueueCreate(CAMERA_NUM_FRAME_BUFFERS + 1, sizeof(camera_fb_t*))) == NULL) {
+        return FALSE;
+    }
+
+    if ((writerDone = xSemaphoreCreateBinary()) == NULL) {
+        vQueueDelete(frameQueue);
+        frameQueue = NULL;
+        return FALSE;
+    }
+
+    if (xTaskCreatePinnedToCore(camera_pipeline_writer, "camera writer", CAMERA_PIPELINE_WRITER_STACK_SIZE, NULL,
+                                CAMERA_PIPELINE_WRITER_PRIORITY, &writerTask, CAMERA_PIPELINE_WRITER_CORE) != pdPASS) {
+        vSemaphoreDelete(writerDone);
+        vQueueDelete(frameQueue);
+        writerDone = NULL;
+        frameQueue = NULL;
+        writerTask = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+uint8_t camera_pipeline_run(bpacket_t* bpacket, camera_pipeline_config_t* config, camera_pipeline_stats_t* stats) {
+
+    memset(stats, 0, sizeof(camera_pipeline_stats_t));
+
+    if (camera_pipeline_init() != TRUE) {
+        return FALSE;
+    }
+
+    runRequest = *bpacket;
+    runStats   = stats;
+    saveFailed = FALSE;
+
+    sensor_t* sensor    = esp_camera_sensor_get();
+    int64_t startUs     = esp_timer_get_time();
+    int64_t nextFrameUs = startUs;
+
+    for (uint16_t i = 0; (i < config->numFrames) && (saveFailed != TRUE); i++) {
+
+        int64_t waitUs = nextFrameUs - esp_timer_get_time();
+        if (waitUs >= 1000) {
+            vTaskDelay(pdMS_TO_TICKS(waitUs / 1000));
+        }
+
+        nextFrameUs += (int64_t)config->intervalMs * 1000;
+
+        // The sensor was already exposing a frame when the level changed so that frame is thrown away
+        if ((config->aeLevelStep != 0) && (sensor != NULL)) {
+            sensor->set_ae_level(sensor, (((int)(i % 3)) - 1) * config->aeLevelStep);
+            camera_fb_t* staleFrame = esp_camera_fb_get();
+            if (staleFrame != NULL) {
+                esp_camera_fb_return(staleFrame);
+            }
+        }
+
+        // The camera fills another frame buffer while the writer saves this one
+        int64_t stageUs    = esp_timer_get_time();
+        camera_fb_t* frame = esp_camera_fb_get();
+        stats->captureTimeUs += esp_timer_get_time() - stageUs;
+
+        if (frame == NULL) {
+            break;
+        }
+
+        stats->numCaptured++;
+
+        // Only waits if every frame buffer is still waiting to be saved
+        stageUs = esp_timer_get_time();
+        xQueueSend(frameQueue, &frame, portMAX_DELAY);
+        stats->queueTimeUs += esp_timer_get_time() - stageUs;
+    }
+
+    camera_fb_t* endOfRun = NULL;
+    xQueueSend(frameQueue, &endOfRun, portMAX_DELAY);
+    xSemaphoreTake(writerDone, portMAX_DELAY);
+
+    if ((config->aeLevelStep != 0) && (sensor != NULL)) {
+        sensor->set_ae_level(sensor, 0);
+    }
+
+    stats->totalTimeUs = esp_timer_get_time() - startUs;
+    runStats           = NULL;
+
+    return (stats->numSaved == config->numFrames) ? TRUE : FALSE;
+}
+
+static void camera_pipeline_writer(void* arg) {
+
+    camera_fb_t* frame;
+
+    while (1) {
+
+        xQueueReceive(frameQueue, &frame, portMAX_DELAY);
+
+        if (frame == NULL) {
+            xSemaphoreGive(writerDone);
+            continue;
+        }
+
+        // Frames taken after one failed to save are handed back without being saved
+        // so the sender only gets one error
+        if (saveFailed != TRUE) {
+
+            frameRequest    = runRequest;
+            int64_t startUs = esp_timer_get_time();
+
+            uint8_t saved       = sd_card_save_image(frame->buf, frame->len, &frameRequest);
+            uint32_t saveTimeUs = esp_timer_get_time() - startUs;
+
+            if (saved != TRUE) {
+                saveFailed = TRUE;
+            } else {
+                if (runStats->numSaved < CAMERA_PIPELINE_NUM_TIMED_FRAMES) {
+                    runStats->frameSaveTimeUs[runStats->numSaved] = saveTimeUs;
+                }
+
+                runStats->numSaved++;
+                runStats->numBytesSaved += frame->len;
+            }
+
+            runStats->saveTimeUs += saveTimeUs;
+            if (saveTimeUs > runStats->maxSaveTimeUs) {
+                runStats->maxSaveTimeUs = saveTimeUs;
+            }
+        }
+
+        esp_camera_fb_return(frame);
+    }
+}
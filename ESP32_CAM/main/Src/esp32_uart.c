@@ -11,24 +11,61 @@
 
 /* Personal Includes */
 #include <string.h>
+#include <stdlib.h>
 
 /* Personal Includes */
 #include "esp32_uart.h"
 #include "hardware_config.h"
 #include "chars.h"
+#include "bpacket_parser.h"
+#include "watchdog_defines.h"
 
 #define UART_NUM HC_UART_COMMS_UART_NUM
 
+#define NACK_TIMEOUT_MS 1000
+#define ACK_TIMEOUT_MS  1000
+#define READ_TIMEOUT_MS 50
+
+#define MIN_BAUD_RATE 9600
+#define MAX_BAUD_RATE 5000000 // Fastest the ESP32 UART can run
+
+#define RX_NUM_BYTES RX_RING_BUFFER_BYTE_SIZE
+
 // support IDF 5.x
 #ifndef portTICK_RATE_MS
     #define portTICK_RATE_MS portTICK_PERIOD_MS
 #endif
 
+/* Private Variables */
+
+// Bytes are read from the UART in blocks. Anything left after a bpacket is parsed
+// on the next read. Bpackets are decoded into rxBpacket so one that arrives over
+// several reads is not split across the callers' bpackets
+bpacket_parser_t parser;
+bpacket_t rxBpacket;
+uint8_t rxBytes[RX_NUM_BYTES];
+uint32_t rxIndex          = 0;
+uint32_t rxNumBytes       = 0;
+uint8_t rxBpacketReceived = FALSE;
+
+/* Function Prototypes */
+void esp32_uart_bpacket_received(uint8_t id, bpacket_t* bpacket);
+uint8_t esp32_uart_read_bpacket_timeout(bpacket_t* bpacket, uint32_t timeoutMs);
+
+void esp32_uart_init(void) {
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_ESP32, &rxBpacket, esp32_uart_bpacket_received);
+}
+
+void esp32_uart_bpacket_received(uint8_t id, bpacket_t* bpacket) {
+    rxBpacketReceived = TRUE;
+}
+
 void esp32_uart_send_bpacket(bpacket_t* bpacket) {
 
-    bpacket_buffer_t bpacketBuffer;
-    bpacket_to_buffer(bpacket, &bpacketBuffer);
-    uart_write_bytes(UART_NUM, bpacketBuffer.buffer, bpacketBuffer.numBytes);
+    // Send straight from the bpacket instead of copying it into a bpacket_buffer_t first
+    bpacket_frame_t frame;
+    bpacket_to_frame(bpacket, &frame, FALSE);
+    bpacket_transmit_frame(esp32_uart_send_data, &frame);
 
     // bpacket_t res;
     // char msg[20];
@@ -68,6 +105,204 @@ void esp32_uart_send_string(char* string) {
     }
 }
 
-int esp32_uart_read_bpacket(uint8_t bpacketBuffer[BPACKET_BUFFER_LENGTH_BYTES]) {
-    return uart_read_bytes(UART_NUM, bpacketBuffer, BPACKET_BUFFER_LENGTH_BYTES, 50 / portTICK_RATE_MS);
-}
\ No newline at end of file
+uint8_t esp32_uart_read_bpacket_timeout(bpacket_t* bpacket, uint32_t timeoutMs) {
+
+    rxBpacketReceived = FALSE;
+
+    while (rxBpacketReceived != TRUE) {
+
+        if (rxIndex == rxNumBytes) {
+
+            // Take everything that has arrived. If nothing has, wait for at least one byte
+            size_t numBufferedBytes = 0;
+            uart_get_buffered_data_len(UART_NUM, &numBufferedBytes);
+
+            if (numBufferedBytes == 0) {
+                numBufferedBytes = 1;
+            }
+
+            if (numBufferedBytes > RX_NUM_BYTES) {
+                numBufferedBytes = RX_NUM_BYTES;
+            }
+
+            int numBytes = uart_read_bytes(UART_NUM, rxBytes, numBufferedBytes, timeoutMs / portTICK_RATE_MS);
+
+            if (numBytes <= 0) {
+                return FALSE;
+            }
+
+            rxIndex    = 0;
+            rxNumBytes = numBytes;
+        }
+
+        rxIndex += bpacket_parser_parse(&parser, &rxBytes[rxIndex], rxNumBytes - rxIndex);
+    }
+
+    *bpacket = rxBpacket;
+
+    return TRUE;
+}
+
+uint8_t esp32_uart_read_bpacket(bpacket_t* bpacket) {
+    return esp32_uart_read_bpacket_timeout(bpacket, READ_TIMEOUT_MS);
+}
+
+void esp32_uart_send_checked_bpacket(bpacket_t* bpacket) {
+
+    bpacket_frame_t frame;
+    bpacket_to_frame(bpacket, &frame, TRUE);
+    bpacket_transmit_frame(esp32_uart_send_data, &frame);
+}
+
+uint8_t esp32_uart_get_nack(bpacket_t* bpacket) {
+
+    for (int i = 0; i < (NACK_TIMEOUT_MS / READ_TIMEOUT_MS); i++) {
+
+        if ((esp32_uart_read_bpacket(bpacket) != TRUE) || (bpacket->request != BPACKET_GEN_R_NACK)) {
+            continue;
+        }
+
+        // A NACK without any sequence numbers means everything was received
+        return (bpacket->numBytes >= 2) ? TRUE : FALSE;
+    }
+
+    return FALSE;
+}
+
+uint8_t esp32_uart_get_ack(uint16_t* numBpacketsReceived) {
+
+    bpacket_t bpacket;
+    uint8_t ackReceived = FALSE;
+    uint32_t timeoutMs  = ACK_TIMEOUT_MS;
+
+    // Several ACKs can arrive at once. Once one has been received, take whatever else has
+    // already arrived because only the latest one matters
+    while (esp32_uart_read_bpacket_timeout(&bpacket, timeoutMs) == TRUE) {
+
+        if ((bpacket.request != BPACKET_GEN_R_ACK) || (bpacket.numBytes != 2)) {
+            continue;
+        }
+
+        *numBpacketsReceived = (bpacket.bytes[0] << 8) | bpacket.bytes[1];
+        ackReceived          = TRUE;
+        timeoutMs            = 0;
+    }
+
+    return ackReceived;
+}
+
+uint8_t esp32_uart_send_transfer(uint8_t receiver, uint8_t sender, uint8_t request, uint8_t* data,
+                                 uint32_t numBytes) {
+
+    if (bpacket_send_data(esp32_uart_send_data, receiver, sender, request, data, numBytes) != TRUE) {
+        return FALSE;
+    }
+
+    // Windowed transfers only finish once every bpacket has been ACKed
+    if ((bpacket_crc_enabled() != TRUE) || (bpacket_get_window_size() != 0)) {
+        return TRUE;
+    }
+
+    // Resend any bpackets that were corrupted before the data is released
+    bpacket_t nack;
+    while (esp32_uart_get_nack(&nack) == TRUE) {
+        for (int i = 0; (i + 1) < nack.numBytes; i += 2) {
+            bpacket_resend_data(esp32_uart_send_data, receiver, sender, request, data, numBytes,
+                                (nack.bytes[i] << 8) | nack.bytes[i + 1]);
+        }
+    }
+
+    return TRUE;
+}
+
+uint8_t esp32_uart_set_baud_rate(bpacket_t* bpacket) {
+
+    uint8_t request  = bpacket->request;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
+
+    uint32_t previousBaudRate;
+    uart_get_baudrate(UART_NUM, &previousBaudRate);
+
+    uint32_t baudRate = 0;
+    if (bpacket->numBytes >= 4) {
+        baudRate = (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) | bpacket->bytes[3];
+    }
+
+    uint8_t baudRateData[4] = {bpacket->bytes[0], bpacket->bytes[1], bpacket->bytes[2], bpacket->bytes[3]};
+
+    if ((baudRate < MIN_BAUD_RATE) || (baudRate > MAX_BAUD_RATE)) {
+        bpacket_create_p(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, 0, NULL);
+        esp32_uart_send_bpacket(bpacket);
+        return FALSE;
+    }
+
+    // Reply at the current baud rate and make sure it has gone out before changing
+    bpacket_create_p(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, 4, baudRateData);
+    esp32_uart_send_bpacket(bpacket);
+    uart_wait_tx_done(UART_NUM, READ_TIMEOUT_MS / portTICK_RATE_MS);
+
+    uart_set_baudrate(UART_NUM, baudRate);
+
+    // Anything received before the change was received at the old baud rate
+    uart_flush_input(UART_NUM);
+    rxIndex = rxNumBytes;
+    bpacket_parser_reset(&parser);
+
+    // The link is only kept at the new baud rate once a ping has made it across
+    uint8_t ping = WATCHDOG_PING_CODE_ESP32;
+    for (int i = 0; i < (BPACKET_BAUD_CONFIRM_TIMEOUT_MS / READ_TIMEOUT_MS); i++) {
+
+        if ((esp32_uart_read_bpacket(bpacket) != TRUE) || (bpacket->request != BPACKET_GEN_R_PING) ||
+            (bpacket->crcStatus == BPACKET_CRC_FAILED)) {
+            continue;
+        }
+
+        bpacket_create_p(bpacket, bpacket->sender, bpacket->receiver, BPACKET_GEN_R_PING, BPACKET_CODE_SUCCESS, 1,
+                         &ping);
+        esp32_uart_send_bpacket(bpacket);
+        return TRUE;
+    }
+
+    uart_set_baudrate(UART_NUM, previousBaudRate);
+    bpacket_parser_reset(&parser);
+
+    return FALSE;
+}
+
+void esp32_uart_send_benchmark(bpacket_t* bpacket) {
+
+    uint8_t request  = bpacket->request;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
+
+    uint32_t numBytes = 0;
+    if (bpacket->numBytes >= 4) {
+        numBytes = (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) | bpacket->bytes[3];
+    }
+
+    if (numBytes > WATCHDOG_BENCHMARK_MAX_NUM_BYTES) {
+        numBytes = WATCHDOG_BENCHMARK_MAX_NUM_BYTES;
+    }
+
+    uint8_t* data = malloc(numBytes);
+
+    if ((numBytes == 0) || (data == NULL)) {
+        free(data);
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Invalid benchmark size\r\n\0");
+        esp32_uart_send_bpacket(bpacket);
+        return;
+    }
+
+    // A counting pattern so a receiver can check the data if it wants to
+    for (uint32_t i = 0; i < numBytes; i++) {
+        data[i] = i & 0xFF;
+    }
+
+    if (esp32_uart_send_transfer(sender, receiver, request, data, numBytes) != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to send benchmark\r\n\0");
+        esp32_uart_send_bpacket(bpacket);
+    }
+
+    free(data);
+}
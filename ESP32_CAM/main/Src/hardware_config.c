@@ -7,6 +7,7 @@
 #include "sd_card.h"
 #include "camera.h"
 #include "uart_comms.h"
+#include "esp32_uart.h"
 #include "utilities.h"
 
 /* Private Function Definitions */
@@ -52,7 +53,7 @@ void hardware_config_uart_comms(void) {
 
     // Configure UART for communications
     const uart_config_t uart_config = {
-        .baud_rate  = 115200,
+        .baud_rate  = HC_UART_COMMS_BAUD_RATE,
         .data_bits  = UART_DATA_8_BITS,
         .parity     = UART_PARITY_DISABLE,
         .stop_bits  = UART_STOP_BITS_1,
@@ -65,5 +66,7 @@ void hardware_config_uart_comms(void) {
     uart_set_pin(HC_UART_COMMS_UART_NUM, HC_UART_COMMS_TX_PIN, HC_UART_COMMS_RX_PIN, UART_PIN_NO_CHANGE,
                  UART_PIN_NO_CHANGE);
 
+    esp32_uart_init();
+
     // TODO: Come up with way to check if UART was configured correctly!
 }
\ No newline at end of file
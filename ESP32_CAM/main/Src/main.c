@@ -42,9 +42,22 @@ uint8_t esp3_match_stm32_request(bpacket_t* bpacket) {
             camera_capture_and_save_image(bpacket);
             break;
 
+        case WATCHDOG_BPK_R_TAKE_BURST:
+            camera_capture_burst(bpacket);
+            break;
+
         case WATCHDOG_BPK_R_RECORD_DATA:
             break;
 
+        case WATCHDOG_BPK_R_TURN_OFF:
+            // The STM32 cuts the power once this is answered so nothing can be left in RAM
+            sd_card_log(SYSTEM_LOG_FILE, "Powering down");
+            sd_card_unmount();
+            bpacket_create_p(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_SUCCESS, 0,
+                             NULL);
+            esp32_uart_send_bpacket(bpacket);
+            break;
+
         default:
             return FALSE;
     }
@@ -61,8 +74,7 @@ uint8_t esp3_match_maple_request(bpacket_t* bpacket) {
     switch (bpacket->request) {
 
         case WATCHDOG_BPK_R_LIST_DIR:
-            bpacket_data_to_string(bpacket, &bpacketCharArray);
-            sd_card_list_directory(bpacket, &bpacketCharArray);
+            sd_card_list_directory(bpacket);
             break;
 
         case WATCHDOG_BPK_R_COPY_FILE:;
@@ -70,10 +82,22 @@ uint8_t esp3_match_maple_request(bpacket_t* bpacket) {
             sd_card_copy_file(bpacket, &bpacketCharArray);
             break;
 
+        case WATCHDOG_BPK_R_GET_IMAGE_INDEX:
+            sd_card_send_image_index(bpacket);
+            break;
+
         case WATCHDOG_BPK_R_STREAM_IMAGE:
             camera_stream_image(bpacket);
             break;
 
+        case WATCHDOG_BPK_R_STOP_STREAM:
+            camera_stop_stream(bpacket);
+            break;
+
+        case WATCHDOG_BPK_R_BENCHMARK:
+            esp32_uart_send_benchmark(bpacket);
+            break;
+
         case WATCHDOG_BPK_R_SET_CAMERA_SETTINGS:;
 
             bpacket_t b1;
@@ -148,23 +172,32 @@ void watchdog_system_start(void) {
 
     uint8_t ping = WATCHDOG_PING_CODE_ESP32;
 
-    uint8_t bdata[BPACKET_BUFFER_LENGTH_BYTES];
     bpacket_t bpacket;
 
+    // Windowed transfers wait on ACKs read from the UART
+    bpacket_set_ack_receiver(esp32_uart_get_ack);
+
     while (1) {
 
-        // Delay for second
-        vTaskDelay(200 / portTICK_PERIOD_MS);
+        // Delay for second. Stream frames are asked for one after another so the delay
+        // is skipped while a stream session is running
+        if (camera_stream_active() != TRUE) {
+            vTaskDelay(200 / portTICK_PERIOD_MS);
+        }
+
+        // Write out log lines that have been waiting too long, then keep the SD card
+        // mounted between requests that arrive close together
+        camera_stream_update();
+        sd_card_log_update();
+        sd_card_unmount_if_idle();
 
         // Read UART and wait for command.
-        if (esp32_uart_read_bpacket(bdata) == 0) {
+        if (esp32_uart_read_bpacket(&bpacket) != TRUE) {
             continue;
         }
 
-        uint8_t result = bpacket_buffer_decode(&bpacket, bdata);
-
-        if (result != TRUE) {
-            esp32_uart_send_bpacket(&bpacket);
+        // Corrupted checked bpackets are dropped. The sender will send them again
+        if (bpacket.crcStatus == BPACKET_CRC_FAILED) {
             continue;
         }
 
@@ -189,6 +222,24 @@ void watchdog_system_start(void) {
                 esp32_uart_send_bpacket(&bpacket);
                 break;
 
+            case BPACKET_GEN_R_EXT_FRAMING:;
+                // Reply with the number of data bytes per bpacket, the flags and the window that were agreed on
+                uint16_t maxNumDataBytes = bpacket_negotiate_ext_framing(&bpacket);
+                uint8_t extFlags         = (bpacket_crc_enabled() == TRUE) ? BPACKET_EXT_FLAG_CRC : 0;
+                uint8_t maxNumBytes[4]   = {(maxNumDataBytes >> 8) & 0xFF, maxNumDataBytes & 0xFF, extFlags,
+                                          bpacket_get_window_size()};
+                bpacket_create_p(&bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, 4, maxNumBytes);
+                esp32_uart_send_bpacket(&bpacket);
+                break;
+
+            case BPACKET_GEN_R_SET_BAUD:
+                esp32_uart_set_baud_rate(&bpacket);
+                break;
+
+            case BPACKET_GEN_R_NACK:
+                // NACKs that arrive after a transfer has finished are ignored
+                break;
+
             case WATCHDOG_BPK_R_LED_RED_ON:
                 led_on(RED_LED);
                 bpacket_create_p(&bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, 0, NULL);
@@ -284,6 +335,9 @@ void app_main(void) {
         sd_card_close();
     }
 
+    // Nothing else uses the SD card so make sure it is unmounted before the power is cut
+    sd_card_unmount();
+
     while (1) {
         // esp32_uart_send_packet(&status);
         // esp32_uart_send_data("\r\n");
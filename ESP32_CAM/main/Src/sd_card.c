@@ -15,10 +15,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "driver/uart.h"
+#include "esp_timer.h"
+#include "ff.h"
+#include "diskio_sdmmc.h"
 
 /* Personal Includes */
 #include "rtc.h"
 #include "sd_card.h"
+#include "sd_card_block.h"
+#include "sd_card_layout.h"
 #include "chars.h"
 #include "hardware_config.h"
 #include "esp32_uart.h"
@@ -41,8 +46,31 @@
 
 #define MAX_PATH_LENGTH 280
 
+// Log lines are kept in RAM and appended to the log file together
+#define LOG_BUFFER_SIZE      4096
+#define LOG_FLUSH_NUM_BYTES  3072 // Flush once this many bytes are waiting
+#define LOG_FLUSH_TIMEOUT_MS 5000 // Flush once the oldest line has waited this long
+
+// The settings are saved as one record with a CRC so a half written file is never used
+#define SETTINGS_RECORD_NUM_BYTES   12
+#define SETTINGS_RECORD_MAGIC_UPPER 'W'
+#define SETTINGS_RECORD_MAGIC_LOWER 'S'
+#define SETTINGS_RECORD_VERSION     1
+#define SETTINGS_LEGACY_NUM_BYTES   7 // Settings files from before the record. Every value with no header
+
+// What sd_card_settings_read_file() found in a settings file
+#define SETTINGS_FILE_INVALID 0
+#define SETTINGS_FILE_RECORD  1
+#define SETTINGS_FILE_LEGACY  2
+
 static const char* SD_CARD_TAG = "SD CARD:";
 
+typedef struct sd_card_index_rebuild_t {
+    FILE* index;
+    uint8_t latest[WD_IMAGE_RECORD_NUM_BYTES]; // Record of the image with the highest number found so far
+    uint8_t foundImage;
+} sd_card_index_rebuild_t;
+
 wd_camera_settings_t deafultCameraSettings = {
     .resolution = WD_CAM_RES_800x600,
 };
@@ -61,14 +89,33 @@ wd_camera_capture_time_settings_t defaultCaptureTimeSettings = {
 
 /* Private Variables */
 int mounted          = FALSE;
-uint16_t imageNumber = 0;
+uint32_t imageNumber = 0;
+
+// The date folder the last image was saved to. Saves checking the folder exists for every image
+char imageFolder[16];
+uint8_t imageFolderExists = FALSE;
+
+// The card stays mounted while any function has it open and for a while after the
+// last one closes it so a burst of requests only mounts the card once
+uint8_t sessionRefCount   = 0;
+int64_t sessionReleasedUs = 0;
+sd_card_mount_stats_t mountStats;
+
+char logBuffer[LOG_BUFFER_SIZE];
+uint16_t logNumBytes    = 0;
+int64_t logFirstLineUs  = 0;
+uint8_t logFolderExists = FALSE; // Saves checking the log folder on every flush
+
+// The settings are read from the SD card once and answered from RAM after that
+wd_settings_t settingsCache;
+uint8_t settingsLoaded = FALSE;
 
 // Options for mounting the SD Card are given in the following
 // configuration
 static esp_vfs_fat_sdmmc_mount_config_t sdCardConfiguration = {
     .format_if_mount_failed = false,
     .max_files              = 5,
-    .allocation_unit_size   = 16 * 1024,
+    .allocation_unit_size   = SD_CARD_BLOCK_SIZE,
 };
 
 sdmmc_card_t* card;
@@ -76,6 +123,19 @@ sdmmc_card_t* card;
 /* Private Function Declarations */
 uint8_t sd_card_check_file_path_exists(char* filePath);
 uint8_t sd_card_check_directory_exists(char* directory);
+uint8_t sd_card_log_write_buffer(void);
+uint8_t sd_card_index_append(wd_image_record_t* record);
+uint8_t sd_card_index_rebuild(void);
+uint8_t sd_card_index_add_image(char* filePath, char* imagePath, void* arg);
+uint8_t sd_card_index_update_paths(void);
+uint8_t sd_card_update_image_layout(void);
+uint8_t sd_card_settings_check_loaded(void);
+void sd_card_send_file_chunk(uint8_t receiver, uint8_t sender, uint8_t request, uint8_t* data, uint16_t numBytes,
+                             uint8_t lastChunk, uint8_t checked, uint16_t sequence);
+void sd_card_settings_to_bytes(wd_settings_t* settings, uint8_t bytes[SETTINGS_RECORD_NUM_BYTES]);
+uint8_t sd_card_settings_read_file(char* filePath, wd_settings_t* settings);
+uint8_t sd_card_settings_save(wd_settings_t* settings);
+uint8_t sd_card_settings_load(void);
 
 /* GOOD FUNCTIONS */
 
@@ -142,6 +202,7 @@ uint8_t sd_card_create_path(char* folderPath, bpacket_t* bpacket) {
     // Validate the path length
     if (chars_get_num_bytes(folderPath) > MAX_PATH_LENGTH) {
         bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Folder path > 50 characters\n");
+        sd_card_close();
         return FALSE;
     }
 
@@ -173,15 +234,18 @@ uint8_t sd_card_create_path(char* folderPath, bpacket_t* bpacket) {
                 if (file == NULL) {
                     bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
                                       "File could not be made\n");
+                    sd_card_close();
                     return FALSE;
                 }
 
+                fclose(file);
                 break;
             }
 
             // Error if the directory does not exist and a new one could not be made
             if (stat(directory, &st) != 0 && mkdir(directory, 0700) != 0) {
                 bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Dir could not be made\n");
+                sd_card_close();
                 return FALSE;
             }
 
@@ -198,104 +262,125 @@ uint8_t sd_card_create_path(char* folderPath, bpacket_t* bpacket) {
     //     esp32_uart_send_bpacket(&b1);
     // }
 
+    sd_card_close();
     return TRUE;
 }
 
-uint8_t sd_card_list_directory(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray) {
+uint8_t sd_card_list_directory(bpacket_t* bpacket) {
 
     // Save address
     uint8_t request  = bpacket->request;
     uint8_t receiver = bpacket->receiver;
     uint8_t sender   = bpacket->sender;
 
-    char* folderPath = bpacketCharArray->string;
-
-    // Try open the SD card
-    if (sd_card_open() != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card could not open\0");
+    wd_list_dir_request_t listDir;
+    uint8_t result = wd_bpacket_to_list_dir_request(bpacket, &listDir);
+    if (result != TRUE) {
+        char errMsg[50];
+        wd_get_error(result, errMsg);
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
         esp32_uart_send_bpacket(bpacket);
         return FALSE;
     }
 
-    // Validate the path length
-    if (chars_get_num_bytes(folderPath) > MAX_PATH_LENGTH) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Folder path > 50 chars\0");
+    // Try open the SD card
+    if (sd_card_open() != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card could not open\0");
         esp32_uart_send_bpacket(bpacket);
         return FALSE;
     }
 
-    // Append the mounting point of the SD card to the folder path
-    char path[MAX_PATH_LENGTH + 9];
-    sprintf(path, "%s%s%s", MOUNT_POINT_PATH, folderPath[0] == '\0' ? "" : "/", folderPath);
+    // The folder is read through FatFs rather than readdir() so the size and modified time
+    // of each entry come with its name instead of needing a stat() per entry
+    char path[WD_LIST_DIR_PATH_SIZE + 8];
+    sprintf(path, "%i:/%s", ff_diskio_get_pdrv_card(card), listDir.path);
 
-    DIR* directory;
-    directory = opendir(path);
-    if (directory == NULL) {
+    FF_DIR directory;
+    if (f_opendir(&directory, path) != FR_OK) {
         bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Filepath could not open\0");
         esp32_uart_send_bpacket(bpacket);
+        sd_card_close();
         return FALSE;
     }
 
-    // Calculate number of characters in all folder names combined
-    uint16_t numChars = 0;
-    struct dirent* dirPtr;
-    while ((dirPtr = readdir(directory)) != NULL) {
-        numChars += strlen(dirPtr->d_name) + 2; // Adding 2 chars for \r\n
+    // Dates are compared as yyyymmdd
+    uint32_t from = (listDir.from.year * 10000) + (listDir.from.month * 100) + listDir.from.day;
+    uint32_t to   = (listDir.to.year * 10000) + (listDir.to.month * 100) + listDir.to.day;
+
+    // The entries are packed into pages as large as the framing allows, which can be more
+    // than a bpacket_t on the ESP32 holds, and sent as frames that point into the page
+    static uint8_t page[BPACKET_EXT_MAX_NUM_DATA_BYTES];
+    uint16_t maxNumDataBytes = bpacket_get_max_num_data_bytes();
+    if (maxNumDataBytes > sizeof(page)) {
+        maxNumDataBytes = sizeof(page);
     }
 
-    // Go back to the start of the directory
-    rewinddir(directory);
+    uint32_t numSkipped = 0;
+    uint32_t numSent    = 0;
+    uint8_t moreEntries = FALSE;
+    uint16_t i          = 0;
+    FILINFO info;
+    wd_dir_entry_t entry;
+    bpacket_frame_t frame;
 
-    int i             = 0;
-    bpacket->receiver = sender;
-    bpacket->sender   = receiver;
-    bpacket->request  = request;
-    bpacket->code     = BPACKET_CODE_IN_PROGRESS;
-    bpacket->numBytes = BPACKET_MAX_NUM_DATA_BYTES;
-    int in            = FALSE; // Variable just to know whether there was anything or not
-    while ((dirPtr = readdir(directory)) != NULL) {
-        in = 1;
-        // Copy the name of the folder into the folder structure string
-        int k = 0;
-        while (dirPtr->d_name[k] != '\0') {
-            bpacket->bytes[i++] = dirPtr->d_name[k];
-
-            if (i == BPACKET_MAX_NUM_DATA_BYTES) {
-                esp32_uart_send_bpacket(bpacket);
-                i = 0;
-            }
+    while ((f_readdir(&directory, &info) == FR_OK) && (info.fname[0] != '\0')) {
+
+        if ((listDir.pattern[0] != '\0') && (chars_matches_pattern(info.fname, listDir.pattern) != TRUE)) {
+            continue;
+        }
 
-            k++;
+        // FAT packs the date as years since 1980, month and day and the time in 2 second steps
+        entry.modified.date.year   = 1980 + (info.fdate >> 9);
+        entry.modified.date.month  = (info.fdate >> 5) & 0x0F;
+        entry.modified.date.day    = info.fdate & 0x1F;
+        entry.modified.time.hour   = info.ftime >> 11;
+        entry.modified.time.minute = (info.ftime >> 5) & 0x3F;
+        entry.modified.time.second = (info.ftime & 0x1F) * 2;
+
+        uint32_t date =
+            (entry.modified.date.year * 10000) + (entry.modified.date.month * 100) + entry.modified.date.day;
+        if (((listDir.from.year != 0) && (date < from)) || ((listDir.to.year != 0) && (date > to))) {
+            continue;
         }
 
-        bpacket->bytes[i++] = '\r';
+        if (numSkipped < listDir.offset) {
+            numSkipped++;
+            continue;
+        }
 
-        if (i == BPACKET_MAX_NUM_DATA_BYTES) {
-            esp32_uart_send_bpacket(bpacket);
-            i = 0;
+        // The folder is only read as far as the first entry after the page
+        if ((listDir.limit != 0) && (numSent == listDir.limit)) {
+            moreEntries = TRUE;
+            break;
         }
 
-        bpacket->bytes[i++] = '\n';
+        entry.type     = ((info.fattrib & AM_DIR) != 0) ? WD_DIR_ENTRY_TYPE_FOLDER : WD_DIR_ENTRY_TYPE_FILE;
+        entry.numBytes = info.fsize;
+        snprintf(entry.name, WD_DIR_ENTRY_NAME_SIZE, "%s", info.fname);
 
-        if (i == BPACKET_MAX_NUM_DATA_BYTES) {
-            esp32_uart_send_bpacket(bpacket);
+        // Send the entries so far if this one does not fit in the page
+        if ((i + WD_DIR_ENTRY_HEADER_NUM_BYTES + strlen(entry.name) + 1) > maxNumDataBytes) {
+            bpacket_encode_frame(&frame, sender, receiver, request, BPACKET_CODE_IN_PROGRESS, page, i, FALSE, 0);
+            bpacket_transmit_frame(esp32_uart_send_data, &frame);
             i = 0;
         }
-    }
 
-    if (i != 0) {
-        bpacket->code     = BPACKET_CODE_SUCCESS;
-        bpacket->numBytes = i;
-        esp32_uart_send_bpacket(bpacket);
+        i += wd_dir_entry_to_bytes(&entry, &page[i]);
+        numSent++;
     }
 
-    if (in == FALSE) {
-        bpacket_create_p(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, 0, NULL);
-        esp32_uart_send_bpacket(bpacket);
+    f_closedir(&directory);
+    sd_card_close();
+
+    if (i != 0) {
+        bpacket_encode_frame(&frame, sender, receiver, request, BPACKET_CODE_IN_PROGRESS, page, i, FALSE, 0);
+        bpacket_transmit_frame(esp32_uart_send_data, &frame);
     }
 
-    closedir(directory);
-    sd_card_close();
+    uint8_t summary[WD_LIST_DIR_SUMMARY_NUM_BYTES] = {(numSent >> 24) & 0xFF, (numSent >> 16) & 0xFF,
+                                                      (numSent >> 8) & 0xFF, numSent & 0xFF, moreEntries};
+    bpacket_create_p(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, WD_LIST_DIR_SUMMARY_NUM_BYTES, summary);
+    esp32_uart_send_bpacket(bpacket);
 
     return TRUE;
 }
@@ -316,6 +401,7 @@ uint8_t sd_card_write_to_file(char* filePath, char* string, bpacket_t* bpacket)
     // Validate the path length
     if (chars_get_num_bytes(filePath) > MAX_PATH_LENGTH) {
         bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Filepath > 50 characters\0");
+        sd_card_close();
         return FALSE;
     }
 
@@ -324,6 +410,7 @@ uint8_t sd_card_write_to_file(char* filePath, char* string, bpacket_t* bpacket)
     sprintf(directory, "%s/%s", MOUNT_POINT_PATH, filePath);
 
     if (sd_card_create_path(directory, bpacket) != TRUE) {
+        sd_card_close();
         return FALSE;
     }
 
@@ -332,17 +419,19 @@ uint8_t sd_card_write_to_file(char* filePath, char* string, bpacket_t* bpacket)
 
     if (file == NULL) {
         bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Filepath could not open\0");
+        sd_card_close();
         return FALSE;
     }
 
     fprintf(file, string);
     fclose(file);
+    sd_card_close();
 
     bpacket_create_p(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, 0, NULL);
     return TRUE;
 }
 
-uint8_t sd_card_search_num_images(uint16_t* numImages, bpacket_t* bpacket) {
+uint8_t sd_card_search_num_images(uint32_t* numImages, bpacket_t* bpacket) {
 
     // Save the address
     uint8_t request  = bpacket->request;
@@ -354,29 +443,18 @@ uint8_t sd_card_search_num_images(uint16_t* numImages, bpacket_t* bpacket) {
         return FALSE;
     }
 
-    // Confirm the directory for the images exists
-    if (sd_card_create_path(IMAGE_DATA_FOLDER, bpacket) != TRUE) {
+    // Every saved image has a record in the index so the date folders do not have to be searched
+    uint32_t numBytes;
+    char errMsg[50];
+    if (sd_card_get_file_size(IMAGE_INDEX_FILE_PATH_START_AT_ROOT, &numBytes, errMsg) != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Img index could not open\0");
+        sd_card_close();
         return FALSE;
     }
 
-    // Open the directory where the images are stored
-    DIR* directory;
-    directory = opendir(ROOT_IMAGE_DATA_FOLDER);
-    if (directory == NULL) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Img dir could not open\0");
-        return FALSE;
-    }
+    *numImages = numBytes / WD_IMAGE_RECORD_NUM_BYTES;
 
-    // Loop through each file and calculate the number of images
-    struct dirent* dirPtr;
-    *numImages = 0;
-    while ((dirPtr = readdir(directory)) != NULL) {
-        // Checking both img and IMG just incase as SD card is weird when it comes allowing/not allowing
-        // lower case letters
-        if (chars_contains(dirPtr->d_name, "img") == TRUE || chars_contains(dirPtr->d_name, "IMG") == TRUE) {
-            *numImages += 1;
-        }
-    }
+    sd_card_close();
 
     return TRUE;
 }
@@ -415,6 +493,9 @@ uint8_t sd_card_save_image(uint8_t* imageData, int imageLength, bpacket_t* bpack
         return FALSE;
     }
 
+    // The ESP32 has no clock of its own so keep it in step with the RTC on the STM32
+    rtc_set_date_time(&datetime);
+
     // Try open the SD card
     if (sd_card_open() != TRUE) {
         bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Could not open the SD card\0");
@@ -422,571 +503,884 @@ uint8_t sd_card_save_image(uint8_t* imageData, int imageLength, bpacket_t* bpack
         return FALSE;
     }
 
-    // Create the data folder path if required
-    if (sd_card_create_path(IMAGE_DATA_FOLDER, bpacket) != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
-                          "Could not create path to data folder\0");
-        esp32_uart_send_bpacket(bpacket);
-        return FALSE;
-    }
+    // Create the date folder for the image if required. It only changes when the day does
+    char folder[sizeof(imageFolder)];
+    sd_card_layout_get_folder(folder, &datetime, SD_CARD_LAYOUT);
+
+    if ((imageFolderExists != TRUE) || (chars_same(folder, imageFolder) != TRUE)) {
+
+        char folderPath[sizeof(imageFolder) + 16];
+        sprintf(folderPath, "%s%s%s", IMAGE_DATA_FOLDER, (folder[0] == '\0') ? "" : "/", folder);
+
+        if (sd_card_create_path(folderPath, bpacket) != TRUE) {
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
+                              "Could not create path to data folder\0");
+            esp32_uart_send_bpacket(bpacket);
+            sd_card_close();
+            return FALSE;
+        }
 
-    // Create formatted image number in the format of xxx
-    char imgNumString[8];
-    sprintf(imgNumString, "%s%s%i", (imageNumber < 100) ? "0" : "", (imageNumber < 10) ? "0" : "", imageNumber);
+        sprintf(imageFolder, "%s", folder);
+        imageFolderExists = TRUE;
+    }
 
-    // Create formatted date time in the format yymmdd_hhmm
-    char datetimeString[40];
-    sprintf(datetimeString, "%i%s%i%s%i_%s%i%s%i", datetime.date.year - 2000, datetime.date.month < 10 ? "0" : "",
-            datetime.date.month, datetime.date.day < 10 ? "0" : "", datetime.date.day,
-            datetime.time.hour < 10 ? "0" : "", datetime.time.hour, datetime.time.minute < 10 ? "0" : "",
-            datetime.time.minute);
+    // Create path for image in the format [date folder/]imgxxxxxx_yymmdd_hhmm.jpg
+    wd_image_record_t record;
+    sd_card_layout_get_image_path(record.fileName, imageNumber, &datetime, SD_CARD_LAYOUT);
 
-    // Create path for image
     char filePath[80];
-    sprintf(filePath, "%s/%s/img%s_%s.jpg", MOUNT_POINT_PATH, IMAGE_DATA_FOLDER, imgNumString, datetimeString);
+    sprintf(filePath, "%s/%s", ROOT_IMAGE_DATA_FOLDER, record.fileName);
 
     FILE* imageFile = fopen(filePath, "wb");
     if (imageFile == NULL) {
         bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Image file failed to open\0");
         esp32_uart_send_bpacket(bpacket);
+        sd_card_close();
         return FALSE;
     }
 
-    for (int i = 0; i < imageLength; i++) {
-        fputc(imageData[i], imageFile);
+    if (sd_card_block_write(imageFile, imageData, imageLength) != TRUE) {
+        fclose(imageFile);
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Image failed to write\0");
+        esp32_uart_send_bpacket(bpacket);
+        sd_card_close();
+        return FALSE;
     }
 
     fclose(imageFile);
 
-    imageNumber++;
-    return TRUE;
-}
-
-uint8_t sd_card_init(bpacket_t* bpacket) {
-
-    // Update the image number
-    if (sd_card_search_num_images(&imageNumber, bpacket) != TRUE) {
-        return FALSE;
+    // Add the image to the index after it has been saved so every record points to a whole image
+    record.imageNumber = imageNumber;
+    record.numBytes    = imageLength;
+    record.datetime    = datetime;
+    record.temp1       = temp1;
+    record.temp2       = temp2;
+    if (sd_card_index_append(&record) != TRUE) {
+        sd_card_log(SYSTEM_LOG_FILE, "Image could not be added to the index");
     }
 
+    sd_card_close();
+
+    imageNumber++;
     return TRUE;
 }
 
-void sd_card_copy_file(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray) {
+uint8_t sd_card_init(bpacket_t* bpacket) {
 
     // Save the address
+    uint8_t request  = bpacket->request;
     uint8_t receiver = bpacket->receiver;
     uint8_t sender   = bpacket->sender;
 
-    // Return error message if the SD card cannot be opened
     if (sd_card_open() != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR,
-                          "SD card failed to open\0");
-        esp32_uart_send_bpacket(bpacket);
-        return;
-    }
-
-    // Return an error if there was no specified file
-    if (bpacketCharArray->string[0] == '\0') {
-        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR,
-                          "No file was specified\0");
-        esp32_uart_send_bpacket(bpacket);
-        return;
-    }
-
-    // Max file length is 50
-    uint16_t filePathNameSize = chars_get_num_bytes(bpacketCharArray->string);
-
-    if (filePathNameSize > (57)) { // including mount point which is current 7 bytes
-        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR, "File path > 50\0");
-        esp32_uart_send_bpacket(bpacket);
-        return;
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card could not open\0");
+        return FALSE;
     }
 
-    char filePath[filePathNameSize + 1]; // add one for null pointer!
-    sprintf(filePath, "%s%s", MOUNT_POINT_PATH, bpacketCharArray->string);
-    int i = 0;
-    for (i = 0; i < filePathNameSize; i++) {
-        filePath[i + 8] = bpacketCharArray->string[i];
+    // Confirm the directory for the images exists
+    if (sd_card_create_path(IMAGE_DATA_FOLDER, bpacket) != TRUE) {
+        sd_card_close();
+        return FALSE;
     }
-    filePath[i + 8] = '\0'; // Add null terminator
 
-    // Get the length of the file
-    uint32_t fileNumBytes;
-    char errMsg[50];
-    if (sd_card_get_file_size(filePath, &fileNumBytes, errMsg) != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR, errMsg);
-        esp32_uart_send_bpacket(bpacket);
+    // Move the images already on the card if the layout has been changed
+    if (sd_card_update_image_layout() != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Image layout update failed\0");
         sd_card_close();
-        return;
+        return FALSE;
     }
 
-    FILE* file;
-    if (sd_card_open_file(&file, filePath, SD_CARD_FILE_READ, errMsg) != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR, errMsg);
-        esp32_uart_send_bpacket(bpacket);
+    // The next image number comes from the last record in the image index so the
+    // data folder only has to be scanned if the index is missing
+    FILE* index = fopen(IMAGE_INDEX_FILE_PATH_START_AT_ROOT, "r+b");
+    if (index == NULL) {
+        uint8_t result = sd_card_index_rebuild();
         sd_card_close();
-        return;
+
+        if (result != TRUE) {
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Image index rebuild failed\0");
+        }
+
+        return result;
     }
 
-    // Change the values of the bpacket so they get sent to Maple
-    bpacket->sender   = receiver;
-    bpacket->receiver = sender;
-    bpacket->code     = BPACKET_CODE_IN_PROGRESS;
-    bpacket->numBytes = BPACKET_MAX_NUM_DATA_BYTES;
-    int pi            = 0;
+    fseek(index, 0L, SEEK_END);
+    uint32_t numRecords = ftell(index) / WD_IMAGE_RECORD_NUM_BYTES;
 
-    for (uint32_t i = 0; i < fileNumBytes; i++) {
+    // Drop a record that was only partly written when the power was cut
+    if ((numRecords * WD_IMAGE_RECORD_NUM_BYTES) != ftell(index)) {
+        fflush(index);
+        ftruncate(fileno(index), numRecords * WD_IMAGE_RECORD_NUM_BYTES);
+    }
 
-        bpacket->bytes[pi++] = fgetc(file);
+    imageNumber = 0;
+    if (numRecords > 0) {
+        uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES];
+        wd_image_record_t record;
 
-        if (pi < BPACKET_MAX_NUM_DATA_BYTES && (i + 1) != fileNumBytes) {
-            continue;
+        fseek(index, (numRecords - 1) * WD_IMAGE_RECORD_NUM_BYTES, SEEK_SET);
+        if (fread(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, index) == WD_IMAGE_RECORD_NUM_BYTES) {
+            wd_bytes_to_image_record(bytes, &record);
+            imageNumber = record.imageNumber + 1;
         }
+    }
 
-        if ((i + 1) == fileNumBytes) {
-            bpacket->code     = BPACKET_CODE_SUCCESS;
-            bpacket->numBytes = pi--;
-        }
+    fclose(index);
+    sd_card_close();
 
-        esp32_uart_send_bpacket(bpacket);
+    return TRUE;
+}
 
-        pi = 0;
+uint8_t sd_card_index_append(wd_image_record_t* record) {
+
+    FILE* index = fopen(IMAGE_INDEX_FILE_PATH_START_AT_ROOT, "ab");
+    if (index == NULL) {
+        return FALSE;
     }
 
-    fclose(file);
+    uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES];
+    wd_image_record_to_bytes(record, bytes);
 
-    // Close the SD card
-    sd_card_close();
-}
+    uint8_t result = (fwrite(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, index) == WD_IMAGE_RECORD_NUM_BYTES) ? TRUE : FALSE;
+    fclose(index);
 
-uint8_t sd_card_write_settings(bpacket_t* bpacket) {
+    return result;
+}
 
-    bpacket_t b1;
+uint8_t sd_card_index_rebuild(void) {
 
-    uint8_t sender   = bpacket->sender;
-    uint8_t receiver = bpacket->receiver;
-    uint8_t request  = bpacket->request;
+    sd_card_log(SYSTEM_LOG_FILE, "Rebuilding the image index");
 
-    // Return error message if the SD card cannot be opened
-    if (sd_card_open() != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card failed to open\r\n\0");
-        esp32_uart_send_bpacket(bpacket);
+    sd_card_index_rebuild_t rebuild;
+    rebuild.foundImage = FALSE;
+    rebuild.index      = fopen(IMAGE_INDEX_FILE_PATH_START_AT_ROOT, "wb");
+    if (rebuild.index == NULL) {
         return FALSE;
     }
 
-    FILE* file;
-    char errMsg[50];
-    if (sd_card_open_file(&file, SETTINGS_FILE_PATH_START_AT_ROOT, SD_CARD_FILE_WRITE, errMsg) != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
-        esp32_uart_send_bpacket(bpacket);
-        sd_card_close();
-        return FALSE;
+    imageNumber    = 0;
+    uint8_t result = sd_card_layout_for_each_image(ROOT_IMAGE_DATA_FOLDER, sd_card_index_add_image, &rebuild);
+
+    if (rebuild.foundImage == TRUE) {
+        fwrite(rebuild.latest, 1, WD_IMAGE_RECORD_NUM_BYTES, rebuild.index);
     }
 
-    switch (bpacket->request) {
+    fclose(rebuild.index);
 
-        case WATCHDOG_BPK_R_SET_CAMERA_SETTINGS:;
+    return result;
+}
 
-            wd_camera_settings_t cameraSettings;
-            if (wd_bpacket_to_camera_settings(bpacket, &cameraSettings) != TRUE) {
-                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
-                                  "Bpacket to camera settings failed. SD Card write attempt\r\n\0");
-                esp32_uart_send_bpacket(bpacket);
-                // Clean up
-                fclose(file);
-                sd_card_close();
-                return FALSE;
-            }
+uint8_t sd_card_index_add_image(char* filePath, char* imagePath, void* arg) {
 
-            fseek(file, 0L, SEEK_SET); // Ensure the file is pointing to first byte
-            fputc(cameraSettings.resolution, file);
+    sd_card_index_rebuild_t* rebuild = arg;
 
-            char h[40];
-            sprintf(h, "Camera settings set to %i\r\n", cameraSettings.resolution);
-            bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS, h);
-            esp32_uart_send_bpacket(&b1);
+    // Everything the index holds is in the name of the image except for its size and
+    // the temperatures, which are not known any more
+    wd_image_record_t record = {0};
+    char* fileName           = strrchr(filePath, '/') + 1;
+    sd_card_layout_parse_image_name(fileName, &record.imageNumber, &record.datetime);
+    snprintf(record.fileName, WD_IMAGE_RECORD_FILE_NAME_SIZE, "%s", imagePath);
 
-            break;
+    struct stat st;
+    record.numBytes = (stat(filePath, &st) == 0) ? st.st_size : 0;
 
-        case WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS:;
+    uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES];
+    wd_image_record_to_bytes(&record, bytes);
 
-            wd_camera_capture_time_settings_t captureTime;
-            if (wd_bpacket_to_capture_time_settings(bpacket, &captureTime) != TRUE) {
-                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
-                                  "Bpacket to capture time settings failed. SD Card write attempt\r\n\0");
-                // Clean up
-                fclose(file);
-                sd_card_close();
-                return FALSE;
-            }
+    // The folders are not searched in order. The record of the latest image is held back
+    // and written last so sd_card_init() finds it at the end of the index
+    if ((rebuild->foundImage == TRUE) && (record.imageNumber < imageNumber)) {
+        fwrite(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, rebuild->index);
+        return TRUE;
+    }
 
-            // Skip the first byte as this is where the camera resolution is stored
-            fseek(file, 1, SEEK_CUR);
-            fputc(captureTime.startTime.minute, file);
-            fputc(captureTime.startTime.hour, file);
-            fputc(captureTime.endTime.minute, file);
-            fputc(captureTime.endTime.hour, file);
-            fputc(captureTime.intervalTime.minute, file);
-            fputc(captureTime.intervalTime.hour, file);
+    if (rebuild->foundImage == TRUE) {
+        fwrite(rebuild->latest, 1, WD_IMAGE_RECORD_NUM_BYTES, rebuild->index);
+    }
 
-            break;
+    memcpy(rebuild->latest, bytes, WD_IMAGE_RECORD_NUM_BYTES);
+    rebuild->foundImage = TRUE;
+    imageNumber         = record.imageNumber + 1;
+
+    return TRUE;
+}
 
-        default:;
+uint8_t sd_card_index_update_paths(void) {
 
-            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "WF: Invalid request!\r\n\0");
-            esp32_uart_send_bpacket(bpacket);
-            return FALSE;
+    // sd_card_init() rebuilds the index if there is not one
+    FILE* index = fopen(IMAGE_INDEX_FILE_PATH_START_AT_ROOT, "r+b");
+    if (index == NULL) {
+        return TRUE;
     }
 
-    // Clean up
-    fclose(file);
-    sd_card_close();
+    // Images are moved to a path made from their number and the time they were taken so
+    // every record can be pointed at its image without searching for it
+    uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES];
+    wd_image_record_t record;
 
-    // Update bpacket to send as success response back
-    bpacket->numBytes = 0;
-    bpacket->receiver = sender;
-    bpacket->sender   = receiver;
-    bpacket->code     = BPACKET_CODE_SUCCESS;
+    for (uint32_t i = 0; fread(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, index) == WD_IMAGE_RECORD_NUM_BYTES; i++) {
+        wd_bytes_to_image_record(bytes, &record);
+        sd_card_layout_get_image_path(record.fileName, record.imageNumber, &record.datetime, SD_CARD_LAYOUT);
+        wd_image_record_to_bytes(&record, bytes);
 
-    bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                      "Leaving write settings\r\n\0");
-    esp32_uart_send_bpacket(&b1);
+        fseek(index, i * WD_IMAGE_RECORD_NUM_BYTES, SEEK_SET);
+        fwrite(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, index);
+        fseek(index, (i + 1) * WD_IMAGE_RECORD_NUM_BYTES, SEEK_SET);
+    }
+
+    fclose(index);
 
     return TRUE;
 }
 
-uint8_t sd_card_format_sd_card(bpacket_t* bpacket) {
+uint8_t sd_card_update_image_layout(void) {
 
-    char errMsg[50];
-    bpacket_t b1;
+    // The layout the images are in is saved on the card so the images are only
+    // searched for when the layout changes
+    uint8_t layout = 0xFF;
+    FILE* file     = fopen(IMAGE_LAYOUT_FILE_PATH_START_AT_ROOT, "rb");
+    if (file != NULL) {
+        fread(&layout, 1, 1, file);
+        fclose(file);
+    }
 
-    // Return error message if the SD card cannot be opened
-    if (sd_card_open() != TRUE) {
-        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                          "SD card failed to open\r\n\0");
-        return FALSE;
+    if (layout == SD_CARD_LAYOUT) {
+        return TRUE;
     }
 
-    /****** START CODE BLOCK ******/
-    // Description: Confirm all the correct folders on the SD card exist
+    uint32_t numMoved;
+    uint8_t result = sd_card_layout_move_images(ROOT_IMAGE_DATA_FOLDER, SD_CARD_LAYOUT, &numMoved);
+    sd_card_layout_remove_empty_folders(ROOT_IMAGE_DATA_FOLDER);
 
-    // Create watchdog folder if necessary
-    if (sd_card_create_path(WATCHDOG_FOLDER_PATH, bpacket) != TRUE) {
-        sd_card_close();
-        return FALSE;
-    }
+    char msg[60];
+    sprintf(msg, "Moved %lu images to layout %i", (unsigned long)numMoved, SD_CARD_LAYOUT);
+    sd_card_log(SYSTEM_LOG_FILE, msg);
 
-    // Create data folder if necessary
-    if (sd_card_create_path(DATA_FOLDER_PATH, bpacket) != TRUE) {
-        sd_card_close();
+    // The layout is not saved if an image could not be moved so it is tried again next boot
+    if (result != TRUE) {
         return FALSE;
     }
 
-    // Create logs folder if necessary
-    if (sd_card_create_path(LOG_FOLDER_PATH, bpacket) != TRUE) {
-        sd_card_close();
+    // The records keep the temperatures so their paths are updated rather than rebuilding the index
+    if ((numMoved > 0) && (sd_card_index_update_paths() != TRUE)) {
         return FALSE;
     }
 
-    // Create settings folder if necessary
-    if (sd_card_create_path(SETTINGS_FOLDER_PATH, bpacket) != TRUE) {
-        sd_card_close();
+    layout = SD_CARD_LAYOUT;
+    if ((file = fopen(IMAGE_LAYOUT_FILE_PATH_START_AT_ROOT, "wb")) == NULL) {
         return FALSE;
     }
 
-    /****** END CODE BLOCK ******/
-
-    /****** START CODE BLOCK ******/
-    // Description: Confirm the settings file exists and that it has valid data
+    fwrite(&layout, 1, 1, file);
+    fclose(file);
 
-    // Create the settings file if required
-    if (sd_card_create_file(SETTINGS_FILE_PATH_START_AT_ROOT, errMsg) != TRUE) {
-        bpacket_create_sp(&b1, bpacket->sender, bpacket->receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_ERROR, errMsg);
-        return FALSE;
-    }
+    return TRUE;
+}
 
-    uint32_t numBytes = 0;
+void sd_card_send_image_index(bpacket_t* bpacket) {
 
-    // Write default settings to settings file the file is empty
-    if (sd_card_get_file_size(SETTINGS_FILE_PATH_START_AT_ROOT, &numBytes, errMsg) != TRUE) {
-        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR, errMsg);
-        sd_card_close();
-        return FALSE;
+    // Maple can ask for the records from a given image onwards so it only fetches new ones
+    uint32_t firstRecord = 0;
+    if (bpacket->numBytes == 4) {
+        firstRecord = ((uint32_t)bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) |
+                      bpacket->bytes[3];
     }
 
-    if (numBytes == 0) {
+    if (sd_card_open() != TRUE) {
+        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
+                          "SD card failed to open\0");
+        esp32_uart_send_bpacket(bpacket);
+        return;
+    }
 
-        // Write the default camera settings to the SD card
-        bpacket_t cSettings;
-        if (wd_camera_settings_to_bpacket(&cSettings, bpacket->receiver, bpacket->sender,
-                                          WATCHDOG_BPK_R_SET_CAMERA_SETTINGS, BPACKET_CODE_EXECUTE,
-                                          &deafultCameraSettings) != TRUE) {
-            bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                              "Failed setting default camera settings\r\n\0");
-            sd_card_close();
-            return FALSE;
-        }
+    sd_card_send_file(bpacket, IMAGE_INDEX_FILE_PATH_START_AT_ROOT, firstRecord * WD_IMAGE_RECORD_NUM_BYTES);
+    sd_card_close();
+}
 
-        if (sd_card_write_settings(&cSettings) != TRUE) {
-            bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                              "Failed setting default camera settings\r\n\0");
-            sd_card_close();
-            return FALSE;
-        }
+void sd_card_copy_file(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray) {
 
-        // Write the default capture time settings to the SD card
-        bpacket_t ctSettings;
-        if (wd_capture_time_settings_to_bpacket(&ctSettings, bpacket->receiver, bpacket->sender,
-                                                WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS, BPACKET_CODE_EXECUTE,
-                                                &defaultCaptureTimeSettings) != TRUE) {
-            bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                              "Failed setting default capture time settings\r\n\0");
-            sd_card_close();
-            return FALSE;
+    // Save the address
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
+
+    // Return error message if the SD card cannot be opened
+    if (sd_card_open() != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR,
+                          "SD card failed to open\0");
+        esp32_uart_send_bpacket(bpacket);
+        return;
+    }
+
+    // Return an error if there was no specified file
+    if (bpacketCharArray->string[0] == '\0') {
+        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR,
+                          "No file was specified\0");
+        esp32_uart_send_bpacket(bpacket);
+        sd_card_close();
+        return;
+    }
+
+    // Max file length is 50
+    uint16_t filePathNameSize = chars_get_num_bytes(bpacketCharArray->string);
+
+    if (filePathNameSize > (57)) { // including mount point which is current 7 bytes
+        bpacket_create_sp(bpacket, sender, receiver, WATCHDOG_BPK_R_COPY_FILE, BPACKET_CODE_ERROR, "File path > 50\0");
+        esp32_uart_send_bpacket(bpacket);
+        sd_card_close();
+        return;
+    }
+
+    char filePath[sizeof(MOUNT_POINT_PATH) + filePathNameSize];
+    sprintf(filePath, "%s%s", MOUNT_POINT_PATH, bpacketCharArray->string);
+
+    // A copy that was cut short is carried on from the byte given after the path
+    uint32_t startByte = 0;
+    if (bpacket->numBytes >= (filePathNameSize + 1 + WD_COPY_FILE_START_NUM_BYTES)) {
+        uint8_t* start = &bpacket->bytes[filePathNameSize + 1];
+        startByte      = ((uint32_t)start[0] << 24) | (start[1] << 16) | (start[2] << 8) | start[3];
+    }
+
+    bpacket->request = WATCHDOG_BPK_R_COPY_FILE;
+    sd_card_send_file(bpacket, filePath, startByte);
+
+    // Close the SD card
+    sd_card_close();
+}
+
+void sd_card_send_file(bpacket_t* bpacket, char* filePath, uint32_t startByte) {
+
+    // Save the address
+    uint8_t request  = bpacket->request;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t sender   = bpacket->sender;
+
+    // Get the length of the file
+    uint32_t fileNumBytes;
+    char errMsg[50];
+    if (sd_card_get_file_size(filePath, &fileNumBytes, errMsg) != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
+        esp32_uart_send_bpacket(bpacket);
+        return;
+    }
+
+    FILE* file;
+    if (sd_card_open_file(&file, filePath, SD_CARD_FILE_READ, errMsg) != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
+        esp32_uart_send_bpacket(bpacket);
+        return;
+    }
+
+    // Only the bytes from the start byte onwards are sent
+    startByte = (startByte < fileNumBytes) ? startByte : fileNumBytes;
+    fileNumBytes -= startByte;
+    fseek(file, startByte, SEEK_SET);
+
+    // Checked bpackets are numbered with 16 bits so larger files can not be sent checked
+    uint32_t maxNumCheckedBytes = (uint32_t)BPACKET_MAX_NUM_CHUNKS * bpacket_get_max_num_data_bytes();
+    if ((bpacket_crc_enabled() == TRUE) && (fileNumBytes > maxNumCheckedBytes)) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "File too large to send checked\0");
+        esp32_uart_send_bpacket(bpacket);
+        fclose(file);
+        return;
+    }
+
+    // Windowed transfers go back and resend everything after the last ACK so the whole file
+    // is loaded and sent with bpacket_send_data(). Large allocations come from PSRAM
+    if ((bpacket_crc_enabled() == TRUE) && (bpacket_get_window_size() != 0)) {
+
+        uint8_t* fileData = malloc(fileNumBytes);
+        if ((fileData == NULL) || (sd_card_block_read(file, fileData, fileNumBytes) != TRUE)) {
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to load file\0");
+            esp32_uart_send_bpacket(bpacket);
+            free(fileData);
+            fclose(file);
+            return;
         }
 
-        if (sd_card_write_settings(&ctSettings) != TRUE) {
-            bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                              "Settings default capture time settings failed\r\n\0");
-            sd_card_close();
-            return FALSE;
+        fclose(file);
+
+        if (esp32_uart_send_transfer(sender, receiver, request, fileData, fileNumBytes) != TRUE) {
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to send file\0");
+            esp32_uart_send_bpacket(bpacket);
         }
+
+        free(fileData);
+        return;
     }
 
-    /****** END CODE BLOCK ******/
+    // Otherwise the file is streamed one block at a time. The next block is read from
+    // the SD card while the current one is being sent
+    uint16_t maxNumDataBytes = bpacket_get_max_num_data_bytes();
+    uint8_t checked          = bpacket_crc_enabled();
+    uint8_t* chunk           = malloc(maxNumDataBytes);
 
-    /****** START CODE BLOCK ******/
-    // Description: Confirm the log and data files exist
+    sd_card_block_reader_t reader;
+    if ((chunk == NULL) || (sd_card_block_reader_open(&reader, file) != TRUE)) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Not enough memory to read file\0");
+        esp32_uart_send_bpacket(bpacket);
+        free(chunk);
+        fclose(file);
+        return;
+    }
 
-    // Create the data file if required
-    if (sd_card_create_file(DATA_FILE_PATH_START_AT_ROOT, errMsg) != TRUE) {
-        bpacket_create_sp(&b1, bpacket->sender, bpacket->receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_ERROR, errMsg);
-        return FALSE;
+    uint32_t numBytesSent  = 0;
+    uint16_t sequence      = 0;
+    uint16_t chunkNumBytes = 0; // Bytes from the end of the previous block waiting to be sent
+    uint32_t blockNumBytes;
+    uint8_t* block;
+
+    while ((blockNumBytes = sd_card_block_reader_next(&reader, &block)) > 0) {
+
+        // Checked receivers place each bpacket by its sequence number so every bpacket except
+        // the last has to be full. One that spans two blocks is put together in the chunk first
+        uint32_t i = 0;
+        if (chunkNumBytes != 0) {
+            i = (maxNumDataBytes - chunkNumBytes) < blockNumBytes ? (maxNumDataBytes - chunkNumBytes) : blockNumBytes;
+            memcpy(&chunk[chunkNumBytes], block, i);
+            chunkNumBytes += i;
+
+            if (chunkNumBytes < maxNumDataBytes) {
+                continue;
+            }
+
+            numBytesSent += chunkNumBytes;
+            sd_card_send_file_chunk(sender, receiver, request, chunk, chunkNumBytes, numBytesSent >= fileNumBytes,
+                                    checked, sequence++);
+            chunkNumBytes = 0;
+        }
+
+        // The rest of the block is sent as bpackets that point straight into it
+        for (; (blockNumBytes - i) >= maxNumDataBytes; i += maxNumDataBytes) {
+            numBytesSent += maxNumDataBytes;
+            sd_card_send_file_chunk(sender, receiver, request, &block[i], maxNumDataBytes,
+                                    numBytesSent >= fileNumBytes, checked, sequence++);
+        }
+
+        chunkNumBytes = blockNumBytes - i;
+        memcpy(chunk, &block[i], chunkNumBytes);
     }
 
-    // Create the logs file if required
-    if (sd_card_create_file(LOG_FILE_PATH_START_AT_ROOT, errMsg) != TRUE) {
-        bpacket_create_sp(&b1, bpacket->sender, bpacket->receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_ERROR, errMsg);
-        return FALSE;
+    uint8_t readOk = sd_card_block_reader_close(&reader);
+
+    // Only the bpacket holding the last byte of the file is marked as a success
+    if ((readOk == TRUE) && ((chunkNumBytes != 0) || (fileNumBytes == 0))) {
+        numBytesSent += chunkNumBytes;
+        sd_card_send_file_chunk(sender, receiver, request, chunk, chunkNumBytes, numBytesSent >= fileNumBytes,
+                                checked, sequence++);
     }
 
-    /****** END CODE BLOCK ******/
+    // The receiver is still waiting for a success or an error if the file could
+    // not be read to the end
+    if ((readOk != TRUE) || (numBytesSent < fileNumBytes)) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to read file\0");
+        esp32_uart_send_bpacket(bpacket);
+        free(chunk);
+        fclose(file);
+        return;
+    }
 
-    sd_card_close();
+    // Checked bpackets that were corrupted are read from the SD card again and resent
+    // until the receiver has all of them
+    bpacket_t nack;
+    while ((checked == TRUE) && (esp32_uart_get_nack(&nack) == TRUE)) {
+        for (int i = 0; (i + 1) < nack.numBytes; i += 2) {
+            uint16_t nackSequence = (nack.bytes[i] << 8) | nack.bytes[i + 1];
+            uint32_t chunkStart   = (uint32_t)nackSequence * maxNumDataBytes;
 
-    return TRUE;
+            // The receiver asks for one past the last bpacket it has in case the last was lost
+            if (chunkStart >= fileNumBytes) {
+                continue;
+            }
+
+            chunkNumBytes = maxNumDataBytes;
+            if ((fileNumBytes - chunkStart) < maxNumDataBytes) {
+                chunkNumBytes = fileNumBytes - chunkStart;
+            }
+
+            if ((fseek(file, startByte + chunkStart, SEEK_SET) != 0) ||
+                (sd_card_block_read(file, chunk, chunkNumBytes) != TRUE)) {
+                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to read file\0");
+                esp32_uart_send_bpacket(bpacket);
+                free(chunk);
+                fclose(file);
+                return;
+            }
+
+            sd_card_send_file_chunk(sender, receiver, request, chunk, chunkNumBytes,
+                                    (chunkStart + chunkNumBytes) >= fileNumBytes, TRUE, nackSequence);
+        }
+    }
+
+    free(chunk);
+    fclose(file);
 }
 
-uint8_t sd_card_read_settings(bpacket_t* bpacket) {
+void sd_card_send_file_chunk(uint8_t receiver, uint8_t sender, uint8_t request, uint8_t* data, uint16_t numBytes,
+                             uint8_t lastChunk, uint8_t checked, uint16_t sequence) {
 
-    // Save the sender, receiver and request so that if the bpacket values get changed
-    // this doesn't alter the sender, receiver, request of any other bpacket message
-    // that might need to be sent from this function.
-    uint8_t sender   = bpacket->sender;
-    uint8_t receiver = bpacket->receiver;
-    uint8_t request  = bpacket->request;
+    uint8_t code = (lastChunk == TRUE) ? BPACKET_CODE_SUCCESS : BPACKET_CODE_IN_PROGRESS;
 
-    bpacket_t b1;
+    bpacket_frame_t frame;
+    bpacket_encode_frame(&frame, receiver, sender, request, code, data, numBytes, checked, sequence);
+    bpacket_transmit_frame(esp32_uart_send_data, &frame);
+}
+
+uint8_t sd_card_settings_check_loaded(void) {
+
+    // The settings are only read from the SD card the first time they are needed
+    if (settingsLoaded != TRUE) {
+        sd_card_settings_load();
+    }
+
+    return settingsLoaded;
+}
+
+void sd_card_settings_to_bytes(wd_settings_t* settings, uint8_t bytes[SETTINGS_RECORD_NUM_BYTES]) {
+
+    bytes[0] = SETTINGS_RECORD_MAGIC_UPPER;
+    bytes[1] = SETTINGS_RECORD_MAGIC_LOWER;
+    bytes[2] = SETTINGS_RECORD_VERSION;
+    bytes[3] = settings->cameraSettings.resolution;
+    bytes[4] = settings->captureTime.startTime.minute;
+    bytes[5] = settings->captureTime.startTime.hour;
+    bytes[6] = settings->captureTime.endTime.minute;
+    bytes[7] = settings->captureTime.endTime.hour;
+    bytes[8] = settings->captureTime.intervalTime.minute;
+    bytes[9] = settings->captureTime.intervalTime.hour;
+
+    uint16_t crc                         = bpacket_crc16(0xFFFF, bytes, SETTINGS_RECORD_NUM_BYTES - 2);
+    bytes[SETTINGS_RECORD_NUM_BYTES - 2] = (crc >> 8) & 0xFF;
+    bytes[SETTINGS_RECORD_NUM_BYTES - 1] = crc & 0xFF;
+}
+
+uint8_t sd_card_settings_read_file(char* filePath, wd_settings_t* settings) {
+
+    FILE* file = fopen(filePath, "rb");
+    if (file == NULL) {
+        return SETTINGS_FILE_INVALID;
+    }
+
+    // One byte more than a record is read so files that are too long are caught
+    uint8_t bytes[SETTINGS_RECORD_NUM_BYTES + 1];
+    uint32_t numBytes = fread(bytes, 1, sizeof(bytes), file);
+    fclose(file);
+
+    uint8_t* values;
+    uint8_t state;
+    uint16_t crc = bpacket_crc16(0xFFFF, bytes, SETTINGS_RECORD_NUM_BYTES - 2);
+
+    if (numBytes == SETTINGS_LEGACY_NUM_BYTES) {
+        values = &bytes[0];
+        state  = SETTINGS_FILE_LEGACY;
+    } else if ((numBytes == SETTINGS_RECORD_NUM_BYTES) && (bytes[0] == SETTINGS_RECORD_MAGIC_UPPER) &&
+               (bytes[1] == SETTINGS_RECORD_MAGIC_LOWER) && (bytes[2] == SETTINGS_RECORD_VERSION) &&
+               (bytes[SETTINGS_RECORD_NUM_BYTES - 2] == ((crc >> 8) & 0xFF)) &&
+               (bytes[SETTINGS_RECORD_NUM_BYTES - 1] == (crc & 0xFF))) {
+        values = &bytes[3];
+        state  = SETTINGS_FILE_RECORD;
+    } else {
+        return SETTINGS_FILE_INVALID;
+    }
+
+    settings->cameraSettings.resolution       = values[0];
+    settings->captureTime.startTime.second    = 0;
+    settings->captureTime.startTime.minute    = values[1];
+    settings->captureTime.startTime.hour      = values[2];
+    settings->captureTime.endTime.second      = 0;
+    settings->captureTime.endTime.minute      = values[3];
+    settings->captureTime.endTime.hour        = values[4];
+    settings->captureTime.intervalTime.second = 0;
+    settings->captureTime.intervalTime.minute = values[5];
+    settings->captureTime.intervalTime.hour   = values[6];
+
+    return state;
+}
+
+uint8_t sd_card_settings_save(wd_settings_t* settings) {
+
+    uint8_t record[SETTINGS_RECORD_NUM_BYTES];
+    uint8_t cachedRecord[SETTINGS_RECORD_NUM_BYTES];
+    sd_card_settings_to_bytes(settings, record);
+    sd_card_settings_to_bytes(&settingsCache, cachedRecord);
+
+    // Nothing is written if the settings have not changed
+    if ((settingsLoaded == TRUE) && (memcmp(record, cachedRecord, SETTINGS_RECORD_NUM_BYTES) == 0)) {
+        return TRUE;
+    }
 
-    // Return error message if the SD card cannot be opened
     if (sd_card_open() != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card failed to open\r\n\0");
         return FALSE;
     }
 
-    // Confirm the file path to the settings exists
-    if (sd_card_create_path(SETTINGS_FOLDER_PATH, bpacket) != TRUE) {
+    // The new settings are written to a temporary file and only replace the old file once
+    // they are on the card. FAT can not rename over a file so the old one is removed first.
+    // If the power goes between the two, sd_card_settings_load() finds the temporary file
+    FILE* file = fopen(SETTINGS_TEMP_FILE_PATH_START_AT_ROOT, "wb");
+    if (file == NULL) {
         sd_card_close();
         return FALSE;
     }
 
-    // Get the file size of the settings file. This needs to be done first because the file
-    // needs to be opened in read mode
-    uint32_t fileNumBytes = 0;
-    char errMsg[50];
-    if (sd_card_get_file_size(SETTINGS_FILE_PATH_START_AT_ROOT, &fileNumBytes, errMsg) != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
-        esp32_uart_send_bpacket(bpacket);
+    uint8_t written = TRUE;
+    if ((fwrite(record, 1, SETTINGS_RECORD_NUM_BYTES, file) != SETTINGS_RECORD_NUM_BYTES) || (fflush(file) != 0) ||
+        (fsync(fileno(file)) != 0)) {
+        written = FALSE;
+    }
+
+    if ((fclose(file) != 0) || (written != TRUE)) {
+        remove(SETTINGS_TEMP_FILE_PATH_START_AT_ROOT);
+        sd_card_close();
         return FALSE;
     }
 
-    if (fileNumBytes == 0) {
+    remove(SETTINGS_FILE_PATH_START_AT_ROOT);
+    if (rename(SETTINGS_TEMP_FILE_PATH_START_AT_ROOT, SETTINGS_FILE_PATH_START_AT_ROOT) != 0) {
+        sd_card_close();
+        return FALSE;
+    }
 
-        switch (bpacket->request) {
+    sd_card_close();
 
-            case WATCHDOG_BPK_R_GET_CAMERA_SETTINGS:;
+    settingsCache  = *settings;
+    settingsLoaded = TRUE;
 
-                bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                                  "RF: 0 bytes req was camera settings\r\n\0");
-                esp32_uart_send_bpacket(&b1);
+    return TRUE;
+}
 
-                bpacket_t camSettingsBpacket;
-                if (wd_camera_settings_to_bpacket(&camSettingsBpacket, receiver, sender,
-                                                  WATCHDOG_BPK_R_SET_CAMERA_SETTINGS, BPACKET_CODE_EXECUTE,
-                                                  &deafultCameraSettings) != TRUE) {
-                    bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
-                                      "Setting deafult camera settings failed\r\n\0");
-                    esp32_uart_send_bpacket(bpacket);
-                    return FALSE;
-                }
+uint8_t sd_card_settings_load(void) {
 
-                if (sd_card_write_settings(&camSettingsBpacket) != TRUE) {
-                    bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                                      "FAILED TO WRITE SETTINGS CORRECTLY\r\n\0");
-                    esp32_uart_send_bpacket(&b1);
-                } else {
-                    bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                                      "WROTE SETTINGS CORECTLY\r\n\0");
-                    esp32_uart_send_bpacket(&b1);
-                }
-                break;
+    if (sd_card_open() != TRUE) {
+        return FALSE;
+    }
 
-            case WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS:;
+    wd_settings_t settings;
 
-                bpacket_t deafultCaptureTimeSettingsBpacket;
+    // A complete temporary file holds settings that were saved but lost power before
+    // they replaced the settings file. Anything less is a write that never finished
+    if (sd_card_settings_read_file(SETTINGS_TEMP_FILE_PATH_START_AT_ROOT, &settings) == SETTINGS_FILE_RECORD) {
+        remove(SETTINGS_FILE_PATH_START_AT_ROOT);
+        rename(SETTINGS_TEMP_FILE_PATH_START_AT_ROOT, SETTINGS_FILE_PATH_START_AT_ROOT);
+    } else {
+        remove(SETTINGS_TEMP_FILE_PATH_START_AT_ROOT);
+    }
 
-                if (wd_capture_time_settings_to_bpacket(&deafultCaptureTimeSettingsBpacket, receiver, sender, request,
-                                                        BPACKET_CODE_EXECUTE, &defaultCaptureTimeSettings) != TRUE) {
-                    bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
-                                      "Setting deafult camera settings failed\r\n\0");
-                    esp32_uart_send_bpacket(bpacket);
-                    return FALSE;
-                }
+    uint8_t state = sd_card_settings_read_file(SETTINGS_FILE_PATH_START_AT_ROOT, &settings);
+
+    if (state == SETTINGS_FILE_RECORD) {
+        settingsCache  = settings;
+        settingsLoaded = TRUE;
+        sd_card_close();
+        return TRUE;
+    }
+
+    // Settings saved before the record had a checksum are kept and saved again as a
+    // record. Settings that are missing or can not be trusted are replaced by the defaults
+    if (state == SETTINGS_FILE_INVALID) {
+        settings.cameraSettings = deafultCameraSettings;
+        settings.captureTime    = defaultCaptureTimeSettings;
+    }
 
-                sd_card_write_settings(&deafultCaptureTimeSettingsBpacket);
+    settingsLoaded = FALSE;
+    uint8_t result = sd_card_settings_save(&settings);
 
-                break;
+    // The settings are still used from RAM if they could not be saved
+    settingsCache  = settings;
+    settingsLoaded = TRUE;
+
+    sd_card_close();
+
+    return result;
+}
+
+uint8_t sd_card_write_settings(bpacket_t* bpacket) {
+
+    uint8_t sender   = bpacket->sender;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    // The settings that are not part of the request are kept from the cache
+    if (sd_card_settings_check_loaded() != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card failed to open\r\n\0");
+        esp32_uart_send_bpacket(bpacket);
+        return FALSE;
+    }
+
+    wd_settings_t settings = settingsCache;
 
-            default:;
+    switch (request) {
 
-                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "RF: Invalid request!\r\n\0");
+        case WATCHDOG_BPK_R_SET_CAMERA_SETTINGS:
+
+            if (wd_bpacket_to_camera_settings(bpacket, &settings.cameraSettings) != TRUE) {
+                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
+                                  "Bpacket to camera settings failed. SD Card write attempt\r\n\0");
                 esp32_uart_send_bpacket(bpacket);
                 return FALSE;
-        }
+            }
 
-        // Open the SD card again
-        if (sd_card_open() != TRUE) {
-            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card failed to open\r\n\0");
+            break;
+
+        case WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS:
+
+            if (wd_bpacket_to_capture_time_settings(bpacket, &settings.captureTime) != TRUE) {
+                bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR,
+                                  "Bpacket to capture time settings failed. SD Card write attempt\r\n\0");
+                esp32_uart_send_bpacket(bpacket);
+                return FALSE;
+            }
+
+            break;
+
+        default:
+
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "WF: Invalid request!\r\n\0");
+            esp32_uart_send_bpacket(bpacket);
             return FALSE;
-        }
     }
 
-    FILE* file;
-    if (sd_card_open_file(&file, SETTINGS_FILE_PATH_START_AT_ROOT, SD_CARD_FILE_READ, errMsg) != TRUE) {
-        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
+    if (sd_card_settings_save(&settings) != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "Failed to save settings\r\n\0");
         esp32_uart_send_bpacket(bpacket);
         return FALSE;
     }
 
-    if (bpacket->request == WATCHDOG_BPK_R_GET_CAMERA_SETTINGS) {
+    // Update bpacket to send as success response back
+    bpacket->numBytes = 0;
+    bpacket->receiver = sender;
+    bpacket->sender   = receiver;
+    bpacket->code     = BPACKET_CODE_SUCCESS;
 
-        bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                          "RF: Request get camera settings\r\n\0");
-        esp32_uart_send_bpacket(&b1);
+    return TRUE;
+}
 
-        wd_camera_settings_t cameraSettings;
-        cameraSettings.resolution = (uint8_t)fgetc(file);
+uint8_t sd_card_format_sd_card(bpacket_t* bpacket) {
 
-        char j[70];
-        sprintf(j, "RF: Resolution read: %i\r\n", cameraSettings.resolution);
-        bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS, j);
-        esp32_uart_send_bpacket(&b1);
+    char errMsg[50];
+    bpacket_t b1;
 
-        uint8_t result =
-            wd_camera_settings_to_bpacket(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS, &cameraSettings);
+    // Return error message if the SD card cannot be opened
+    if (sd_card_open() != TRUE) {
+        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
+                          "SD card failed to open\r\n\0");
+        return FALSE;
+    }
 
-        bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                          "RF: Checking results\r\n\0");
-        esp32_uart_send_bpacket(&b1);
-        if (result != TRUE) {
-            char errMsg[50];
-            wd_get_error(result, errMsg);
-            sprintf(j, "FAILED CRES: %i %s\r\n", result, errMsg);
-            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, j);
-            esp32_uart_send_bpacket(bpacket);
+    /****** START CODE BLOCK ******/
+    // Description: Confirm all the correct folders on the SD card exist
 
-            // Clean up
-            fclose(file);
-            sd_card_close();
-            return FALSE;
-        }
+    // Create watchdog folder if necessary
+    if (sd_card_create_path(WATCHDOG_FOLDER_PATH, bpacket) != TRUE) {
+        sd_card_close();
+        return FALSE;
+    }
 
-        bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                          "RF: Converted settings to bpacket\r\n\0");
-        esp32_uart_send_bpacket(&b1);
-    }
-
-    if (bpacket->request == WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS) {
-
-        bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                          "RF: Request get capture time\r\n\0");
-        esp32_uart_send_bpacket(&b1);
-
-        // Set the cursor to the 1st index to skip the camera settings
-        fseek(file, 1, SEEK_CUR);
-        wd_camera_capture_time_settings_t captureTime;
-        // Seconds are required to be set to default otherwise they will assume
-        // the values of whatever is stored in that memory and will fail when
-        // being converted from a capture time to bpacket
-        captureTime.startTime.second    = 0;
-        captureTime.startTime.minute    = fgetc(file);
-        captureTime.startTime.hour      = fgetc(file);
-        captureTime.endTime.second      = 0;
-        captureTime.endTime.minute      = fgetc(file);
-        captureTime.endTime.hour        = fgetc(file);
-        captureTime.intervalTime.second = 0;
-        captureTime.intervalTime.minute = fgetc(file);
-        captureTime.intervalTime.hour   = fgetc(file);
-
-        if (wd_capture_time_settings_to_bpacket(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS,
-                                                &captureTime) != TRUE) {
-            bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
-                              "Capture time settings to bpacket failed. SD Card read\r\n\0");
-
-            // Clean up
-            fclose(file);
-            sd_card_close();
-            return FALSE;
-        }
+    // Create data folder if necessary
+    if (sd_card_create_path(DATA_FOLDER_PATH, bpacket) != TRUE) {
+        sd_card_close();
+        return FALSE;
+    }
 
-        bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS,
-                          "Capture time read\r\n\0");
-        esp32_uart_send_bpacket(&b1);
+    // Create logs folder if necessary
+    if (sd_card_create_path(LOG_FOLDER_PATH, bpacket) != TRUE) {
+        sd_card_close();
+        return FALSE;
     }
 
-    // Clean up
-    fclose(file);
-    sd_card_close();
+    // Create settings folder if necessary
+    if (sd_card_create_path(SETTINGS_FOLDER_PATH, bpacket) != TRUE) {
+        sd_card_close();
+        return FALSE;
+    }
+
+    /****** END CODE BLOCK ******/
+
+    /****** START CODE BLOCK ******/
+    // Description: Read the settings into RAM. The defaults are saved if the card has none
+
+    if (sd_card_settings_load() != TRUE) {
+        bpacket_create_sp(bpacket, bpacket->sender, bpacket->receiver, bpacket->request, BPACKET_CODE_ERROR,
+                          "Failed to load settings\r\n\0");
+        sd_card_close();
+        return FALSE;
+    }
+
+    /****** END CODE BLOCK ******/
+
+    /****** START CODE BLOCK ******/
+    // Description: Confirm the log and data files exist
 
-    bpacket_create_sp(&b1, sender, receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_SUCCESS, "RF: Closing up!\r\n\0");
-    esp32_uart_send_bpacket(&b1);
+    // Create the data file if required
+    if (sd_card_create_file(DATA_FILE_PATH_START_AT_ROOT, errMsg) != TRUE) {
+        bpacket_create_sp(&b1, bpacket->sender, bpacket->receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_ERROR, errMsg);
+        sd_card_close();
+        return FALSE;
+    }
+
+    // Create the logs file if required
+    if (sd_card_create_file(LOG_FILE_PATH_START_AT_ROOT, errMsg) != TRUE) {
+        bpacket_create_sp(&b1, bpacket->sender, bpacket->receiver, BPACKET_GEN_R_MESSAGE, BPACKET_CODE_ERROR, errMsg);
+        sd_card_close();
+        return FALSE;
+    }
+
+    /****** END CODE BLOCK ******/
+
+    sd_card_close();
 
     return TRUE;
 }
 
-uint8_t sd_card_get_camera_settings(wd_camera_settings_t* cameraSettings) {
+uint8_t sd_card_read_settings(bpacket_t* bpacket) {
+
+    // Save the sender, receiver and request so that if the bpacket values get changed
+    // this doesn't alter the sender, receiver, request of any other bpacket message
+    // that might need to be sent from this function.
+    uint8_t sender   = bpacket->sender;
+    uint8_t receiver = bpacket->receiver;
+    uint8_t request  = bpacket->request;
 
-    // Create a bpacket with the correct information to read camera settings
-    bpacket_t bpacket;
-    bpacket_create_p(&bpacket, BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_GET_CAMERA_SETTINGS,
-                     BPACKET_CODE_EXECUTE, 0, NULL);
+    if (sd_card_settings_check_loaded() != TRUE) {
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "SD card failed to open\r\n\0");
+        return FALSE;
+    }
+
+    uint8_t result;
+
+    switch (request) {
+
+        case WATCHDOG_BPK_R_GET_CAMERA_SETTINGS:
+            result = wd_camera_settings_to_bpacket(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS,
+                                                   &settingsCache.cameraSettings);
+            break;
 
-    if (sd_card_read_settings(&bpacket) != TRUE) {
-        bpacket_create_sp(&bpacket, BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_ESP32, BPACKET_GEN_R_MESSAGE,
-                          BPACKET_CODE_ERROR, "CS: Failed to read camera settings\r\n\0");
-        esp32_uart_send_bpacket(&bpacket);
+        case WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS:
+            result = wd_capture_time_settings_to_bpacket(bpacket, sender, receiver, request, BPACKET_CODE_SUCCESS,
+                                                         &settingsCache.captureTime);
+            break;
+
+        default:
+            bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, "RF: Invalid request!\r\n\0");
+            return FALSE;
+    }
+
+    if (result != TRUE) {
+        char errMsg[50];
+        wd_get_error(result, errMsg);
+        bpacket_create_sp(bpacket, sender, receiver, request, BPACKET_CODE_ERROR, errMsg);
         return FALSE;
     }
 
-    // Convert the bpacket to camera settings
-    if (wd_bpacket_to_camera_settings(&bpacket, cameraSettings) != TRUE) {
-        bpacket_create_sp(&bpacket, BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_ESP32, BPACKET_GEN_R_MESSAGE,
-                          BPACKET_CODE_ERROR, "CS: Failed to parse camera settings\r\n\0");
-        esp32_uart_send_bpacket(&bpacket);
+    return TRUE;
+}
+
+uint8_t sd_card_get_camera_settings(wd_camera_settings_t* cameraSettings) {
+
+    if (sd_card_settings_check_loaded() != TRUE) {
         return FALSE;
     }
 
+    *cameraSettings = settingsCache.cameraSettings;
+
     return TRUE;
 }
 
@@ -994,11 +1388,19 @@ uint8_t sd_card_get_camera_settings(wd_camera_settings_t* cameraSettings) {
 
 uint8_t sd_card_open(void) {
 
-    // Return if the sd card has already been mounted
+    // Reuse the mount if the card is still mounted from an earlier session
     if (mounted != FALSE) {
+
+        if (sessionRefCount == 0) {
+            mountStats.numReuses++;
+        }
+
+        sessionRefCount++;
         return TRUE;
     }
 
+    int64_t startUs = esp_timer_get_time();
+
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
 
     // This initializes the slot without card detect (CD) and write protect (WP) signals.
@@ -1025,6 +1427,12 @@ uint8_t sd_card_open(void) {
         return SD_CARD_ERROR_CONNECTION_FAILURE;
     }
 
+    mountStats.numMounts++;
+    mountStats.mountTimeUs += esp_timer_get_time() - startUs;
+
+    mounted         = TRUE;
+    sessionRefCount = 1;
+
     // Log SD Card information
     char sdCardLog[LOG_MSG_MAX_CHARACTERS];
     if (card->max_freq_khz < 1000) {
@@ -1044,26 +1452,64 @@ uint8_t sd_card_open(void) {
         }
     }
 
-    mounted = TRUE;
     return TRUE;
 }
 
 void sd_card_close(void) {
 
+    if ((mounted != TRUE) || (sessionRefCount == 0)) {
+        return;
+    }
+
+    // The card is left mounted. sd_card_unmount_if_idle() unmounts it if nothing opens it again soon
+    if (--sessionRefCount == 0) {
+        sessionReleasedUs = esp_timer_get_time();
+    }
+}
+
+void sd_card_unmount_if_idle(void) {
+
+    if ((mounted != TRUE) || (sessionRefCount != 0)) {
+        return;
+    }
+
+    if ((esp_timer_get_time() - sessionReleasedUs) < (SD_CARD_IDLE_UNMOUNT_MS * 1000)) {
+        return;
+    }
+
+    sd_card_unmount();
+}
+
+void sd_card_get_mount_stats(sd_card_mount_stats_t* stats) {
+    *stats = mountStats;
+}
+
+void sd_card_unmount(void) {
+
     if (mounted != TRUE) {
         return;
     }
 
+    int64_t startUs = esp_timer_get_time();
+
     // Log the SD card being disabled
     char msg[40];
     sprintf(msg, "Unmounting SD card");
     sd_card_log(SYSTEM_LOG_FILE, msg);
 
+    // Anything still in the log buffer is written while the card is mounted
+    sd_card_log_write_buffer();
+    logFolderExists   = FALSE;
+    imageFolderExists = FALSE;
+
     // All done, unmount partition and disable SDMMC peripheral
     esp_vfs_fat_sdcard_unmount(MOUNT_POINT_PATH, card);
 
     // ESP_LOGI(SD_CARD_TAG, "Card unmounted");
-    mounted = FALSE;
+    mounted         = FALSE;
+    sessionRefCount = 0;
+
+    mountStats.unmountTimeUs += esp_timer_get_time() - startUs;
 }
 
 uint8_t sd_card_check_file_path_exists(char* filePath) {
@@ -1120,6 +1566,14 @@ uint8_t sd_card_write(char* filePath, char* fileName, char* message) {
     // Log to console that data is being written to this file name
     // ESP_LOGI(SD_CARD_TAG, "Writing data to %s", filePath);
 
+    // Confirm the message is within character limit. The character
+    // limit can be increased if necessary. To do so, change the
+    // maximum character limit macro
+    if (strlen(message) > LOG_MSG_MAX_CHARACTERS) {
+        ESP_LOGE(SD_CARD_TAG, "Message '%s' is too long", message);
+        return LOG_ERR_MSG_TOO_LONG;
+    }
+
     if (sd_card_check_file_path_exists(filePath) != TRUE) {
         return SD_CARD_ERROR_IO_ERROR;
     }
@@ -1138,27 +1592,11 @@ uint8_t sd_card_write(char* filePath, char* fileName, char* message) {
     }
 
     // Get the time from the real time clock
-    char formattedDateTime[20];
-    sprintf(formattedDateTime, "1/1/2023 9:00am");
-
-    // Confirm the message is within character limit. The character
-    // limit can be increased if necessary. To do so, change the
-    // maximum character limit macro
-    int length = 0;
-    while (message[length++] != '\0') {
-        if (length > LOG_MSG_MAX_CHARACTERS) {
-            ESP_LOGE(SD_CARD_TAG, "Message '%s' is too long", message);
-            return LOG_ERR_MSG_TOO_LONG;
-        }
-    }
-
-    // Append the time to the message to create log that will be written to file
-    int msgLength = 20 + LOG_MSG_MAX_CHARACTERS + NULL_CHAR_LENGTH + 5;
-    char log[msgLength];
-    sprintf(log, "%s\t%s\n", formattedDateTime, message);
+    char formattedDateTime[RTC_DATE_TIME_CHAR_LENGTH];
+    rtc_get_formatted_date_time(formattedDateTime);
 
     // Write log to file
-    fprintf(file, log);
+    fprintf(file, "%s\t%s\n", formattedDateTime, message);
 
     fclose(file);
 
@@ -1166,54 +1604,97 @@ uint8_t sd_card_write(char* filePath, char* fileName, char* message) {
 }
 
 uint8_t sd_card_log(char* fileName, char* message) {
-    char name[30];
-    sprintf(name, "%s", fileName); // Doing this so \0 is added to the end
-    return sd_card_write(ROOT_LOG_FOLDER_PATH, name, message);
 
-    // // Print log to console
-    // ESP_LOGI("LOG", "%s", message);
+    // Only the system log is buffered
+    if (strcmp(fileName, SYSTEM_LOG_FILE) != 0) {
+        char name[30];
+        sprintf(name, "%s", fileName); // Doing this so \0 is added to the end
+        return sd_card_write(ROOT_LOG_FOLDER_PATH, name, message);
+    }
 
-    // if (sd_card_check_file_path_exists(ROOT_LOG_FOLDER_PATH) != TRUE) {
-    //     return SD_CARD_ERROR_IO_ERROR;
-    // }
+    if (strlen(message) > LOG_MSG_MAX_CHARACTERS) {
+        ESP_LOGE(SD_CARD_TAG, "Message '%s' is too long", message);
+        return LOG_ERR_MSG_TOO_LONG;
+    }
 
-    // // Open the given file path for appending (a+). If the file does not exist
-    // // fopen will create a new file with the given file path. Note fopen() can
-    // // not make new directories!
-    // char filePath[100];
-    // sprintf(filePath, "%s/%s", ROOT_LOG_FOLDER_PATH, fileName);
-    // FILE* file = fopen(filePath, "a+");
-
-    // // Confirm the file was opened/created correctly
-    // if (file == NULL) {
-    //     ESP_LOGE(SD_CARD_TAG, "Could not open/create %s", filePath);
-    //     return SD_CARD_ERROR_IO_ERROR;
-    // }
+    char log[RTC_DATE_TIME_CHAR_LENGTH + LOG_MSG_MAX_CHARACTERS + NULL_CHAR_LENGTH + 5];
+    rtc_get_formatted_date_time(log);
+    int length = strlen(log);
+    length += sprintf(&log[length], "\t%s\n", message);
 
-    // // Get the time from the real time clock
-    // char formattedDateTime[20];
-    // rtc_get_formatted_date_time(formattedDateTime);
-
-    // // Confirm the message is within character limit. The character
-    // // limit can be increased if necessary. To do so, change the
-    // // maximum character limit macro
-    // int length = 0;
-    // while (message[length++] != '\0') {
-    //     if (length > LOG_MSG_MAX_CHARACTERS) {
-    //         ESP_LOGE(SD_CARD_TAG, "Message '%s' is too long", message);
-    //         return LOG_ERR_MSG_TOO_LONG;
-    //     }
-    // }
+    // Make room if the line does not fit. If the card can not be written the oldest
+    // lines are dropped so the newest ones are kept
+    if ((logNumBytes + length) > LOG_BUFFER_SIZE) {
+        sd_card_log_flush();
+    }
+
+    if ((logNumBytes + length) > LOG_BUFFER_SIZE) {
+        uint16_t numBytesToDrop = logNumBytes + length - LOG_BUFFER_SIZE;
+        memmove(logBuffer, &logBuffer[numBytesToDrop], logNumBytes - numBytesToDrop);
+        logNumBytes -= numBytesToDrop;
+    }
+
+    if (logNumBytes == 0) {
+        logFirstLineUs = esp_timer_get_time();
+    }
+
+    memcpy(&logBuffer[logNumBytes], log, length);
+    logNumBytes += length;
+
+    if (logNumBytes >= LOG_FLUSH_NUM_BYTES) {
+        return sd_card_log_flush();
+    }
+
+    return TRUE;
+}
+
+uint8_t sd_card_log_flush(void) {
+
+    if (logNumBytes == 0) {
+        return TRUE;
+    }
+
+    if (sd_card_open() != TRUE) {
+        return SD_CARD_ERROR_CONNECTION_FAILURE;
+    }
+
+    uint8_t result = sd_card_log_write_buffer();
+    sd_card_close();
+
+    return result;
+}
+
+void sd_card_log_update(void) {
+
+    if ((logNumBytes != 0) && ((esp_timer_get_time() - logFirstLineUs) >= (LOG_FLUSH_TIMEOUT_MS * 1000))) {
+        sd_card_log_flush();
+    }
+}
 
-    // // Append the time to the message to create log that will be written to file
-    // int msgLength = RTC_DATE_TIME_CHAR_LENGTH + LOG_MSG_MAX_CHARACTERS + NULL_CHAR_LENGTH + 5;
-    // char log[msgLength];
-    // sprintf(log, "%s\t%s\n", formattedDateTime, message);
+uint8_t sd_card_log_write_buffer(void) {
 
-    // // Write log to file
-    // fprintf(file, log);
+    if (logNumBytes == 0) {
+        return TRUE;
+    }
 
-    // fclose(file);
+    if ((logFolderExists != TRUE) && (sd_card_check_file_path_exists(ROOT_LOG_FOLDER_PATH) != TRUE)) {
+        return SD_CARD_ERROR_IO_ERROR;
+    }
+    logFolderExists = TRUE;
 
-    // return TRUE;
-}
\ No newline at end of file
+    FILE* file = fopen(LOG_FILE_PATH_START_AT_ROOT, "a");
+    if (file == NULL) {
+        ESP_LOGE(SD_CARD_TAG, "Could not open/create %s", LOG_FILE_PATH_START_AT_ROOT);
+        return SD_CARD_ERROR_IO_ERROR;
+    }
+
+    // Every waiting line goes in one append
+    uint8_t result = (fwrite(logBuffer, 1, logNumBytes, file) == logNumBytes) ? TRUE : SD_CARD_ERROR_IO_ERROR;
+    fclose(file);
+
+    if (result == TRUE) {
+        logNumBytes = 0;
+    }
+
+    return result;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file sd_card_block.c
+ * @author Gian Barta-Dougall
+ * @brief Block sized reads and writes for files on the SD card. The block reader
+ * keeps two blocks. Its thread reads the file into whichever block is free while
+ * the caller sends the other one, so the SD card and the UART are busy at the same
+ * time instead of taking turns
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdlib.h>
+
+/* Personal Includes */
+#include "sd_card_block.h"
+#include "utilities.h"
+
+/* Function Prototypes */
+static void* sd_card_block_reader_task(void* arg);
+
+uint8_t sd_card_block_read(FILE* file, uint8_t* data, uint32_t numBytes) {
+
+    // Read straight into the caller's buffer rather than through the stdio buffer
+    setvbuf(file, NULL, _IONBF, 0);
+
+    for (uint32_t i = 0; i < numBytes; i += SD_CARD_BLOCK_SIZE) {
+        uint32_t blockNumBytes = (numBytes - i) < SD_CARD_BLOCK_SIZE ? (numBytes - i) : SD_CARD_BLOCK_SIZE;
+
+        if (fread(&data[i], 1, blockNumBytes, file) != blockNumBytes) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+uint8_t sd_card_block_write(FILE* file, uint8_t* data, uint32_t numBytes) {
+
+    setvbuf(file, NULL, _IONBF, 0);
+
+    for (uint32_t i = 0; i < numBytes; i += SD_CARD_BLOCK_SIZE) {
+        uint32_t blockNumBytes = (numBytes - i) < SD_CARD_BLOCK_SIZE ? (numBytes - i) : SD_CARD_BLOCK_SIZE;
+
+        if (fwrite(&data[i], 1, blockNumBytes, file) != blockNumBytes) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+uint8_t sd_card_block_reader_open(sd_card_block_reader_t* reader, FILE* file) {
+
+    reader->file      = file;
+    reader->readIndex = 0;
+    reader->holding   = FALSE;
+    reader->finished  = FALSE;
+    reader->failed    = FALSE;
+    reader->stop      = FALSE;
+
+    for (uint8_t i = 0; i < SD_CARD_BLOCK_NUM_BUFFERS; i++) {
+        reader->blocks[i]   = malloc(SD_CARD_BLOCK_SIZE);
+        reader->numBytes[i] = 0;
+        reader->full[i]     = FALSE;
+    }
+
+    if ((reader->blocks[0] == NULL) || (reader->blocks[1] == NULL)) {
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return FALSE;
+    }
+
+    setvbuf(file, NULL, _IONBF, 0);
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+
+    if (pthread_create(&reader->thread, NULL, sd_card_block_reader_task, reader) != 0) {
+        pthread_cond_destroy(&reader->changed);
+        pthread_mutex_destroy(&reader->lock);
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+uint32_t sd_card_block_reader_next(sd_card_block_reader_t* reader, uint8_t** block) {
+
+    pthread_mutex_lock(&reader->lock);
+
+    // The caller is done with the last block so the thread can fill it again
+    if (reader->holding == TRUE) {
+        reader->full[reader->readIndex] = FALSE;
+        reader->readIndex               = (reader->readIndex + 1) % SD_CARD_BLOCK_NUM_BUFFERS;
+        reader->holding                 = FALSE;
+        pthread_cond_broadcast(&reader->changed);
+    }
+
+    // Blocks are filled in order so the end of the file has only been reached once
+    // the thread has finished and this block is still empty
+    while ((reader->full[reader->readIndex] == FALSE) && (reader->finished == FALSE)) {
+        pthread_cond_wait(&reader->changed, &reader->lock);
+    }
+
+    uint32_t numBytes = 0;
+    if (reader->full[reader->readIndex] == TRUE) {
+        numBytes        = reader->numBytes[reader->readIndex];
+        *block          = reader->blocks[reader->readIndex];
+        reader->holding = TRUE;
+    }
+
+    pthread_mutex_unlock(&reader->lock);
+
+    return numBytes;
+}
+
+uint8_t sd_card_block_reader_close(sd_card_block_reader_t* reader) {
+
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = TRUE;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+
+    pthread_join(reader->thread, NULL);
+
+    pthread_cond_destroy(&reader->changed);
+    pthread_mutex_destroy(&reader->lock);
+    free(reader->blocks[0]);
+    free(reader->blocks[1]);
+
+    return (reader->failed == TRUE) ? FALSE : TRUE;
+}
+
+static void* sd_card_block_reader_task(void* arg) {
+
+    sd_card_block_reader_t* reader = arg;
+    uint8_t fillIndex              = 0;
+
+    while (TRUE) {
+
+        // Wait for the caller to release the block before reading over it
+        pthread_mutex_lock(&reader->lock);
+        while ((reader->full[fillIndex] == TRUE) && (reader->stop == FALSE)) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        }
+
+        if (reader->stop == TRUE) {
+            pthread_mutex_unlock(&reader->lock);
+            break;
+        }
+        pthread_mutex_unlock(&reader->lock);
+
+        // The lock is not held while reading so the caller can keep sending the other block
+        uint32_t numBytes = fread(reader->blocks[fillIndex], 1, SD_CARD_BLOCK_SIZE, reader->file);
+
+        pthread_mutex_lock(&reader->lock);
+
+        if (numBytes > 0) {
+            reader->numBytes[fillIndex] = numBytes;
+            reader->full[fillIndex]     = TRUE;
+        }
+
+        // A short read is either the end of the file or an error
+        if (numBytes < SD_CARD_BLOCK_SIZE) {
+            reader->finished = TRUE;
+            reader->failed   = (ferror(reader->file) != 0) ? TRUE : FALSE;
+        }
+
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+
+        if (numBytes < SD_CARD_BLOCK_SIZE) {
+            break;
+        }
+
+        fillIndex = (fillIndex + 1) % SD_CARD_BLOCK_NUM_BUFFERS;
+    }
+
+    return NULL;
+}
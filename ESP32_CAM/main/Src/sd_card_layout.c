@@ -0,0 +1,258 @@
+/**
+ * @file sd_card_layout.c
+ * @author Gian Barta-Dougall
+ * @brief Where images are kept inside the data folder
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Personal Includes */
+#include "sd_card_layout.h"
+#include "utilities.h"
+
+typedef struct sd_card_layout_move_t {
+    char* dataFolder;
+    uint8_t layout;
+    uint32_t numMoved;
+    uint8_t failed;
+} sd_card_layout_move_t;
+
+/* Function Prototypes */
+static uint8_t sd_card_layout_is_date_folder(char* name);
+static uint8_t sd_card_layout_walk(char* path, uint16_t pathLength, uint8_t depth, sd_card_layout_callback_t callback,
+                                   void* arg, uint16_t dataFolderLength);
+static uint8_t sd_card_layout_move_image(char* filePath, char* imagePath, void* arg);
+static void sd_card_layout_remove_folders(char* path, uint16_t pathLength, uint8_t depth);
+
+void sd_card_layout_get_folder(char* folder, dt_datetime_t* datetime, uint8_t layout) {
+
+    folder[0] = '\0';
+
+    if (layout >= SD_CARD_LAYOUT_YEAR) {
+        folder += sprintf(folder, "%04u", datetime->date.year);
+    }
+
+    if (layout >= SD_CARD_LAYOUT_MONTH) {
+        folder += sprintf(folder, "/%02u", datetime->date.month);
+    }
+
+    if (layout >= SD_CARD_LAYOUT_DAY) {
+        sprintf(folder, "/%02u", datetime->date.day);
+    }
+}
+
+void sd_card_layout_get_image_path(char* imagePath, uint32_t imageNumber, dt_datetime_t* datetime, uint8_t layout) {
+
+    sd_card_layout_get_folder(imagePath, datetime, layout);
+
+    if (imagePath[0] != '\0') {
+        strcat(imagePath, "/");
+    }
+
+    sprintf(&imagePath[strlen(imagePath)], "img%0*lu_%02u%02u%02u_%02u%02u.jpg", SD_CARD_LAYOUT_IMAGE_NUM_DIGITS,
+            (unsigned long)imageNumber, datetime->date.year % 100, datetime->date.month, datetime->date.day,
+            datetime->time.hour, datetime->time.minute);
+}
+
+uint8_t sd_card_layout_parse_image_name(char* fileName, uint32_t* imageNumber, dt_datetime_t* datetime) {
+
+    unsigned long number;
+    unsigned int year, month, day, hour, minute;
+
+    // The case of the name depends on the SD card so both img and IMG are accepted
+    int numMatched =
+        sscanf(fileName, "%*1[iI]%*1[mM]%*1[gG]%lu_%2u%2u%2u_%2u%2u", &number, &year, &month, &day, &hour, &minute);
+
+    if (numMatched != 6) {
+        return FALSE;
+    }
+
+    *imageNumber          = number;
+    datetime->date.year   = year + 2000;
+    datetime->date.month  = month;
+    datetime->date.day    = day;
+    datetime->time.hour   = hour;
+    datetime->time.minute = minute;
+    datetime->time.second = 0;
+
+    return TRUE;
+}
+
+uint8_t sd_card_layout_for_each_image(char* dataFolder, sd_card_layout_callback_t callback, void* arg) {
+
+    // One path is shared by every level of the search rather than each level keeping its own
+    char path[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    uint16_t pathLength = strlen(dataFolder);
+
+    if (pathLength > SD_CARD_LAYOUT_MAX_PATH_LENGTH) {
+        return FALSE;
+    }
+
+    strcpy(path, dataFolder);
+
+    return sd_card_layout_walk(path, pathLength, 0, callback, arg, pathLength);
+}
+
+uint8_t sd_card_layout_move_images(char* dataFolder, uint8_t layout, uint32_t* numMoved) {
+
+    sd_card_layout_move_t move = {
+        .dataFolder = dataFolder,
+        .layout     = layout,
+        .numMoved   = 0,
+        .failed     = FALSE,
+    };
+
+    uint8_t result = sd_card_layout_for_each_image(dataFolder, sd_card_layout_move_image, &move);
+    *numMoved      = move.numMoved;
+
+    return ((result == TRUE) && (move.failed == FALSE)) ? TRUE : FALSE;
+}
+
+void sd_card_layout_remove_empty_folders(char* dataFolder) {
+
+    char path[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    uint16_t pathLength = strlen(dataFolder);
+
+    if (pathLength > SD_CARD_LAYOUT_MAX_PATH_LENGTH) {
+        return;
+    }
+
+    strcpy(path, dataFolder);
+    sd_card_layout_remove_folders(path, pathLength, 0);
+}
+
+static uint8_t sd_card_layout_is_date_folder(char* name) {
+
+    if (name[0] == '\0') {
+        return FALSE;
+    }
+
+    for (uint8_t i = 0; name[i] != '\0'; i++) {
+        if ((name[i] < '0') || (name[i] > '9')) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static uint8_t sd_card_layout_walk(char* path, uint16_t pathLength, uint8_t depth, sd_card_layout_callback_t callback,
+                                   void* arg, uint16_t dataFolderLength) {
+
+    DIR* directory = opendir(path);
+    if (directory == NULL) {
+        return FALSE;
+    }
+
+    struct dirent* dirPtr;
+    uint8_t result = TRUE;
+    uint32_t number;
+    dt_datetime_t datetime;
+
+    while ((result == TRUE) && ((dirPtr = readdir(directory)) != NULL)) {
+
+        uint16_t nameLength = strlen(dirPtr->d_name);
+        if ((pathLength + 1 + nameLength) > SD_CARD_LAYOUT_MAX_PATH_LENGTH) {
+            continue;
+        }
+
+        sprintf(&path[pathLength], "/%s", dirPtr->d_name);
+
+        // Only the date folders are searched so nothing else kept in the data folder is touched
+        if (dirPtr->d_type == DT_DIR) {
+            if ((depth < SD_CARD_LAYOUT_DAY) && (sd_card_layout_is_date_folder(dirPtr->d_name) == TRUE)) {
+                result =
+                    sd_card_layout_walk(path, pathLength + 1 + nameLength, depth + 1, callback, arg, dataFolderLength);
+            }
+        } else if (sd_card_layout_parse_image_name(dirPtr->d_name, &number, &datetime) == TRUE) {
+            result = callback(path, &path[dataFolderLength + 1], arg);
+        }
+
+        path[pathLength] = '\0';
+    }
+
+    closedir(directory);
+
+    return result;
+}
+
+static uint8_t sd_card_layout_move_image(char* filePath, char* imagePath, void* arg) {
+
+    sd_card_layout_move_t* move = arg;
+
+    uint32_t imageNumber;
+    dt_datetime_t datetime;
+    char* fileName = strrchr(filePath, '/') + 1;
+    sd_card_layout_parse_image_name(fileName, &imageNumber, &datetime);
+
+    char newImagePath[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    sd_card_layout_get_image_path(newImagePath, imageNumber, &datetime, move->layout);
+
+    // Images that have already been moved can be found again later in the search
+    if (strcmp(imagePath, newImagePath) == 0) {
+        return TRUE;
+    }
+
+    char newFilePath[SD_CARD_LAYOUT_MAX_PATH_LENGTH + 1];
+    if (snprintf(newFilePath, sizeof(newFilePath), "%s/%s", move->dataFolder, newImagePath) >= sizeof(newFilePath)) {
+        move->failed = TRUE;
+        return TRUE;
+    }
+
+    // Create each date folder on the way to the image. Folders that already exist fail to be made
+    char* slash = strchr(&newFilePath[strlen(move->dataFolder) + 1], '/');
+    while (slash != NULL) {
+        *slash = '\0';
+        mkdir(newFilePath, 0700);
+        *slash = '/';
+        slash  = strchr(slash + 1, '/');
+    }
+
+    if (rename(filePath, newFilePath) != 0) {
+        move->failed = TRUE;
+        return TRUE;
+    }
+
+    move->numMoved++;
+
+    return TRUE;
+}
+
+static void sd_card_layout_remove_folders(char* path, uint16_t pathLength, uint8_t depth) {
+
+    DIR* directory = opendir(path);
+    if (directory == NULL) {
+        return;
+    }
+
+    struct dirent* dirPtr;
+    while ((dirPtr = readdir(directory)) != NULL) {
+
+        uint16_t nameLength = strlen(dirPtr->d_name);
+        if ((dirPtr->d_type != DT_DIR) || (depth >= SD_CARD_LAYOUT_DAY) ||
+            (sd_card_layout_is_date_folder(dirPtr->d_name) != TRUE) ||
+            ((pathLength + 1 + nameLength) > SD_CARD_LAYOUT_MAX_PATH_LENGTH)) {
+            continue;
+        }
+
+        sprintf(&path[pathLength], "/%s", dirPtr->d_name);
+        sd_card_layout_remove_folders(path, pathLength + 1 + nameLength, depth + 1);
+
+        // Folders that still have something in them fail to be removed
+        rmdir(path);
+        path[pathLength] = '\0';
+    }
+
+    closedir(directory);
+}
@@ -0,0 +1,11 @@
+/**
+ * @file config.h
+ * @author Gian Barta-Dougall
+ * @brief Stands in for the config.h that autoconf would make for LibSerialPort. Left
+ * empty so the Linux port falls back to plain termios
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
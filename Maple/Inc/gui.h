@@ -18,6 +18,8 @@
 /* C Private Includes */
 #include "bpacket.h"
 #include "watchdog_defines.h"
+#include "maple_os.h"
+#include "maple_ring.h"
 
 /* Public Marcos */
 #define SYSTEM_STATUS_ERROR 0
@@ -44,12 +46,21 @@ typedef struct watchdog_info_t {
 typedef struct gui_initalisation_t {
     watchdog_info_t* watchdog;
     uint32_t* flags;
-    bpacket_circular_buffer_t* guiToMain;
-    bpacket_circular_buffer_t* mainToGui;
+    maple_ring_t* guiToMain;
+    maple_ring_t* mainToGui;
+    maple_os_event_t* mainEvent; // Signalled by the GUI after it pushes a bpacket for main
+    maple_os_event_t* guiEvent;  // Signalled by main after it pushes a bpacket for the GUI
 } gui_initalisation_t;
 
 void gui_init();
 
 void gui_update();
 
-DWORD WINAPI gui(void* arg);
\ No newline at end of file
+DWORD WINAPI gui(void* arg);
+
+/**
+ * @brief Wakes the GUI message loop so it checks for bpackets from main. Call after
+ * every push to the main-to-gui ring. Does nothing until the window has been made
+ *
+ */
+void gui_wake(void);
\ No newline at end of file
@@ -0,0 +1,98 @@
+/**
+ * @file maple_os.h
+ * @author Gian Barta-Dougall
+ * @brief Threads, events and timing for Maple on Windows and Linux. An event lets a
+ * thread sleep until another thread has something for it instead of spinning on the
+ * indexes of the buffers they share
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef MAPLE_OS_H
+#define MAPLE_OS_H
+
+/* C Library Includes */
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+/* Public Macros */
+#define MAPLE_OS_WAIT_FOREVER 0xFFFFFFFF
+
+typedef struct maple_os_event_t {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE changed;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+#endif
+    uint32_t count; // Number of times the event has been signalled
+} maple_os_event_t;
+
+typedef void (*maple_os_thread_function_t)(void* arg);
+
+/**
+ * @brief Starts a thread running the given function. The thread is never joined and
+ * ends when the function returns or Maple exits
+ *
+ * @return uint8_t TRUE if the thread was started else FALSE
+ */
+uint8_t maple_os_thread_create(maple_os_thread_function_t function, void* arg);
+
+void maple_os_event_init(maple_os_event_t* event);
+
+/**
+ * @brief Wakes every thread waiting on the event
+ *
+ */
+void maple_os_event_signal(maple_os_event_t* event);
+
+/**
+ * @brief Gets the number of times the event has been signalled. Read this before
+ * checking whether there is anything to do, then pass it to maple_os_event_wait()
+ * so a signal given in between is not missed
+ *
+ */
+uint32_t maple_os_event_get_count(maple_os_event_t* event);
+
+/**
+ * @brief Sleeps until the event has been signalled since its count was read
+ *
+ * @param count The count read with maple_os_event_get_count()
+ * @param timeoutMs The longest time to wait. MAPLE_OS_WAIT_FOREVER never times out
+ * @return uint8_t TRUE if the event was signalled else FALSE if the wait timed out
+ */
+uint8_t maple_os_event_wait(maple_os_event_t* event, uint32_t count, uint32_t timeoutMs);
+
+/**
+ * @brief Gets the time in ms from a clock that only ever goes forward. Unlike clock()
+ * it keeps counting while the calling thread is asleep
+ *
+ */
+uint32_t maple_os_get_time_ms(void);
+
+void maple_os_sleep_ms(uint32_t ms);
+
+/**
+ * @brief Creates a folder. Does nothing if the folder already exists
+ *
+ * @return uint8_t TRUE if the folder exists once this returns else FALSE
+ */
+uint8_t maple_os_make_dir(char* path);
+
+/**
+ * @brief Cuts an open file down to the given number of bytes
+ *
+ * @return uint8_t TRUE if the file was cut down else FALSE
+ */
+uint8_t maple_os_truncate_file(FILE* file, long numBytes);
+
+#endif // MAPLE_OS_H
@@ -0,0 +1,83 @@
+/**
+ * @file maple_ring.h
+ * @author Gian Barta-Dougall
+ * @brief Ring of bpackets passed from one thread to one other thread without locks.
+ * The producer fills a slot in place and pushes it. The consumer reads the slot in
+ * place and pops it once it is done with it, so a slot is never written while it is
+ * still being read
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef MAPLE_RING_H
+#define MAPLE_RING_H
+
+/* C Library Includes */
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* Personal Includes */
+#include "bpacket.h"
+
+/* Public Macros */
+#define MAPLE_RING_CACHE_LINE_SIZE 64
+
+typedef struct maple_ring_t {
+
+    // Producer side. The head is the number of bpackets pushed
+    _Alignas(MAPLE_RING_CACHE_LINE_SIZE) atomic_uint head;
+    bpacket_t* writeSlot;     // The slot being filled. NULL until maple_ring_get_write_slot() is called
+    atomic_uint numOverflows; // Bpackets dropped because the ring was full
+
+    // Consumer side. The tail is the number of bpackets popped
+    _Alignas(MAPLE_RING_CACHE_LINE_SIZE) atomic_uint tail;
+
+    _Alignas(MAPLE_RING_CACHE_LINE_SIZE) uint32_t size;
+    bpacket_t* slots;
+    bpacket_t overflowSlot; // Filled instead of a slot when the ring is full
+} maple_ring_t;
+
+/**
+ * @brief Sets up an empty ring using the given slots
+ *
+ * @param size The number of slots. Must be a power of 2
+ */
+void maple_ring_init(maple_ring_t* ring, bpacket_t* slots, uint32_t size);
+
+/**
+ * @brief Producer only. Gets the slot to fill with the next bpacket. The same slot is
+ * returned until maple_ring_push() is called. Never returns NULL. If the ring is full
+ * a spare slot is given instead and the bpacket is dropped if the ring is still full
+ * when it is pushed
+ *
+ */
+bpacket_t* maple_ring_get_write_slot(maple_ring_t* ring);
+
+/**
+ * @brief Producer only. Hands the filled write slot to the consumer
+ *
+ * @return uint8_t TRUE if the bpacket was pushed else FALSE if it was dropped
+ */
+uint8_t maple_ring_push(maple_ring_t* ring);
+
+/**
+ * @brief Consumer only. Gets the oldest bpacket in the ring without removing it
+ *
+ * @return bpacket_t* The bpacket or NULL if the ring is empty
+ */
+bpacket_t* maple_ring_peek(maple_ring_t* ring);
+
+/**
+ * @brief Consumer only. Removes the oldest bpacket so the producer can reuse its slot.
+ * Any pointer to it from maple_ring_peek() must not be used after this
+ *
+ */
+void maple_ring_pop(maple_ring_t* ring);
+
+uint8_t maple_ring_is_empty(maple_ring_t* ring);
+
+uint32_t maple_ring_get_num_overflows(maple_ring_t* ring);
+
+#endif // MAPLE_RING_H
@@ -0,0 +1,60 @@
+/**
+ * @file maple_sim.h
+ * @author Gian Barta-Dougall
+ * @brief Simulated Watchdogs on pseudo terminals so several devices can be run
+ * without the hardware. Each simulated device answers pings, extended framing, benchmark
+ * requests, datetime updates, settings, streamed frames and copies from a small image index
+ * and rejects everything else. Transfers are windowed the same way the ESP32 sends them.
+ * Only built on Linux
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef MAPLE_SIM_H
+#define MAPLE_SIM_H
+
+/* C Library Includes */
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Opens a pseudo terminal pair and starts a simulated Watchdog on one end
+ *
+ * @return int The file descriptor of the other end that Maple talks to the device
+ * through or -1 if the device could not be started
+ */
+int maple_sim_start_device(void);
+
+/**
+ * @brief Closes Maple's end of a simulated device. The device stops once it sees the
+ * pseudo terminal has been closed
+ *
+ */
+void maple_sim_stop_device(int fd);
+
+/**
+ * @brief Limits how fast every simulated device sends to what a UART at the given baud
+ * rate could send so transfer times can be compared with the real hardware
+ *
+ * @param baudRate The baud rate to simulate. 0 sends as fast as the pseudo terminal allows
+ */
+void maple_sim_set_baud_rate(uint32_t baudRate);
+
+/**
+ * @brief Reads whatever has arrived from a simulated device, up to count bytes
+ *
+ * @param timeoutMs The longest time to wait for a byte. 0 waits forever
+ * @return int The number of bytes read, 0 if none arrived in time or -1 on error
+ */
+int maple_sim_read(int fd, void* buf, size_t count, uint32_t timeoutMs);
+
+/**
+ * @brief Writes every byte to a simulated device
+ *
+ * @return int The number of bytes written or -1 on error
+ */
+int maple_sim_write(int fd, void* buf, size_t count);
+
+#endif // MAPLE_SIM_H
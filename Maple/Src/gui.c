@@ -101,6 +101,8 @@
 #define CAMERA_VIEW SW_HIDE
 #define NORMAL_VIEW SW_SHOW
 
+#define GUI_SETTINGS_TIMEOUT 5000
+
 // Struct that contains all of the settings
 
 typedef struct rectangle_t {
@@ -117,15 +119,17 @@ uint8_t draw_image(HWND hwnd, char* filePath, rectangle_t* position);
 void draw_rectangle(HWND hwnd, rectangle_t* rectangle, uint8_t r, uint8_t g, uint8_t b);
 void gui_update_camera_view(char* fileName);
 void send_current_settings(void);
+void gui_send_to_main(void);
 
 // Create instances of structs that are used for the GUI
 watchdog_info_t* watchdog;
 uint32_t* flags;
-bpacket_circular_buffer_t* guiToMainCircularBuffer;
-bpacket_circular_buffer_t* mainToGuiCircularBuffer;
+maple_ring_t* guiToMainRing;
+maple_ring_t* mainToGuiRing;
+maple_os_event_t* mainEvent;
+maple_os_event_t* guiEvent;
+HWND guiWindow = NULL; // Set once the window is made so main can wake the message loop
 
-// Macro that takes the bpacket out of the circular buffer at the read index
-#define MTG_CB_CURRENT_BPACKET (mainToGuiCircularBuffer->circularBuffer[*mainToGuiCircularBuffer->readIndex])
 
 /*
  * Here all of the structs are made and populated with all of the current information of from the ESP32, start time,
@@ -499,6 +503,7 @@ uint8_t click_off_interval_tb(HWND hwnd) {
 }
 
 int cameraViewOn = FALSE;
+HWND labelStreamFps; // The frames per second the camera view is receiving
 
 // This function is for changing from normal -> camera view and back, takes CAMERA_VIEW and NORMAL_VIEW view macros,
 // these are just SW_HIDE and SW_SHOW respectively
@@ -537,28 +542,28 @@ void gui_change_view(int cameraViewMode, HWND hwnd) {
 void send_current_camera_settings(void) {
 
     uint8_t result = wd_camera_settings_to_bpacket(
-        guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex], BPACKET_ADDRESS_ESP32,
+        maple_ring_get_write_slot(guiToMainRing), BPACKET_ADDRESS_ESP32,
         BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_SET_CAMERA_SETTINGS, BPACKET_CODE_EXECUTE, &cameraSettings);
     if (result != TRUE) {
         char msg[50];
         wd_get_error(result, msg);
         printf(msg);
     }
-    bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+    gui_send_to_main();
     return;
 }
 
 void send_current_capture_time_settings(void) {
 
     uint8_t result = wd_capture_time_settings_to_bpacket(
-        guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex], BPACKET_ADDRESS_STM32,
+        maple_ring_get_write_slot(guiToMainRing), BPACKET_ADDRESS_STM32,
         BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS, BPACKET_CODE_EXECUTE, &captureTime);
     if (result != TRUE) {
         char msg[50];
         wd_get_error(result, msg);
         printf(msg);
     }
-    bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+    gui_send_to_main();
     return;
 }
 
@@ -578,14 +583,14 @@ void send_current_date_time(void) {
         .time = {.second = timeinfo->tm_sec, .minute = timeinfo->tm_min, .hour = timeinfo->tm_hour},
         .date = {.day = timeinfo->tm_mday, .month = timeinfo->tm_mon + 1, .year = timeinfo->tm_year + 1900}};
     uint8_t result = wd_datetime_to_bpacket(
-        guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex], BPACKET_ADDRESS_STM32,
+        maple_ring_get_write_slot(guiToMainRing), BPACKET_ADDRESS_STM32,
         BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_SET_DATETIME, BPACKET_CODE_EXECUTE, &dateTime);
     if (result != TRUE) {
         char msg[50];
         wd_get_error(result, msg);
         printf(msg);
     }
-    bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+    gui_send_to_main();
     return;
 }
 
@@ -626,6 +631,9 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                                                    labelList[i].width, labelList[i].height, hwnd, NULL);
             }
 
+            labelStreamFps = create_label("", COL_4, ROW_2, LABEL_WIDTH, LABEL_HEIGHT, hwnd, NULL);
+            ShowWindow(labelStreamFps, SW_HIDE);
+
             break;
 
         case WM_COMMAND:
@@ -635,20 +643,20 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 *flags |= GUI_TURN_RED_LED_ON;
                 // TODO: decide what is going to happen when this button is clicked
 
-                bpacket_create_p(guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex],
+                bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
                                  BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, BPACKET_CODE_EXECUTE,
                                  WATCHDOG_BPK_R_LED_RED_ON, 0, NULL);
-                bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+                gui_send_to_main();
             }
 
             if ((HWND)lParam == buttonList[BUTTON_EXPORT_DATA].handle) {
                 *flags |= GUI_TURN_RED_LED_OFF;
                 // TODO: decide what is going to happen when this button is clicked
 
-                bpacket_create_p(guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex],
+                bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
                                  BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, BPACKET_CODE_EXECUTE,
                                  WATCHDOG_BPK_R_LED_RED_OFF, 0, NULL);
-                bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+                gui_send_to_main();
                 // printf("Exporting SD card data\n");
             }
 
@@ -657,16 +665,18 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 gui_change_view(CAMERA_VIEW, hwnd);
 
                 printf("Starting livestream\n");
+                SetWindowText(labelStreamFps, "Starting stream");
+                ShowWindow(labelStreamFps, SW_SHOW);
                 InvalidateRect(hwnd, NULL, TRUE);
                 rectangle_t rectangle;
                 rectangle.startX = COL_1;
                 rectangle.startY = ROW_3;
                 rectangle.width  = 600;
                 rectangle.height = 480;
-                bpacket_create_p(guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex],
-                                 BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, BPACKET_CODE_EXECUTE,
-                                 WATCHDOG_BPK_R_STREAM_IMAGE, 0, NULL);
-                bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+                bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
+                                 BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_STREAM_IMAGE,
+                                 BPACKET_CODE_EXECUTE, 0, NULL);
+                gui_send_to_main();
 
                 draw_image(hwnd, CAMERA_VIEW_FILENAME, &rectangle);
             }
@@ -681,15 +691,22 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             }
 
             if ((HWND)lParam == buttonList[BUTTON_POLL_STATUS].handle) {
-                bpacket_create_p(guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex],
+                bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
                                  BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE, BPACKET_CODE_EXECUTE,
                                  WATCHDOG_BPK_R_GET_STATUS, 0, NULL);
-                bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+                gui_send_to_main();
             }
 
             if ((HWND)lParam == buttonList[BUTTON_NORMAL_VIEW].handle) {
                 cameraViewOn = FALSE;
 
+                // Stop asking for frames and let the ESP32 end the stream session
+                ShowWindow(labelStreamFps, SW_HIDE);
+                bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
+                                 BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_STOP_STREAM,
+                                 BPACKET_CODE_EXECUTE, 0, NULL);
+                gui_send_to_main();
+
                 // Clear the screen
                 rectangle_t rectangle;
                 rectangle.startX = COL_1;
@@ -824,11 +841,13 @@ DWORD WINAPI gui(void* arg) {
     gui_initalisation_t* guiInit = (gui_initalisation_t*)arg;
     watchdog                     = guiInit->watchdog;
     flags                        = guiInit->flags;
-    guiToMainCircularBuffer      = guiInit->guiToMain;
-    mainToGuiCircularBuffer      = guiInit->mainToGui;
+    guiToMainRing                = guiInit->guiToMain;
+    mainToGuiRing                = guiInit->mainToGui;
+    mainEvent                    = guiInit->mainEvent;
+    guiEvent                     = guiInit->guiEvent;
 
     /* GET THE CAPTURE TIME SETTINGS*/
-    uint8_t result = bpacket_create_p(guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex],
+    uint8_t result = bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
                                       BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE,
                                       WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS, BPACKET_CODE_EXECUTE, 0, NULL);
     if (result != TRUE) {
@@ -836,10 +855,10 @@ DWORD WINAPI gui(void* arg) {
         bpacket_get_error(result, msg);
         printf("%s\n", msg);
     }
-    bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+    gui_send_to_main();
 
     /* GET THE CAMERA SETTINGS*/
-    result = bpacket_create_p(guiToMainCircularBuffer->circularBuffer[*guiToMainCircularBuffer->writeIndex],
+    result = bpacket_create_p(maple_ring_get_write_slot(guiToMainRing),
                               BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE, WATCHDOG_BPK_R_GET_CAMERA_SETTINGS,
                               BPACKET_CODE_EXECUTE, 0, NULL);
     if (result != TRUE) {
@@ -847,7 +866,7 @@ DWORD WINAPI gui(void* arg) {
         bpacket_get_error(result, msg);
         printf("%s\n", msg);
     }
-    bpacket_increment_circular_buffer_index(guiToMainCircularBuffer->writeIndex);
+    gui_send_to_main();
 
     cameraViewImagePosition.startX = COL_1;
     cameraViewImagePosition.startY = ROW_2;
@@ -879,40 +898,44 @@ DWORD WINAPI gui(void* arg) {
 
     bpacket_t* receivedBpacket;
     cameraSettingsFlag = FALSE;
-    clock_t time       = clock();
+    uint32_t startTime = maple_os_get_time_ms();
     // Before it goes into the main loop the settings need to be returned
     while (cameraSettingsFlag == FALSE || captureTimeFlag == FALSE) {
-        // printf("Y\n");
-        if ((clock() - time) > 5000) {
+        uint32_t elapsed = maple_os_get_time_ms() - startTime;
+        if (elapsed > GUI_SETTINGS_TIMEOUT) {
             printf("Time out when receiving camera settings\n");
             break;
         }
-        if (*mainToGuiCircularBuffer->readIndex != *mainToGuiCircularBuffer->writeIndex) {
-
-            receivedBpacket = MTG_CB_CURRENT_BPACKET;
-            bpacket_increment_circular_buffer_index(mainToGuiCircularBuffer->readIndex);
-
-            if (receivedBpacket->request == WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS) {
-                wd_bpacket_to_capture_time_settings(receivedBpacket, &captureTime);
-                wd_camera_capture_time_settings_t tempTime;
-                wd_bpacket_to_capture_time_settings(receivedBpacket, &tempTime);
-                printf("HAYDEN PRINT: received capture time settings in GUI, start time: %i:%i\n",
-                       tempTime.startTime.hour, tempTime.startTime.minute);
-                text_box_default_text(captureTime);
-                captureTimeFlag = TRUE;
-            }
-            if (receivedBpacket->request == WATCHDOG_BPK_R_GET_CAMERA_SETTINGS) {
-                wd_bpacket_to_camera_settings(receivedBpacket, &cameraSettings);
-                cameraSettingsFlag = TRUE;
-            }
 
-            if (receivedBpacket->request == WATCHDOG_BPK_R_GET_STATUS) {
-                for (int i = 0; i < receivedBpacket->numBytes; i++) {
-                    printf("%c", receivedBpacket->bytes[i]);
-                }
-                printf("\n");
+        // Sleep until main has a bpacket for the GUI
+        uint32_t eventCount = maple_os_event_get_count(guiEvent);
+        if ((receivedBpacket = maple_ring_peek(mainToGuiRing)) == NULL) {
+            maple_os_event_wait(guiEvent, eventCount, GUI_SETTINGS_TIMEOUT - elapsed);
+            continue;
+        }
+
+        if (receivedBpacket->request == WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS) {
+            wd_bpacket_to_capture_time_settings(receivedBpacket, &captureTime);
+            wd_camera_capture_time_settings_t tempTime;
+            wd_bpacket_to_capture_time_settings(receivedBpacket, &tempTime);
+            printf("HAYDEN PRINT: received capture time settings in GUI, start time: %i:%i\n",
+                   tempTime.startTime.hour, tempTime.startTime.minute);
+            text_box_default_text(captureTime);
+            captureTimeFlag = TRUE;
+        }
+        if (receivedBpacket->request == WATCHDOG_BPK_R_GET_CAMERA_SETTINGS) {
+            wd_bpacket_to_camera_settings(receivedBpacket, &cameraSettings);
+            cameraSettingsFlag = TRUE;
+        }
+
+        if (receivedBpacket->request == WATCHDOG_BPK_R_GET_STATUS) {
+            for (int i = 0; i < receivedBpacket->numBytes; i++) {
+                printf("%c", receivedBpacket->bytes[i]);
             }
+            printf("\n");
         }
+
+        maple_ring_pop(mainToGuiRing);
     }
     // Callibrate real time clock
     send_current_date_time();
@@ -929,6 +952,10 @@ DWORD WINAPI gui(void* arg) {
 
     ShowWindow(hwnd, SW_SHOWNORMAL);
     UpdateWindow(hwnd);
+    guiWindow = hwnd;
+
+    // Bpackets main pushed before the window was made have no message to wake the loop
+    gui_wake();
     // Free the memory for the default text box text
     free_text_box_default_text();
 
@@ -944,11 +971,8 @@ DWORD WINAPI gui(void* arg) {
         }
 
         // If a Bpacket is received from main, deal with it in here
-        if (*mainToGuiCircularBuffer->readIndex != *mainToGuiCircularBuffer->writeIndex) {
+        if ((receivedBpacket = maple_ring_peek(mainToGuiRing)) != NULL) {
             printf("Start Time: %i\n", captureTime.startTime.hour);
-
-            receivedBpacket = MTG_CB_CURRENT_BPACKET;
-            bpacket_increment_circular_buffer_index(mainToGuiCircularBuffer->readIndex);
             if (receivedBpacket->code != TRUE) {
 
                 char msg[50];
@@ -967,6 +991,14 @@ DWORD WINAPI gui(void* arg) {
                 rectangle.height = 480;
                 draw_rectangle(hwnd, &rectangle, 255, 255, 255);
                 draw_image(hwnd, CAMERA_VIEW_FILENAME, &rectangle);
+
+                // Main counts the frames per second over a short period. 0 until the first period is up
+                uint16_t fpsX100 = (receivedBpacket->bytes[0] << 8) | receivedBpacket->bytes[1];
+                if ((receivedBpacket->numBytes == 2) && (fpsX100 != 0)) {
+                    char fps[30];
+                    sprintf(fps, "%u.%02u fps", fpsX100 / 100, fpsX100 % 100);
+                    SetWindowText(labelStreamFps, fps);
+                }
             }
             // if (receivedBpacket->request == WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS) {
             //     wd_camera_capture_time_settings_t tempTime;
@@ -976,6 +1008,8 @@ DWORD WINAPI gui(void* arg) {
             // }
             // The bpacket is now received, now it can be one of a bunch of possible requets.
             // Now check which request it is and do what you need to do
+
+            maple_ring_pop(mainToGuiRing);
         }
         // switch (receivedBpacket->request) {
         //     case WATCHDOG_BPK_R_GET_DATETIME:
@@ -987,6 +1021,22 @@ DWORD WINAPI gui(void* arg) {
     return FALSE;
 }
 
+void gui_wake(void) {
+
+    // Posting a message makes GetMessage() return so the loop checks the main-to-gui ring
+    if (guiWindow != NULL) {
+        PostMessage(guiWindow, WM_NULL, 0, 0);
+    }
+}
+
+void gui_send_to_main(void) {
+    if (maple_ring_push(guiToMainRing) != TRUE) {
+        printf("Main is behind. Dropped %u bpackets\n", maple_ring_get_num_overflows(guiToMainRing));
+    }
+
+    maple_os_event_signal(mainEvent);
+}
+
 /* Private Functions */
 
 uint8_t draw_image(HWND hwnd, char* filePath, rectangle_t* position) {
@@ -18,8 +18,9 @@
 /* C Library Includes */
 #include <string.h>
 #include <stdio.h>
-#include <windows.h> // Use for multi threading
-#include "time.h"    // Use for ms timer
+#include <stdlib.h>
+#include <stdarg.h>
+#include "time.h"
 
 /* C Library Includes for COM Port Interfacing */
 #include <libserialport.h>
@@ -29,18 +30,118 @@
 #include "uart_lib.h"
 #include "watchdog_defines.h"
 #include "bpacket.h"
-#include "gui.h"
+#include "bpacket_parser.h"
+#include "maple_os.h"
+#include "maple_ring.h"
+#ifdef _WIN32
+    #include "gui.h"
+#else
+    #include "maple_sim.h"
+#endif
 #include "datetime.h"
 #include "uart_lib.h"
 #include "bpacket.h"
 
 #define MAPLE_MAX_ARGS     5
-#define PACKET_BUFFER_SIZE 50
-
-bpacket_circular_buffer_t guiToMainCircularBuffer1;
-bpacket_circular_buffer_t mainToGuiCircularBuffer1;
-
-#define GTM_CB_CURRENT_BPACKET (guiToMainCircularBuffer1.circularBuffer[*guiToMainCircularBuffer1.readIndex])
+#define PACKET_BUFFER_SIZE 64 // Must be a power of 2
+#define MAPLE_GUI_RING_SIZE 16 // Must be a power of 2
+#define MAPLE_RX_READ_SIZE BPACKET_EXT_MAX_NUM_DATA_BYTES // Max bytes read from the port at once
+
+// Must be shorter than the time the ESP32 waits for a NACK but longer than the largest
+// checked bpacket takes to arrive at MAPLE_DEFAULT_BAUD_RATE (about 360ms)
+#define MAPLE_TRANSFER_TIMEOUT    500
+#define MAPLE_MAX_NACK_ROUNDS     5
+#define MAPLE_MAX_TRANSFER_CHUNKS BPACKET_MAX_NUM_CHUNKS // Every sequence number a sender can use
+#define MAPLE_TRANSFER_WINDOW     (PACKET_BUFFER_SIZE / 2) // Max bpackets in flight. Must fit in the packet buffer
+
+#define MAPLE_DEFAULT_BAUD_RATE   115200 // Every link starts at this baud rate
+#define MAPLE_NUM_BAUD_RATES      5
+#define MAPLE_BAUD_REPLY_TIMEOUT  500
+#define MAPLE_BAUD_SETTLE_TIME    20   // Time given to the STM32 to change its baud rate
+#define MAPLE_LINK_REPLY_TIMEOUT  3000 // The STM32 waits on the ESP32 before it replies
+#define MAPLE_BENCHMARK_NUM_BYTES 65536
+#define MAPLE_LIST_DIR_PAGE_SIZE  50 // Number of entries asked for in each WATCHDOG_BPK_R_LIST_DIR request
+#define MAPLE_LIST_DIR_TIMEOUT    3000
+#define MAPLE_BURST_TIMEOUT       10000 // Time given to a burst on top of the interval and save time of each frame
+#define MAPLE_BURST_FRAME_TIMEOUT 1000  // Time given to save each frame of a burst
+#define MAPLE_STREAM_FPS_PERIOD   1000  // The frames per second shown in the camera view are counted over this time
+#define MAPLE_PING_TIMEOUT        200
+#define MAPLE_DATETIME_TIMEOUT    1000
+#define MAPLE_PROBE_TIMEOUT       50 // Time every port is given to answer at each baud rate when connecting
+#define MAPLE_MAX_NUM_DEVICES     16
+#define MAPLE_MAX_NUM_PORTS       32
+#define MAPLE_DEVICE_NAME_SIZE    64
+
+#define MAPLE_PORT_CACHE_FILE_NAME "maple_ports.txt" // The port and baud rate of each device found last time
+#define MAPLE_STREAM_FILE_NAME     "streamImage.jpg" // Each streamed frame is written over this unless given a folder
+#define MAPLE_PART_FILE_EXTENSION  ".part"           // Added to images until they have been downloaded in full
+#define MAPLE_PATH_SIZE            256
+
+#define MAPLE_NUM_RESOLUTIONS    7
+#define MAPLE_SETTING_RESOLUTION 0x01
+#define MAPLE_SETTING_START      0x02
+#define MAPLE_SETTING_END        0x04
+#define MAPLE_SETTING_INTERVAL   0x08
+
+typedef struct maple_device_t {
+    uint8_t index; // Position in devices[]. Used as the id of its RX parser
+    char name[MAPLE_DEVICE_NAME_SIZE];
+    struct sp_port* port; // NULL if the device is simulated
+    int simFd;            // The pseudo terminal of a simulated device. -1 otherwise
+
+    // The RX thread decodes bpackets straight into the slots of the RX ring
+    maple_ring_t rxRing;
+    bpacket_t rxBpackets[PACKET_BUFFER_SIZE];
+    uint8_t holdingResponse; // TRUE while the last response given out is still in the RX ring
+
+    // Signalled whenever the RX thread or the GUI has a bpacket for the thread talking to the device
+    maple_os_event_t event;
+
+    uint8_t transferWindow; // Number of bpackets the ESP32 sends before waiting for an ACK. 0 if disabled
+    uint32_t baudRate;      // Baud rate both links are running at
+
+    // Tracks which chunks of a checked transfer have been written to the file
+    uint8_t chunkReceived[MAPLE_MAX_TRANSFER_CHUNKS];
+    uint32_t numBytesInOrder; // Bytes at the start of the last transfer that were received without any gaps
+} maple_device_t;
+
+// A port being pinged while Maple looks for devices
+typedef struct maple_probe_t {
+    struct sp_port* port;
+    bpacket_parser_t parser;
+    bpacket_t response;
+    uint32_t baudRates[MAPLE_NUM_BAUD_RATES]; // In the order they are tried
+    uint32_t cachedBaudRate;                  // The baud rate the port answered at last time. 0 if it didn't
+    uint32_t baudRate;                        // The baud rate the port answered at
+    uint8_t waiting;                          // TRUE until the port answers or has been tried at every baud rate
+    uint8_t answered;
+} maple_probe_t;
+
+typedef uint8_t (*maple_operation_t)(void* arg);
+
+typedef struct maple_fan_out_t {
+    maple_operation_t operation;
+    void* arg; // Passed to the operation on every device
+    uint8_t results[MAPLE_MAX_NUM_DEVICES];
+} maple_fan_out_t;
+
+// Totals kept by each device while syncing
+typedef struct maple_sync_t {
+    char* dest; // Folder the images are saved to
+    uint32_t numFiles[MAPLE_MAX_NUM_DEVICES];
+    uint32_t numFailed[MAPLE_MAX_NUM_DEVICES];
+    long numBytes[MAPLE_MAX_NUM_DEVICES]; // Bytes received. Images that were skipped are not counted
+} maple_sync_t;
+
+typedef struct maple_settings_change_t {
+    uint8_t changed; // MAPLE_SETTING_ flags of the settings that were given
+    wd_settings_t settings;
+} maple_settings_change_t;
+
+typedef struct maple_worker_t {
+    maple_device_t* device;
+    maple_fan_out_t* fanOut;
+} maple_worker_t;
 
 /* Example of how to get a list of serial ports on the system.
  *
@@ -52,44 +153,158 @@ void maple_create_and_send_bpacket(uint8_t request, uint8_t receiver, uint8_t nu
 void maple_create_and_send_sbpacket(uint8_t request, uint8_t receiver, char* string);
 void maple_print_uart_response(void);
 uint8_t maple_match_args(char** args, int numArgs);
+uint8_t maple_get_response(bpacket_t** bpacket, uint8_t request, uint16_t timeout);
+uint16_t maple_negotiate_ext_framing(void);
+uint8_t maple_receive_transfer(FILE* target, uint8_t request);
+void maple_send_nack(uint16_t* sequences, uint8_t numSequences);
+void maple_send_ack(uint16_t numChunksReceived);
 void maple_command_line(void);
 void maple_test(void);
+uint8_t maple_set_link_baud_rate(uint8_t link, uint32_t newBaudRate);
+uint32_t maple_negotiate_baud_rate(void);
+void maple_benchmark(void);
+int maple_goodput(void);
+uint8_t maple_get_image_index(uint32_t firstRecord);
+uint8_t maple_list_directory(char* path, char* pattern);
+uint8_t maple_take_burst(wd_burst_t* burst);
+bpacket_t* maple_wait_for_bpacket_response(uint32_t timeoutMs);
+uint8_t maple_connect_to_devices(void);
+void maple_run_on_all_devices(maple_fan_out_t* fanOut);
+void maple_device_print(char* format, ...);
+uint8_t maple_all_devices(char* operation);
+long maple_benchmark_transfer(uint32_t* timeMs);
+uint8_t maple_download_image_index(FILE* target, uint32_t firstRecord);
+
+bpacket_t guiToMainBpackets[MAPLE_GUI_RING_SIZE];
+bpacket_t mainToGuiBpackets[MAPLE_GUI_RING_SIZE];
+
+maple_ring_t guiToMainRing;
+maple_ring_t mainToGuiRing;
+
+maple_os_event_t guiEvent;   // Signalled whenever main has a bpacket for the GUI
+maple_os_event_t fanOutDone; // Signalled by each device when it finishes an operation run on every device
+
+// Every Watchdog that answered a ping. The GUI and the command line talk to the first one
+maple_device_t* devices[MAPLE_MAX_NUM_DEVICES];
+uint8_t numDevices = 0;
+
+// The device the calling thread is talking to. Each thread that talks to a device sets its own
+_Thread_local maple_device_t* activeDevice = NULL;
+// Set by maple_ping_received() for the parser with that id on the thread probing the ports
+_Thread_local uint8_t pingAnswered[MAPLE_MAX_NUM_PORTS];
+
+// Baud rates tried when ramping up the links, slowest first
+uint32_t mapleBaudRates[MAPLE_NUM_BAUD_RATES] = {MAPLE_DEFAULT_BAUD_RATE, 230400, 460800, 921600, 2000000};
+
+// Resolutions that can be given to 'settings set'
+uint8_t mapleResolutions[MAPLE_NUM_RESOLUTIONS] = {WD_CAM_RES_320x240,  WD_CAM_RES_352x288,   WD_CAM_RES_640x480,
+                                                   WD_CAM_RES_800x600,  WD_CAM_RES_1024x768,  WD_CAM_RES_1280x1024,
+                                                   WD_CAM_RES_1600x1200};
+char* mapleResolutionNames[MAPLE_NUM_RESOLUTIONS] = {"320x240",  "352x288",   "640x480",  "800x600",
+                                                     "1024x768", "1280x1024", "1600x1200"};
+
+int maple_device_write(maple_device_t* device, void* buf, size_t count) {
+
+#ifndef _WIN32
+    if (device->port == NULL) {
+        return maple_sim_write(device->simFd, buf, count);
+    }
+#endif
+
+    return sp_blocking_write(device->port, buf, count, 100);
+}
+
+int maple_device_read(maple_device_t* device, void* buf, size_t count, unsigned int timeout_ms) {
+
+#ifndef _WIN32
+    if (device->port == NULL) {
+        return maple_sim_read(device->simFd, buf, count, timeout_ms);
+    }
+#endif
 
-uint8_t guiWriteIndex  = 0;
-uint8_t guiReadIndex   = 0;
-uint8_t mainWriteIndex = 0;
-uint8_t mainReadIndex  = 0;
+    // Returns as soon as any bytes are available instead of waiting for all of them
+    return sp_blocking_read_next(device->port, buf, count, timeout_ms);
+}
 
-bpacket_t guiToMainBpackets[BPACKET_CIRCULAR_BUFFER_SIZE];
-bpacket_t mainToGuiBpackets[BPACKET_CIRCULAR_BUFFER_SIZE];
+void maple_device_set_baud_rate(maple_device_t* device, uint32_t newBaudRate) {
 
-uint32_t packetBufferIndex  = 0;
-uint32_t packetPendingIndex = 0;
-bpacket_t packetBuffer[PACKET_BUFFER_SIZE];
+    // Simulated devices run as fast as the pseudo terminal allows
+    if (device->port == NULL) {
+        return;
+    }
 
-struct sp_port* activePort = NULL;
+    sp_drain(device->port);
+    sp_set_baudrate(device->port, newBaudRate);
+}
 
 uint8_t maple_send_bpacket(bpacket_t* bpacket) {
 
     bpacket_buffer_t packetBuffer;
     bpacket_to_buffer(bpacket, &packetBuffer);
 
-    if (sp_blocking_write(activePort, packetBuffer.buffer, packetBuffer.numBytes, 100) < 0) {
+    if (maple_device_write(activeDevice, packetBuffer.buffer, packetBuffer.numBytes) < 0) {
         return FALSE;
     }
 
     return TRUE;
 }
 
+void maple_device_print(char* format, ...) {
+
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    // Printed in one go so lines from devices running at the same time are not mixed together
+    printf("[%s] %s", activeDevice->name, message);
+}
+
 bpacket_t* maple_get_next_bpacket_response(void) {
 
-    if (packetPendingIndex == packetBufferIndex) {
-        return NULL;
+    // The last response stays in its slot until the next one is asked for so the RX
+    // thread can't decode over it while the caller is still reading it
+    if (activeDevice->holdingResponse == TRUE) {
+        maple_ring_pop(&activeDevice->rxRing);
+        activeDevice->holdingResponse = FALSE;
+    }
+
+    bpacket_t* bpacket = maple_ring_peek(&activeDevice->rxRing);
+    if (bpacket != NULL) {
+        activeDevice->holdingResponse = TRUE;
     }
 
-    bpacket_t* buffer = &packetBuffer[packetPendingIndex];
-    bpacket_increment_circ_buff_index(&packetPendingIndex, PACKET_BUFFER_SIZE);
-    return buffer;
+    return bpacket;
+}
+
+bpacket_t* maple_wait_for_bpacket_response(uint32_t timeoutMs) {
+
+    uint32_t startTime = maple_os_get_time_ms();
+
+    while (1) {
+
+        // The count is read first so a bpacket that arrives after the check still wakes the wait
+        uint32_t eventCount = maple_os_event_get_count(&activeDevice->event);
+        bpacket_t* bpacket  = maple_get_next_bpacket_response();
+
+        if (bpacket != NULL) {
+            return bpacket;
+        }
+
+        uint32_t waitTime = 0;
+        if (timeoutMs != MAPLE_OS_WAIT_FOREVER) {
+            uint32_t elapsed = maple_os_get_time_ms() - startTime;
+            if (elapsed >= timeoutMs) {
+                return NULL;
+            }
+
+            waitTime = timeoutMs - elapsed;
+        }
+
+        maple_os_event_wait(&activeDevice->event, eventCount,
+                            (timeoutMs == MAPLE_OS_WAIT_FOREVER) ? timeoutMs : waitTime);
+    }
 }
 
 void maple_create_and_send_bpacket(uint8_t request, uint8_t receiver, uint8_t numDataBytes, uint8_t* data) {
@@ -138,404 +353,1920 @@ void maple_print_bpacket_data(bpacket_t* bpacket) {
     }
 }
 
-void maple_print_uart_response(void) {
+void maple_print_uart_response(void) {
+
+    int packetsFinished = FALSE;
+    while (packetsFinished == FALSE) {
+
+        // Wait until the packet is ready
+        bpacket_t* bpacket = maple_wait_for_bpacket_response(MAPLE_OS_WAIT_FOREVER);
+
+        // Packet ready. Print its contents
+        for (int i = 0; i < bpacket->numBytes; i++) {
+            printf("%c", bpacket->bytes[i]);
+        }
+
+        if (bpacket->request == BPACKET_CODE_SUCCESS) {
+            packetsFinished = TRUE;
+        }
+    }
+}
+
+void maple_bpacket_received(uint8_t id, bpacket_t* bpacket) {
+
+    maple_device_t* device = devices[id];
+
+    // Print out the data of the bpacket if the bpacket was a message
+    if ((bpacket->request == BPACKET_GEN_R_MESSAGE) || (bpacket->code == BPACKET_CODE_ERROR)) {
+
+        if (numDevices > 1) {
+            printf("[%s] ", device->name);
+        }
+
+        switch (bpacket->code) {
+
+            case BPACKET_CODE_SUCCESS:
+                printf(ASCII_COLOR_GREEN);
+                break;
+
+            case BPACKET_CODE_DEBUG:
+                printf(ASCII_COLOR_BLUE);
+                break;
+
+            case BPACKET_CODE_TODO:
+                printf(ASCII_COLOR_MAGENTA);
+                break;
+
+            case BPACKET_CODE_ERROR:
+                printf(ASCII_COLOR_RED);
+                break;
+
+            default:
+                break;
+        }
+
+        for (int i = 0; i < bpacket->numBytes; i++) {
+            printf("%c", bpacket->bytes[i]);
+        }
+        printf(ASCII_COLOR_WHITE);
+    }
+
+    // Hand the bpacket to the main thread so the next one is decoded into the next slot
+    if (maple_ring_push(&device->rxRing) != TRUE) {
+        printf("%s[%s] RX ring full. Dropped %u bpackets%s\n", ASCII_COLOR_RED, device->name,
+               maple_ring_get_num_overflows(&device->rxRing), ASCII_COLOR_WHITE);
+    }
+
+    maple_os_event_signal(&device->event);
+}
+
+void maple_unframed_bytes(uint8_t id, uint8_t* data, uint32_t numBytes) {
+    fwrite(data, 1, numBytes, stdout);
+}
+
+void maple_listen_rx(void* arg) {
+
+    maple_device_t* device = arg;
+    static _Thread_local uint8_t rxBytes[MAPLE_RX_READ_SIZE];
+    bpacket_parser_t parser;
+    int numBytes;
+
+    bpacket_parser_init(&parser, device->index, BPACKET_ADDRESS_MAPLE, maple_ring_get_write_slot(&device->rxRing),
+                        maple_bpacket_received);
+    parser.unframed_bytes = maple_unframed_bytes;
+
+    // Read whatever has arrived, up to a full extended bpacket at a time
+    while ((numBytes = maple_device_read(device, rxBytes, MAPLE_RX_READ_SIZE, 0)) >= 0) {
+
+        uint32_t numBytesParsed = 0;
+
+        while (numBytesParsed < (uint32_t)numBytes) {
+            numBytesParsed += bpacket_parser_parse(&parser, &rxBytes[numBytesParsed], numBytes - numBytesParsed);
+            parser.bpacket = maple_ring_get_write_slot(&device->rxRing);
+        }
+    }
+
+    printf("[%s] Error reading COM port\n", device->name);
+}
+
+void maple_ping_received(uint8_t id, bpacket_t* bpacket) {
+
+    // Confirm the request is valid and the ping code was correct
+    if ((bpacket->request == BPACKET_GEN_R_PING) && (bpacket->numBytes > 0) &&
+        (bpacket->bytes[0] == WATCHDOG_PING_CODE_STM32)) {
+        pingAnswered[id] = TRUE;
+    }
+}
+
+uint8_t maple_ping_device(maple_device_t* device) {
+
+    // Send a ping
+    bpacket_t bpacket;
+    bpacket_buffer_t bpacketBuffer;
+    bpacket_create_p(&bpacket, BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE, BPACKET_GEN_R_PING, BPACKET_CODE_EXECUTE,
+                     0, NULL);
+    bpacket_to_buffer(&bpacket, &bpacketBuffer);
+
+    if (maple_device_write(device, bpacketBuffer.buffer, bpacketBuffer.numBytes) < 0) {
+        printf("Unable to write\n");
+        return FALSE;
+    }
+
+    // The RX thread is only started once the device has answered so the reply is read here.
+    // Response may include other incoming messages as well, not just a response to a ping
+    bpacket_t response;
+    bpacket_parser_t parser;
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_MAPLE, &response, maple_ping_received);
+    pingAnswered[0] = FALSE;
+
+    uint8_t rxBytes[BPACKET_BUFFER_LENGTH_BYTES];
+    uint32_t startTime = maple_os_get_time_ms();
+    uint32_t elapsed;
+    while ((elapsed = maple_os_get_time_ms() - startTime) < MAPLE_PING_TIMEOUT) {
+
+        int numBytes = maple_device_read(device, rxBytes, sizeof(rxBytes), MAPLE_PING_TIMEOUT - elapsed);
+        if (numBytes < 0) {
+            return FALSE;
+        }
+
+        uint32_t numBytesParsed = 0;
+        while ((numBytesParsed < (uint32_t)numBytes) && (pingAnswered[0] != TRUE)) {
+            numBytesParsed += bpacket_parser_parse(&parser, &rxBytes[numBytesParsed], numBytes - numBytesParsed);
+        }
+
+        if (pingAnswered[0] == TRUE) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+maple_device_t* maple_create_device(struct sp_port* port, int simFd) {
+
+    if (numDevices == MAPLE_MAX_NUM_DEVICES) {
+        return NULL;
+    }
+
+    maple_device_t* device = malloc(sizeof(maple_device_t));
+    if (device == NULL) {
+        return NULL;
+    }
+
+    device->index           = numDevices;
+    device->port            = port;
+    device->simFd           = simFd;
+    device->holdingResponse = FALSE;
+    device->transferWindow  = 0;
+    device->baudRate        = MAPLE_DEFAULT_BAUD_RATE;
+    maple_ring_init(&device->rxRing, device->rxBpackets, PACKET_BUFFER_SIZE);
+    maple_os_event_init(&device->event);
+
+    if (port != NULL) {
+        snprintf(device->name, MAPLE_DEVICE_NAME_SIZE, "%s", sp_get_port_name(port));
+    } else {
+        snprintf(device->name, MAPLE_DEVICE_NAME_SIZE, "sim%i", numDevices);
+    }
+
+    return device;
+}
+
+uint8_t maple_add_device(maple_device_t* device) {
+
+    if (maple_os_thread_create(maple_listen_rx, device) != TRUE) {
+        printf("[%s] Thread failed\n", device->name);
+        return FALSE;
+    }
+
+    devices[numDevices++] = device;
+
+    return TRUE;
+}
+
+uint32_t maple_get_cached_baud_rate(char* portName) {
+
+    FILE* cache = fopen(MAPLE_PORT_CACHE_FILE_NAME, "r");
+    if (cache == NULL) {
+        return 0;
+    }
+
+    char name[MAPLE_DEVICE_NAME_SIZE];
+    uint32_t baudRate;
+    uint32_t cachedBaudRate = 0;
+    while (fscanf(cache, "%63s %u", name, &baudRate) == 2) {
+        if (strcmp(name, portName) == 0) {
+            cachedBaudRate = baudRate;
+            break;
+        }
+    }
+
+    fclose(cache);
+
+    return cachedBaudRate;
+}
+
+void maple_save_port_cache(void) {
+
+    FILE* cache = fopen(MAPLE_PORT_CACHE_FILE_NAME, "w");
+    if (cache == NULL) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < numDevices; i++) {
+        if (devices[i]->port != NULL) {
+            fprintf(cache, "%s %u\n", devices[i]->name, devices[i]->baudRate);
+        }
+    }
+
+    fclose(cache);
+}
+
+uint8_t maple_open_probe(maple_probe_t* probe, struct sp_port* listedPort, uint8_t id) {
+
+    // The list is freed once the ports have been probed so each probe keeps its own copy of the port
+    if (sp_copy_port(listedPort, &probe->port) != SP_OK) {
+        return FALSE;
+    }
+
+    // Ports that are in use by something else are skipped
+    if (sp_open(probe->port, SP_MODE_READ_WRITE) != SP_OK) {
+        sp_free_port(probe->port);
+        return FALSE;
+    }
+
+    // Configure the port settings for communication
+    sp_set_bits(probe->port, 8);
+    sp_set_parity(probe->port, SP_PARITY_NONE);
+    sp_set_stopbits(probe->port, 1);
+    sp_set_flowcontrol(probe->port, SP_FLOWCONTROL_NONE);
+
+    bpacket_parser_init(&probe->parser, id, BPACKET_ADDRESS_MAPLE, &probe->response, maple_ping_received);
+    probe->waiting  = TRUE;
+    probe->answered = FALSE;
+
+    // The STM32 keeps the baud rate a previous session negotiated until it is reset, so every baud
+    // rate is tried. The one the port answered at last time is tried first
+    probe->cachedBaudRate = maple_get_cached_baud_rate(sp_get_port_name(probe->port));
+    uint8_t numBaudRates  = 0;
+    if (probe->cachedBaudRate != 0) {
+        probe->baudRates[numBaudRates++] = probe->cachedBaudRate;
+    }
+
+    for (int i = 0; (i < MAPLE_NUM_BAUD_RATES) && (numBaudRates < MAPLE_NUM_BAUD_RATES); i++) {
+        if (mapleBaudRates[i] != probe->cachedBaudRate) {
+            probe->baudRates[numBaudRates++] = mapleBaudRates[i];
+        }
+    }
+
+    return TRUE;
+}
+
+uint8_t maple_wait_for_probes(maple_probe_t* probes, uint8_t numProbes, uint8_t numWaiting, uint32_t baudRateIndex) {
+
+    static uint8_t rxBytes[BPACKET_BUFFER_LENGTH_BYTES];
+
+    uint32_t startTime = maple_os_get_time_ms();
+    uint32_t elapsed;
+    while ((numWaiting > 0) && ((elapsed = maple_os_get_time_ms() - startTime) < MAPLE_PROBE_TIMEOUT)) {
+
+        // Only the ports that have not answered yet are waited on so the ones that have can't
+        // keep waking the wait up
+        struct sp_event_set* eventSet;
+        if (sp_new_event_set(&eventSet) != SP_OK) {
+            break;
+        }
+
+        for (uint8_t i = 0; i < numProbes; i++) {
+            if (probes[i].waiting == TRUE) {
+                sp_add_port_events(eventSet, probes[i].port, SP_EVENT_RX_READY);
+            }
+        }
+
+        sp_wait(eventSet, MAPLE_PROBE_TIMEOUT - elapsed);
+        sp_free_event_set(eventSet);
+
+        for (uint8_t i = 0; i < numProbes; i++) {
+
+            if (probes[i].waiting != TRUE) {
+                continue;
+            }
+
+            int numBytes = sp_nonblocking_read(probes[i].port, rxBytes, sizeof(rxBytes));
+            if (numBytes < 0) {
+                probes[i].waiting = FALSE;
+                numWaiting--;
+                continue;
+            }
+
+            uint32_t numBytesParsed = 0;
+            while ((numBytesParsed < (uint32_t)numBytes) && (pingAnswered[i] != TRUE)) {
+                numBytesParsed += bpacket_parser_parse(&probes[i].parser, &rxBytes[numBytesParsed],
+                                                       numBytes - numBytesParsed);
+            }
+
+            if (pingAnswered[i] == TRUE) {
+                probes[i].waiting  = FALSE;
+                probes[i].answered = TRUE;
+                probes[i].baudRate = probes[i].baudRates[baudRateIndex];
+                numWaiting--;
+            }
+        }
+    }
+
+    return numWaiting;
+}
+
+uint8_t maple_connect_to_devices(void) {
+
+    // Create a struct to hold all the COM ports currently in use
+    struct sp_port** port_list;
+
+    if (sp_list_ports(&port_list) != SP_OK) {
+        printf("Failed to list ports\r\n");
+        return numDevices;
+    }
+
+    maple_probe_t* probes = malloc(sizeof(maple_probe_t) * MAPLE_MAX_NUM_PORTS);
+    if (probes == NULL) {
+        sp_free_port_list(port_list);
+        return numDevices;
+    }
+
+    // Every port is opened at once so they can all be pinged at the same time
+    uint8_t numProbes = 0;
+    for (int i = 0; (port_list[i] != NULL) && (numProbes < MAPLE_MAX_NUM_PORTS); i++) {
+        if (maple_open_probe(&probes[numProbes], port_list[i], numProbes) == TRUE) {
+            numProbes++;
+        }
+    }
+
+    sp_free_port_list(port_list);
+
+    bpacket_t ping;
+    bpacket_buffer_t pingBuffer;
+    bpacket_create_p(&ping, BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE, BPACKET_GEN_R_PING, BPACKET_CODE_EXECUTE, 0,
+                     NULL);
+    bpacket_to_buffer(&ping, &pingBuffer);
+
+    // Each round pings every port that has not answered yet at the next baud rate on its list
+    // and waits on all of them together, so finding the devices takes no longer with more ports
+    uint8_t numWaiting = numProbes;
+    for (uint32_t i = 0; (i < MAPLE_NUM_BAUD_RATES) && (numWaiting > 0); i++) {
+
+        for (uint8_t j = 0; j < numProbes; j++) {
+
+            if (probes[j].waiting != TRUE) {
+                continue;
+            }
+
+            sp_set_baudrate(probes[j].port, probes[j].baudRates[i]);
+            bpacket_parser_reset(&probes[j].parser);
+            pingAnswered[j] = FALSE;
+
+            if (sp_nonblocking_write(probes[j].port, pingBuffer.buffer, pingBuffer.numBytes) < 0) {
+                probes[j].waiting = FALSE;
+                numWaiting--;
+            }
+        }
+
+        numWaiting = maple_wait_for_probes(probes, numProbes, numWaiting, i);
+    }
+
+    // Devices on their cached port come first so the GUI talks to the same one as last time
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint8_t i = 0; i < numProbes; i++) {
+
+            if ((probes[i].answered != TRUE) || ((probes[i].baudRate == probes[i].cachedBaudRate) != (pass == 0))) {
+                continue;
+            }
+
+            maple_device_t* device = maple_create_device(probes[i].port, -1);
+            if (device != NULL) {
+                device->baudRate = probes[i].baudRate;
+            }
+
+            if ((device == NULL) || (maple_add_device(device) != TRUE)) {
+                free(device);
+                probes[i].answered = FALSE;
+            }
+        }
+    }
+
+    // Close the ports nothing answered on
+    for (uint8_t i = 0; i < numProbes; i++) {
+        if (probes[i].answered != TRUE) {
+            sp_close(probes[i].port);
+            sp_free_port(probes[i].port);
+        }
+    }
+
+    free(probes);
+
+    // The cache is kept when nothing is found in case the devices have only been unplugged for now
+    if (numDevices > 0) {
+        maple_save_port_cache();
+    }
+
+    return numDevices;
+}
+
+void maple_run_worker(void* arg) {
+
+    maple_worker_t* worker = arg;
+    activeDevice           = worker->device;
+
+    worker->fanOut->results[activeDevice->index] = worker->fanOut->operation(worker->fanOut->arg);
+    maple_os_event_signal(&fanOutDone);
+}
+
+void maple_run_on_all_devices(maple_fan_out_t* fanOut) {
+
+    maple_worker_t workers[MAPLE_MAX_NUM_DEVICES];
+    uint32_t startCount = maple_os_event_get_count(&fanOutDone);
+
+    // Every device gets its own thread so one slow device does not hold up the rest
+    uint8_t numStarted = 0;
+    for (uint8_t i = 0; i < numDevices; i++) {
+
+        workers[i].device = devices[i];
+        workers[i].fanOut = fanOut;
+
+        if (maple_os_thread_create(maple_run_worker, &workers[i]) != TRUE) {
+            printf("[%s] Thread failed\n", devices[i]->name);
+            fanOut->results[i] = FALSE;
+            continue;
+        }
+
+        numStarted++;
+    }
+
+    uint32_t count;
+    while (((count = maple_os_event_get_count(&fanOutDone)) - startCount) < numStarted) {
+        maple_os_event_wait(&fanOutDone, count, MAPLE_OS_WAIT_FOREVER);
+    }
+}
+
+uint16_t maple_negotiate_ext_framing(void) {
+
+    // Older STM32 firmware drops extended bpackets instead of forwarding them. Only
+    // ask the ESP32 to use them once the STM32 has confirmed it can forward them
+    maple_create_and_send_bpacket(BPACKET_GEN_R_EXT_FRAMING, BPACKET_ADDRESS_STM32, 0, NULL);
+
+    bpacket_t* response;
+    if ((maple_get_response(&response, BPACKET_GEN_R_EXT_FRAMING, 200) != TRUE) ||
+        (response->code != BPACKET_CODE_SUCCESS)) {
+        return BPACKET_MAX_NUM_DATA_BYTES;
+    }
+
+    // Only ask for CRCs if the STM32 is able to forward checked bpackets
+    uint8_t extFlags = 0;
+    if ((response->numBytes >= 3) && ((response->bytes[2] & BPACKET_EXT_FLAG_CRC) != 0)) {
+        extFlags |= BPACKET_EXT_FLAG_CRC;
+    }
+
+    // The window can be no larger than the number of bpackets the STM32 is able to buffer
+    // while forwarding them. Older STM32 firmware does not report its buffer size
+    uint8_t window = 0;
+    if (response->numBytes >= BPACKET_EXT_NUM_BYTES) {
+        uint16_t stm32BufferSize =
+            (response->bytes[BPACKET_EXT_RX_BUFFER_INDEX] << 8) | response->bytes[BPACKET_EXT_RX_BUFFER_INDEX + 1];
+        uint16_t numBpackets     = stm32BufferSize / (BPACKET_NODE_MAX_NUM_DATA_BYTES + BPACKET_CRC_NUM_NON_DATA_BYTES);
+        window                   = (numBpackets < MAPLE_TRANSFER_WINDOW) ? numBpackets : MAPLE_TRANSFER_WINDOW;
+        window                   = (window == 0) ? 1 : window;
+    }
+
+    uint8_t maxNumBytes[4] = {(BPACKET_NODE_MAX_NUM_DATA_BYTES >> 8) & 0xFF, BPACKET_NODE_MAX_NUM_DATA_BYTES & 0xFF,
+                              extFlags, window};
+    maple_create_and_send_bpacket(BPACKET_GEN_R_EXT_FRAMING, BPACKET_ADDRESS_ESP32, 4, maxNumBytes);
+
+    if ((maple_get_response(&response, BPACKET_GEN_R_EXT_FRAMING, 200) != TRUE) ||
+        (response->code != BPACKET_CODE_SUCCESS) || (response->numBytes < 2)) {
+        return BPACKET_MAX_NUM_DATA_BYTES;
+    }
+
+    // Older ESP32 firmware does not reply with a window and will never wait for ACKs
+    activeDevice->transferWindow =
+        (response->numBytes > BPACKET_EXT_WINDOW_INDEX) ? response->bytes[BPACKET_EXT_WINDOW_INDEX] : 0;
+
+    return (response->bytes[0] << 8) | response->bytes[1];
+}
+
+uint8_t maple_set_link_baud_rate(uint8_t link, uint32_t newBaudRate) {
+
+    bpacket_t* response;
+    uint8_t data[5] = {(newBaudRate >> 24) & 0xFF, (newBaudRate >> 16) & 0xFF, (newBaudRate >> 8) & 0xFF,
+                       newBaudRate & 0xFF, link};
+    maple_create_and_send_bpacket(BPACKET_GEN_R_SET_BAUD, BPACKET_ADDRESS_STM32, 5, data);
+
+    // The STM32 changes the link to the ESP32 itself and falls back if the ESP32 stops responding
+    if (link == BPACKET_ADDRESS_ESP32) {
+        return ((maple_get_response(&response, BPACKET_GEN_R_SET_BAUD, MAPLE_LINK_REPLY_TIMEOUT) == TRUE) &&
+                (response->code == BPACKET_CODE_SUCCESS))
+                   ? TRUE
+                   : FALSE;
+    }
+
+    // The STM32 replies at the current baud rate and then waits to be pinged at the new one
+    if ((maple_get_response(&response, BPACKET_GEN_R_SET_BAUD, MAPLE_BAUD_REPLY_TIMEOUT) != TRUE) ||
+        (response->code != BPACKET_CODE_SUCCESS)) {
+        return FALSE;
+    }
+
+    // Both links are kept at the same baud rate so the port is running at the current one
+    maple_device_set_baud_rate(activeDevice, newBaudRate);
+    maple_os_sleep_ms(MAPLE_BAUD_SETTLE_TIME);
+
+    maple_create_and_send_bpacket(BPACKET_GEN_R_PING, BPACKET_ADDRESS_STM32, 0, NULL);
+
+    if ((maple_get_response(&response, BPACKET_GEN_R_PING, MAPLE_BAUD_REPLY_TIMEOUT) == TRUE) &&
+        (response->bytes[0] == WATCHDOG_PING_CODE_STM32)) {
+        return TRUE;
+    }
+
+    // Give the STM32 time to fall back as well
+    maple_device_set_baud_rate(activeDevice, activeDevice->baudRate);
+    maple_os_sleep_ms(BPACKET_BAUD_CONFIRM_TIMEOUT_MS);
+
+    return FALSE;
+}
+
+uint32_t maple_negotiate_baud_rate(void) {
+
+    // Both links are stepped up together so the STM32 never receives faster than it can forward
+    for (int i = 0; i < MAPLE_NUM_BAUD_RATES; i++) {
+
+        if (mapleBaudRates[i] <= activeDevice->baudRate) {
+            continue;
+        }
+
+        if (maple_set_link_baud_rate(BPACKET_ADDRESS_ESP32, mapleBaudRates[i]) != TRUE) {
+            break;
+        }
+
+        if (maple_set_link_baud_rate(BPACKET_ADDRESS_MAPLE, mapleBaudRates[i]) != TRUE) {
+            maple_set_link_baud_rate(BPACKET_ADDRESS_ESP32, activeDevice->baudRate);
+            break;
+        }
+
+        activeDevice->baudRate = mapleBaudRates[i];
+    }
+
+    return activeDevice->baudRate;
+}
+
+long maple_benchmark_transfer(uint32_t* timeMs) {
+
+    uint8_t numBytes[4] = {(MAPLE_BENCHMARK_NUM_BYTES >> 24) & 0xFF, (MAPLE_BENCHMARK_NUM_BYTES >> 16) & 0xFF,
+                           (MAPLE_BENCHMARK_NUM_BYTES >> 8) & 0xFF, MAPLE_BENCHMARK_NUM_BYTES & 0xFF};
+
+    FILE* target = tmpfile();
+    if (target == NULL) {
+        printf("Could not create a file for the benchmark\n");
+        return -1;
+    }
+
+    uint32_t startTime = maple_os_get_time_ms();
+    maple_create_and_send_bpacket(WATCHDOG_BPK_R_BENCHMARK, BPACKET_ADDRESS_ESP32, 4, numBytes);
+    uint8_t result = maple_receive_transfer(target, WATCHDOG_BPK_R_BENCHMARK);
+    *timeMs        = maple_os_get_time_ms() - startTime;
+
+    fseek(target, 0, SEEK_END);
+    long numBytesReceived = ftell(target);
+    fclose(target);
+
+    return (result == TRUE) ? numBytesReceived : -1;
+}
+
+void maple_benchmark(void) {
+
+    // Step through the baud rates from the current one up, timing the same transfer at each
+    for (int i = 0; i < MAPLE_NUM_BAUD_RATES; i++) {
+
+        if (mapleBaudRates[i] < activeDevice->baudRate) {
+            continue;
+        }
+
+        if (mapleBaudRates[i] > activeDevice->baudRate) {
+
+            if (maple_set_link_baud_rate(BPACKET_ADDRESS_ESP32, mapleBaudRates[i]) != TRUE) {
+                printf("%u baud: ESP32 link failed\n", mapleBaudRates[i]);
+                break;
+            }
+
+            if (maple_set_link_baud_rate(BPACKET_ADDRESS_MAPLE, mapleBaudRates[i]) != TRUE) {
+                printf("%u baud: Maple link failed\n", mapleBaudRates[i]);
+                maple_set_link_baud_rate(BPACKET_ADDRESS_ESP32, activeDevice->baudRate);
+                break;
+            }
+
+            activeDevice->baudRate = mapleBaudRates[i];
+        }
+
+        uint32_t timeMs;
+        long numBytesReceived = maple_benchmark_transfer(&timeMs);
+
+        if (numBytesReceived < 0) {
+            printf("%u baud: transfer failed\n", activeDevice->baudRate);
+            continue;
+        }
+
+        double numSeconds = (double)timeMs / 1000;
+        printf("%u baud: %li bytes in %.2fs, %.1f KB/s\n", activeDevice->baudRate, numBytesReceived, numSeconds,
+               (numSeconds > 0) ? (numBytesReceived / 1024.0) / numSeconds : 0.0);
+    }
+}
+
+int maple_goodput(void) {
+
+    uint32_t timeMs;
+    long numBytesReceived = maple_benchmark_transfer(&timeMs);
+
+    if (numBytesReceived < 0) {
+        printf("goodput device=%s status=failed baud=%u window=%u\n", activeDevice->name, activeDevice->baudRate,
+               activeDevice->transferWindow);
+        return 1;
+    }
+
+    // Each byte takes 10 bits on the wire so a link can carry at most a tenth of its baud rate
+    long bytesPerSecond = (timeMs > 0) ? (numBytesReceived * 1000) / timeMs : 0;
+    long efficiency     = (bytesPerSecond * 1000) / (activeDevice->baudRate / 10);
+
+    printf("goodput device=%s status=ok baud=%u window=%u bytes=%li ms=%u bytes_per_s=%li efficiency=%li.%li%%\n",
+           activeDevice->name, activeDevice->baudRate, activeDevice->transferWindow, numBytesReceived, timeMs,
+           bytesPerSecond, efficiency / 10, efficiency % 10);
+
+    return 0;
+}
+
+void maple_send_nack(uint16_t* sequences, uint8_t numSequences) {
+
+    uint8_t data[BPACKET_NACK_MAX_NUM_SEQUENCES * 2];
+
+    for (int i = 0; i < numSequences; i++) {
+        data[i * 2]       = (sequences[i] >> 8) & 0xFF;
+        data[(i * 2) + 1] = sequences[i] & 0xFF;
+    }
+
+    maple_create_and_send_bpacket(BPACKET_GEN_R_NACK, BPACKET_ADDRESS_ESP32, numSequences * 2, data);
+}
+
+void maple_send_ack(uint16_t numChunksReceived) {
+
+    uint8_t data[2] = {(numChunksReceived >> 8) & 0xFF, numChunksReceived & 0xFF};
+    maple_create_and_send_bpacket(BPACKET_GEN_R_ACK, BPACKET_ADDRESS_ESP32, 2, data);
+}
+
+uint8_t maple_receive_transfer(FILE* target, uint8_t request) {
+
+    // Tracks which chunks of a checked transfer have been written to the file
+    uint8_t* chunkReceived = activeDevice->chunkReceived;
+    memset(chunkReceived, FALSE, MAPLE_MAX_TRANSFER_CHUNKS);
+
+    uint8_t transferWindow = activeDevice->transferWindow;
+
+    // The transfer is written from wherever the file is at so a download can carry on from a partial file
+    long startPosition            = ftell(target);
+    activeDevice->numBytesInOrder = 0;
+
+    uint16_t nacks[BPACKET_NACK_MAX_NUM_SEQUENCES];
+    uint32_t chunkSize       = 0;
+    uint32_t numChunks       = 0; // Only known once the last chunk has been received
+    uint32_t highestSequence = 0;
+    uint32_t numInOrder      = 0; // Number of chunks received without any gaps
+    uint8_t checked          = FALSE;
+    uint8_t numNackRounds    = 0;
+
+    while (1) {
+
+        // Wait until the packet is ready
+        bpacket_t* bpacket = maple_wait_for_bpacket_response(MAPLE_TRANSFER_TIMEOUT);
+
+        if ((bpacket != NULL) && (bpacket->request == BPACKET_GEN_R_MESSAGE)) {
+            continue;
+        }
+
+        if ((bpacket != NULL) && (bpacket->request != request)) {
+            printf("PACKET ERROR FOUND. Request %i\n", bpacket->request);
+            continue;
+        }
+
+        if ((bpacket != NULL) && (bpacket->code == BPACKET_CODE_ERROR)) {
+            maple_print_bpacket_data(bpacket);
+            return FALSE;
+        }
+
+        // Legacy transfers have no way to recover from a lost bpacket
+        if ((bpacket == NULL) && (checked != TRUE)) {
+            printf("Timeout %ims\n", MAPLE_TRANSFER_TIMEOUT);
+            return FALSE;
+        }
+
+        if ((bpacket != NULL) && (bpacket->crcStatus == BPACKET_CRC_NONE)) {
+
+            fwrite(bpacket->bytes, 1, bpacket->numBytes, target);
+            activeDevice->numBytesInOrder += bpacket->numBytes;
+
+            if (bpacket->code == BPACKET_CODE_SUCCESS) {
+                return TRUE;
+            }
+
+            continue;
+        }
+
+        uint8_t roundFinished = (bpacket == NULL) ? TRUE : FALSE;
+
+        if (bpacket != NULL) {
+            checked = TRUE;
+
+            // Every chunk except the last is the same size
+            if ((chunkSize == 0) && (bpacket->code == BPACKET_CODE_IN_PROGRESS)) {
+                chunkSize = bpacket->numBytes;
+            }
+
+            // A chunk that can not be tracked would be left out of the file without being NACKed
+            if (bpacket->sequence >= MAPLE_MAX_TRANSFER_CHUNKS) {
+                printf("Transfer failed. It has more than %i chunks\n", MAPLE_MAX_TRANSFER_CHUNKS);
+                if (transferWindow == 0) {
+                    maple_send_nack(NULL, 0);
+                }
+                return FALSE;
+            }
+
+            // Corrupted chunks are left out so they get NACKed
+            if ((bpacket->crcStatus == BPACKET_CRC_OK) && ((chunkSize != 0) || (bpacket->sequence == 0))) {
+
+                fseek(target, startPosition + (bpacket->sequence * chunkSize), SEEK_SET);
+                fwrite(bpacket->bytes, 1, bpacket->numBytes, target);
+                chunkReceived[bpacket->sequence] = TRUE;
+
+                if (bpacket->sequence > highestSequence) {
+                    highestSequence = bpacket->sequence;
+                }
+
+                if (bpacket->code == BPACKET_CODE_SUCCESS) {
+                    numChunks     = bpacket->sequence + 1;
+                    roundFinished = TRUE;
+                }
+            }
+
+            // The ESP32 resends everything after the last ACK so a lost chunk is recovered without a NACK
+            while ((numInOrder < MAPLE_MAX_TRANSFER_CHUNKS) && (chunkReceived[numInOrder] == TRUE)) {
+                numInOrder++;
+            }
+
+            // Only wrong once the last chunk is in order, which finishes the transfer
+            activeDevice->numBytesInOrder = numInOrder * chunkSize;
+
+            if (transferWindow != 0) {
+                maple_send_ack(numInOrder);
+            }
+        }
+
+        // Find the chunks that are missing. If the last chunk has not arrived, ask for the
+        // one after the highest received in case it was the last chunk that was lost
+        uint8_t numNacks   = 0;
+        uint32_t lastChunk = (numChunks != 0) ? numChunks : (highestSequence + 2);
+        for (uint32_t i = 0; (i < lastChunk) && (i < MAPLE_MAX_TRANSFER_CHUNKS); i++) {
+            if ((chunkReceived[i] != TRUE) && (numNacks < BPACKET_NACK_MAX_NUM_SEQUENCES)) {
+                nacks[numNacks++] = i;
+            }
+        }
+
+        // Let the sender know the transfer is complete. Windowed transfers finish on the last ACK
+        if ((numChunks != 0) && (numNacks == 0)) {
+            if (transferWindow == 0) {
+                maple_send_nack(NULL, 0);
+            }
+
+            fseek(target, 0, SEEK_END);
+            activeDevice->numBytesInOrder = ftell(target) - startPosition;
+            return TRUE;
+        }
+
+        if (roundFinished != TRUE) {
+            continue;
+        }
+
+        if (numNackRounds++ == MAPLE_MAX_NACK_ROUNDS) {
+            printf("Transfer failed. %i chunks could not be recovered\n", numNacks);
+            if (transferWindow == 0) {
+                maple_send_nack(NULL, 0);
+            }
+            return FALSE;
+        }
+
+        // The ESP32 recovers from missing chunks itself when it stops receiving ACKs
+        if (transferWindow != 0) {
+            continue;
+        }
+
+        printf("Requesting %i chunks again\n", numNacks);
+        maple_send_nack(nacks, numNacks);
+    }
+}
+
+uint8_t maple_stream(char* cpyFileName) {
+
+    FILE* target;
+    target = fopen(cpyFileName, "wb"); // Read binary
+
+    if (target == NULL) {
+        printf("Could not open file\n");
+        return FALSE;
+    }
+
+    // Send command to copy file. Keeping reading until no more data to send across
+    maple_create_and_send_bpacket(WATCHDOG_BPK_R_STREAM_IMAGE, BPACKET_ADDRESS_ESP32, 0, NULL);
+
+    uint8_t result = maple_receive_transfer(target, WATCHDOG_BPK_R_STREAM_IMAGE);
+
+    fclose(target);
+
+    return result;
+}
+
+uint8_t maple_download_image_index(FILE* target, uint32_t firstRecord) {
+
+    // The ESP32 sends the index as a file so the data folder does not have to be listed
+    uint8_t data[4] = {(firstRecord >> 24) & 0xFF, (firstRecord >> 16) & 0xFF, (firstRecord >> 8) & 0xFF,
+                       firstRecord & 0xFF};
+    maple_create_and_send_bpacket(WATCHDOG_BPK_R_GET_IMAGE_INDEX, BPACKET_ADDRESS_ESP32, 4, data);
+
+    return maple_receive_transfer(target, WATCHDOG_BPK_R_GET_IMAGE_INDEX);
+}
+
+uint8_t maple_get_image_index(uint32_t firstRecord) {
+
+    // The index is only kept until it has been printed
+    FILE* target = tmpfile();
+
+    if (target == NULL) {
+        printf("Could not open file\n");
+        return FALSE;
+    }
+
+    if (maple_download_image_index(target, firstRecord) != TRUE) {
+        fclose(target);
+        return FALSE;
+    }
+
+    uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES];
+    wd_image_record_t record;
+
+    fseek(target, 0L, SEEK_SET);
+    while (fread(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, target) == WD_IMAGE_RECORD_NUM_BYTES) {
+        wd_bytes_to_image_record(bytes, &record);
+        printf("%6u %-36s %02i/%02i/%04i %02i:%02i:%02i %8u bytes %s%i.%i %s%i.%i\n", record.imageNumber,
+               record.fileName, record.datetime.date.day, record.datetime.date.month, record.datetime.date.year,
+               record.datetime.time.hour, record.datetime.time.minute, record.datetime.time.second, record.numBytes,
+               (record.temp1.sign == 1) ? "-" : "", record.temp1.decimal, record.temp1.fraction,
+               (record.temp2.sign == 1) ? "-" : "", record.temp2.decimal, record.temp2.fraction);
+    }
+
+    fclose(target);
+
+    return TRUE;
+}
+
+uint8_t maple_list_directory(char* path, char* pattern) {
+
+    wd_list_dir_request_t listDir = {0};
+    listDir.limit                 = MAPLE_LIST_DIR_PAGE_SIZE;
+    snprintf(listDir.path, WD_LIST_DIR_PATH_SIZE, "%s", path);
+    snprintf(listDir.pattern, WD_LIST_DIR_PATTERN_SIZE, "%s", pattern);
+
+    // Each page is printed as it arrives so large folders show up straight away
+    uint8_t moreEntries = TRUE;
+    while (moreEntries == TRUE) {
+
+        bpacket_t request;
+        uint8_t result = wd_list_dir_request_to_bpacket(&request, BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE,
+                                                        BPACKET_CODE_EXECUTE, &listDir);
+        if (result != TRUE) {
+            char errMsg[50];
+            wd_get_error(result, errMsg);
+            printf("%s", errMsg);
+            return FALSE;
+        }
+
+        maple_send_bpacket(&request);
+
+        bpacket_t* bpacket;
+        wd_dir_entry_t entry;
+        while (1) {
+
+            if (maple_get_response(&bpacket, WATCHDOG_BPK_R_LIST_DIR, MAPLE_LIST_DIR_TIMEOUT) != TRUE) {
+                printf("Timeout %ims\n", MAPLE_LIST_DIR_TIMEOUT);
+                return FALSE;
+            }
+
+            if (bpacket->code == BPACKET_CODE_ERROR) {
+                maple_print_bpacket_data(bpacket);
+                return FALSE;
+            }
+
+            if (bpacket->code == BPACKET_CODE_SUCCESS) {
+                break;
+            }
+
+            uint16_t numEntryBytes;
+            for (uint16_t i = 0; i < bpacket->numBytes; i += numEntryBytes) {
+
+                if ((numEntryBytes = wd_bytes_to_dir_entry(&bpacket->bytes[i], bpacket->numBytes - i, &entry)) == 0) {
+                    break;
+                }
+
+                printf("%-40s%s %10u %02i/%02i/%04i %02i:%02i\n", entry.name,
+                       (entry.type == WD_DIR_ENTRY_TYPE_FOLDER) ? "/" : " ", entry.numBytes, entry.modified.date.day,
+                       entry.modified.date.month, entry.modified.date.year, entry.modified.time.hour,
+                       entry.modified.time.minute);
+            }
+        }
+
+        // The last bpacket holds the number of entries sent and whether there are more
+        if (bpacket->numBytes != WD_LIST_DIR_SUMMARY_NUM_BYTES) {
+            return FALSE;
+        }
+
+        listDir.offset += (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) |
+                          bpacket->bytes[3];
+        moreEntries = bpacket->bytes[4];
+    }
+
+    return TRUE;
+}
+
+uint8_t maple_take_burst(wd_burst_t* burst) {
+
+    // The STM32 adds the photo data before sending the burst on to the ESP32
+    bpacket_t request;
+    uint8_t result =
+        wd_burst_to_bpacket(&request, BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE, BPACKET_CODE_EXECUTE, burst);
+    if (result != TRUE) {
+        char errMsg[50];
+        wd_get_error(result, errMsg);
+        printf("%s", errMsg);
+        return FALSE;
+    }
+
+    maple_send_bpacket(&request);
+
+    // The response only comes once every frame has been saved
+    bpacket_t* bpacket;
+    uint32_t timeout   = MAPLE_BURST_TIMEOUT + burst->numFrames * (burst->intervalMs + MAPLE_BURST_FRAME_TIMEOUT);
+    uint32_t startTime = maple_os_get_time_ms();
+    while (maple_get_response(&bpacket, WATCHDOG_BPK_R_TAKE_BURST, MAPLE_BURST_FRAME_TIMEOUT) != TRUE) {
+        if ((maple_os_get_time_ms() - startTime) > timeout) {
+            printf("Timeout %lims\n", (long)timeout);
+            return FALSE;
+        }
+    }
+
+    if (bpacket->code != BPACKET_CODE_SUCCESS) {
+        maple_print_bpacket_data(bpacket);
+        return FALSE;
+    }
+
+    wd_burst_result_t burstResult;
+    if (wd_bpacket_to_burst_result(bpacket, &burstResult) != TRUE) {
+        printf("Invalid burst response\n");
+        return FALSE;
+    }
+
+    printf("Saved %i of %i frames at %i.%02i fps\n", burstResult.numSaved, burst->numFrames,
+           burstResult.fpsX100 / 100, burstResult.fpsX100 % 100);
+    for (uint8_t i = 0; i < burstResult.numSaved; i++) {
+        printf("Frame %2i saved in %5i ms\n", i + 1, burstResult.saveTimeMs[i]);
+    }
+
+    return TRUE;
+}
+
+uint8_t maple_ext_framing_operation(void* arg) {
+    maple_device_print("Max bytes per bpacket: %i\n", maple_negotiate_ext_framing());
+    return TRUE;
+}
+
+uint8_t maple_baud_rate_operation(void* arg) {
+    maple_device_print("Baud rate: %u\n", maple_negotiate_baud_rate());
+    return TRUE;
+}
+
+uint8_t maple_ping_operation(void* arg) {
+
+    uint32_t startTime = maple_os_get_time_ms();
+    maple_create_and_send_bpacket(BPACKET_GEN_R_PING, BPACKET_ADDRESS_STM32, 0, NULL);
+
+    bpacket_t* response;
+    if ((maple_get_response(&response, BPACKET_GEN_R_PING, MAPLE_PING_TIMEOUT) != TRUE) ||
+        (response->bytes[0] != WATCHDOG_PING_CODE_STM32)) {
+        maple_device_print("%sNo reply to ping%s\n", ASCII_COLOR_RED, ASCII_COLOR_WHITE);
+        return FALSE;
+    }
+
+    maple_device_print("Replied in %ims\n", maple_os_get_time_ms() - startTime);
+    return TRUE;
+}
+
+uint8_t maple_set_datetime_operation(void* arg) {
+
+    bpacket_t request;
+    uint8_t result = wd_datetime_to_bpacket(&request, BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE,
+                                            WATCHDOG_BPK_R_SET_DATETIME, BPACKET_CODE_EXECUTE, (dt_datetime_t*)arg);
+    if (result != TRUE) {
+        char errMsg[50];
+        wd_get_error(result, errMsg);
+        maple_device_print("%s\n", errMsg);
+        return FALSE;
+    }
+
+    maple_send_bpacket(&request);
+
+    bpacket_t* response;
+    if ((maple_get_response(&response, WATCHDOG_BPK_R_SET_DATETIME, MAPLE_DATETIME_TIMEOUT) != TRUE) ||
+        (response->code != BPACKET_CODE_SUCCESS)) {
+        maple_device_print("%sSetting the datetime failed%s\n", ASCII_COLOR_RED, ASCII_COLOR_WHITE);
+        return FALSE;
+    }
+
+    maple_device_print("Datetime set\n");
+    return TRUE;
+}
+
+uint8_t maple_benchmark_operation(void* arg) {
+
+    uint32_t timeMs;
+    long numBytesReceived = maple_benchmark_transfer(&timeMs);
+
+    if (numBytesReceived < 0) {
+        maple_device_print("%sTransfer failed%s\n", ASCII_COLOR_RED, ASCII_COLOR_WHITE);
+        return FALSE;
+    }
+
+    // Legacy transfers can lose bpackets without noticing so the size is checked as well
+    if (numBytesReceived != MAPLE_BENCHMARK_NUM_BYTES) {
+        maple_device_print("%sReceived %li of %i bytes%s\n", ASCII_COLOR_RED, numBytesReceived,
+                           MAPLE_BENCHMARK_NUM_BYTES, ASCII_COLOR_WHITE);
+        return FALSE;
+    }
+
+    // Each device adds up its own bytes so the total throughput can be worked out once all are done
+    ((long*)arg)[activeDevice->index] = numBytesReceived;
+
+    double numSeconds = (double)timeMs / 1000;
+    maple_device_print("%u baud: %li bytes in %.2fs, %.1f KB/s\n", activeDevice->baudRate, numBytesReceived,
+                       numSeconds, (numSeconds > 0) ? (numBytesReceived / 1024.0) / numSeconds : 0.0);
+    return TRUE;
+}
+
+uint8_t maple_index_operation(void* arg) {
+
+    FILE* target = tmpfile();
+    if (target == NULL) {
+        maple_device_print("Could not open file\n");
+        return FALSE;
+    }
+
+    if (maple_download_image_index(target, 0) != TRUE) {
+        maple_device_print("%sDownloading the image index failed%s\n", ASCII_COLOR_RED, ASCII_COLOR_WHITE);
+        fclose(target);
+        return FALSE;
+    }
+
+    fseek(target, 0, SEEK_END);
+    maple_device_print("%li images\n", ftell(target) / WD_IMAGE_RECORD_NUM_BYTES);
+    fclose(target);
+
+    return TRUE;
+}
+
+/**
+ * @brief Runs an operation on every connected device at the same time. Each device
+ * prints its own progress as it goes and a summary is printed once all are done
+ *
+ * @param operation One of ping, time, baud, benchmark or index
+ * @return uint8_t FALSE if the operation is not known else TRUE
+ */
+uint8_t maple_all_devices(char* operation) {
+
+    maple_fan_out_t fanOut;
+    long numBytes[MAPLE_MAX_NUM_DEVICES] = {0};
+    dt_datetime_t datetime;
+
+    if (chars_same(operation, "ping\0") == TRUE) {
+        fanOut.operation = maple_ping_operation;
+    } else if (chars_same(operation, "time\0") == TRUE) {
+
+        // Every device is given the same time
+        time_t now          = time(NULL);
+        struct tm* calendar = localtime(&now);
+        dt_time_init(&datetime.time, calendar->tm_sec, calendar->tm_min, calendar->tm_hour);
+        dt_date_init(&datetime.date, calendar->tm_mday, calendar->tm_mon + 1, calendar->tm_year + 1900);
+
+        fanOut.operation = maple_set_datetime_operation;
+        fanOut.arg       = &datetime;
+    } else if (chars_same(operation, "baud\0") == TRUE) {
+        fanOut.operation = maple_baud_rate_operation;
+    } else if (chars_same(operation, "benchmark\0") == TRUE) {
+        fanOut.operation = maple_benchmark_operation;
+        fanOut.arg       = numBytes;
+    } else if (chars_same(operation, "index\0") == TRUE) {
+        fanOut.operation = maple_index_operation;
+    } else {
+        return FALSE;
+    }
+
+    uint32_t startTime = maple_os_get_time_ms();
+    maple_run_on_all_devices(&fanOut);
+    double numSeconds = (double)(maple_os_get_time_ms() - startTime) / 1000;
+
+    long totalNumBytes = 0;
+    uint8_t numPassed  = 0;
+    for (uint8_t i = 0; i < numDevices; i++) {
+        numPassed += (fanOut.results[i] == TRUE) ? 1 : 0;
+        totalNumBytes += numBytes[i];
+    }
+
+    printf("%s%i of %i devices passed in %.2fs%s\n", (numPassed == numDevices) ? ASCII_COLOR_GREEN : ASCII_COLOR_RED,
+           numPassed, numDevices, numSeconds, ASCII_COLOR_WHITE);
+
+    if (fanOut.operation == maple_benchmark_operation) {
+        printf("Total: %li bytes, %.1f KB/s\n", totalNumBytes,
+               (numSeconds > 0) ? (totalNumBytes / 1024.0) / numSeconds : 0.0);
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief Turns a port name or the path of an image into a name that can be used for a
+ * file or folder. Leading separators are dropped and the rest are replaced with '_'
+ *
+ */
+void maple_to_file_name(char* name, char* fileName) {
+
+    while ((*name == '/') || (*name == '\\') || (*name == ':') || (*name == '.')) {
+        name++;
+    }
+
+    int i;
+    for (i = 0; name[i] != '\0'; i++) {
+        fileName[i] = ((name[i] == '/') || (name[i] == '\\') || (name[i] == ':')) ? '_' : name[i];
+    }
+
+    fileName[i] = '\0';
+}
+
+/**
+ * @brief Gets the value given after an option such as --dest
+ *
+ * @return char* The value or NULL if the option was not given
+ */
+char* maple_get_option(int argc, char** argv, char* option) {
+
+    for (int i = 0; i < (argc - 1); i++) {
+        if (chars_same(argv[i], option) == TRUE) {
+            return argv[i + 1];
+        }
+    }
+
+    return NULL;
+}
+
+void maple_print_sync_file(char* fileName, char* status, long numBytes, uint32_t timeMs) {
+
+    // One printf per line so lines from devices syncing at the same time are never mixed up
+    printf("sync device=%s file=%s status=%s bytes=%li ms=%u bytes_per_s=%li\n", activeDevice->name, fileName, status,
+           numBytes, timeMs, (timeMs > 0) ? (numBytes * 1000) / timeMs : 0);
+    fflush(stdout);
+}
+
+/**
+ * @brief Downloads one image into the folder unless it is already there. The image is
+ * saved to a .part file as it arrives and only renamed once all of it has been received,
+ * so a download that is cut short carries on from where it stopped next time
+ *
+ * @param numBytesReceived Set to the number of bytes received from the Watchdog
+ * @return uint8_t TRUE if the image is in the folder once this returns else FALSE
+ */
+uint8_t maple_sync_file(char* folder, wd_image_record_t* record, long* numBytesReceived) {
+
+    char fileName[WD_IMAGE_RECORD_FILE_NAME_SIZE];
+    char path[MAPLE_PATH_SIZE];
+    char partPath[MAPLE_PATH_SIZE + sizeof(MAPLE_PART_FILE_EXTENSION)];
+    maple_to_file_name(record->fileName, fileName);
+    snprintf(path, sizeof(path), "%s/%s", folder, fileName);
+    snprintf(partPath, sizeof(partPath), "%s%s", path, MAPLE_PART_FILE_EXTENSION);
+
+    *numBytesReceived = 0;
+
+    // Images that were downloaded in full last time are left alone
+    FILE* target = fopen(path, "rb");
+    if (target != NULL) {
+        fseek(target, 0, SEEK_END);
+        long numBytes = ftell(target);
+        fclose(target);
+
+        if (numBytes == (long)record->numBytes) {
+            maple_print_sync_file(fileName, "skipped", 0, 0);
+            return TRUE;
+        }
+    }
+
+    target = fopen(partPath, "r+b");
+    if (target == NULL) {
+        target = fopen(partPath, "w+b");
+    }
+
+    if (target == NULL) {
+        maple_print_sync_file(fileName, "failed", 0, 0);
+        return FALSE;
+    }
+
+    // A .part file bigger than the image is from an older image with the same name
+    fseek(target, 0, SEEK_END);
+    long startByte = ftell(target);
+    if (startByte > (long)record->numBytes) {
+        maple_os_truncate_file(target, 0);
+        startByte = 0;
+    }
+
+    fseek(target, startByte, SEEK_SET);
+
+    uint32_t startTime = maple_os_get_time_ms();
+    uint8_t result     = TRUE;
+    if (startByte < (long)record->numBytes) {
+
+        // The path from the root of the SD card, then a null character and the byte to start from
+        uint8_t data[BPACKET_MAX_NUM_DATA_BYTES];
+        int pathSize = snprintf((char*)data, sizeof(data) - WD_COPY_FILE_START_NUM_BYTES, "%s/%s", DATA_FOLDER_PATH,
+                                record->fileName);
+        data[pathSize + 1] = (startByte >> 24) & 0xFF;
+        data[pathSize + 2] = (startByte >> 16) & 0xFF;
+        data[pathSize + 3] = (startByte >> 8) & 0xFF;
+        data[pathSize + 4] = startByte & 0xFF;
+
+        maple_create_and_send_bpacket(WATCHDOG_BPK_R_COPY_FILE, BPACKET_ADDRESS_ESP32,
+                                      pathSize + 1 + WD_COPY_FILE_START_NUM_BYTES, data);
+        result            = maple_receive_transfer(target, WATCHDOG_BPK_R_COPY_FILE);
+        *numBytesReceived = activeDevice->numBytesInOrder;
+    }
+
+    uint32_t timeMs = maple_os_get_time_ms() - startTime;
+
+    // Only the bytes received without any gaps are kept to carry on from
+    if (result != TRUE) {
+        maple_os_truncate_file(target, startByte + activeDevice->numBytesInOrder);
+        fclose(target);
+        maple_print_sync_file(fileName, "failed", *numBytesReceived, timeMs);
+        return FALSE;
+    }
+
+    fseek(target, 0, SEEK_END);
+    long numBytes = ftell(target);
+    fclose(target);
+
+    // Windows does not rename over a file that already exists
+    remove(path);
+    if ((numBytes != (long)record->numBytes) || (rename(partPath, path) != 0)) {
+        maple_print_sync_file(fileName, "failed", *numBytesReceived, timeMs);
+        return FALSE;
+    }
+
+    maple_print_sync_file(fileName, (startByte > 0) ? "resumed" : "ok", *numBytesReceived, timeMs);
+    return TRUE;
+}
+
+uint8_t maple_sync_operation(void* arg) {
 
-    int packetsFinished = FALSE;
-    while (packetsFinished == FALSE) {
+    maple_sync_t* sync = (maple_sync_t*)arg;
+    uint8_t index      = activeDevice->index;
 
-        // Wait until the packet is ready
-        while (packetPendingIndex == packetBufferIndex) {}
+    // Each device is given its own folder unless it is the only one
+    char folder[MAPLE_PATH_SIZE];
+    if (numDevices == 1) {
+        snprintf(folder, sizeof(folder), "%s", sync->dest);
+    } else {
+        char deviceName[MAPLE_DEVICE_NAME_SIZE];
+        maple_to_file_name(activeDevice->name, deviceName);
+        snprintf(folder, sizeof(folder), "%s/%s", sync->dest, deviceName);
+    }
 
-        bpacket_t* bpacket = maple_get_next_bpacket_response();
+    if (maple_os_make_dir(folder) != TRUE) {
+        printf("sync device=%s status=failed error=folder\n", activeDevice->name);
+        return FALSE;
+    }
 
-        // Packet ready. Print its contents
-        for (int i = 0; i < bpacket->numBytes; i++) {
-            printf("%c", bpacket->bytes[i]);
-        }
+    maple_negotiate_baud_rate();
 
-        if (bpacket->request == BPACKET_CODE_SUCCESS) {
-            packetsFinished = TRUE;
+    FILE* imageIndex = tmpfile();
+    if ((imageIndex == NULL) || (maple_download_image_index(imageIndex, 0) != TRUE)) {
+        printf("sync device=%s status=failed error=index\n", activeDevice->name);
+        if (imageIndex != NULL) {
+            fclose(imageIndex);
         }
+        return FALSE;
     }
-}
 
-int maple_read_port(void* buf, size_t count, unsigned int timeout_ms) {
+    uint8_t bytes[WD_IMAGE_RECORD_NUM_BYTES];
+    wd_image_record_t record;
 
-    if (activePort == NULL) {
-        return 0;
-    }
+    uint32_t startTime = maple_os_get_time_ms();
+    fseek(imageIndex, 0, SEEK_SET);
+    while (fread(bytes, 1, WD_IMAGE_RECORD_NUM_BYTES, imageIndex) == WD_IMAGE_RECORD_NUM_BYTES) {
+        wd_bytes_to_image_record(bytes, &record);
 
-    return sp_blocking_read(activePort, buf, count, timeout_ms);
-}
+        long numBytesReceived;
+        if (maple_sync_file(folder, &record, &numBytesReceived) != TRUE) {
+            sync->numFailed[index]++;
+        }
 
-DWORD WINAPI maple_listen_rx(void* arg) {
+        sync->numFiles[index]++;
+        sync->numBytes[index] += numBytesReceived;
+    }
 
-    uint16_t numBytes            = 0;
-    uint8_t expectedByteId       = BPACKET_START_BYTE_UPPER_ID;
-    uint8_t numDataBytesReceived = 0;
-    uint8_t numDataBytesExpected = 0;
-    uint8_t bpacketByteIndex     = 0;
-    uint8_t byte;
-    uint8_t connectionFlag = FALSE;
+    fclose(imageIndex);
 
-    while ((numBytes = maple_read_port(&byte, 1, 0)) >= 0) {
+    uint32_t timeMs = maple_os_get_time_ms() - startTime;
+    printf("sync device=%s status=%s files=%u failed=%u bytes=%li ms=%u bytes_per_s=%li\n", activeDevice->name,
+           (sync->numFailed[index] == 0) ? "ok" : "failed", sync->numFiles[index], sync->numFailed[index],
+           sync->numBytes[index], timeMs, (timeMs > 0) ? (sync->numBytes[index] * 1000) / timeMs : 0);
 
-        if (expectedByteId == BPACKET_DATA_BYTE_ID) {
+    return (sync->numFailed[index] == 0) ? TRUE : FALSE;
+}
 
-            // Increment the number of data bytes received
-            numDataBytesReceived++;
+/**
+ * @brief Downloads every image on every device that is not already in the destination
+ * folder. Prints a line of key=value pairs for each image and each device
+ *
+ * @return int 0 if every image was downloaded else 1
+ */
+int maple_sync(int argc, char** argv) {
 
-            // Set the expected byte to stop byte if this is the last data byte expected
-            if (numDataBytesReceived == numDataBytesExpected) {
-                expectedByteId = BPACKET_STOP_BYTE_UPPER_ID;
-            }
+    maple_sync_t sync = {0};
+    sync.dest         = maple_get_option(argc, argv, "--dest\0");
+    if (sync.dest == NULL) {
+        printf("Usage: sync --dest DIR\n");
+        return 1;
+    }
 
-            // Add byte to bpacket
-            packetBuffer[packetBufferIndex].bytes[bpacketByteIndex++] = byte;
-            continue;
-        }
+    if (maple_os_make_dir(sync.dest) != TRUE) {
+        printf("sync status=failed error=folder\n");
+        return 1;
+    }
 
-        if ((expectedByteId == BPACKET_STOP_BYTE_LOWER_ID) && (byte == BPACKET_STOP_BYTE_LOWER)) {
+    maple_fan_out_t fanOut = {.operation = maple_sync_operation, .arg = &sync};
 
-            // End of packet reached. Reset the system
-            expectedByteId = BPACKET_START_BYTE_UPPER_ID;
+    uint32_t startTime = maple_os_get_time_ms();
+    maple_run_on_all_devices(&fanOut);
+    uint32_t timeMs = maple_os_get_time_ms() - startTime;
 
-            // Print out the data of the bpacket if the bpacket was a message
-            if ((packetBuffer[packetBufferIndex].request == BPACKET_GEN_R_MESSAGE) ||
-                (packetBuffer[packetBufferIndex].code == BPACKET_CODE_ERROR)) {
+    uint32_t numFiles = 0, numFailed = 0;
+    uint8_t numPassed  = 0;
+    long totalNumBytes = 0;
+    for (uint8_t i = 0; i < numDevices; i++) {
+        numPassed += (fanOut.results[i] == TRUE) ? 1 : 0;
+        numFiles += sync.numFiles[i];
+        numFailed += sync.numFailed[i];
+        totalNumBytes += sync.numBytes[i];
+    }
 
-                switch (packetBuffer[packetBufferIndex].code) {
+    printf("sync status=%s devices=%i passed=%i files=%u failed=%u bytes=%li ms=%u bytes_per_s=%li\n",
+           (numPassed == numDevices) ? "ok" : "failed", numDevices, numPassed, numFiles, numFailed, totalNumBytes,
+           timeMs, (timeMs > 0) ? (totalNumBytes * 1000) / timeMs : 0);
 
-                    case BPACKET_CODE_SUCCESS:
-                        printf(ASCII_COLOR_GREEN);
-                        break;
+    return (numPassed == numDevices) ? 0 : 1;
+}
 
-                    case BPACKET_CODE_DEBUG:
-                        printf(ASCII_COLOR_BLUE);
-                        break;
+/**
+ * @brief Streams frames from the first device to disk. Prints a line of key=value pairs
+ * for each frame, the frames per second every MAPLE_STREAM_FPS_PERIOD and the frame
+ * count the ESP32 gives when the stream is stopped
+ *
+ * @param argv --frames N stops after N frames, else frames are streamed until Maple is
+ * stopped. --fps N asks for at most N frames a second. --dest DIR saves every frame to
+ * DIR, else each frame is written over MAPLE_STREAM_FILE_NAME
+ * @return int 0 if every frame was received else 1
+ */
+int maple_stream_to_disk(int argc, char** argv) {
 
-                    case BPACKET_CODE_TODO:
-                        printf(ASCII_COLOR_MAGENTA);
-                        break;
+    char* option       = maple_get_option(argc, argv, "--frames\0");
+    uint32_t numFrames = (option != NULL) ? strtoul(option, NULL, 10) : 0;
+    option             = maple_get_option(argc, argv, "--fps\0");
+    uint32_t maxFps    = (option != NULL) ? strtoul(option, NULL, 10) : 0;
+    char* dest         = maple_get_option(argc, argv, "--dest\0");
 
-                    case BPACKET_CODE_ERROR:
-                        printf(ASCII_COLOR_RED);
-                        break;
+    if ((dest != NULL) && (maple_os_make_dir(dest) != TRUE)) {
+        printf("stream status=failed error=folder\n");
+        return 1;
+    }
 
-                    default:
-                        break;
-                }
+    maple_negotiate_baud_rate();
 
-                for (int i = 0; i < packetBuffer[packetBufferIndex].numBytes; i++) {
-                    printf("%c", packetBuffer[packetBufferIndex].bytes[i]);
-                }
-                printf(ASCII_COLOR_WHITE);
-            }
+    char path[MAPLE_PATH_SIZE] = MAPLE_STREAM_FILE_NAME;
+    uint8_t failed             = FALSE;
+    uint32_t startTime         = maple_os_get_time_ms();
+    uint32_t fpsStart          = startTime;
+    uint32_t fpsNumFrames      = 0;
 
-            // Increment the packet buffer. Reset the buffer index
-            bpacket_increment_circ_buff_index(&packetBufferIndex, PACKET_BUFFER_SIZE);
+    for (uint32_t frame = 0; (numFrames == 0) || (frame < numFrames); frame++) {
 
-            bpacketByteIndex = 0;
-            continue;
+        // Frames are asked for on a fixed schedule so one slow frame does not hold back the rest
+        if (maxFps != 0) {
+            int32_t waitTime = (int32_t)((startTime + (uint32_t)(((uint64_t)frame * 1000) / maxFps)) -
+                                         maple_os_get_time_ms());
+            if (waitTime > 0) {
+                maple_os_sleep_ms(waitTime);
+            }
         }
 
-        if ((expectedByteId == BPACKET_STOP_BYTE_UPPER_ID) && (byte == BPACKET_STOP_BYTE_UPPER)) {
-            expectedByteId = BPACKET_STOP_BYTE_LOWER_ID;
-            continue;
+        if (dest != NULL) {
+            snprintf(path, sizeof(path), "%s/frame_%05u.jpg", dest, frame);
         }
 
-        if (expectedByteId == BPACKET_NUM_BYTES_BYTE_ID) {
-
-            // Set the number of bytes in the bpacket
-            packetBuffer[packetBufferIndex].numBytes = byte;
-
-            // Set the number of data bytes expected
-            numDataBytesExpected = byte;
-            numDataBytesReceived = 0;
+        uint32_t frameStart = maple_os_get_time_ms();
+        uint8_t result      = maple_stream(path);
+        uint32_t timeMs     = maple_os_get_time_ms() - frameStart;
 
-            // Update the expected byte to data bytes
-            if (byte == 0) {
-                expectedByteId = BPACKET_STOP_BYTE_UPPER_ID;
-            } else {
-                expectedByteId = BPACKET_DATA_BYTE_ID;
-            }
+        printf("stream device=%s frame=%u file=%s status=%s bytes=%u ms=%u\n", activeDevice->name, frame, path,
+               (result == TRUE) ? "ok" : "failed", activeDevice->numBytesInOrder, timeMs);
 
-            continue;
+        if (result != TRUE) {
+            failed = TRUE;
+            break;
         }
 
-        if (expectedByteId == BPACKET_CODE_BYTE_ID) {
-            packetBuffer[packetBufferIndex].code = byte;
-
-            expectedByteId = BPACKET_NUM_BYTES_BYTE_ID;
-            continue;
+        fpsNumFrames++;
+        uint32_t fpsTime = maple_os_get_time_ms() - fpsStart;
+        if (fpsTime >= MAPLE_STREAM_FPS_PERIOD) {
+            printf("stream device=%s fps=%.2f\n", activeDevice->name, (fpsNumFrames * 1000.0) / fpsTime);
+            fpsNumFrames = 0;
+            fpsStart     = maple_os_get_time_ms();
         }
 
-        if (expectedByteId == BPACKET_REQUEST_BYTE_ID) {
-            packetBuffer[packetBufferIndex].request = byte;
-
-            expectedByteId = BPACKET_CODE_BYTE_ID;
-            continue;
-        }
+        fflush(stdout);
+    }
 
-        if (expectedByteId == BPACKET_SENDER_BYTE_ID) {
-            packetBuffer[packetBufferIndex].sender = byte;
+    // End the stream session now instead of leaving the ESP32 to time it out
+    maple_create_and_send_bpacket(WATCHDOG_BPK_R_STOP_STREAM, BPACKET_ADDRESS_ESP32, 0, NULL);
 
-            expectedByteId = BPACKET_REQUEST_BYTE_ID;
-            continue;
-        }
+    bpacket_t* response;
+    if ((maple_get_response(&response, WATCHDOG_BPK_R_STOP_STREAM, MAPLE_LINK_REPLY_TIMEOUT) != TRUE) ||
+        (response->code != BPACKET_CODE_SUCCESS) || (response->numBytes < WD_STREAM_RESULT_NUM_BYTES)) {
+        printf("stream device=%s status=failed error=stop\n", activeDevice->name);
+        return 1;
+    }
 
-        if (expectedByteId == BPACKET_RECEIVER_BYTE_ID) {
+    uint16_t numFramesSent = (response->bytes[0] << 8) | response->bytes[1];
+    uint16_t fpsX100       = (response->bytes[2] << 8) | response->bytes[3];
+    printf("stream device=%s status=%s frames=%u fps=%u.%02u\n", activeDevice->name, (failed == TRUE) ? "failed" : "ok",
+           numFramesSent, fpsX100 / 100, fpsX100 % 100);
 
-            packetBuffer[packetBufferIndex].receiver = byte;
-            expectedByteId                           = BPACKET_SENDER_BYTE_ID;
-            continue;
-        }
+    return (failed == TRUE) ? 1 : 0;
+}
 
-        if ((expectedByteId == BPACKET_START_BYTE_LOWER_ID) && (byte == BPACKET_START_BYTE_LOWER)) {
+/**
+ * @brief Gets the camera settings from the ESP32 and the capture times from the STM32
+ *
+ * @return uint8_t TRUE if both were received else FALSE
+ */
+uint8_t maple_get_settings(wd_settings_t* settings) {
 
-            expectedByteId = BPACKET_RECEIVER_BYTE_ID;
-            continue;
-        }
+    bpacket_t* response;
 
-        if ((expectedByteId == BPACKET_START_BYTE_UPPER_ID) && (byte == BPACKET_START_BYTE_UPPER)) {
-            expectedByteId = BPACKET_START_BYTE_LOWER_ID;
+    maple_create_and_send_bpacket(WATCHDOG_BPK_R_GET_CAMERA_SETTINGS, BPACKET_ADDRESS_ESP32, 0, NULL);
+    if ((maple_get_response(&response, WATCHDOG_BPK_R_GET_CAMERA_SETTINGS, MAPLE_LINK_REPLY_TIMEOUT) != TRUE) ||
+        (wd_bpacket_to_camera_settings(response, &settings->cameraSettings) != TRUE)) {
+        return FALSE;
+    }
 
-            // Reset the byte index
-            bpacketByteIndex = 0;
+    maple_create_and_send_bpacket(WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS, BPACKET_ADDRESS_STM32, 0, NULL);
+    if ((maple_get_response(&response, WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS, MAPLE_LINK_REPLY_TIMEOUT) != TRUE) ||
+        (wd_bpacket_to_capture_time_settings(response, &settings->captureTime) != TRUE)) {
+        return FALSE;
+    }
 
-            // Flag just to indicate when transmission has occured
-            connectionFlag = TRUE;
+    return TRUE;
+}
 
-            continue;
-        }
+void maple_print_settings(wd_settings_t* settings) {
 
-        // If the micrcontroller is unplugged from the computer than the number of bytes read
-        // will be larger than 1. If this is the case, exit the thread
-        if ((connectionFlag == TRUE) && (numBytes > 1)) {
-            printf("%sExiting thread%s\n", ASCII_COLOR_MAGENTA, ASCII_COLOR_WHITE);
-            break;
+    char* resolution = "unknown";
+    for (int i = 0; i < MAPLE_NUM_RESOLUTIONS; i++) {
+        if (mapleResolutions[i] == settings->cameraSettings.resolution) {
+            resolution = mapleResolutionNames[i];
         }
+    }
 
-        printf("%c", byte);
+    printf("settings device=%s status=ok resolution=%s start=%02i:%02i end=%02i:%02i interval=%02i:%02i\n",
+           activeDevice->name, resolution, settings->captureTime.startTime.hour,
+           settings->captureTime.startTime.minute, settings->captureTime.endTime.hour,
+           settings->captureTime.endTime.minute, settings->captureTime.intervalTime.hour,
+           settings->captureTime.intervalTime.minute);
+}
 
-        // Erraneous byte. Reset the system
-        expectedByteId = BPACKET_START_BYTE_UPPER_ID;
-    }
+uint8_t maple_get_settings_operation(void* arg) {
 
-    if (numBytes < 0) {
-        printf("Error reading COM port\n");
+    wd_settings_t settings;
+    if (maple_get_settings(&settings) != TRUE) {
+        printf("settings device=%s status=failed error=get\n", activeDevice->name);
+        return FALSE;
     }
 
-    return FALSE;
+    maple_print_settings(&settings);
+    return TRUE;
 }
 
-uint8_t maple_connect_to_device(uint8_t address, uint8_t pingCode) {
+uint8_t maple_set_settings_operation(void* arg) {
 
-    // Create a struct to hold all the COM ports currently in use
-    struct sp_port** port_list;
+    maple_settings_change_t* change = (maple_settings_change_t*)arg;
 
-    if (sp_list_ports(&port_list) != SP_OK) {
-        printf("Failed to list ports\r\n");
-        return 0;
+    // Settings that were not given are sent back as they are
+    wd_settings_t settings = {0};
+    if (maple_get_settings(&settings) != TRUE) {
+        printf("settings device=%s status=failed error=get\n", activeDevice->name);
+        return FALSE;
     }
 
-    // Loop through all the ports
-    uint8_t portFound = FALSE;
+    bpacket_t request;
+    bpacket_t* response;
 
-    for (int i = 0; port_list[i] != NULL; i++) {
+    if ((change->changed & MAPLE_SETTING_RESOLUTION) != 0) {
+        settings.cameraSettings = change->settings.cameraSettings;
+        uint8_t result = wd_camera_settings_to_bpacket(&request, BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_MAPLE,
+                                                       WATCHDOG_BPK_R_SET_CAMERA_SETTINGS, BPACKET_CODE_EXECUTE,
+                                                       &settings.cameraSettings);
 
-        activePort = port_list[i];
-
-        // Open the port
-        enum sp_return result = sp_open(activePort, SP_MODE_READ_WRITE);
-        if (result != SP_OK) {
-            return result;
+        if ((result != TRUE) || (maple_send_bpacket(&request) != TRUE) ||
+            (maple_get_response(&response, WATCHDOG_BPK_R_SET_CAMERA_SETTINGS, MAPLE_LINK_REPLY_TIMEOUT) != TRUE) ||
+            (response->code != BPACKET_CODE_SUCCESS)) {
+            printf("settings device=%s status=failed error=resolution\n", activeDevice->name);
+            return FALSE;
         }
+    }
 
-        // Configure the port settings for communication
-        sp_set_baudrate(activePort, 115200);
-        sp_set_bits(activePort, 8);
-        sp_set_parity(activePort, SP_PARITY_NONE);
-        sp_set_stopbits(activePort, 1);
-        sp_set_flowcontrol(activePort, SP_FLOWCONTROL_NONE);
-
-        // Send a ping
-        bpacket_t bpacket;
-        bpacket_buffer_t bpacketBuffer;
-        bpacket_create_p(&bpacket, BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE, BPACKET_GEN_R_PING,
-                         BPACKET_CODE_EXECUTE, 0, NULL);
-        bpacket_to_buffer(&bpacket, &bpacketBuffer);
+    if ((change->changed & (MAPLE_SETTING_START | MAPLE_SETTING_END | MAPLE_SETTING_INTERVAL)) != 0) {
 
-        if (sp_blocking_write(activePort, bpacketBuffer.buffer, bpacketBuffer.numBytes, 100) < 0) {
-            printf("Unable to write\n");
-            continue;
+        if ((change->changed & MAPLE_SETTING_START) != 0) {
+            settings.captureTime.startTime = change->settings.captureTime.startTime;
         }
 
-        // Response may include other incoming messages as well, not just a response to a ping.
-        // Create a timeout of 2 seconds and look for response from ping
+        if ((change->changed & MAPLE_SETTING_END) != 0) {
+            settings.captureTime.endTime = change->settings.captureTime.endTime;
+        }
 
-        clock_t startTime = clock();
-        while ((clock() - startTime) < 200) {
+        if ((change->changed & MAPLE_SETTING_INTERVAL) != 0) {
+            settings.captureTime.intervalTime = change->settings.captureTime.intervalTime;
+        }
 
-            // Wait for bpacket to be received
-            while (packetPendingIndex != packetBufferIndex) {
+        // The STM32 passes the capture times on to the ESP32 before it replies
+        uint8_t result = wd_capture_time_settings_to_bpacket(&request, BPACKET_ADDRESS_STM32, BPACKET_ADDRESS_MAPLE,
+                                                             WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS,
+                                                             BPACKET_CODE_EXECUTE, &settings.captureTime);
 
-                // Confirm the request is valid
-                if (packetBuffer[packetPendingIndex].request == BPACKET_GEN_R_PING) {
+        if ((result != TRUE) || (maple_send_bpacket(&request) != TRUE) ||
+            (maple_get_response(&response, WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS, MAPLE_LINK_REPLY_TIMEOUT) !=
+             TRUE) ||
+            (response->code != BPACKET_CODE_SUCCESS)) {
+            printf("settings device=%s status=failed error=capture_time\n", activeDevice->name);
+            return FALSE;
+        }
+    }
 
-                    // Confirm the ping code was correct
-                    if (packetBuffer[packetPendingIndex].bytes[0] == WATCHDOG_PING_CODE_STM32) {
-                        portFound = TRUE;
-                    }
-                }
+    maple_print_settings(&settings);
+    return TRUE;
+}
 
-                bpacket_increment_circ_buff_index(&packetPendingIndex, PACKET_BUFFER_SIZE);
-            }
-        }
+/**
+ * @brief Checks whether a key=value setting is for the given key
+ *
+ */
+uint8_t maple_setting_is(char* setting, char* key) {
 
-        // Close port and check next port if this was not the correct port
-        if (portFound != TRUE) {
-            sp_close(activePort);
-            continue;
-        }
+    size_t keySize = strlen(key);
+    return ((strncmp(setting, key, keySize) == 0) && (setting[keySize] == '=')) ? TRUE : FALSE;
+}
 
-        break;
-    }
+uint8_t maple_parse_time(char* value, dt_time_t* time) {
 
-    if (portFound != TRUE) {
+    unsigned int hour, minute;
+    char extra;
+    if ((sscanf(value, "%u:%u%c", &hour, &minute, &extra) != 2) || (dt_time_valid(0, minute, hour) != TRUE)) {
         return FALSE;
     }
 
+    dt_time_init(time, 0, minute, hour);
     return TRUE;
 }
 
-uint8_t maple_stream(char* cpyFileName) {
+/**
+ * @brief Reads a key=value setting given to 'settings set' into the change
+ *
+ * @param setting One of resolution=WxH, start=HH:MM, end=HH:MM or interval=HH:MM
+ * @return uint8_t TRUE if the setting is valid else FALSE
+ */
+uint8_t maple_parse_setting(char* setting, maple_settings_change_t* change) {
 
-    FILE* target;
-    target = fopen(cpyFileName, "wb"); // Read binary
+    char* value = strchr(setting, '=');
+    if (value == NULL) {
+        return FALSE;
+    }
+
+    value++;
+
+    if (maple_setting_is(setting, "resolution\0") == TRUE) {
+        for (int i = 0; i < MAPLE_NUM_RESOLUTIONS; i++) {
+            if (chars_same(value, mapleResolutionNames[i]) == TRUE) {
+                change->settings.cameraSettings.resolution = mapleResolutions[i];
+                change->changed |= MAPLE_SETTING_RESOLUTION;
+                return TRUE;
+            }
+        }
 
-    if (target == NULL) {
-        printf("Could not open file\n");
-        fclose(target);
         return FALSE;
     }
 
-    // Send command to copy file. Keeping reading until no more data to send across
-    maple_create_and_send_bpacket(WATCHDOG_BPK_R_STREAM_IMAGE, BPACKET_ADDRESS_ESP32, 0, NULL);
+    if (maple_setting_is(setting, "start\0") == TRUE) {
+        change->changed |= MAPLE_SETTING_START;
+        return maple_parse_time(value, &change->settings.captureTime.startTime);
+    }
 
-    int packetsFinished = FALSE;
-    clock_t startTime;
-    while (packetsFinished == FALSE) {
+    if (maple_setting_is(setting, "end\0") == TRUE) {
+        change->changed |= MAPLE_SETTING_END;
+        return maple_parse_time(value, &change->settings.captureTime.endTime);
+    }
 
-        // Wait until the packet is ready
-        startTime = clock();
-        while (packetPendingIndex == packetBufferIndex) {
+    if (maple_setting_is(setting, "interval\0") == TRUE) {
+        change->changed |= MAPLE_SETTING_INTERVAL;
+        return maple_parse_time(value, &change->settings.captureTime.intervalTime);
+    }
 
-            if ((clock() - startTime) > 6000) {
-                printf("Timeout 1000ms\n");
-                return FALSE;
+    return FALSE;
+}
+
+/**
+ * @brief Prints or changes the settings of every device. 'settings get' prints them and
+ * 'settings set key=value...' changes the ones given then prints them
+ *
+ * @return int 0 if every device passed else 1
+ */
+int maple_settings(int argc, char** argv) {
+
+    maple_settings_change_t change = {0};
+    maple_fan_out_t fanOut         = {.operation = maple_get_settings_operation, .arg = NULL};
+
+    if ((argc > 1) && (chars_same(argv[0], "set\0") == TRUE)) {
+        for (int i = 1; i < argc; i++) {
+            if (maple_parse_setting(argv[i], &change) != TRUE) {
+                printf("Invalid setting '%s'\n", argv[i]);
+                return 1;
             }
         }
 
-        if (packetBuffer[packetPendingIndex].request == BPACKET_GEN_R_MESSAGE) {
-            bpacket_increment_circ_buff_index(&packetPendingIndex, PACKET_BUFFER_SIZE);
-            continue;
-        }
+        fanOut.operation = maple_set_settings_operation;
+        fanOut.arg       = &change;
+    } else if ((argc != 1) || (chars_same(argv[0], "get\0") != TRUE)) {
+        printf("Usage: settings get | settings set [resolution=WxH] [start=HH:MM] [end=HH:MM] [interval=HH:MM]\n");
+        return 1;
+    }
 
-        if (packetBuffer[packetPendingIndex].request != BPACKET_CODE_IN_PROGRESS &&
-            packetBuffer[packetPendingIndex].request != BPACKET_CODE_SUCCESS) {
-            printf("PACKET ERROR FOUND. Request %i\n", packetBuffer[packetPendingIndex].request);
-            fclose(target);
-            return FALSE;
-        }
+    maple_run_on_all_devices(&fanOut);
 
-        if (packetBuffer[packetPendingIndex].request == BPACKET_CODE_SUCCESS) {
-            packetsFinished = TRUE;
+    for (uint8_t i = 0; i < numDevices; i++) {
+        if (fanOut.results[i] != TRUE) {
+            return 1;
         }
+    }
+
+    return 0;
+}
+
+#ifndef _WIN32
+uint8_t maple_start_sim_devices(int numSimDevices) {
 
-        printf("Storing data\n");
-        for (int i = 0; i < packetBuffer[packetPendingIndex].numBytes; i++) {
-            fputc(packetBuffer[packetPendingIndex].bytes[i], target);
+    for (int i = 0; i < numSimDevices; i++) {
+
+        int simFd = maple_sim_start_device();
+        if (simFd < 0) {
+            printf("Unable to start simulated device\n");
+            break;
         }
 
-        bpacket_increment_circ_buff_index(&packetPendingIndex, PACKET_BUFFER_SIZE);
+        // Simulated devices are connected the same way as real ones
+        maple_device_t* device = maple_create_device(NULL, simFd);
+        if ((device == NULL) || (maple_ping_device(device) != TRUE) || (maple_add_device(device) != TRUE)) {
+            printf("Unable to connect to simulated device\n");
+            maple_sim_stop_device(simFd);
+            free(device);
+            break;
+        }
     }
 
-    fclose(target);
+    return numDevices;
+}
+#endif
 
-    return TRUE;
+#ifdef _WIN32
+void maple_wake_gui(void) {
+
+    // The GUI waits on the event until its window is made and on window messages after that
+    maple_os_event_signal(&guiEvent);
+    gui_wake();
 }
+#endif
 
 int main(int argc, char** argv) {
 
-    HANDLE thread = CreateThread(NULL, 0, maple_listen_rx, NULL, 0, NULL);
+    maple_os_event_init(&guiEvent);
+    maple_os_event_init(&fanOutDone);
+    maple_ring_init(&guiToMainRing, guiToMainBpackets, MAPLE_GUI_RING_SIZE);
+    maple_ring_init(&mainToGuiRing, mainToGuiBpackets, MAPLE_GUI_RING_SIZE);
+
+    uint8_t simulated = FALSE;
+
+#ifndef _WIN32
+    // Talk to simulated Watchdogs instead of the ones plugged in. The arguments after the
+    // number of devices are handled as normal
+    if ((argc > 2) && (chars_same(argv[1], "sim\0") == TRUE)) {
+        maple_start_sim_devices(atoi(argv[2]));
+        simulated = TRUE;
+        argc -= 2;
+        argv += 2;
+    }
+#endif
 
-    if (!thread) {
-        printf("Thread failed\n");
-        return 0;
+    // Try connect to every device
+    if (simulated != TRUE) {
+        maple_connect_to_devices();
     }
 
-    // Try connect to the device
-    if (maple_connect_to_device(BPACKET_ADDRESS_STM32, WATCHDOG_PING_CODE_STM32) != TRUE) {
+    if (numDevices == 0) {
         printf("Unable to connect to device\n");
-        TerminateThread(thread, 0);
-        return FALSE;
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < numDevices; i++) {
+        printf("Connected to port %s\n", devices[i]->name);
+    }
+
+    maple_fan_out_t extFraming = {.operation = maple_ext_framing_operation, .arg = NULL};
+    maple_run_on_all_devices(&extFraming);
+
+    // Run an operation on every device at once instead of starting the GUI
+    if ((argc > 2) && (chars_same(argv[1], "all\0") == TRUE)) {
+        if (maple_all_devices(argv[2]) != TRUE) {
+            printf("Unknown operation '%s'\n", argv[2]);
+        }
+        return 0;
+    }
+
+    // Scripted commands that print a line of key=value pairs for each step instead of starting the GUI
+    if ((argc > 1) && (chars_same(argv[1], "sync\0") == TRUE)) {
+        return maple_sync(argc - 2, argv + 2);
+    }
+
+    if ((argc > 1) && (chars_same(argv[1], "settings\0") == TRUE)) {
+        return maple_settings(argc - 2, argv + 2);
+    }
+
+    // Everything else talks to the first device
+    activeDevice = devices[0];
+
+    if ((argc > 1) && (chars_same(argv[1], "stream\0") == TRUE)) {
+        return maple_stream_to_disk(argc - 2, argv + 2);
+    }
+
+    // Measure the throughput at every baud rate instead of starting the GUI
+    if ((argc > 1) && (chars_same(argv[1], "benchmark\0") == TRUE)) {
+        maple_benchmark();
+        return 0;
+    }
+
+    // Time one windowed transfer at the current baud rate. Simulated devices are held to the
+    // baud rate so the result can be compared with the hardware
+    if ((argc > 1) && (chars_same(argv[1], "goodput\0") == TRUE)) {
+#ifndef _WIN32
+        if (simulated == TRUE) {
+            maple_sim_set_baud_rate(activeDevice->baudRate);
+        }
+#endif
+        return maple_goodput();
+    }
+
+    // Print the images saved on the SD card instead of starting the GUI. An optional
+    // image number skips the records before it
+    if ((argc > 1) && (chars_same(argv[1], "index\0") == TRUE)) {
+        maple_get_image_index((argc > 2) ? atoi(argv[2]) : 0);
+        return 0;
     }
 
-    printf("Connected to port %s\n", sp_get_port_name(activePort));
+    printf("Baud rate: %u\n", maple_negotiate_baud_rate());
 
     // maple_test();
 
     // maple_stream("testImage.jpg");
     // printf("File saved\n");
 
-    // maple_command_line();
-
-    bpacket_circular_buffer_t guiToMainCircularBuffer1;
-    bpacket_create_circular_buffer(&guiToMainCircularBuffer1, &guiWriteIndex, &mainReadIndex, &guiToMainBpackets[0]);
-
-    bpacket_circular_buffer_t mainToGuiCircularBuffer1;
-    bpacket_create_circular_buffer(&mainToGuiCircularBuffer1, &mainWriteIndex, &guiReadIndex, &mainToGuiBpackets[0]);
+#ifndef _WIN32
+    // The GUI is only built on Windows
+    maple_command_line();
+    return 0;
+#else
+    // Fill in whatever the STM32 sent last while connecting
+    bpacket_t* infoBpacket = maple_get_next_bpacket_response();
+    static bpacket_t noInfo;
+    if (infoBpacket == NULL) {
+        infoBpacket = &noInfo;
+    }
 
     watchdog_info_t watchdogInfo;
-    watchdogInfo.id               = packetBuffer[packetPendingIndex].bytes[0];
-    watchdogInfo.cameraResolution = packetBuffer[packetPendingIndex].bytes[1];
-    watchdogInfo.numImages =
-        (packetBuffer[packetPendingIndex].bytes[2] << 8) | packetBuffer[packetPendingIndex].bytes[3];
-    watchdogInfo.status = (packetBuffer[packetPendingIndex].bytes[4] == 0) ? SYSTEM_STATUS_OK : SYSTEM_STATUS_ERROR;
+    watchdogInfo.id               = infoBpacket->bytes[0];
+    watchdogInfo.cameraResolution = infoBpacket->bytes[1];
+    watchdogInfo.numImages        = (infoBpacket->bytes[2] << 8) | infoBpacket->bytes[3];
+    watchdogInfo.status           = (infoBpacket->bytes[4] == 0) ? SYSTEM_STATUS_OK : SYSTEM_STATUS_ERROR;
     sprintf(watchdogInfo.datetime, "01/03/2022 9:15 AM");
 
-    // packetPendingIndex++;
-
     uint32_t flags = 0;
     // uint8_t cameraView = FALSE;
 
     gui_initalisation_t guiInit;
     guiInit.watchdog  = &watchdogInfo;
     guiInit.flags     = &flags;
-    guiInit.guiToMain = &guiToMainCircularBuffer1;
-    guiInit.mainToGui = &mainToGuiCircularBuffer1;
-
-    guiInit.guiToMain = &guiToMainCircularBuffer1;
-    guiInit.mainToGui = &mainToGuiCircularBuffer1;
+    guiInit.guiToMain = &guiToMainRing;
+    guiInit.mainToGui = &mainToGuiRing;
+    guiInit.mainEvent = &activeDevice->event;
+    guiInit.guiEvent  = &guiEvent;
 
     HANDLE guiThread = CreateThread(NULL, 0, gui, &guiInit, 0, NULL);
 
-    uint8_t startOfImgData = TRUE;
-    FILE* streamImage      = NULL;
-
     if (!guiThread) {
         printf("Thread failed\n");
         return 0;
     }
 
+    // The camera view streams frames until it sends WATCHDOG_BPK_R_STOP_STREAM
+    uint8_t streaming        = FALSE;
+    uint32_t streamNumFrames = 0; // Frames received since streamFpsStart
+    uint32_t streamFpsStart  = 0;
+    uint16_t streamFpsX100   = 0;
+
     while (1) {
+
+        // Sleep until the GUI or the RX thread has something for the main thread. The count is read
+        // before the rings are checked so a bpacket pushed in between still wakes the wait
+        uint32_t eventCount   = maple_os_event_get_count(&activeDevice->event);
+        bpacket_t* guiBpacket = maple_ring_peek(&guiToMainRing);
+        if ((streaming != TRUE) && (guiBpacket == NULL) && (maple_ring_is_empty(&activeDevice->rxRing) == TRUE)) {
+            maple_os_event_wait(&activeDevice->event, eventCount, MAPLE_OS_WAIT_FOREVER);
+            continue;
+        }
+
+        // The camera view starts a stream session on the ESP32 with its first frame
+        if ((guiBpacket != NULL) && (guiBpacket->request == WATCHDOG_BPK_R_STREAM_IMAGE)) {
+
+            maple_ring_pop(&guiToMainRing);
+
+            streaming       = TRUE;
+            streamNumFrames = 0;
+            streamFpsStart  = maple_os_get_time_ms();
+            streamFpsX100   = 0;
+            continue;
+        }
+
+        // Streamed images are received here so corrupted chunks can be requested again. The next
+        // frame is asked for as soon as the last one arrives unless the GUI has sent something
+        if ((streaming == TRUE) && (guiBpacket == NULL)) {
+
+            if (maple_stream(CAMERA_VIEW_FILENAME) != TRUE) {
+                continue;
+            }
+
+            streamNumFrames++;
+            uint32_t fpsTime = maple_os_get_time_ms() - streamFpsStart;
+            if (fpsTime >= MAPLE_STREAM_FPS_PERIOD) {
+                streamFpsX100   = (streamNumFrames * 100000) / fpsTime;
+                streamNumFrames = 0;
+                streamFpsStart  = maple_os_get_time_ms();
+            }
+
+            uint8_t fps[2] = {(streamFpsX100 >> 8) & 0xFF, streamFpsX100 & 0xFF};
+            bpacket_create_p(maple_ring_get_write_slot(&mainToGuiRing), BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_MAPLE,
+                             GUI_BPK_R_UPDATE_STREAM_IMAGE, BPACKET_CODE_SUCCESS, 2, fps);
+            maple_ring_push(&mainToGuiRing);
+            maple_wake_gui();
+            continue;
+        }
+
         // If a bpacket is recieved from the Gui, deal with it in here
-        if (*guiToMainCircularBuffer1.readIndex != *guiToMainCircularBuffer1.writeIndex) {
-            uint8_t sendStatus = maple_send_bpacket(GTM_CB_CURRENT_BPACKET);
+        if (guiBpacket != NULL) {
+            if (guiBpacket->request == WATCHDOG_BPK_R_STOP_STREAM) {
+                streaming = FALSE;
+            }
+
+            uint8_t sendStatus = maple_send_bpacket(guiBpacket);
             wd_camera_capture_time_settings_t captureTime;
-            if (GTM_CB_CURRENT_BPACKET->request == WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS) {
-                wd_bpacket_to_capture_time_settings(GTM_CB_CURRENT_BPACKET, &captureTime);
+            if (guiBpacket->request == WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS) {
+                wd_bpacket_to_capture_time_settings(guiBpacket, &captureTime);
                 printf("HAYDEN PRINT: Start Time I want it sent to is: %i:%i\n", captureTime.startTime.hour,
                        captureTime.startTime.minute);
             }
@@ -545,52 +2276,21 @@ int main(int argc, char** argv) {
                 printf("%s\n", sendBpErrorMsg);
             }
 
-            // printf("Sending Request %i\n", GTM_CB_CURRENT_BPACKET->request);
+            // printf("Sending Request %i\n", guiBpacket->request);
 
-            bpacket_increment_circular_buffer_index(guiToMainCircularBuffer1.readIndex);
+            maple_ring_pop(&guiToMainRing);
         }
 
-        // If their is a bpacket put into the packet buffer, it gets put in the main-to-gui circular
-        // buffer
-
-        if (packetBufferIndex != packetPendingIndex) {
+        // If their is a bpacket in the RX ring, a copy of it gets put in the main-to-gui ring. The
+        // GUI gets its own copy because the RX thread reuses the slot once main has moved on
 
-            bpacket_t* receivedBpacket = maple_get_next_bpacket_response();
+        bpacket_t* receivedBpacket = maple_get_next_bpacket_response();
+        if (receivedBpacket != NULL) {
 
             if (receivedBpacket->request == BPACKET_GEN_R_MESSAGE) {
                 continue;
             }
 
-            if (receivedBpacket->request == WATCHDOG_BPK_R_STREAM_IMAGE) {
-                if (startOfImgData == TRUE) {
-                    startOfImgData = FALSE;
-
-                    if ((streamImage = fopen(CAMERA_VIEW_FILENAME, "wb")) == NULL) {
-                        // TODO: make this do something proper
-                        printf("Couldnt open stream file");
-                    }
-                    for (int i = 0; i < receivedBpacket->numBytes; i++) {
-                        fputc(receivedBpacket->bytes[i], streamImage);
-                    }
-                } else if (receivedBpacket->code == BPACKET_CODE_SUCCESS) {
-                    startOfImgData = TRUE;
-                    for (int i = 0; i < receivedBpacket->numBytes; i++) {
-                        fputc(receivedBpacket->bytes[i], streamImage);
-                    }
-                    fclose(streamImage);
-                    // Create Bpacket to update the thing
-                    bpacket_create_p(mainToGuiCircularBuffer1.circularBuffer[*mainToGuiCircularBuffer1.writeIndex],
-                                     BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_MAPLE, BPACKET_CODE_EXECUTE,
-                                     GUI_BPK_R_UPDATE_STREAM_IMAGE, 0, NULL);
-                    bpacket_increment_circular_buffer_index(mainToGuiCircularBuffer1.writeIndex);
-                } else if (receivedBpacket->code == BPACKET_CODE_IN_PROGRESS) {
-                    for (int i = 0; i < receivedBpacket->numBytes; i++) {
-                        fputc(receivedBpacket->bytes[i], streamImage);
-                    }
-                }
-                continue;
-            }
-
             if (receivedBpacket->request == WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS) {
                 printf(" ");
             }
@@ -602,24 +2302,28 @@ int main(int argc, char** argv) {
                 printf("GET TIME SETTINGS,(in main, about to go into main to gui buffer) start time %i:%i\n",
                        tempTime.startTime.hour, tempTime.startTime.minute);
             }
-            mainToGuiCircularBuffer1.circularBuffer[*mainToGuiCircularBuffer1.writeIndex] = receivedBpacket;
 
-            // Increae write index of the main to gui circular buffer so that it can be parsed to
-            // the GUI
-            bpacket_increment_circular_buffer_index(mainToGuiCircularBuffer1.writeIndex);
+            *maple_ring_get_write_slot(&mainToGuiRing) = *receivedBpacket;
+            if (maple_ring_push(&mainToGuiRing) != TRUE) {
+                printf("GUI is behind. Dropped %u bpackets\n", maple_ring_get_num_overflows(&mainToGuiRing));
+            }
+
+            maple_wake_gui();
         }
     }
 
     return 0;
+#endif
 }
 
 uint8_t maple_response_is_valid(uint8_t expectedRequest, uint16_t timeout) {
 
     // Print response
-    clock_t startTime = clock();
-    while ((clock() - startTime) < timeout) {
+    uint32_t startTime = maple_os_get_time_ms();
+    uint32_t elapsed;
+    while ((elapsed = maple_os_get_time_ms() - startTime) < timeout) {
 
-        bpacket_t* bpacket = maple_get_next_bpacket_response();
+        bpacket_t* bpacket = maple_wait_for_bpacket_response(timeout - elapsed);
 
         // If there is next response yet then skip
         if (bpacket == NULL) {
@@ -661,22 +2365,18 @@ void maple_command_line(void) {
     while (1) {
 
         // Get input from user
-        gets(userInput);
-
-        // Split the string by spaces
-        char* ptr = strtok(userInput, " ");
-        char* args[5];
-        int numArgs;
-        for (numArgs = 0; ptr != NULL; numArgs++) {
-
-            args[numArgs] = malloc(sizeof(char) * strlen(ptr));
-            strcpy(args[numArgs], ptr);
+        if (fgets(userInput, sizeof(userInput), stdin) == NULL) {
+            return;
+        }
 
-            ptr = strtok(NULL, " ");
+        userInput[strcspn(userInput, "\r\n")] = '\0';
 
-            if (numArgs == MAPLE_MAX_ARGS) {
-                break;
-            }
+        // Split the string by spaces. The args point into the input so nothing has to be copied
+        char* args[MAPLE_MAX_ARGS];
+        int numArgs = 0;
+        for (char* ptr = strtok(userInput, " "); (ptr != NULL) && (numArgs < MAPLE_MAX_ARGS);
+             ptr = strtok(NULL, " ")) {
+            args[numArgs++] = ptr;
         }
 
         if (numArgs == 0) {
@@ -684,12 +2384,7 @@ void maple_command_line(void) {
         }
 
         if (maple_match_args(args, numArgs) == FALSE) {
-            printf(ASCII_COLOR_RED "Unkown command: '%s'\n" ASCII_COLOR_WHITE, userInput);
-        }
-
-        // Free list of args
-        for (int i = 0; i < numArgs; i++) {
-            free(args[i]);
+            printf(ASCII_COLOR_RED "Unkown command: '%s'\n" ASCII_COLOR_WHITE, args[0]);
         }
     }
 }
@@ -727,7 +2422,12 @@ uint8_t maple_match_args(char** args, int numArgs) {
             }
 
             if (chars_same(args[0], "ls\0") == TRUE) {
-                maple_create_and_send_sbpacket(WATCHDOG_BPK_R_LIST_DIR, BPACKET_ADDRESS_ESP32, "\0");
+                maple_list_directory("\0", "\0");
+                return TRUE;
+            }
+
+            if (chars_same(args[0], "index\0") == TRUE) {
+                maple_get_image_index(0);
                 return TRUE;
             }
 
@@ -758,7 +2458,13 @@ uint8_t maple_match_args(char** args, int numArgs) {
         case 2:
 
             if (chars_same(args[0], "ls\0") == TRUE) {
-                maple_create_and_send_sbpacket(WATCHDOG_BPK_R_LIST_DIR, BPACKET_ADDRESS_ESP32, args[1]);
+                maple_list_directory(args[1], "\0");
+                return TRUE;
+            }
+
+            if (chars_same(args[0], "burst\0") == TRUE) {
+                wd_burst_t burst = {.numFrames = atoi(args[1]), .intervalMs = 0, .aeLevelStep = 0};
+                maple_take_burst(&burst);
                 return TRUE;
             }
 
@@ -771,6 +2477,17 @@ uint8_t maple_match_args(char** args, int numArgs) {
 
         case 3:
 
+            if (chars_same(args[0], "ls\0") == TRUE) {
+                maple_list_directory(args[1], args[2]);
+                return TRUE;
+            }
+
+            if (chars_same(args[0], "burst\0") == TRUE) {
+                wd_burst_t burst = {.numFrames = atoi(args[1]), .intervalMs = atoi(args[2]), .aeLevelStep = 0};
+                maple_take_burst(&burst);
+                return TRUE;
+            }
+
             if (chars_same(args[0], "led\0") == TRUE && chars_same(args[1], "red\0") == TRUE &&
                 chars_same(args[2], "on\0") == TRUE) {
                 maple_create_and_send_bpacket(WATCHDOG_BPK_R_LED_RED_ON, BPACKET_ADDRESS_ESP32, 0, NULL);
@@ -797,6 +2514,20 @@ uint8_t maple_match_args(char** args, int numArgs) {
 
             break;
 
+        case 4:
+
+            if (chars_same(args[0], "burst\0") == TRUE) {
+                wd_burst_t burst = {
+                    .numFrames   = atoi(args[1]),
+                    .intervalMs  = atoi(args[2]),
+                    .aeLevelStep = atoi(args[3]),
+                };
+                maple_take_burst(&burst);
+                return TRUE;
+            }
+
+            break;
+
         default:
             break;
     }
@@ -807,10 +2538,11 @@ uint8_t maple_match_args(char** args, int numArgs) {
 uint8_t maple_get_response(bpacket_t** bpacket, uint8_t request, uint16_t timeout) {
 
     // Print response
-    clock_t startTime = clock();
-    while ((clock() - startTime) < timeout) {
+    uint32_t startTime = maple_os_get_time_ms();
+    uint32_t elapsed;
+    while ((elapsed = maple_os_get_time_ms() - startTime) < timeout) {
 
-        *bpacket = maple_get_next_bpacket_response();
+        *bpacket = maple_wait_for_bpacket_response(timeout - elapsed);
 
         // If there is next response yet then skip
         if ((*bpacket != NULL) && ((*bpacket)->request == request)) {
@@ -839,8 +2571,7 @@ uint8_t maple_restart_esp32(void) {
         return FALSE;
     }
 
-    clock_t time = clock();
-    while ((clock() - time) < 200) {}
+    maple_os_sleep_ms(200);
 
     // Delay of 1500ms because the STM32 will automatically delay for 1s when turning the esp32
     // so it has enough time to boot up
@@ -1319,24 +3050,21 @@ void maple_test(void) {
             maple_create_and_send_bpacket(WATCHDOG_BPK_R_STREAM_IMAGE, BPACKET_ADDRESS_ESP32, 0, NULL);
 
             uint8_t fileTransfered = FALSE;
-            clock_t time           = clock();
             while (fileTransfered != TRUE) {
 
-                if ((clock() - time) > 6000) {
+                // Wait for data
+                bpacket_t* packet = maple_wait_for_bpacket_response(6000);
+
+                if (packet == NULL) {
                     fclose(streamImage);
                     printf("%sTime out when receiving image data%s\n", ASCII_COLOR_RED, ASCII_COLOR_WHITE);
                     break;
                 }
 
-                // Wait for data
-                bpacket_t* packet = maple_get_next_bpacket_response();
-
-                if ((packet == NULL) || (packet->request != WATCHDOG_BPK_R_STREAM_IMAGE)) {
+                if (packet->request != WATCHDOG_BPK_R_STREAM_IMAGE) {
                     continue;
                 }
 
-                time = clock();
-
                 // Store data
                 for (int i = 0; i < packet->numBytes; i++) {
                     fputc(packet->bytes[i], streamImage);
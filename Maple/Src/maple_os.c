@@ -0,0 +1,244 @@
+/**
+ * @file maple_os.c
+ * @author Gian Barta-Dougall
+ * @brief Threads, events and timing for Maple on Windows and Linux
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <errno.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/* Personal Includes */
+#include "maple_os.h"
+#include "utilities.h"
+
+typedef struct maple_os_thread_t {
+    maple_os_thread_function_t function;
+    void* arg;
+} maple_os_thread_t;
+
+/* Function Prototypes */
+#ifdef _WIN32
+DWORD WINAPI maple_os_thread_start(void* arg);
+#else
+void* maple_os_thread_start(void* arg);
+#endif
+
+#ifdef _WIN32
+DWORD WINAPI maple_os_thread_start(void* arg) {
+#else
+void* maple_os_thread_start(void* arg) {
+#endif
+
+    maple_os_thread_t thread = *(maple_os_thread_t*)arg;
+    free(arg);
+
+    thread.function(thread.arg);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+uint8_t maple_os_thread_create(maple_os_thread_function_t function, void* arg) {
+
+    // Freed by the new thread once it has copied it
+    maple_os_thread_t* thread = malloc(sizeof(maple_os_thread_t));
+    if (thread == NULL) {
+        return FALSE;
+    }
+
+    thread->function = function;
+    thread->arg      = arg;
+
+#ifdef _WIN32
+    HANDLE handle = CreateThread(NULL, 0, maple_os_thread_start, thread, 0, NULL);
+    if (handle == NULL) {
+        free(thread);
+        return FALSE;
+    }
+
+    CloseHandle(handle);
+#else
+    pthread_t handle;
+    if (pthread_create(&handle, NULL, maple_os_thread_start, thread) != 0) {
+        free(thread);
+        return FALSE;
+    }
+
+    pthread_detach(handle);
+#endif
+
+    return TRUE;
+}
+
+void maple_os_event_init(maple_os_event_t* event) {
+
+    event->count = 0;
+
+#ifdef _WIN32
+    InitializeCriticalSection(&event->lock);
+    InitializeConditionVariable(&event->changed);
+#else
+    // Timeouts are measured on the same clock as maple_os_get_time_ms()
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&event->lock, NULL);
+    pthread_cond_init(&event->changed, &attributes);
+    pthread_condattr_destroy(&attributes);
+#endif
+}
+
+void maple_os_event_signal(maple_os_event_t* event) {
+
+#ifdef _WIN32
+    EnterCriticalSection(&event->lock);
+    event->count++;
+    LeaveCriticalSection(&event->lock);
+    WakeAllConditionVariable(&event->changed);
+#else
+    pthread_mutex_lock(&event->lock);
+    event->count++;
+    pthread_mutex_unlock(&event->lock);
+    pthread_cond_broadcast(&event->changed);
+#endif
+}
+
+uint32_t maple_os_event_get_count(maple_os_event_t* event) {
+
+    uint32_t count;
+
+#ifdef _WIN32
+    EnterCriticalSection(&event->lock);
+    count = event->count;
+    LeaveCriticalSection(&event->lock);
+#else
+    pthread_mutex_lock(&event->lock);
+    count = event->count;
+    pthread_mutex_unlock(&event->lock);
+#endif
+
+    return count;
+}
+
+uint8_t maple_os_event_wait(maple_os_event_t* event, uint32_t count, uint32_t timeoutMs) {
+
+    uint8_t signalled = TRUE;
+
+#ifdef _WIN32
+    uint32_t startTime = maple_os_get_time_ms();
+    EnterCriticalSection(&event->lock);
+
+    // Wake ups that happen without a signal go back to waiting for the time that is left
+    while (event->count == count) {
+
+        DWORD waitTime = INFINITE;
+        if (timeoutMs != MAPLE_OS_WAIT_FOREVER) {
+            uint32_t elapsed = maple_os_get_time_ms() - startTime;
+            if (elapsed >= timeoutMs) {
+                signalled = FALSE;
+                break;
+            }
+
+            waitTime = timeoutMs - elapsed;
+        }
+
+        SleepConditionVariableCS(&event->changed, &event->lock, waitTime);
+    }
+
+    LeaveCriticalSection(&event->lock);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&event->lock);
+
+    while (event->count == count) {
+
+        if (timeoutMs == MAPLE_OS_WAIT_FOREVER) {
+            pthread_cond_wait(&event->changed, &event->lock);
+            continue;
+        }
+
+        if (pthread_cond_timedwait(&event->changed, &event->lock, &deadline) == ETIMEDOUT) {
+            signalled = (event->count != count) ? TRUE : FALSE;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&event->lock);
+#endif
+
+    return signalled;
+}
+
+uint32_t maple_os_get_time_ms(void) {
+
+#ifdef _WIN32
+    return (uint32_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec * 1000) + (now.tv_nsec / 1000000));
+#endif
+}
+
+void maple_os_sleep_ms(uint32_t ms) {
+
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec duration = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000};
+    while ((nanosleep(&duration, &duration) != 0) && (errno == EINTR)) {}
+#endif
+}
+
+uint8_t maple_os_make_dir(char* path) {
+
+#ifdef _WIN32
+    if ((CreateDirectoryA(path, NULL) == 0) && (GetLastError() != ERROR_ALREADY_EXISTS)) {
+        return FALSE;
+    }
+#else
+    if ((mkdir(path, 0755) != 0) && (errno != EEXIST)) {
+        return FALSE;
+    }
+#endif
+
+    return TRUE;
+}
+
+uint8_t maple_os_truncate_file(FILE* file, long numBytes) {
+
+    // Anything still buffered would be written past the new end of the file
+    fflush(file);
+
+#ifdef _WIN32
+    return (_chsize(_fileno(file), numBytes) == 0) ? TRUE : FALSE;
+#else
+    return (ftruncate(fileno(file), numBytes) == 0) ? TRUE : FALSE;
+#endif
+}
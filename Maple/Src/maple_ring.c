@@ -0,0 +1,92 @@
+/**
+ * @file maple_ring.c
+ * @author Gian Barta-Dougall
+ * @brief Ring of bpackets passed from one thread to one other thread without locks
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <string.h>
+
+/* Personal Includes */
+#include "maple_ring.h"
+#include "utilities.h"
+
+void maple_ring_init(maple_ring_t* ring, bpacket_t* slots, uint32_t size) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->numOverflows, 0);
+    ring->writeSlot = NULL;
+    ring->size      = size;
+    ring->slots     = slots;
+}
+
+bpacket_t* maple_ring_get_write_slot(maple_ring_t* ring) {
+
+    if (ring->writeSlot != NULL) {
+        return ring->writeSlot;
+    }
+
+    // The head is only written by this thread. The acquire on the tail stops the slot
+    // being written before the consumer has finished reading it
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    ring->writeSlot = ((head - tail) < ring->size) ? &ring->slots[head & (ring->size - 1)] : &ring->overflowSlot;
+    return ring->writeSlot;
+}
+
+uint8_t maple_ring_push(maple_ring_t* ring) {
+
+    bpacket_t* slot = maple_ring_get_write_slot(ring);
+    uint32_t head   = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->writeSlot = NULL;
+
+    // The ring was full when the bpacket was started. Keep it if a slot has been freed since
+    if (slot == &ring->overflowSlot) {
+
+        if ((head - atomic_load_explicit(&ring->tail, memory_order_acquire)) >= ring->size) {
+            atomic_fetch_add_explicit(&ring->numOverflows, 1, memory_order_relaxed);
+            return FALSE;
+        }
+
+        memcpy(&ring->slots[head & (ring->size - 1)], slot, sizeof(bpacket_t));
+    }
+
+    // The release makes the contents of the slot visible before the consumer sees the new head
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return TRUE;
+}
+
+bpacket_t* maple_ring_peek(maple_ring_t* ring) {
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        return NULL;
+    }
+
+    return &ring->slots[tail & (ring->size - 1)];
+}
+
+void maple_ring_pop(maple_ring_t* ring) {
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        return;
+    }
+
+    // The release stops the producer reusing the slot before it has been read
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+uint8_t maple_ring_is_empty(maple_ring_t* ring) {
+    return (maple_ring_peek(ring) == NULL) ? TRUE : FALSE;
+}
+
+uint32_t maple_ring_get_num_overflows(maple_ring_t* ring) {
+    return atomic_load_explicit(&ring->numOverflows, memory_order_relaxed);
+}
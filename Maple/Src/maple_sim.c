@@ -0,0 +1,502 @@
+/**
+ * @file maple_sim.c
+ * @author Gian Barta-Dougall
+ * @brief Simulated Watchdogs on pseudo terminals
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Needed for the pseudo terminal functions and cfmakeraw()
+#define _GNU_SOURCE
+
+/* C Library Includes */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Personal Includes */
+#include "maple_sim.h"
+#include "maple_os.h"
+#include "bpacket.h"
+#include "bpacket_parser.h"
+#include "watchdog_defines.h"
+#include "utilities.h"
+
+/* Private Macros */
+#define MAPLE_SIM_READ_SIZE        256
+#define MAPLE_SIM_NUM_IMAGES       3
+#define MAPLE_SIM_IMAGE_NUM_BYTES  20000 // Each image is 1000 bytes bigger than the one before it
+#define MAPLE_SIM_FRAME_NUM_BYTES  8000
+#define MAPLE_SIM_ACK_TIMEOUT_MS   1000 // The same as the ESP32
+#define MAPLE_SIM_BITS_PER_BYTE    10   // A start and stop bit are sent with every byte
+
+// The STM32 holds two of the largest checked bpackets while it forwards them
+#define MAPLE_SIM_RX_BUFFER_SIZE ((BPACKET_EXT_MAX_NUM_DATA_BYTES + BPACKET_CRC_NUM_NON_DATA_BYTES) * 2)
+
+/* Private Variables */
+_Thread_local int simTxFd; // The end of the pseudo terminal the device on this thread writes to
+
+uint32_t simBaudRate = 0;            // Every device sends as fast as the pseudo terminal allows while 0
+_Thread_local uint64_t simLineFreeUs; // When the simulated UART on this thread finishes sending
+
+// ACKs are read with their own parser while the device is in the middle of a windowed transfer
+_Thread_local bpacket_parser_t simAckParser;
+_Thread_local uint8_t simAckReceived;
+_Thread_local uint16_t simNumBpacketsAcked;
+_Thread_local bpacket_t simHeldRequest; // A request that arrived while the device was waiting for an ACK
+_Thread_local uint8_t simRequestHeld;
+
+// Each device keeps its own settings so changing one device can be told apart from the rest
+_Thread_local wd_settings_t simSettings = {
+    .cameraSettings = {.resolution = WD_CAM_RES_640x480},
+    .captureTime    = {.startTime = {.hour = 8}, .endTime = {.hour = 17}, .intervalTime = {.minute = 30}},
+};
+
+_Thread_local uint16_t simNumFramesStreamed;
+_Thread_local uint32_t simStreamStartTime;
+
+/* Function Prototypes */
+void maple_sim_device(void* arg);
+void maple_sim_transmit(uint8_t* data, uint16_t bufferNumBytes);
+void maple_sim_request_received(uint8_t id, bpacket_t* bpacket);
+void maple_sim_ack_received(uint8_t id, bpacket_t* bpacket);
+uint8_t maple_sim_get_ack(uint16_t* numBpacketsReceived);
+void maple_sim_send_ext_framing(bpacket_t* bpacket);
+void maple_sim_send_benchmark(bpacket_t* bpacket);
+void maple_sim_send_image_index(bpacket_t* bpacket);
+void maple_sim_send_image(bpacket_t* bpacket);
+void maple_sim_send_frame(bpacket_t* bpacket);
+
+int maple_sim_start_device(void) {
+
+    int deviceFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (deviceFd < 0) {
+        return -1;
+    }
+
+    int mapleFd = -1;
+    if ((grantpt(deviceFd) == 0) && (unlockpt(deviceFd) == 0)) {
+        mapleFd = open(ptsname(deviceFd), O_RDWR | O_NOCTTY);
+    }
+
+    if (mapleFd < 0) {
+        close(deviceFd);
+        return -1;
+    }
+
+    // Bytes must go through untouched in both directions
+    struct termios settings;
+    tcgetattr(mapleFd, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(mapleFd, TCSANOW, &settings);
+
+    int* arg = malloc(sizeof(int));
+    if (arg == NULL) {
+        close(deviceFd);
+        close(mapleFd);
+        return -1;
+    }
+
+    *arg = deviceFd;
+    if (maple_os_thread_create(maple_sim_device, arg) != TRUE) {
+        free(arg);
+        close(deviceFd);
+        close(mapleFd);
+        return -1;
+    }
+
+    return mapleFd;
+}
+
+void maple_sim_stop_device(int fd) {
+    close(fd);
+}
+
+void maple_sim_set_baud_rate(uint32_t baudRate) {
+    simBaudRate = baudRate;
+}
+
+int maple_sim_read(int fd, void* buf, size_t count, uint32_t timeoutMs) {
+
+    struct pollfd pollFd = {.fd = fd, .events = POLLIN};
+
+    int result;
+    while (((result = poll(&pollFd, 1, (timeoutMs == 0) ? -1 : (int)timeoutMs)) < 0) && (errno == EINTR)) {}
+
+    if (result <= 0) {
+        return result;
+    }
+
+    return read(fd, buf, count);
+}
+
+int maple_sim_write(int fd, void* buf, size_t count) {
+
+    size_t numBytesWritten = 0;
+
+    while (numBytesWritten < count) {
+
+        ssize_t result = write(fd, (uint8_t*)buf + numBytesWritten, count - numBytesWritten);
+        if ((result < 0) && (errno != EINTR)) {
+            return -1;
+        }
+
+        numBytesWritten += (result > 0) ? result : 0;
+    }
+
+    return numBytesWritten;
+}
+
+void maple_sim_device(void* arg) {
+
+    simTxFd = *(int*)arg;
+    free(arg);
+
+    // Every device sends windowed transfers the way the ESP32 does. The framing it
+    // negotiates is kept for this thread only
+    bpacket_set_ack_receiver(maple_sim_get_ack);
+
+    static _Thread_local uint8_t rxBytes[MAPLE_SIM_READ_SIZE];
+    static _Thread_local bpacket_t request;
+    static _Thread_local bpacket_t ack;
+    static _Thread_local bpacket_t heldRequest;
+
+    bpacket_parser_t parser;
+    // Nothing is forwarded so bpackets for the ESP32 are answered here as well
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_STM32, &request, maple_sim_request_received);
+    bpacket_parser_init(&simAckParser, 0, BPACKET_ADDRESS_ESP32, &ack, maple_sim_ack_received);
+
+    int numBytes;
+    while ((numBytes = maple_sim_read(simTxFd, rxBytes, MAPLE_SIM_READ_SIZE, 0)) >= 0) {
+
+        uint32_t numBytesParsed = 0;
+        while (numBytesParsed < (uint32_t)numBytes) {
+            numBytesParsed += bpacket_parser_parse(&parser, &rxBytes[numBytesParsed], numBytes - numBytesParsed);
+        }
+
+        // Maple can send its next request before the last ACK of a transfer has been read. It is
+        // copied out first because another request can be held while this one is answered
+        while (simRequestHeld == TRUE) {
+            heldRequest    = simHeldRequest;
+            simRequestHeld = FALSE;
+            maple_sim_request_received(0, &heldRequest);
+        }
+    }
+
+    close(simTxFd);
+}
+
+void maple_sim_transmit(uint8_t* data, uint16_t bufferNumBytes) {
+
+    // Hold the bytes back until a UART running at the simulated baud rate would have sent them
+    if (simBaudRate != 0) {
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t nowUs = ((uint64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+
+        if (simLineFreeUs < nowUs) {
+            simLineFreeUs = nowUs;
+        }
+
+        simLineFreeUs += ((uint64_t)bufferNumBytes * MAPLE_SIM_BITS_PER_BYTE * 1000000) / simBaudRate;
+
+        struct timespec lineFree = {.tv_sec = simLineFreeUs / 1000000, .tv_nsec = (simLineFreeUs % 1000000) * 1000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &lineFree, NULL) == EINTR) {}
+    }
+
+    maple_sim_write(simTxFd, data, bufferNumBytes);
+}
+
+void maple_sim_ack_received(uint8_t id, bpacket_t* bpacket) {
+
+    if (bpacket->request != BPACKET_GEN_R_ACK) {
+        simHeldRequest = *bpacket;
+        simRequestHeld = TRUE;
+        return;
+    }
+
+    if (bpacket->numBytes != 2) {
+        return;
+    }
+
+    simNumBpacketsAcked = (bpacket->bytes[0] << 8) | bpacket->bytes[1];
+    simAckReceived      = TRUE;
+}
+
+uint8_t maple_sim_get_ack(uint16_t* numBpacketsReceived) {
+
+    static _Thread_local uint8_t rxBytes[MAPLE_SIM_READ_SIZE];
+
+    simAckReceived     = FALSE;
+    uint32_t timeoutMs = MAPLE_SIM_ACK_TIMEOUT_MS;
+
+    // Several ACKs can arrive at once. Once one has been received, take whatever else has
+    // already arrived because only the latest one matters
+    int numBytes;
+    while ((numBytes = maple_sim_read(simTxFd, rxBytes, MAPLE_SIM_READ_SIZE, timeoutMs)) > 0) {
+
+        uint32_t numBytesParsed = 0;
+        while (numBytesParsed < (uint32_t)numBytes) {
+            numBytesParsed += bpacket_parser_parse(&simAckParser, &rxBytes[numBytesParsed], numBytes - numBytesParsed);
+        }
+
+        timeoutMs = (simAckReceived == TRUE) ? 1 : timeoutMs;
+    }
+
+    *numBpacketsReceived = simNumBpacketsAcked;
+
+    return simAckReceived;
+}
+
+void maple_sim_request_received(uint8_t id, bpacket_t* bpacket) {
+
+    uint8_t receiver = bpacket->sender;
+    uint8_t sender   = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    switch (request) {
+
+        case BPACKET_GEN_R_PING:;
+            uint8_t ping = (sender == BPACKET_ADDRESS_ESP32) ? WATCHDOG_PING_CODE_ESP32 : WATCHDOG_PING_CODE_STM32;
+            bpacket_create_p(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS, 1, &ping);
+            break;
+
+        case BPACKET_GEN_R_EXT_FRAMING:
+            maple_sim_send_ext_framing(bpacket);
+            return;
+
+        // ACKs that arrive once a windowed transfer has finished are not needed
+        case BPACKET_GEN_R_ACK:
+            return;
+
+        case WATCHDOG_BPK_R_BENCHMARK:
+            maple_sim_send_benchmark(bpacket);
+            return;
+
+        case WATCHDOG_BPK_R_SET_DATETIME:
+            bpacket_create_p(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS, 0, NULL);
+            break;
+
+        case WATCHDOG_BPK_R_GET_IMAGE_INDEX:
+            maple_sim_send_image_index(bpacket);
+            return;
+
+        case WATCHDOG_BPK_R_COPY_FILE:
+            maple_sim_send_image(bpacket);
+            return;
+
+        case WATCHDOG_BPK_R_STREAM_IMAGE:
+            maple_sim_send_frame(bpacket);
+            return;
+
+        case WATCHDOG_BPK_R_STOP_STREAM:;
+            uint32_t streamTime = maple_os_get_time_ms() - simStreamStartTime;
+            uint16_t fpsX100    = (streamTime > 0) ? (simNumFramesStreamed * 100000) / streamTime : 0;
+            uint8_t result[WD_STREAM_RESULT_NUM_BYTES] = {(simNumFramesStreamed >> 8) & 0xFF,
+                                                          simNumFramesStreamed & 0xFF, (fpsX100 >> 8) & 0xFF,
+                                                          fpsX100 & 0xFF};
+            simNumFramesStreamed                       = 0;
+            bpacket_create_p(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS, WD_STREAM_RESULT_NUM_BYTES,
+                             result);
+            break;
+
+        case WATCHDOG_BPK_R_GET_CAMERA_SETTINGS:
+            wd_camera_settings_to_bpacket(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS,
+                                          &simSettings.cameraSettings);
+            break;
+
+        case WATCHDOG_BPK_R_SET_CAMERA_SETTINGS:;
+            uint8_t code = (wd_bpacket_to_camera_settings(bpacket, &simSettings.cameraSettings) == TRUE)
+                               ? BPACKET_CODE_SUCCESS
+                               : BPACKET_CODE_ERROR;
+            bpacket_create_p(bpacket, receiver, sender, request, code, 0, NULL);
+            break;
+
+        case WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS:
+            wd_capture_time_settings_to_bpacket(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS,
+                                                &simSettings.captureTime);
+            break;
+
+        case WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS:
+            code = (wd_bpacket_to_capture_time_settings(bpacket, &simSettings.captureTime) == TRUE)
+                       ? BPACKET_CODE_SUCCESS
+                       : BPACKET_CODE_ERROR;
+            bpacket_create_p(bpacket, receiver, sender, request, code, 0, NULL);
+            break;
+
+        // Baud rate changes and everything else are turned down
+        default:
+            bpacket_create_sp(bpacket, receiver, sender, request, BPACKET_CODE_ERROR, "Not simulated\r\n");
+            break;
+    }
+
+    bpacket_buffer_t buffer;
+    bpacket_to_buffer(bpacket, &buffer);
+    maple_sim_transmit(buffer.buffer, buffer.numBytes);
+}
+
+void maple_sim_send_ext_framing(bpacket_t* bpacket) {
+
+    uint8_t receiver = bpacket->sender;
+    uint8_t sender   = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    // The STM32 replies with what it can forward. The ESP32 replies with what was agreed on
+    if (sender == BPACKET_ADDRESS_STM32) {
+        uint8_t reply[BPACKET_EXT_NUM_BYTES] = {(BPACKET_EXT_MAX_NUM_DATA_BYTES >> 8) & 0xFF,
+                                                BPACKET_EXT_MAX_NUM_DATA_BYTES & 0xFF,
+                                                BPACKET_EXT_FLAG_CRC,
+                                                0,
+                                                (MAPLE_SIM_RX_BUFFER_SIZE >> 8) & 0xFF,
+                                                MAPLE_SIM_RX_BUFFER_SIZE & 0xFF};
+        bpacket_create_p(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS, BPACKET_EXT_NUM_BYTES, reply);
+    } else {
+        uint16_t maxNumDataBytes = bpacket_negotiate_ext_framing(bpacket);
+        uint8_t extFlags         = (bpacket_crc_enabled() == TRUE) ? BPACKET_EXT_FLAG_CRC : 0;
+        uint8_t reply[4] = {(maxNumDataBytes >> 8) & 0xFF, maxNumDataBytes & 0xFF, extFlags, bpacket_get_window_size()};
+        bpacket_create_p(bpacket, receiver, sender, request, BPACKET_CODE_SUCCESS, 4, reply);
+    }
+
+    bpacket_buffer_t buffer;
+    bpacket_to_buffer(bpacket, &buffer);
+    maple_sim_transmit(buffer.buffer, buffer.numBytes);
+}
+
+void maple_sim_send_benchmark(bpacket_t* bpacket) {
+
+    uint8_t receiver = bpacket->sender;
+    uint8_t sender   = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    uint32_t numBytes = 0;
+    if (bpacket->numBytes >= 4) {
+        numBytes = (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) | bpacket->bytes[3];
+    }
+
+    if (numBytes > WATCHDOG_BENCHMARK_MAX_NUM_BYTES) {
+        numBytes = WATCHDOG_BENCHMARK_MAX_NUM_BYTES;
+    }
+
+    uint8_t* data = malloc(numBytes);
+
+    if ((numBytes == 0) || (data == NULL)) {
+        free(data);
+        bpacket_create_p(bpacket, receiver, sender, request, BPACKET_CODE_ERROR, 0, NULL);
+        bpacket_buffer_t buffer;
+        bpacket_to_buffer(bpacket, &buffer);
+        maple_sim_transmit(buffer.buffer, buffer.numBytes);
+        return;
+    }
+
+    // The same counting pattern the ESP32 sends
+    for (uint32_t i = 0; i < numBytes; i++) {
+        data[i] = i & 0xFF;
+    }
+
+    bpacket_send_data(maple_sim_transmit, receiver, sender, request, data, numBytes);
+    free(data);
+}
+
+uint32_t maple_sim_get_image_num_bytes(uint32_t imageNumber) {
+    return MAPLE_SIM_IMAGE_NUM_BYTES + (imageNumber * 1000);
+}
+
+void maple_sim_send_image_index(bpacket_t* bpacket) {
+
+    uint8_t receiver = bpacket->sender;
+    uint8_t sender   = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    uint32_t firstRecord = 0;
+    if (bpacket->numBytes >= 4) {
+        firstRecord =
+            (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) | bpacket->bytes[3];
+    }
+
+    uint8_t records[MAPLE_SIM_NUM_IMAGES * WD_IMAGE_RECORD_NUM_BYTES];
+    uint32_t numRecords = 0;
+
+    for (uint32_t i = firstRecord; i < MAPLE_SIM_NUM_IMAGES; i++) {
+        wd_image_record_t record = {.imageNumber = i, .numBytes = maple_sim_get_image_num_bytes(i)};
+        snprintf(record.fileName, WD_IMAGE_RECORD_FILE_NAME_SIZE, "img_%lu.jpg", (unsigned long)i);
+        wd_image_record_to_bytes(&record, &records[(numRecords++) * WD_IMAGE_RECORD_NUM_BYTES]);
+    }
+
+    bpacket_send_data(maple_sim_transmit, receiver, sender, request, records, numRecords * WD_IMAGE_RECORD_NUM_BYTES);
+}
+
+void maple_sim_send_image(bpacket_t* bpacket) {
+
+    uint8_t receiver = bpacket->sender;
+    uint8_t sender   = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    // The path may be followed by a null character and the byte to start from
+    char path[BPACKET_MAX_NUM_DATA_BYTES + 1];
+    memcpy(path, bpacket->bytes, bpacket->numBytes);
+    path[bpacket->numBytes] = '\0';
+
+    uint32_t pathSize  = strlen(path);
+    uint32_t startByte = 0;
+    if (bpacket->numBytes >= (pathSize + 1 + WD_COPY_FILE_START_NUM_BYTES)) {
+        uint8_t* start = &bpacket->bytes[pathSize + 1];
+        startByte      = ((uint32_t)start[0] << 24) | (start[1] << 16) | (start[2] << 8) | start[3];
+    }
+
+    uint32_t imageNumber;
+    uint32_t numBytes = 0;
+    for (imageNumber = 0; imageNumber < MAPLE_SIM_NUM_IMAGES; imageNumber++) {
+        char imagePath[BPACKET_MAX_NUM_DATA_BYTES];
+        snprintf(imagePath, sizeof(imagePath), "%s/img_%lu.jpg", DATA_FOLDER_PATH, (unsigned long)imageNumber);
+        if (strcmp(path, imagePath) == 0) {
+            numBytes = maple_sim_get_image_num_bytes(imageNumber);
+            break;
+        }
+    }
+
+    uint8_t* data = (startByte < numBytes) ? malloc(numBytes - startByte) : NULL;
+
+    if (data == NULL) {
+        bpacket_create_sp(bpacket, receiver, sender, request, BPACKET_CODE_ERROR, "File not found\r\n");
+        bpacket_buffer_t buffer;
+        bpacket_to_buffer(bpacket, &buffer);
+        maple_sim_transmit(buffer.buffer, buffer.numBytes);
+        return;
+    }
+
+    // Every byte depends on its position and the image so a resumed copy that is put together wrong shows up
+    for (uint32_t i = startByte; i < numBytes; i++) {
+        data[i - startByte] = (i + imageNumber) & 0xFF;
+    }
+
+    bpacket_send_data(maple_sim_transmit, receiver, sender, request, data, numBytes - startByte);
+    free(data);
+}
+
+void maple_sim_send_frame(bpacket_t* bpacket) {
+
+    uint8_t receiver = bpacket->sender;
+    uint8_t sender   = bpacket->receiver;
+    uint8_t request  = bpacket->request;
+
+    if (simNumFramesStreamed++ == 0) {
+        simStreamStartTime = maple_os_get_time_ms();
+    }
+
+    uint8_t frame[MAPLE_SIM_FRAME_NUM_BYTES];
+    for (uint32_t i = 0; i < MAPLE_SIM_FRAME_NUM_BYTES; i++) {
+        frame[i] = (i + simNumFramesStreamed) & 0xFF;
+    }
+
+    bpacket_send_data(maple_sim_transmit, receiver, sender, request, frame, MAPLE_SIM_FRAME_NUM_BYTES);
+}
@@ -0,0 +1,164 @@
+/**
+ * @file maple_ring_test.c
+ * @author Gian Barta-Dougall
+ * @brief Pushes millions of bpackets through a small maple_ring from one thread to
+ * another and checks every bpacket that was not dropped arrives whole and in order,
+ * including ones started while the ring was full.
+ * Built with the thread sanitizer by the ring-test target of the MakeFile, e.g.
+ * ./build/maple_ring_test 10000000
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+/* Personal Includes */
+#include "maple_ring.h"
+#include "utilities.h"
+
+#define DEFAULT_NUM_BPACKETS 4000000
+#define RING_SIZE            8 // Small so the ring is often full and often empty
+#define MAX_NUM_DATA_BYTES   32
+#define BURST_PERIOD         64
+
+/* Private Variables */
+static maple_ring_t ring;
+static bpacket_t slots[RING_SIZE];
+static uint32_t numBpackets;
+static uint32_t numPushed;
+static atomic_uint producerDone;
+static atomic_uint numPopped; // Only used to slow the producer down
+
+static void test_fill(bpacket_t* bpacket, uint32_t number) {
+
+    bpacket->request  = number & 0xFF;
+    bpacket->numBytes = 4 + (number % MAX_NUM_DATA_BYTES);
+    bpacket->bytes[0] = (number >> 24) & 0xFF;
+    bpacket->bytes[1] = (number >> 16) & 0xFF;
+    bpacket->bytes[2] = (number >> 8) & 0xFF;
+    bpacket->bytes[3] = number & 0xFF;
+
+    for (uint16_t i = 4; i < bpacket->numBytes; i++) {
+        bpacket->bytes[i] = number + i;
+    }
+}
+
+// Returns the number the bpacket was filled with or -1 if it is not whole
+static int64_t test_check(bpacket_t* bpacket) {
+
+    uint32_t number = (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) |
+                      bpacket->bytes[3];
+
+    if ((bpacket->request != (number & 0xFF)) || (bpacket->numBytes != (4 + (number % MAX_NUM_DATA_BYTES)))) {
+        return -1;
+    }
+
+    for (uint16_t i = 4; i < bpacket->numBytes; i++) {
+        if (bpacket->bytes[i] != (uint8_t)(number + i)) {
+            return -1;
+        }
+    }
+
+    return number;
+}
+
+static void* test_producer(void* arg) {
+
+    for (uint32_t i = 0; i < numBpackets; i++) {
+
+        // Wait for room most of the time so most bpackets get through. Every so often a burst
+        // is sent without waiting, which fills the ring so bpackets go through the overflow slot
+        if ((i % BURST_PERIOD) >= (RING_SIZE * 2)) {
+            while ((numPushed - atomic_load_explicit(&numPopped, memory_order_relaxed)) >= RING_SIZE) {
+                sched_yield(); // Lets the consumer run on machines with a single core
+            }
+        }
+
+        test_fill(maple_ring_get_write_slot(&ring), i);
+
+        if (maple_ring_push(&ring) == TRUE) {
+            numPushed++;
+        }
+    }
+
+    atomic_store_explicit(&producerDone, TRUE, memory_order_release);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+
+    numBpackets = (argc > 1) ? atoi(argv[1]) : DEFAULT_NUM_BPACKETS;
+
+    if (numBpackets == 0) {
+        printf("Usage: maple_ring_test [number of bpackets]\r\n");
+        return 1;
+    }
+
+    maple_ring_init(&ring, slots, RING_SIZE);
+    atomic_init(&producerDone, FALSE);
+    atomic_init(&numPopped, 0);
+
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, test_producer, NULL) != 0) {
+        printf("Could not start the producer\r\n");
+        return 1;
+    }
+
+    uint32_t numReceived   = 0;
+    uint32_t numCorrupted  = 0;
+    uint32_t numOutOfOrder = 0;
+    int64_t lastNumber     = -1;
+
+    while (1) {
+
+        bpacket_t* bpacket = maple_ring_peek(&ring);
+
+        if (bpacket == NULL) {
+
+            // The producer has to be seen to be done before the ring is seen to be empty
+            if ((atomic_load_explicit(&producerDone, memory_order_acquire) == TRUE) &&
+                (maple_ring_is_empty(&ring) == TRUE)) {
+                break;
+            }
+
+            sched_yield();
+            continue;
+        }
+
+        int64_t number = test_check(bpacket);
+        if (number < 0) {
+            numCorrupted++;
+        } else if (number <= lastNumber) {
+            numOutOfOrder++;
+        } else {
+            lastNumber = number;
+        }
+
+        maple_ring_pop(&ring);
+        numReceived++;
+        atomic_store_explicit(&numPopped, numReceived, memory_order_relaxed);
+    }
+
+    pthread_join(producer, NULL);
+
+    uint32_t numOverflows = maple_ring_get_num_overflows(&ring);
+    printf("maple_ring: %u bpackets, %u received, %u dropped, %u corrupted, %u out of order\r\n", numBpackets,
+           numReceived, numOverflows, numCorrupted, numOutOfOrder);
+
+    if ((numReceived != numPushed) || ((numReceived + numOverflows) != numBpackets) || (numCorrupted != 0) ||
+        (numOutOfOrder != 0)) {
+        printf("maple_ring: check failed\r\n");
+        return 1;
+    }
+
+    printf("maple_ring: all checks passed\r\n");
+    return 0;
+}
@@ -75,6 +75,18 @@
 #define UART_ESP32_RX_PIN    7
 #define UART_ESP32_TX_PIN    9
 #define UART_ESP32_BUAD_RATE 115200
+
+// Bytes sent to the ESP32 are transmitted by DMA
+#define UART_ESP32_TX_DMA_CHANNEL DMA1_Channel4
+#define UART_ESP32_TX_DMA_IRQn    DMA1_Channel4_IRQn
+#define UART_ESP32_TX_DMA_SELECT  (0x02 << DMA_CSELR_C4S_Pos) // USART1_TX
+#define UART_ESP32_TX_DMA_CLEAR   DMA_CSELR_C4S_Msk
+
+// Bytes from the ESP32 are received by DMA into a circular buffer
+#define UART_ESP32_RX_DMA_CHANNEL DMA1_Channel5
+#define UART_ESP32_RX_DMA_IRQn    DMA1_Channel5_IRQn
+#define UART_ESP32_RX_DMA_SELECT  (0x02 << DMA_CSELR_C5S_Pos) // USART1_RX
+#define UART_ESP32_RX_DMA_CLEAR   DMA_CSELR_C5S_Msk
 /*******************************************************************/
 
 /********** Marcos for hardware related to the debug log **********/
@@ -94,6 +106,18 @@
 #define UART_LOG_RX_PIN    15
 #define UART_LOG_TX_PIN    2
 #define UART_LOG_BUAD_RATE 115200
+
+// Bytes sent to Maple are transmitted by DMA
+#define UART_LOG_TX_DMA_CHANNEL DMA1_Channel7
+#define UART_LOG_TX_DMA_IRQn    DMA1_Channel7_IRQn
+#define UART_LOG_TX_DMA_SELECT  (0x02 << DMA_CSELR_C7S_Pos) // USART2_TX
+#define UART_LOG_TX_DMA_CLEAR   DMA_CSELR_C7S_Msk
+
+// Bytes from Maple are received by DMA into a circular buffer
+#define UART_LOG_RX_DMA_CHANNEL DMA1_Channel6
+#define UART_LOG_RX_DMA_IRQn    DMA1_Channel6_IRQn
+#define UART_LOG_RX_DMA_SELECT  (0x02 << DMA_CSELR_C6S_Pos) // USART2_RX
+#define UART_LOG_RX_DMA_CLEAR   DMA_CSELR_C6S_Msk
 /**************************************************************/
 
 /********** Marcos for hardware related to the onbaord RTC **********/
@@ -15,4 +15,12 @@ uint8_t chars_to_int(char* str, int* number);
 
 uint8_t chars_contains(char* string, char* substring);
 
+/**
+ * @brief Checks if a string matches a pattern where '*' matches any number of
+ * characters and '?' matches any one character. Letters match either case
+ *
+ * @return uint8_t TRUE if the whole string matches the pattern else FALSE
+ */
+uint8_t chars_matches_pattern(char* string, char* pattern);
+
 #endif // CHAR_H
\ No newline at end of file
@@ -32,10 +32,10 @@ void log_warning(char* msg);
 void log_message(char* msg);
 
 /**
- * @brief Writes data of USART using the STM32 HAL library.
- * Maximum write size of 256 bytes per function call.
+ * @brief Queues a message to be sent to Maple by DMA. Never waits so it can be
+ * called from interrupts
  *
- * @note This function has a timeout of 1000ms
+ * @note The message is dropped if there is not enough room in the TX ring
  *
  * @param msg Pointer to the data to be transmitted
  */
@@ -58,7 +58,7 @@ void log_clear(void);
 
 void log_print_const(const char* msg);
 
-void log_send_data(char* data, uint8_t length);
-void log_send_bdata(uint8_t* data, uint8_t length);
+void log_send_data(char* data, uint16_t length);
+void log_send_bdata(uint8_t* data, uint16_t length);
 
 #endif // log_LOG_H
\ No newline at end of file
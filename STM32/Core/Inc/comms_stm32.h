@@ -18,15 +18,43 @@
 
 #define NUM_BUFFERS 2
 
+// Holds two of the largest checked bpackets. Maple sizes its transfer window from this
+#define RX_BUFFER_SIZE ((BPACKET_EXT_MAX_NUM_DATA_BYTES + BPACKET_CRC_NUM_NON_DATA_BYTES) * 2)
+
 #define BUFFER_1_ID 0
 #define BUFFER_2_ID 1
 #define BUFFER_3_ID 3
 
 #define BUFFER_1 UART_ESP32
 #define BUFFER_2 UART_LOG
+
+#define BUFFER_1_TX_DMA UART_ESP32_TX_DMA_CHANNEL
+#define BUFFER_2_TX_DMA UART_LOG_TX_DMA_CHANNEL
+
+#define BUFFER_1_RX_DMA UART_ESP32_RX_DMA_CHANNEL
+#define BUFFER_2_RX_DMA UART_LOG_RX_DMA_CHANNEL
 // #define BUFFER_3
 
-void comms_add_to_buffer(uint8_t bufferId, uint8_t byte);
+typedef struct comms_rx_stats_t {
+    uint32_t numBytes;       // Total number of bytes received
+    uint32_t bytesPerSecond; // Average since the last time the stats were read
+    uint32_t numOverruns;    // Bytes lost because the UART was not read in time
+    uint32_t numOverflows;   // Times the RX buffer filled before it was processed or forwarded
+} comms_rx_stats_t;
+
+/**
+ * @brief Publishes the bytes the DMA has written into the RX buffer since the
+ * last call. Called from the UART idle interrupt and the DMA half and full
+ * transfer interrupts
+ */
+void comms_stm32_rx_update(uint8_t bufferId);
+
+/**
+ * @brief Called from the UART interrupt when an overrun error occurs
+ */
+void comms_stm32_rx_overrun(uint8_t bufferId);
+
+void comms_stm32_get_rx_stats(uint8_t bufferId, comms_rx_stats_t* stats);
 
 uint8_t comms_process_rxbuffer(uint8_t bufferId, bpacket_t* bpacket);
 
@@ -36,6 +64,58 @@ void comms_stm32_init(void);
 
 uint8_t comms_stm32_get_bpacket(bpacket_t* bpacket);
 
+/**
+ * @brief Copies bytes into the TX ring of a UART to be sent by DMA. Only waits
+ * if the TX ring is full, so the bytes may still be sending when this returns
+ */
 void comms_transmit(uint8_t bufferId, uint8_t* data, uint16_t numBytes);
 
-uint8_t comms_stm32_request_pending(uint8_t bufferId);
\ No newline at end of file
+/**
+ * @brief Same as comms_transmit() except it never waits, so it can be called
+ * from interrupts
+ *
+ * @return uint8_t TRUE if the bytes were queued. FALSE if there was not enough
+ * room in the TX ring, in which case none of the bytes were queued
+ */
+uint8_t comms_transmit_async(uint8_t bufferId, uint8_t* data, uint16_t numBytes);
+
+/**
+ * @brief The number of bytes comms_transmit_async() can take without failing
+ */
+uint16_t comms_tx_num_free_bytes(uint8_t bufferId);
+
+/**
+ * @brief Returns TRUE once everything queued for a UART has been sent
+ */
+uint8_t comms_tx_is_idle(uint8_t bufferId);
+
+/**
+ * @brief Queues bytes to be transmitted by DMA. Bytes inside the RX buffer of the
+ * other UART are sent from where they are if they will be sent before the RX DMA
+ * can write over them. Anything else is copied first
+ */
+void comms_forward(uint8_t bufferId, uint8_t* data, uint32_t numBytes);
+
+/**
+ * @brief Called from the DMA transfer complete interrupt of a UART
+ */
+void comms_stm32_tx_complete(uint8_t bufferId);
+
+uint8_t comms_stm32_request_pending(uint8_t bufferId);
+
+/**
+ * @brief Returns TRUE if the UART clock can be divided down to within a couple of
+ * percent of the baud rate
+ */
+uint8_t comms_stm32_baud_rate_is_valid(uint32_t baudRate);
+
+/**
+ * @brief Waits for everything queued on a UART to be sent and then changes its
+ * baud rate
+ *
+ * @return uint8_t TRUE if the baud rate was changed, FALSE if it can not be
+ * generated from the UART clock
+ */
+uint8_t comms_stm32_set_baud_rate(uint8_t bufferId, uint32_t baudRate);
+
+uint32_t comms_stm32_get_baud_rate(uint8_t bufferId);
@@ -34,6 +34,7 @@ void hardware_config_timer_init(void);
 void hardware_error_handler(void);
 void hardware_config_gpio_reset(void);
 void hardware_config_uart_init(void);
+void hardware_config_dma_init(void);
 void hardware_config_stm32_peripherals(void);
 
 /* Public Functions */
@@ -46,6 +47,9 @@ void hardware_config_init(void) {
     // Initialise uart communication and debugging
     hardware_config_uart_init();
 
+    // Initialise the DMA channels the uarts transmit and receive with
+    hardware_config_dma_init();
+
     // Initialise all GPIO ports
     hardware_config_gpio_init();
 
@@ -242,13 +246,74 @@ void hardware_config_uart_init(void) {
     UART_ESP32_CLK_ENABLE();
     UART_ESP32->BRR = SystemCoreClock / UART_ESP32_BUAD_RATE;
     UART_ESP32->CR1 = 0x00; // reset UART
-    UART_ESP32->CR1 |= (USART_CR1_RE | USART_CR1_TE | USART_CR1_UE | USART_CR1_RXNEIE);
+    UART_ESP32->CR1 |= (USART_CR1_RE | USART_CR1_TE | USART_CR1_UE | USART_CR1_IDLEIE);
+    UART_ESP32->CR3 |= USART_CR3_EIE; // Overrun interrupts no longer come through RXNEIE
 
     // Set baud rate
     UART_LOG_CLK_ENABLE();
     UART_LOG->BRR = SystemCoreClock / UART_LOG_BUAD_RATE;
     UART_LOG->CR1 &= ~(USART_CR1_EOBIE); // Reset USART
-    UART_LOG->CR1 |= (USART_CR1_RE | USART_CR1_TE | USART_CR1_UE | USART_CR1_RXNEIE | USART_CR1_PEIE);
+    UART_LOG->CR1 |= (USART_CR1_RE | USART_CR1_TE | USART_CR1_UE | USART_CR1_IDLEIE | USART_CR1_PEIE);
+    UART_LOG->CR3 |= USART_CR3_EIE;
+}
+
+void hardware_config_dma_init(void) {
+
+    // Enable the DMA clock
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+
+    /* Configure DMA for transmitting to the ESP32 Cam */
+    DMA1_CSELR->CSELR &= ~(UART_ESP32_TX_DMA_CLEAR);
+    DMA1_CSELR->CSELR |= UART_ESP32_TX_DMA_SELECT;
+
+    // Read from memory, write to the UART data register and interrupt when the transfer is complete
+    UART_ESP32_TX_DMA_CHANNEL->CCR  = 0x00; // Reset channel
+    UART_ESP32_TX_DMA_CHANNEL->CPAR = (uint32_t)&UART_ESP32->TDR;
+    UART_ESP32_TX_DMA_CHANNEL->CCR |= (DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_TCIE);
+    UART_ESP32->CR3 |= USART_CR3_DMAT;
+
+    HAL_NVIC_SetPriority(UART_ESP32_TX_DMA_IRQn, 10, 0);
+    HAL_NVIC_EnableIRQ(UART_ESP32_TX_DMA_IRQn);
+
+    /* Configure DMA for receiving from the ESP32 Cam */
+    DMA1_CSELR->CSELR &= ~(UART_ESP32_RX_DMA_CLEAR);
+    DMA1_CSELR->CSELR |= UART_ESP32_RX_DMA_SELECT;
+
+    // Read from the UART data register into a circular buffer. The half and full transfer
+    // interrupts make sure the write index is published at least twice per lap. The buffer
+    // is set and the channel enabled by comms_stm32_init()
+    UART_ESP32_RX_DMA_CHANNEL->CCR  = 0x00; // Reset channel
+    UART_ESP32_RX_DMA_CHANNEL->CPAR = (uint32_t)&UART_ESP32->RDR;
+    UART_ESP32_RX_DMA_CHANNEL->CCR |= (DMA_CCR_CIRC | DMA_CCR_MINC | DMA_CCR_HTIE | DMA_CCR_TCIE);
+    UART_ESP32->CR3 |= USART_CR3_DMAR;
+
+    // Same priority as the UART interrupt so the two never interrupt each other
+    HAL_NVIC_SetPriority(UART_ESP32_RX_DMA_IRQn, 10, 0);
+    HAL_NVIC_EnableIRQ(UART_ESP32_RX_DMA_IRQn);
+
+    /* Configure DMA for transmitting to Maple */
+    DMA1_CSELR->CSELR &= ~(UART_LOG_TX_DMA_CLEAR);
+    DMA1_CSELR->CSELR |= UART_LOG_TX_DMA_SELECT;
+
+    UART_LOG_TX_DMA_CHANNEL->CCR  = 0x00; // Reset channel
+    UART_LOG_TX_DMA_CHANNEL->CPAR = (uint32_t)&UART_LOG->TDR;
+    UART_LOG_TX_DMA_CHANNEL->CCR |= (DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_TCIE);
+    UART_LOG->CR3 |= USART_CR3_DMAT;
+
+    HAL_NVIC_SetPriority(UART_LOG_TX_DMA_IRQn, 11, 0);
+    HAL_NVIC_EnableIRQ(UART_LOG_TX_DMA_IRQn);
+
+    /* Configure DMA for receiving from Maple */
+    DMA1_CSELR->CSELR &= ~(UART_LOG_RX_DMA_CLEAR);
+    DMA1_CSELR->CSELR |= UART_LOG_RX_DMA_SELECT;
+
+    UART_LOG_RX_DMA_CHANNEL->CCR  = 0x00; // Reset channel
+    UART_LOG_RX_DMA_CHANNEL->CPAR = (uint32_t)&UART_LOG->RDR;
+    UART_LOG_RX_DMA_CHANNEL->CCR |= (DMA_CCR_CIRC | DMA_CCR_MINC | DMA_CCR_HTIE | DMA_CCR_TCIE);
+    UART_LOG->CR3 |= USART_CR3_DMAR;
+
+    HAL_NVIC_SetPriority(UART_LOG_RX_DMA_IRQn, 11, 0);
+    HAL_NVIC_EnableIRQ(UART_LOG_RX_DMA_IRQn);
 }
 
 void hardware_config_uart_sleep(void) {
@@ -20,65 +20,86 @@
 
 void USART1_IRQHandler(void) {
 
-    if ((USART1->ISR & USART_ISR_RXNE) != 0) {
-
-        char c = USART1->RDR;
-        // uint8_t c = USART1->RDR;
-        // log_send_data(&c, 1);
-        // log_prints("got char\r\n");
-        // Copy bit into buffer. Reading RDR automatically clears flag
-        comms_add_to_buffer(BUFFER_1_ID, (uint8_t)c);
+    // The line has gone quiet so publish whatever the DMA has received so far
+    if ((USART1->ISR & USART_ISR_IDLE) != 0) {
+        USART1->ICR = USART_ICR_IDLECF;
+        comms_stm32_rx_update(BUFFER_1_ID);
     }
 
     if ((USART1->ISR & USART_ISR_PE) != 0) {
+        USART1->ICR = USART_ICR_PECF;
         log_prints("Parity error UART 1\r\n");
     }
 
     if ((USART1->ISR & USART_ISR_ORE) != 0) {
-        USART1->ICR |= USART_ICR_ORECF; // Clear flag
-        log_error("USART1 overrun error\r\n");
+        USART1->ICR = USART_ICR_ORECF; // Clear flag
+        comms_stm32_rx_overrun(BUFFER_1_ID);
+    }
+
+    // Noise and framing errors are also raised by EIE. The byte is still received
+    if ((USART1->ISR & (USART_ISR_NE | USART_ISR_FE)) != 0) {
+        USART1->ICR = (USART_ICR_NCF | USART_ICR_FECF);
     }
 }
 
 void USART2_IRQHandler(void) {
 
-    if ((USART2->ISR & USART_ISR_RXNE) != 0) {
-
-        char c = USART2->RDR;
-
-        // Copy bit into buffer. Reading RDR automatically clears flag
-        // comms_add_to_buffer(USART2, c);
-        comms_add_to_buffer(BUFFER_2_ID, (uint8_t)c);
-        return;
+    if ((USART2->ISR & USART_ISR_IDLE) != 0) {
+        USART2->ICR = USART_ICR_IDLECF;
+        comms_stm32_rx_update(BUFFER_2_ID);
     }
 
     if ((USART2->ISR & USART_ISR_PE) != 0) {
+        USART2->ICR = USART_ICR_PECF;
         log_prints("Parity error UART 2\r\n");
     }
 
-    if ((USART2->ISR & USART_ISR_EOBF) != 0) {
-        USART2->ICR |= USART_ICR_EOBCF;
-        log_error("USART 2 Full Block received\r\n");
-        return;
-    }
-
     // Overrun error occurs when the STM32 is receiving data slower than the
     // UART sending to it is sending
     if ((USART2->ISR & USART_ISR_ORE) != 0) {
-        USART2->ICR |= USART_ICR_ORECF;
-        log_error("USART 2 Overrun error\r\n");
-        return;
+        USART2->ICR = USART_ICR_ORECF;
+        comms_stm32_rx_overrun(BUFFER_2_ID);
     }
 
-    if ((USART2->ISR & USART_ISR_IDLE) != 0) {
-        USART2->ICR |= USART_ICR_IDLECF;
-        log_error("USART 2 Idle error\r\n");
-        return;
+    if ((USART2->ISR & (USART_ISR_NE | USART_ISR_FE)) != 0) {
+        USART2->ICR = (USART_ICR_NCF | USART_ICR_FECF);
     }
+}
+
+void DMA1_Channel5_IRQHandler(void) {
 
-    char msg[50];
-    sprintf(msg, "%lx\r\n", USART2->ISR);
-    log_message(msg);
+    // The DMA receiving from the ESP32 is half way or all the way around its buffer
+    if ((DMA1->ISR & (DMA_ISR_HTIF5 | DMA_ISR_TCIF5)) != 0) {
+        DMA1->IFCR = (DMA_IFCR_CHTIF5 | DMA_IFCR_CTCIF5);
+        comms_stm32_rx_update(BUFFER_1_ID);
+    }
+}
+
+void DMA1_Channel6_IRQHandler(void) {
+
+    // The DMA receiving from Maple is half way or all the way around its buffer
+    if ((DMA1->ISR & (DMA_ISR_HTIF6 | DMA_ISR_TCIF6)) != 0) {
+        DMA1->IFCR = (DMA_IFCR_CHTIF6 | DMA_IFCR_CTCIF6);
+        comms_stm32_rx_update(BUFFER_2_ID);
+    }
+}
+
+void DMA1_Channel4_IRQHandler(void) {
+
+    // Finished transmitting a span to the ESP32
+    if ((DMA1->ISR & DMA_ISR_TCIF4) != 0) {
+        DMA1->IFCR = DMA_IFCR_CTCIF4;
+        comms_stm32_tx_complete(BUFFER_1_ID);
+    }
+}
+
+void DMA1_Channel7_IRQHandler(void) {
+
+    // Finished transmitting a span to Maple
+    if ((DMA1->ISR & DMA_ISR_TCIF7) != 0) {
+        DMA1->IFCR = DMA_IFCR_CTCIF7;
+        comms_stm32_tx_complete(BUFFER_2_ID);
+    }
 }
 
 void RTC_Alarm_IRQHandler(void) {
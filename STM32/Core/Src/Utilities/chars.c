@@ -85,4 +85,44 @@ uint8_t chars_to_int(char* str, int* number) {
     *number = atoi(str);
 
     return TRUE;
-}
\ No newline at end of file
+}
+
+static char chars_to_lower(char c) {
+    return ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
+}
+
+uint8_t chars_matches_pattern(char* string, char* pattern) {
+
+    // Where to carry on from if the characters after the last '*' stop matching
+    char* starPattern = NULL;
+    char* starString  = NULL;
+
+    while (*string != '\0') {
+
+        if (*pattern == '*') {
+            starPattern = ++pattern;
+            starString  = string;
+            continue;
+        }
+
+        if ((*pattern == '?') || ((*pattern != '\0') && (chars_to_lower(*pattern) == chars_to_lower(*string)))) {
+            pattern++;
+            string++;
+            continue;
+        }
+
+        if (starPattern == NULL) {
+            return FALSE;
+        }
+
+        // Let the last '*' match one more character and try again
+        pattern = starPattern;
+        string  = ++starString;
+    }
+
+    while (*pattern == '*') {
+        pattern++;
+    }
+
+    return (*pattern == '\0') ? TRUE : FALSE;
+}
@@ -11,6 +11,7 @@
 
 /* Private Includes */
 #include "log.h"
+#include "comms_stm32.h"
 
 #define LOG_COLOR_BLACK   "\x1b[30m"
 #define LOG_COLOR_RED     "\x1b[31m"
@@ -73,27 +74,11 @@ void log_success(char* msg) {
 }
 
 void log_prints(char* msg) {
-    uint16_t i = 0;
-
-    // Transmit until end of message reached
-    while (msg[i] != '\0') {
-        while ((USART2->ISR & USART_ISR_TXE) == 0) {};
-
-        USART2->TDR = msg[i];
-        i++;
-    }
+    log_send_data(msg, get_length(msg));
 }
 
 void log_print_const(const char* msg) {
-    uint16_t i = 0;
-
-    // Transmit until end of message reached
-    while (msg[i] != '\0') {
-        while ((USART2->ISR & USART_ISR_TXE) == 0) {};
-
-        USART2->TDR = msg[i];
-        i++;
-    }
+    log_prints((char*)msg);
 }
 
 char log_getc(void) {
@@ -107,22 +92,16 @@ void log_clear(void) {
     log_prints("\033[2J\033[H");
 }
 
-void log_send_data(char* data, uint8_t length) {
-
-    // Transmit until end of message reached
-    for (int i = 0; i < length; i++) {
-        while ((USART2->ISR & USART_ISR_TXE) == 0) {};
-        USART2->TDR = data[i];
-    }
+void log_send_data(char* data, uint16_t length) {
+    log_send_bdata((uint8_t*)data, length);
 }
 
-void log_send_bdata(uint8_t* data, uint8_t length) {
+void log_send_bdata(uint8_t* data, uint16_t length) {
 
-    // Transmit until end of message reached
-    for (int i = 0; i < length; i++) {
-        while ((USART2->ISR & USART_ISR_TXE) == 0) {};
-        USART2->TDR = data[i];
-    }
+    // Maple is sent bpackets by DMA on the same UART, so the log has to queue behind them
+    // rather than write to the UART itself. Never waits, so messages are dropped when the
+    // TX ring is full
+    comms_transmit_async(BUFFER_2_ID, data, length);
 }
 
 /**
@@ -15,12 +15,12 @@
 #include "log.h"
 #include "watchdog_defines.h"
 #include "chars.h"
-
-#define PACKET_BUFFER_SIZE 10
-
-#define RX_BUFFER_SIZE (BPACKET_BUFFER_LENGTH_BYTES * PACKET_BUFFER_SIZE)
+#include "bpacket_parser.h"
+#include "tx_queue.h"
 
 /* Private Macros */
+#define MIN_BRR_VALUE            16 // The UARTs oversample by 16
+#define MAX_BAUD_RATE_ERROR_PERC 2  // Max difference between the requested and actual baud rate
 
 /* Private Variables */
 USART_TypeDef* uarts[NUM_BUFFERS] = {
@@ -28,266 +28,193 @@ USART_TypeDef* uarts[NUM_BUFFERS] = {
     BUFFER_2,
 };
 
-// Create a list for every single UART line
-uint8_t rxBuffers[NUM_BUFFERS][RX_BUFFER_SIZE] = {{0}, {0}};
-uint32_t rxBufIndexes[NUM_BUFFERS];
-uint32_t rxBufProcessedIndexes[NUM_BUFFERS];
+uint32_t baudRates[NUM_BUFFERS] = {
+    UART_ESP32_BUAD_RATE,
+    UART_LOG_BUAD_RATE,
+};
 
-#define BUFFER(id) (rxBuffers[id][rxBufIndexes[id]])
+DMA_Channel_TypeDef* txDmaChannels[NUM_BUFFERS] = {
+    BUFFER_1_TX_DMA,
+    BUFFER_2_TX_DMA,
+};
 
-// New Bpacket system variables
-uint8_t expectedByteId[NUM_BUFFERS];
-uint8_t numDataBytesExpected[NUM_BUFFERS];
-uint8_t numDataBytesReceived[NUM_BUFFERS];
-uint8_t divertedBytesBufferId[NUM_BUFFERS];
-uint8_t bpacketByteIndex[NUM_BUFFERS];
-uint8_t divertBytes[NUM_BUFFERS];
-uint8_t lastByte = 0;
+DMA_Channel_TypeDef* rxDmaChannels[NUM_BUFFERS] = {
+    BUFFER_1_RX_DMA,
+    BUFFER_2_RX_DMA,
+};
 
-// For some reason haven't worked it out, if you set this to false at the start of the rxProcessBuffer
-// it will stuff up the diversion of bytes. Need to keep it global
-// uint8_t divertBytes           = FALSE;
-// uint8_t divertedBytesBufferId = BUFFER_1_ID;
+// Everything is transmitted by DMA. Forwarded bytes are sent straight out of the RX
+// buffers as long as they will be sent before the RX DMA can get back around to them.
+// Anything else, including forwarded bytes the RX DMA could reach, is copied into the
+// TX ring of the queue
+tx_queue_t txQueues[NUM_BUFFERS];
+
+// Every UART line is received by a circular DMA into its own buffer. The write index
+// is only moved forward from interrupts, once a burst of bytes has ended or the DMA
+// is half way around the buffer
+uint8_t rxBuffers[NUM_BUFFERS][RX_BUFFER_SIZE] = {{0}, {0}};
+volatile uint32_t rxBufIndexes[NUM_BUFFERS];
+uint32_t rxBufProcessedIndexes[NUM_BUFFERS];
+
+// Bytes forwarded straight out of an RX buffer are held until the TX DMA has sent them.
+// The released index is the end of the last forwarded span that was sent. It is only
+// moved by the main loop while nothing is waiting to be sent, and by the TX interrupt
+// otherwise. The counters tell the two apart
+volatile uint32_t rxBufReleasedIndexes[NUM_BUFFERS];
+volatile uint32_t rxNumBytesForwarded[NUM_BUFFERS];
+volatile uint32_t rxNumBytesForwardSent[NUM_BUFFERS];
+
+volatile uint32_t rxNumBytes[NUM_BUFFERS];
+volatile uint32_t rxNumOverruns[NUM_BUFFERS];
+volatile uint32_t rxNumOverflows[NUM_BUFFERS];
+uint32_t rxStatsNumBytes[NUM_BUFFERS]; // Number of bytes received when the stats were last read
+uint32_t rxStatsTick[NUM_BUFFERS];
+
+// Bpackets are parsed straight out of the RX buffers. Bpackets for the ESP32 and
+// Maple are forwarded as they are parsed
+bpacket_parser_t parsers[NUM_BUFFERS];
+uint8_t bpacketReceived[NUM_BUFFERS];
 
 /* Function Prototyes */
 void comms_send_byte(uint8_t bufferId, uint8_t byte);
 void comms_stm32_log_invalid_byte(uint8_t bufferId, uint8_t byte);
+void comms_stm32_bpacket_received(uint8_t bufferId, bpacket_t* bpacket);
+void comms_stm32_forward_bytes(uint8_t bufferId, uint8_t receiver, uint8_t* data, uint32_t numBytes);
+void comms_stm32_start_transfer(uint8_t bufferId, uint8_t* data, uint16_t numBytes);
+void comms_stm32_span_sent(uint8_t bufferId, uint8_t* data, uint16_t numBytes);
+uint32_t comms_stm32_get_dma_write_index(uint8_t bufferId);
+uint8_t comms_stm32_forward_in_place(uint8_t bufferId, uint8_t* data, uint32_t numBytes);
+uint8_t comms_stm32_push(uint8_t bufferId, uint8_t* data, uint32_t numBytes, uint8_t copy);
 
 void comms_stm32_init(void) {
 
     for (int i = 0; i < NUM_BUFFERS; i++) {
         rxBufIndexes[i]          = 0;
         rxBufProcessedIndexes[i] = 0;
-
-        expectedByteId[i]   = BPACKET_START_BYTE_UPPER_ID;
-        bpacketByteIndex[i] = 0;
-        divertBytes[i]      = FALSE;
+        rxBufReleasedIndexes[i]  = 0;
+        rxNumBytesForwarded[i]   = 0;
+        rxNumBytesForwardSent[i] = 0;
+        bpacketReceived[i]       = FALSE;
+
+        bpacket_parser_init(&parsers[i], i, BPACKET_ADDRESS_STM32, NULL, comms_stm32_bpacket_received);
+        parsers[i].forward_bytes = comms_stm32_forward_bytes;
+
+        tx_queue_init(&txQueues[i], i, comms_stm32_start_transfer);
+        txQueues[i].span_sent = comms_stm32_span_sent;
+
+        rxNumBytes[i]      = 0;
+        rxNumOverruns[i]   = 0;
+        rxNumOverflows[i]  = 0;
+        rxStatsNumBytes[i] = 0;
+        rxStatsTick[i]     = HAL_GetTick();
+
+        // Start receiving. The channel never stops, it just keeps lapping the buffer
+        DMA_Channel_TypeDef* channel = rxDmaChannels[i];
+        channel->CCR &= ~(DMA_CCR_EN);
+        channel->CMAR  = (uint32_t)rxBuffers[i];
+        channel->CNDTR = RX_BUFFER_SIZE;
+        channel->CCR |= DMA_CCR_EN;
     }
 }
 
-void comms_add_to_buffer(uint8_t bufferId, uint8_t byte) {
-    BUFFER(bufferId) = byte;
-    bpacket_increment_circ_buff_index(&rxBufIndexes[bufferId], RX_BUFFER_SIZE);
-}
-
-uint8_t comms_process_rxbuffer(uint8_t bufferId, bpacket_t* bpacket) {
-
-    while (rxBufProcessedIndexes[bufferId] != rxBufIndexes[bufferId]) {
+uint32_t comms_stm32_get_dma_write_index(uint8_t bufferId) {
 
-        uint8_t byte = rxBuffers[bufferId][rxBufProcessedIndexes[bufferId]];
-        bpacket_increment_circ_buff_index(&rxBufProcessedIndexes[bufferId], RX_BUFFER_SIZE);
+    // CNDTR counts down from the size of the buffer and is reloaded when it reaches 0
+    uint32_t writeIndex = RX_BUFFER_SIZE - rxDmaChannels[bufferId]->CNDTR;
 
-        if (expectedByteId[bufferId] == BPACKET_DATA_BYTE_ID) {
+    return (writeIndex == RX_BUFFER_SIZE) ? 0 : writeIndex;
+}
 
-            // Increment the number of data bytes received
-            numDataBytesReceived[bufferId]++;
+void comms_stm32_rx_update(uint8_t bufferId) {
 
-            // Set the expected byte to stop byte if this is the last data byte expected
-            if (numDataBytesReceived[bufferId] == numDataBytesExpected[bufferId]) {
-                expectedByteId[bufferId] = BPACKET_STOP_BYTE_UPPER_ID;
-            }
+    uint32_t writeIndex     = comms_stm32_get_dma_write_index(bufferId);
+    uint32_t lastWriteIndex = rxBufIndexes[bufferId];
 
-            // Divert byte to intended receiver
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-                continue;
-            }
+    // Bytes forwarded out of the buffer are still needed after they are processed, until
+    // the TX DMA has sent them
+    uint32_t oldestIndex = (rxNumBytesForwarded[bufferId] != rxNumBytesForwardSent[bufferId])
+                               ? rxBufReleasedIndexes[bufferId]
+                               : rxBufProcessedIndexes[bufferId];
 
-            // Add byte to bpacket
-            bpacket->bytes[bpacketByteIndex[bufferId]++] = byte;
-            continue;
-        }
+    uint32_t numNewBytes = (writeIndex >= lastWriteIndex) ? (writeIndex - lastWriteIndex)
+                                                          : (RX_BUFFER_SIZE - lastWriteIndex + writeIndex);
+    uint32_t numHeldBytes = (lastWriteIndex >= oldestIndex) ? (lastWriteIndex - oldestIndex)
+                                                            : (RX_BUFFER_SIZE - oldestIndex + lastWriteIndex);
 
-        if ((expectedByteId[bufferId] == BPACKET_STOP_BYTE_LOWER_ID) && (byte == BPACKET_STOP_BYTE_LOWER)) {
+    // The DMA has written over bytes that had not been processed or sent yet
+    if ((numHeldBytes + numNewBytes) >= RX_BUFFER_SIZE) {
+        rxNumOverflows[bufferId]++;
+    }
 
-            // if (bufferId == BUFFER_1_ID) {
-            //     log_send_data(" STP BYTE LW ", 13);
-            // }
-            // End of packet reached. Reset the system. It is important that this is done
-            // regardless of whether the bytes were diverted or not. This ensures the next
-            // packet can be read
-            expectedByteId[bufferId] = BPACKET_START_BYTE_UPPER_ID;
+    rxNumBytes[bufferId] += numNewBytes;
+    rxBufIndexes[bufferId] = writeIndex;
+}
 
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-                continue;
-            }
+void comms_stm32_rx_overrun(uint8_t bufferId) {
+    rxNumOverruns[bufferId]++;
+}
 
-            // Reset the divertBytes flag to FALSE
-            divertBytes[bufferId] = FALSE;
+void comms_stm32_get_rx_stats(uint8_t bufferId, comms_rx_stats_t* stats) {
 
-            return TRUE;
-        }
+    uint32_t tick        = HAL_GetTick();
+    uint32_t numBytes    = rxNumBytes[bufferId];
+    uint32_t numMs       = tick - rxStatsTick[bufferId];
+    uint64_t numNewBytes = numBytes - rxStatsNumBytes[bufferId];
 
-        if ((expectedByteId[bufferId] == BPACKET_STOP_BYTE_UPPER_ID) && (byte == BPACKET_STOP_BYTE_UPPER)) {
+    stats->numBytes       = numBytes;
+    stats->bytesPerSecond = (numMs == 0) ? 0 : (uint32_t)((numNewBytes * 1000) / numMs);
+    stats->numOverruns    = rxNumOverruns[bufferId];
+    stats->numOverflows   = rxNumOverflows[bufferId];
 
-            // if (bufferId == BUFFER_1_ID) {
-            //     log_send_data(" STP BYTE UP ", 13);
-            // }
-            expectedByteId[bufferId] = BPACKET_STOP_BYTE_LOWER_ID;
+    rxStatsNumBytes[bufferId] = numBytes;
+    rxStatsTick[bufferId]     = tick;
+}
 
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-            }
+void comms_stm32_bpacket_received(uint8_t bufferId, bpacket_t* bpacket) {
 
-            continue;
-        }
+    // Corrupted checked bpackets are dropped. The sender will send them again
+    if (bpacket->crcStatus == BPACKET_CRC_FAILED) {
+        return;
+    }
 
-        if (expectedByteId[bufferId] == BPACKET_NUM_BYTES_BYTE_ID) {
-            // if (bufferId == BUFFER_1_ID) {
-            //     char y[20];
-            //     sprintf(y, " LEN BYTE[%i] ", byte);
-            //     log_send_data(y, chars_get_num_bytes(y));
-            // }
-
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-            } else {
-
-                // Set the number of bytes in the bpacket
-                bpacket->numBytes = byte;
-            }
-            // Set the number of data bytes expected
-            numDataBytesExpected[bufferId] = byte;
-            numDataBytesReceived[bufferId] = 0;
-
-            // Update the expected byte to data bytes
-            if (byte == 0) {
-                expectedByteId[bufferId] = BPACKET_STOP_BYTE_UPPER_ID;
-            } else {
-                expectedByteId[bufferId] = BPACKET_DATA_BYTE_ID;
-            }
+    bpacketReceived[bufferId] = TRUE;
+}
 
-            continue;
-        }
+void comms_stm32_forward_bytes(uint8_t bufferId, uint8_t receiver, uint8_t* data, uint32_t numBytes) {
 
-        if (expectedByteId[bufferId] == BPACKET_CODE_BYTE_ID) {
-
-            // if (bufferId == BUFFER_1_ID) {
-            //     char y[20];
-            //     sprintf(y, " COD BYTE[%i] ", byte);
-            //     log_send_data(y, chars_get_num_bytes(y));
-            // }
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-            } else {
-                bpacket->code = byte;
-            }
-            expectedByteId[bufferId] = BPACKET_NUM_BYTES_BYTE_ID;
-            continue;
-        }
+    switch (receiver) {
 
-        if (expectedByteId[bufferId] == BPACKET_REQUEST_BYTE_ID) {
-            // if (bufferId == BUFFER_1_ID) {
-            //     char y[20];
-            //     sprintf(y, " REQ BYTE[%i] ", byte);
-            //     log_send_data(y, chars_get_num_bytes(y));
-            // }
-
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-            } else {
-                bpacket->request = byte;
-            }
-            expectedByteId[bufferId] = BPACKET_CODE_BYTE_ID;
-            continue;
-        }
+        case BPACKET_ADDRESS_ESP32:
+            comms_forward(BUFFER_1_ID, data, numBytes);
+            break;
 
-        if (expectedByteId[bufferId] == BPACKET_SENDER_BYTE_ID) {
-            // if (bufferId == BUFFER_1_ID) {
-            //     char y[20];
-            //     sprintf(y, " SND BYTE[%i] ", byte);
-            //     log_send_data(y, chars_get_num_bytes(y));
-            // }
-
-            if (divertBytes[bufferId] == TRUE) {
-                comms_send_byte(divertedBytesBufferId[bufferId], byte);
-            } else {
-                bpacket->sender = byte;
-            }
-            expectedByteId[bufferId] = BPACKET_REQUEST_BYTE_ID;
-            continue;
-        }
+        case BPACKET_ADDRESS_MAPLE:
+            comms_forward(BUFFER_2_ID, data, numBytes);
+            break;
 
-        if (expectedByteId[bufferId] == BPACKET_RECEIVER_BYTE_ID) {
-            // if (bufferId == BUFFER_1_ID) {
-            //     log_send_data(" REC BYTE  ", 10);
-            // }
-
-            // Determine if this bpacket needs to be diverted to another mcu or not
-            switch (byte) {
-
-                case BPACKET_ADDRESS_ESP32: // Required to divert bytes to ESP32
-                    // if (bufferId == BUFFER_1_ID) {
-                    //     log_send_data(" REC ESP ", 9);
-                    // }
-                    // log_send_data(" DIV ESP ", 9);
-                    // Set the flag to divert bytes
-                    divertBytes[bufferId]           = TRUE;
-                    divertedBytesBufferId[bufferId] = BUFFER_1_ID;
-
-                    // Send the start bytes and the receiver address to the ESP32
-                    comms_send_byte(BUFFER_1_ID, BPACKET_START_BYTE_UPPER);
-                    comms_send_byte(BUFFER_1_ID, BPACKET_START_BYTE_LOWER);
-                    comms_send_byte(BUFFER_1_ID, BPACKET_ADDRESS_ESP32);
-                    break;
-
-                case BPACKET_ADDRESS_MAPLE: // Required to divert bytes to STM32
-                    // log_send_data(" DIV MPL ", 9);
-                    // if (bufferId == BUFFER_1_ID) {
-                    //     log_send_data(" REC MPL", 9);
-                    // }
-                    // Set the flag to divert bytes
-                    divertBytes[bufferId]           = TRUE;
-                    divertedBytesBufferId[bufferId] = BUFFER_2_ID;
-
-                    // Send the start bytes and the receiver address to Maple
-                    comms_send_byte(BUFFER_2_ID, BPACKET_START_BYTE_UPPER);
-                    comms_send_byte(BUFFER_2_ID, BPACKET_START_BYTE_LOWER);
-                    comms_send_byte(BUFFER_2_ID, BPACKET_ADDRESS_MAPLE);
-                    break;
-
-                case BPACKET_ADDRESS_STM32: // No need to divert bytes
-
-                default: // Unknown receiver address. Pass onto STM32 and let STM32 handle it
-                    bpacket->receiver     = BPACKET_ADDRESS_STM32;
-                    divertBytes[bufferId] = FALSE;
-                    break;
-            }
-
-            expectedByteId[bufferId] = BPACKET_SENDER_BYTE_ID;
-            continue;
-        }
+        default: // Unknown receiver address. Nowhere to send it so the bpacket is dropped
+            break;
+    }
+}
 
-        if ((expectedByteId[bufferId] == BPACKET_START_BYTE_LOWER_ID) && (byte == BPACKET_START_BYTE_LOWER)) {
-            // if (bufferId == BUFFER_1_ID) {
-            //     log_send_data(" START LOWER ", 13);
-            // }
-            expectedByteId[bufferId] = BPACKET_RECEIVER_BYTE_ID;
-            continue;
-        }
+uint8_t comms_process_rxbuffer(uint8_t bufferId, bpacket_t* bpacket) {
 
-        if ((expectedByteId[bufferId] == BPACKET_START_BYTE_UPPER_ID) && (byte == BPACKET_START_BYTE_UPPER)) {
-            // if (bufferId == BUFFER_1_ID) {
-            //     log_send_data(" START UPPER ", 13);
-            // }
-            expectedByteId[bufferId] = BPACKET_START_BYTE_LOWER_ID;
+    parsers[bufferId].bpacket = bpacket;
+    bpacketReceived[bufferId] = FALSE;
 
-            // Reset the byte index
-            bpacketByteIndex[bufferId] = 0;
+    while ((rxBufProcessedIndexes[bufferId] != rxBufIndexes[bufferId]) && (bpacketReceived[bufferId] != TRUE)) {
 
-            continue;
-        }
+        // Parse everything up to the write index, or the end of the buffer if it has wrapped around
+        uint32_t readIndex  = rxBufProcessedIndexes[bufferId];
+        uint32_t writeIndex = rxBufIndexes[bufferId];
+        uint32_t numBytes   = (writeIndex > readIndex) ? (writeIndex - readIndex) : (RX_BUFFER_SIZE - readIndex);
 
-        // Log data if required
-        // comms_send_byte(bufferId, byte);
-        // comms_stm32_log_invalid_byte(bufferId, byte);
+        readIndex += bpacket_parser_parse(&parsers[bufferId], &rxBuffers[bufferId][readIndex], numBytes);
 
-        // Erraneous byte. Reset the system
-        expectedByteId[bufferId] = BPACKET_START_BYTE_UPPER_ID;
+        rxBufProcessedIndexes[bufferId] = (readIndex == RX_BUFFER_SIZE) ? 0 : readIndex;
     }
 
-    return FALSE;
+    return bpacketReceived[bufferId];
 }
 
 uint8_t comms_stm32_request_pending(uint8_t bufferId) {
@@ -308,21 +235,172 @@ void comms_stm32_log_invalid_byte(uint8_t bufferId, uint8_t byte) {
 
 void comms_send_byte(uint8_t bufferId, uint8_t byte) {
     // log_send_data("rx SENT ", 8);
-    // Wait for USART to be ready to send a byte
-    while ((uarts[bufferId]->ISR & USART_ISR_TXE) == 0) {};
-
-    // Send byte of usart
-    uarts[bufferId]->TDR = byte;
+    comms_transmit(bufferId, &byte, 1);
 }
 
 void comms_transmit(uint8_t bufferId, uint8_t* data, uint16_t numBytes) {
 
-    for (int i = 0; i < numBytes; i++) {
+    // Queue as much as fits in the TX ring. This only waits if the ring is full
+    while (numBytes > 0) {
+
+        uint16_t numBytesToQueue = tx_queue_num_free_bytes(&txQueues[bufferId]);
+        if (numBytesToQueue > numBytes) {
+            numBytesToQueue = numBytes;
+        }
+
+        if ((numBytesToQueue == 0) || (comms_stm32_push(bufferId, data, numBytesToQueue, TRUE) != TRUE)) {
+            continue;
+        }
+
+        data += numBytesToQueue;
+        numBytes -= numBytesToQueue;
+    }
+}
+
+uint8_t comms_transmit_async(uint8_t bufferId, uint8_t* data, uint16_t numBytes) {
+    return comms_stm32_push(bufferId, data, numBytes, TRUE);
+}
+
+uint16_t comms_tx_num_free_bytes(uint8_t bufferId) {
+    return tx_queue_num_free_bytes(&txQueues[bufferId]);
+}
+
+uint8_t comms_tx_is_idle(uint8_t bufferId) {
+    return tx_queue_is_empty(&txQueues[bufferId]);
+}
+
+uint8_t comms_stm32_forward_in_place(uint8_t bufferId, uint8_t* data, uint32_t numBytes) {
+
+    // Anything outside the RX buffers (e.g the start bytes the parser rebuilds) may
+    // not exist by the time the DMA gets to it
+    if ((data < rxBuffers[0]) || (data >= (rxBuffers[0] + sizeof(rxBuffers)))) {
+        return FALSE;
+    }
+
+    // Only one UART sends bytes out of each RX buffer so they are always released in order
+    uint8_t rxBufferId = (data - rxBuffers[0]) / RX_BUFFER_SIZE;
+    if (rxBufferId == bufferId) {
+        return FALSE;
+    }
+
+    // Number of bytes the RX DMA can write before it reaches the start of the span. The DMA
+    // is read directly because it can be up to half the buffer past the published write index
+    uint32_t startIndex = data - rxBuffers[rxBufferId];
+    uint32_t writeIndex = comms_stm32_get_dma_write_index(rxBufferId);
+    uint32_t numFreeBytes =
+        (startIndex > writeIndex) ? (startIndex - writeIndex) : (RX_BUFFER_SIZE - writeIndex + startIndex);
+
+    // The span is sent once everything queued before it has gone. Bytes keep arriving on
+    // the other UART while that happens so scale by the difference in baud rate
+    uint64_t numBytesUntilSent = tx_queue_num_pending_bytes(&txQueues[bufferId]) + numBytes;
+    uint64_t numBytesReceived  = (numBytesUntilSent * baudRates[rxBufferId]) / baudRates[bufferId];
+
+    if (numBytesReceived >= numFreeBytes) {
+        return FALSE;
+    }
+
+    // The span is the oldest byte held in the RX buffer if nothing before it is still being sent
+    if (rxNumBytesForwarded[rxBufferId] == rxNumBytesForwardSent[rxBufferId]) {
+        rxBufReleasedIndexes[rxBufferId] = startIndex;
+    }
+
+    rxNumBytesForwarded[rxBufferId] += numBytes;
+
+    // Wait for the DMA to free up a span if the queue is full
+    while (comms_stm32_push(bufferId, data, numBytes, FALSE) != TRUE) {};
+
+    return TRUE;
+}
+
+uint8_t comms_stm32_push(uint8_t bufferId, uint8_t* data, uint32_t numBytes, uint8_t copy) {
+
+    // The log queues messages from interrupts as well as the main loop. Interrupts are held
+    // off while a span is added so neither can see the queue half updated
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t queued = (copy == TRUE) ? tx_queue_push_copy(&txQueues[bufferId], data, numBytes)
+                                    : tx_queue_push(&txQueues[bufferId], data, numBytes);
+
+    __set_PRIMASK(primask);
+
+    return queued;
+}
+
+void comms_forward(uint8_t bufferId, uint8_t* data, uint32_t numBytes) {
+
+    if (comms_stm32_forward_in_place(bufferId, data, numBytes) == TRUE) {
+        return;
+    }
+
+    comms_transmit(bufferId, data, numBytes);
+}
+
+void comms_stm32_start_transfer(uint8_t bufferId, uint8_t* data, uint16_t numBytes) {
+
+    DMA_Channel_TypeDef* channel = txDmaChannels[bufferId];
+
+    // The channel has to be disabled before the address and count can be changed
+    channel->CCR &= ~(DMA_CCR_EN);
+    channel->CMAR  = (uint32_t)data;
+    channel->CNDTR = numBytes;
+    channel->CCR |= DMA_CCR_EN;
+}
+
+void comms_stm32_tx_complete(uint8_t bufferId) {
+    tx_queue_transfer_complete(&txQueues[bufferId]);
+}
+
+void comms_stm32_span_sent(uint8_t bufferId, uint8_t* data, uint16_t numBytes) {
+
+    // Only forwarded bytes are sent without being copied
+    uint8_t rxBufferId = (data - rxBuffers[0]) / RX_BUFFER_SIZE;
+    uint32_t endIndex  = (data + numBytes) - rxBuffers[rxBufferId];
+
+    rxBufReleasedIndexes[rxBufferId] = (endIndex == RX_BUFFER_SIZE) ? 0 : endIndex;
+    rxNumBytesForwardSent[rxBufferId] += numBytes;
+}
+
+uint8_t comms_stm32_baud_rate_is_valid(uint32_t baudRate) {
+
+    if (baudRate == 0) {
+        return FALSE;
+    }
+
+    // The UART clock has to be divided down to within a couple of percent of the baud rate
+    uint32_t brr = (SystemCoreClock + (baudRate / 2)) / baudRate;
+    if ((brr < MIN_BRR_VALUE) || (brr > 0xFFFF)) {
+        return FALSE;
+    }
+
+    uint32_t actualBaudRate = SystemCoreClock / brr;
+    uint32_t error = (actualBaudRate > baudRate) ? (actualBaudRate - baudRate) : (baudRate - actualBaudRate);
+
+    return ((error * 100) <= (baudRate * MAX_BAUD_RATE_ERROR_PERC)) ? TRUE : FALSE;
+}
 
-        // Wait for USART to be ready to send a byte
-        while ((uarts[bufferId]->ISR & USART_ISR_TXE) == 0) {};
+uint8_t comms_stm32_set_baud_rate(uint8_t bufferId, uint32_t baudRate) {
 
-        // Send byte of usart
-        uarts[bufferId]->TDR = data[i];
+    if (comms_stm32_baud_rate_is_valid(baudRate) != TRUE) {
+        return FALSE;
     }
-}
\ No newline at end of file
+
+    USART_TypeDef* uart = uarts[bufferId];
+
+    // Let everything that is queued go out at the current baud rate first
+    while (tx_queue_is_empty(&txQueues[bufferId]) != TRUE) {};
+    while ((uart->ISR & USART_ISR_TC) == 0) {};
+
+    // The baud rate can only be changed while the UART is disabled
+    uart->CR1 &= ~(USART_CR1_UE);
+    uart->BRR = (SystemCoreClock + (baudRate / 2)) / baudRate;
+    uart->CR1 |= USART_CR1_UE;
+
+    baudRates[bufferId] = baudRate;
+
+    return TRUE;
+}
+
+uint32_t comms_stm32_get_baud_rate(uint8_t bufferId) {
+    return baudRates[bufferId];
+}
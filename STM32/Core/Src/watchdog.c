@@ -43,6 +43,11 @@
 #define TIMEOUT         5000
 #define COUNT_DOWN_TIME 5000
 
+#define BAUD_REPLY_TIMEOUT 1000 // The ESP32 only checks for requests every 200ms
+#define BAUD_SETTLE_TIME   5    // Time given to the other end of a link to change its baud rate
+
+#define ESP32_SHUTDOWN_TIMEOUT 1000 // Time the ESP32 gets to finish writing to the SD card
+
 #define WATCHDOG_CODE_MESSAGE 0
 #define WATCHDOG_CODE_TODO    1
 #define WATCHDOG_CODE_ERROR   2
@@ -72,9 +77,13 @@ void watchdog_create_and_send_bpacket_to_esp32(uint8_t request, uint8_t code, ui
 void watchdog_create_and_send_bpacket_to_maple(uint8_t request, uint8_t code, uint8_t numBytes, uint8_t* data);
 uint8_t stm32_match_esp32_request(bpacket_t* bpacket);
 uint8_t stm32_match_maple_request(bpacket_t* bpacket);
+uint8_t watchdog_create_photo_request(bpacket_t* photoRequest, uint8_t request);
 void process_watchdog_stm32_request(bpacket_t* bpacket);
 void watchdog_report_success(uint8_t request);
 void watchdog_message_maple(char* string, uint8_t bpacketCode);
+uint8_t watchdog_wait_for_bpacket(uint8_t bufferId, uint8_t request, bpacket_t* bpacket, uint32_t timeout);
+uint8_t watchdog_set_esp32_baud_rate(uint32_t baudRate);
+void watchdog_set_maple_baud_rate(uint32_t baudRate);
 
 void bpacket_print(bpacket_t* bpacket) {
     char msg[BPACKET_BUFFER_LENGTH_BYTES + 2];
@@ -531,6 +540,63 @@ void process_watchdog_stm32_request(bpacket_t* bpacket) {
             log_send_bdata(bpacket->bytes, bpacket->numBytes);
             break;
 
+        case BPACKET_GEN_R_EXT_FRAMING:
+
+            // The STM32 only forwards extended and checked bpackets so it can pass on any size. Reply
+            // with the max so Maple knows it is safe to negotiate extended framing with the ESP32. The
+            // STM32 never waits for ACKs so its window is 0. The size of the RX buffer is included so
+            // Maple can limit how many bpackets are in flight
+            if (bpacket->code == BPACKET_CODE_EXECUTE) {
+                uint8_t maxNumBytes[BPACKET_EXT_NUM_BYTES] = {(BPACKET_EXT_MAX_NUM_DATA_BYTES >> 8) & 0xFF,
+                                                              BPACKET_EXT_MAX_NUM_DATA_BYTES & 0xFF,
+                                                              BPACKET_EXT_FLAG_CRC,
+                                                              0,
+                                                              (RX_BUFFER_SIZE >> 8) & 0xFF,
+                                                              RX_BUFFER_SIZE & 0xFF};
+                watchdog_create_and_send_bpacket_to_maple(BPACKET_GEN_R_EXT_FRAMING, BPACKET_CODE_SUCCESS,
+                                                          BPACKET_EXT_NUM_BYTES, maxNumBytes);
+                break;
+            }
+
+            watchdog_message_maple("Invalid code for extended framing!\r\n", BPACKET_CODE_ERROR);
+
+            break;
+
+        case BPACKET_GEN_R_SET_BAUD:;
+
+            if ((bpacket->code != BPACKET_CODE_EXECUTE) || (bpacket->numBytes < 4)) {
+                watchdog_message_maple("Invalid set baud rate request!\r\n", BPACKET_CODE_ERROR);
+                break;
+            }
+
+            uint32_t baudRate = (bpacket->bytes[0] << 24) | (bpacket->bytes[1] << 16) | (bpacket->bytes[2] << 8) |
+                                bpacket->bytes[3];
+            uint8_t link      = bpacket->sender;
+            if (bpacket->numBytes > BPACKET_BAUD_LINK_INDEX) {
+                link = bpacket->bytes[BPACKET_BAUD_LINK_INDEX];
+            }
+
+            if (link == BPACKET_ADDRESS_MAPLE) {
+                watchdog_set_maple_baud_rate(baudRate);
+                break;
+            }
+
+            if (link == BPACKET_ADDRESS_ESP32) {
+
+                // Reply with the baud rate the link ended up at
+                uint8_t code            = (watchdog_set_esp32_baud_rate(baudRate) == TRUE) ? BPACKET_CODE_SUCCESS
+                                                                                           : BPACKET_CODE_ERROR;
+                uint32_t esp32BaudRate  = comms_stm32_get_baud_rate(ESP32_UART);
+                uint8_t baudRateData[4] = {(esp32BaudRate >> 24) & 0xFF, (esp32BaudRate >> 16) & 0xFF,
+                                           (esp32BaudRate >> 8) & 0xFF, esp32BaudRate & 0xFF};
+                watchdog_create_and_send_bpacket_to_maple(BPACKET_GEN_R_SET_BAUD, code, 4, baudRateData);
+                break;
+            }
+
+            watchdog_message_maple("Unknown link for set baud rate!\r\n", BPACKET_CODE_ERROR);
+
+            break;
+
         default:;
             char bpacketInfo[80];
             bpacket_get_info(bpacket, bpacketInfo);
@@ -594,6 +660,12 @@ uint8_t stm32_match_esp32_request(bpacket_t* bpacket) {
 
             break;
 
+        case WATCHDOG_BPK_R_TAKE_BURST: // ESP32 response to a burst. Maple gets the results or the error
+
+            watchdog_create_and_send_bpacket_to_maple(WATCHDOG_BPK_R_TAKE_BURST, bpacket->code, bpacket->numBytes,
+                                                      bpacket->bytes);
+            break;
+
         case WATCHDOG_BPK_R_SET_CAPTURE_TIME_SETTINGS:
 
             // Log success to Maple
@@ -622,9 +694,39 @@ uint8_t stm32_match_esp32_request(bpacket_t* bpacket) {
     return TRUE;
 }
 
+uint8_t watchdog_create_photo_request(bpacket_t* photoRequest, uint8_t request) {
+
+    // Record the current temperature from both temperature sensors
+    if (ds18b20_read_temperature(DS18B20_SENSOR_ID_1) != TRUE) {
+        watchdog_message_maple("Failed to read temperature", BPACKET_CODE_ERROR);
+    }
+
+    ds18b20_temp_t temp1;
+    if (ds18b20_copy_temperature(DS18B20_SENSOR_ID_1, &temp1) != TRUE) {
+        watchdog_message_maple("Failed to copy temperature", BPACKET_CODE_ERROR);
+    }
+
+    if (ds18b20_read_temperature(DS18B20_SENSOR_ID_2) != TRUE) {
+        watchdog_message_maple("Failed to read temperature", BPACKET_CODE_ERROR);
+    }
+
+    ds18b20_temp_t temp2;
+    if (ds18b20_copy_temperature(DS18B20_SENSOR_ID_2, &temp2) != TRUE) {
+        watchdog_message_maple("Failed to copy temperature", BPACKET_CODE_ERROR);
+    }
+
+    // Update the datetime struct
+    stm32_rtc_read_datetime(&datetime);
+
+    // Put the real time clock time and date in a packet to send to the ESP32
+    return wd_photo_data_to_bpacket(photoRequest, BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_STM32, request,
+                                    BPACKET_CODE_EXECUTE, &datetime, &temp1, &temp2);
+}
+
 uint8_t stm32_match_maple_request(bpacket_t* bpacket) {
 
     bpacket_buffer_t bpacketBuffer;
+    bpacket_t photoRequest;
     uint8_t request = bpacket->request;
     uint8_t result;
 
@@ -632,42 +734,40 @@ uint8_t stm32_match_maple_request(bpacket_t* bpacket) {
 
         case WATCHDOG_BPK_R_TAKE_PHOTO: // Send command to ESP32 to take a photo
 
-            // Record the current temperature from both temperature sensors
-            if (ds18b20_read_temperature(DS18B20_SENSOR_ID_1) != TRUE) {
-                watchdog_message_maple("Failed to read temperature", BPACKET_CODE_ERROR);
-            }
-
-            ds18b20_temp_t temp1;
-            if (ds18b20_copy_temperature(DS18B20_SENSOR_ID_1, &temp1) != TRUE) {
-                watchdog_message_maple("Failed to copy temperature", BPACKET_CODE_ERROR);
-            }
+            result = watchdog_create_photo_request(&photoRequest, WATCHDOG_BPK_R_TAKE_PHOTO);
 
-            if (ds18b20_read_temperature(DS18B20_SENSOR_ID_2) != TRUE) {
-                watchdog_message_maple("Failed to read temperature", BPACKET_CODE_ERROR);
+            if (result == TRUE) {
+                watchdog_send_bpacket_to_esp32(&photoRequest);
+            } else {
+                char errMsg[50];
+                wd_get_error(result, errMsg);
+                char msg[130];
+                sprintf(msg, "Failed to convert photo data to bpacket with error: %s\r\n", errMsg);
+                watchdog_message_maple(msg, BPACKET_CODE_ERROR);
             }
 
-            ds18b20_temp_t temp2;
-            if (ds18b20_copy_temperature(DS18B20_SENSOR_ID_2, &temp2) != TRUE) {
-                watchdog_message_maple("Failed to copy temperature", BPACKET_CODE_ERROR);
-            }
+            break;
 
-            // Update the datetime struct
-            stm32_rtc_read_datetime(&datetime);
+        case WATCHDOG_BPK_R_TAKE_BURST:; // Send command to ESP32 to take several photos
 
-            // Get the real time clock time and date. Put it in a packet and send to the ESP32
-            bpacket_t photoRequest;
+            wd_burst_t burst;
+            result = wd_bpacket_to_burst(bpacket, &burst);
 
-            result =
-                wd_photo_data_to_bpacket(&photoRequest, BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_STM32,
-                                         WATCHDOG_BPK_R_TAKE_PHOTO, BPACKET_CODE_EXECUTE, &datetime, &temp1, &temp2);
+            if (result == TRUE) {
+                result = watchdog_create_photo_request(&photoRequest, WATCHDOG_BPK_R_TAKE_BURST);
+            }
 
             if (result == TRUE) {
+                // The ESP32 reads the burst settings from after the photo data
+                memcpy(&photoRequest.bytes[WD_PHOTO_DATA_NUM_BYTES],
+                       &bpacket->bytes[bpacket->numBytes - WD_BURST_NUM_BYTES], WD_BURST_NUM_BYTES);
+                photoRequest.numBytes += WD_BURST_NUM_BYTES;
                 watchdog_send_bpacket_to_esp32(&photoRequest);
             } else {
                 char errMsg[50];
                 wd_get_error(result, errMsg);
                 char msg[130];
-                sprintf(msg, "Failed to convert photo data to bpacket with error: %s\r\n", errMsg);
+                sprintf(msg, "Failed to create burst request with error: %s\r\n", errMsg);
                 watchdog_message_maple(msg, BPACKET_CODE_ERROR);
             }
 
@@ -699,9 +799,21 @@ uint8_t stm32_match_maple_request(bpacket_t* bpacket) {
 
             break;
 
-        case WATCHDOG_BPK_R_GET_STATUS:
-            watchdog_message_maple("This feature has not been implemented yet\r\n", BPACKET_CODE_TODO);
-            // TODO: Implement
+        case WATCHDOG_BPK_R_GET_STATUS:;
+
+            // Report how well each UART is keeping up with what it receives
+            comms_rx_stats_t esp32Stats, mapleStats;
+            comms_stm32_get_rx_stats(BUFFER_1_ID, &esp32Stats);
+            comms_stm32_get_rx_stats(BUFFER_2_ID, &mapleStats);
+
+            char status[BPACKET_MAX_NUM_DATA_BYTES];
+            sprintf(status,
+                    "ESP32 RX: %lu B/s %lu overruns %lu overflows\r\n"
+                    "Maple RX: %lu B/s %lu overruns %lu overflows",
+                    esp32Stats.bytesPerSecond, esp32Stats.numOverruns, esp32Stats.numOverflows,
+                    mapleStats.bytesPerSecond, mapleStats.numOverruns, mapleStats.numOverflows);
+            watchdog_create_and_send_bpacket_to_maple(WATCHDOG_BPK_R_GET_STATUS, BPACKET_CODE_SUCCESS,
+                                                      chars_get_num_bytes(status), (uint8_t*)status);
             break;
 
         case WATCHDOG_BPK_R_GET_CAPTURE_TIME_SETTINGS:;
@@ -769,6 +881,83 @@ void watchdog_update(void) {
     // }
 }
 
+uint8_t watchdog_wait_for_bpacket(uint8_t bufferId, uint8_t request, bpacket_t* bpacket, uint32_t timeout) {
+
+    // Any other bpackets for the STM32 that arrive while waiting are dropped
+    uint32_t startTime = HAL_GetTick();
+
+    while ((HAL_GetTick() - startTime) < timeout) {
+        if ((comms_process_rxbuffer(bufferId, bpacket) == TRUE) && (bpacket->request == request)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+uint8_t watchdog_set_esp32_baud_rate(uint32_t baudRate) {
+
+    uint32_t previousBaudRate = comms_stm32_get_baud_rate(ESP32_UART);
+
+    if (comms_stm32_baud_rate_is_valid(baudRate) != TRUE) {
+        return FALSE;
+    }
+
+    // The ESP32 replies at the current baud rate before it changes
+    bpacket_t response;
+    uint8_t baudRateData[4] = {(baudRate >> 24) & 0xFF, (baudRate >> 16) & 0xFF, (baudRate >> 8) & 0xFF,
+                               baudRate & 0xFF};
+    watchdog_create_and_send_bpacket_to_esp32(BPACKET_GEN_R_SET_BAUD, BPACKET_CODE_EXECUTE, 4, baudRateData);
+
+    if ((watchdog_wait_for_bpacket(ESP32_UART, BPACKET_GEN_R_SET_BAUD, &response, BAUD_REPLY_TIMEOUT) != TRUE) ||
+        (response.code != BPACKET_CODE_SUCCESS)) {
+        return FALSE;
+    }
+
+    comms_stm32_set_baud_rate(ESP32_UART, baudRate);
+    HAL_Delay(BAUD_SETTLE_TIME);
+
+    // Confirm the link works at the new baud rate. If the ping is lost the ESP32 goes back
+    // to the previous baud rate by itself
+    watchdog_create_and_send_bpacket_to_esp32(BPACKET_GEN_R_PING, BPACKET_CODE_EXECUTE, 0, NULL);
+
+    if ((watchdog_wait_for_bpacket(ESP32_UART, BPACKET_GEN_R_PING, &response, BPACKET_BAUD_CONFIRM_TIMEOUT_MS) ==
+         TRUE) &&
+        (response.code == BPACKET_CODE_SUCCESS)) {
+        return TRUE;
+    }
+
+    comms_stm32_set_baud_rate(ESP32_UART, previousBaudRate);
+
+    return FALSE;
+}
+
+void watchdog_set_maple_baud_rate(uint32_t baudRate) {
+
+    uint32_t previousBaudRate = comms_stm32_get_baud_rate(MAPLE_UART);
+    uint8_t baudRateData[4]   = {(baudRate >> 24) & 0xFF, (baudRate >> 16) & 0xFF, (baudRate >> 8) & 0xFF,
+                                 baudRate & 0xFF};
+
+    if (comms_stm32_baud_rate_is_valid(baudRate) != TRUE) {
+        watchdog_create_and_send_bpacket_to_maple(BPACKET_GEN_R_SET_BAUD, BPACKET_CODE_ERROR, 4, baudRateData);
+        return;
+    }
+
+    // Reply at the current baud rate. This is sent before the baud rate changes
+    watchdog_create_and_send_bpacket_to_maple(BPACKET_GEN_R_SET_BAUD, BPACKET_CODE_SUCCESS, 4, baudRateData);
+    comms_stm32_set_baud_rate(MAPLE_UART, baudRate);
+
+    // Maple pings once it has changed the baud rate of its own port
+    bpacket_t ping;
+    if (watchdog_wait_for_bpacket(MAPLE_UART, BPACKET_GEN_R_PING, &ping, BPACKET_BAUD_CONFIRM_TIMEOUT_MS) == TRUE) {
+        uint8_t pingCode = WATCHDOG_PING_CODE_STM32;
+        watchdog_create_and_send_bpacket_to_maple(BPACKET_GEN_R_PING, BPACKET_CODE_SUCCESS, 1, &pingCode);
+        return;
+    }
+
+    comms_stm32_set_baud_rate(MAPLE_UART, previousBaudRate);
+}
+
 void watchdog_esp32_on(void) {
     ESP32_POWER_PORT->BSRR |= (0x01 << ESP32_POWER_PIN);
 
@@ -777,5 +966,13 @@ void watchdog_esp32_on(void) {
 }
 
 void watchdog_esp32_off(void) {
+
+    // Let the ESP32 write out its buffered logs and unmount the SD card before the power is cut
+    bpacket_t bpacket;
+    bpacket_create_p(&bpacket, BPACKET_ADDRESS_ESP32, BPACKET_ADDRESS_STM32, WATCHDOG_BPK_R_TURN_OFF,
+                     BPACKET_CODE_EXECUTE, 0, NULL);
+    watchdog_send_bpacket_to_esp32(&bpacket);
+    watchdog_wait_for_bpacket(ESP32_UART, WATCHDOG_BPK_R_TURN_OFF, &bpacket, ESP32_SHUTDOWN_TIMEOUT);
+
     ESP32_POWER_PORT->BSRR |= (0x10000 << ESP32_POWER_PIN);
 }
\ No newline at end of file
@@ -25,6 +25,17 @@
 #define BPACKET_STOP_BYTE_UPPER 'j'
 #define BPACKET_STOP_BYTE_LOWER 'Y'
 
+// Extended bpackets use a different lower start byte so a receiver knows
+// the length field that follows is two bytes (upper byte first) instead
+// of one. Peers that have not negotiated extended framing will treat the
+// start byte as invalid and discard the bpacket
+#define BPACKET_START_BYTE_EXT_LOWER 'x'
+
+// Checked bpackets have the extended header followed by a two byte sequence
+// number, and a CRC-16 of everything between the start bytes and the CRC just
+// before the stop bytes. They are only sent once CRCs have been negotiated
+#define BPACKET_START_BYTE_CRC_LOWER 'c'
+
 // #define BPACKET_START_BYTE 'A'
 // #define BPACKET_STOP_BYTE  'B'
 
@@ -60,6 +71,41 @@
 #define BPACKET_GEN_R_MESSAGE     (BPACKET_MIN_REQUEST_INDEX + 4) // Used for debugging purposes and general messages
 #define BPACKET_SPECIFIC_R_OFFSET (BPACKET_MIN_REQUEST_INDEX + 6) // This is the offset applied to specific projects
 
+// Requests used by the bpacket transport itself. These count down from the
+// maximum request value so they never collide with project specific requests
+#define BPACKET_GEN_R_EXT_FRAMING (BPACKET_MAX_REQUEST_VALUE - 0) // Negotiate the max data bytes per bpacket
+#define BPACKET_GEN_R_NACK        (BPACKET_MAX_REQUEST_VALUE - 1) // Ask the sender to resend checked bpackets
+#define BPACKET_GEN_R_ACK         (BPACKET_MAX_REQUEST_VALUE - 2) // Number of checked bpackets received in order
+#define BPACKET_GEN_R_SET_BAUD    (BPACKET_MAX_REQUEST_VALUE - 3) // Change the baud rate of a link
+
+// Optional third byte of a BPACKET_GEN_R_EXT_FRAMING request
+#define BPACKET_EXT_FLAG_CRC 0x01 // Send data with sequence numbers and a CRC trailer
+
+// Optional fourth byte of a BPACKET_GEN_R_EXT_FRAMING request. The max number of checked
+// bpackets the sender can have in flight before it must wait for a BPACKET_GEN_R_ACK.
+// Zero turns flow control off
+#define BPACKET_EXT_WINDOW_INDEX 3
+
+// Optional fifth and sixth bytes of a BPACKET_GEN_R_EXT_FRAMING reply. The size of the buffer
+// the node receives bpackets into (upper byte first). Nodes that forward bpackets send this so
+// the window can be kept within what they can hold. Zero if the node does not report it
+#define BPACKET_EXT_RX_BUFFER_INDEX 4
+#define BPACKET_EXT_NUM_BYTES       6 // The number of bytes in a BPACKET_GEN_R_EXT_FRAMING reply with every field
+
+// A BPACKET_GEN_R_SET_BAUD request holds the new baud rate as four bytes (upper byte first).
+// Nodes with more than one link take an optional fifth byte, the address of the node at the
+// other end of the link to change. Otherwise the link the request arrived on is changed
+#define BPACKET_BAUD_LINK_INDEX 4
+
+// The receiver of a BPACKET_GEN_R_SET_BAUD replies at the current baud rate and then changes.
+// If a BPACKET_GEN_R_PING does not arrive at the new baud rate within this time it goes back
+// to the previous one
+#define BPACKET_BAUD_CONFIRM_TIMEOUT_MS 1000
+
+// Number of times the sender will go back to the first unacknowledged bpacket after
+// the ACKs stop before the transfer is abandoned
+#define BPACKET_WINDOW_MAX_NUM_TIMEOUTS 5
+
 #define BPACKET_CODE_IS_INVALID(code)         ((code > BPACKET_CODE_EXECUTE) == TRUE)
 #define BPACKET_SENDER_IS_INVALID(sender)     ((sender > BPACKET_ADDRESS_15) == TRUE)
 #define BPACKET_RECEIVER_IS_INVALID(receiver) ((receiver > BPACKET_ADDRESS_15) == TRUE)
@@ -112,6 +158,45 @@
 #define BPACKET_NUM_NON_DATA_BYTES  9
 #define BPACKET_BUFFER_LENGTH_BYTES (BPACKET_MAX_NUM_DATA_BYTES + BPACKET_NUM_NON_DATA_BYTES)
 
+// Extended bpackets have a 16 bit length field. They are only ever sent once both
+// ends of a link have agreed to use them (see BPACKET_GEN_R_EXT_FRAMING). Any
+// bpacket with 255 data bytes or less is always sent with legacy framing
+#define BPACKET_EXT_MAX_NUM_DATA_BYTES  4096
+#define BPACKET_EXT_NUM_INFO_BYTES      2
+#define BPACKET_EXT_NUM_NON_DATA_BYTES  10
+#define BPACKET_EXT_BUFFER_LENGTH_BYTES (BPACKET_EXT_MAX_NUM_DATA_BYTES + BPACKET_EXT_NUM_NON_DATA_BYTES)
+#define BPACKET_CRC_NUM_INFO_BYTES      4 // Two sequence bytes and two CRC bytes
+#define BPACKET_CRC_NUM_NON_DATA_BYTES  14
+
+// Checked bpackets and the ACKs for them number bpackets with 16 bits so a checked
+// transfer can be split into at most this many bpackets
+#define BPACKET_MAX_NUM_CHUNKS 0xFFFF
+
+// A NACK carries a list of sequence numbers (upper byte first). A NACK with no
+// sequence numbers tells the sender every bpacket was received
+#define BPACKET_NACK_MAX_NUM_SEQUENCES (BPACKET_MAX_NUM_DATA_BYTES / 2)
+
+// CRC status of a received bpacket
+#define BPACKET_CRC_NONE   0 // The bpacket had no CRC trailer
+#define BPACKET_CRC_OK     1
+#define BPACKET_CRC_FAILED 2
+
+// The number of data bytes a bpacket_t on this node can hold. Nodes that receive
+// extended bpackets (i.e Maple) override this at compile time. Nodes that only
+// send or forward extended bpackets keep the legacy size to save RAM
+#ifndef BPACKET_NODE_MAX_NUM_DATA_BYTES
+#    define BPACKET_NODE_MAX_NUM_DATA_BYTES BPACKET_MAX_NUM_DATA_BYTES
+#endif
+
+// The framing agreed with BPACKET_GEN_R_EXT_FRAMING and the ACK receiver are kept for the
+// whole node. Builds that run a link per thread (i.e Maple's simulated devices) define
+// BPACKET_THREAD_LOCAL_LINKS so each thread negotiates its own
+#ifdef BPACKET_THREAD_LOCAL_LINKS
+#    define BPACKET_LINK_STATE static _Thread_local
+#else
+#    define BPACKET_LINK_STATE static
+#endif
+
 #define BPACKET_CIRCULAR_BUFFER_SIZE 10
 
 // Bpacket data type ids
@@ -125,6 +210,11 @@
 #define BPACKET_REQUEST_BYTE_ID     7
 #define BPACKET_SENDER_BYTE_ID      8
 #define BPACKET_RECEIVER_BYTE_ID    9
+#define BPACKET_NUM_BYTES_LOWER_ID  10 // Second length byte of an extended bpacket
+#define BPACKET_SEQUENCE_UPPER_ID   11
+#define BPACKET_SEQUENCE_LOWER_ID   12
+#define BPACKET_CRC_UPPER_ID        13
+#define BPACKET_CRC_LOWER_ID        14
 
 // Bpacket Errors
 #define BPACKET_ERR_OFFSET                 2 // Offset so no error code = TRUE/FALSE
@@ -134,10 +224,18 @@
 #define BPACKET_ERR_INVALID_CODE           (BPACKET_ERR_OFFSET + 3)
 #define BPACKET_ERR_INVALID_NUM_DATA_BYTES (BPACKET_ERR_OFFSET + 4)
 #define BPACKET_ERR_INVALID_START_BYTE     (BPACKET_ERR_OFFSET + 5)
+#define BPACKET_ERR_INVALID_EXT_FRAMING    (BPACKET_ERR_OFFSET + 6)
+#define BPACKET_ERR_INVALID_CRC            (BPACKET_ERR_OFFSET + 7)
 
 #define BPACKET_START_BYTE(byteUpper, byteLower) \
     ((byteUpper == BPACKET_START_BYTE_UPPER) && (byteLower == BPACKET_START_BYTE_LOWER))
 
+#define BPACKET_EXT_START_BYTE(byteUpper, byteLower) \
+    ((byteUpper == BPACKET_START_BYTE_UPPER) && (byteLower == BPACKET_START_BYTE_EXT_LOWER))
+
+#define BPACKET_CRC_START_BYTE(byteUpper, byteLower) \
+    ((byteUpper == BPACKET_START_BYTE_UPPER) && (byteLower == BPACKET_START_BYTE_CRC_LOWER))
+
 #define BPACKET_STOP_BYTE(byteUpper, byteLower) \
     ((byteUpper == BPACKET_STOP_BYTE_UPPER) && (byteLower == BPACKET_STOP_BYTE_LOWER))
 
@@ -178,7 +276,9 @@
 
 #define BPACKET_ASSERT_VALID_START_BYTE(startByteUpper, startByteLower)                                     \
     do {                                                                                                    \
-        if ((startByteUpper != BPACKET_START_BYTE_UPPER) || (BPACKET_START_BYTE_LOWER != startByteLower)) { \
+        if ((BPACKET_START_BYTE(startByteUpper, startByteLower) != TRUE) &&                                 \
+            (BPACKET_EXT_START_BYTE(startByteUpper, startByteLower) != TRUE) &&                             \
+            (BPACKET_CRC_START_BYTE(startByteUpper, startByteLower) != TRUE)) {                             \
             return BPACKET_ERR_INVALID_START_BYTE;                                                          \
         }                                                                                                   \
     } while (0)
@@ -186,7 +286,7 @@
 typedef struct bpacket_t {
     uint8_t receiver;
     uint8_t sender;
-    uint8_t numBytes; // The number of bytes in the bytes array
+    uint16_t numBytes; // The number of bytes in the bytes array. Can only exceed 255 for extended bpackets
     uint8_t request;
     /**
      * @brief The code gives context to the request. If you receive a request
@@ -196,14 +296,29 @@ typedef struct bpacket_t {
      * failed
      */
     uint8_t code;
-    uint8_t bytes[BPACKET_MAX_NUM_DATA_BYTES]; // Minus 1 because this includes request
+    uint16_t sequence; // Only sent in checked bpackets
+    uint8_t crcStatus; // Set when a bpacket is received. See BPACKET_CRC_NONE
+    uint8_t bytes[BPACKET_NODE_MAX_NUM_DATA_BYTES];
 } bpacket_t;
 
 typedef struct bpacket_buffer_t {
     uint16_t numBytes; // Bpacket size needs to be a uint16_t because bpacket buffer > 255 bytes when put into a buffer
-    uint8_t buffer[BPACKET_BUFFER_LENGTH_BYTES];
+    uint8_t buffer[BPACKET_NODE_MAX_NUM_DATA_BYTES + BPACKET_CRC_NUM_NON_DATA_BYTES];
 } bpacket_buffer_t;
 
+/**
+ * @brief A bpacket split into the three parts that get transmitted. The data is
+ * not copied, it points into the buffer the frame was encoded from
+ */
+typedef struct bpacket_frame_t {
+    uint8_t header[BPACKET_CRC_NUM_NON_DATA_BYTES - 4];
+    uint8_t numHeaderBytes;
+    uint8_t* data;
+    uint16_t numDataBytes;
+    uint8_t trailer[4];
+    uint8_t numTrailerBytes;
+} bpacket_frame_t;
+
 typedef struct bpacket_char_array_t {
     uint16_t numBytes;
     char string[BPACKET_MAX_NUM_DATA_BYTES + 1]; // One extra for null character
@@ -223,6 +338,46 @@ void bpacket_create_circular_buffer(bpacket_circular_buffer_t* bufferStruct, uin
 
 uint8_t bpacket_buffer_decode(bpacket_t* bpacket, uint8_t data[BPACKET_BUFFER_LENGTH_BYTES]);
 
+/**
+ * @brief Handles the data of a BPACKET_GEN_R_EXT_FRAMING request. The requested
+ * number of data bytes per bpacket is clamped to what this node supports and
+ * stored so bpacket_send_data() uses it for all following transfers
+ *
+ * @param bpacket The request. Must contain the requested max number of data
+ * bytes as two bytes (upper byte first)
+ * @return uint16_t The number of data bytes per bpacket that was agreed on
+ */
+uint16_t bpacket_negotiate_ext_framing(bpacket_t* bpacket);
+
+uint16_t bpacket_get_max_num_data_bytes(void);
+
+uint8_t bpacket_crc_enabled(void);
+
+uint8_t bpacket_get_window_size(void);
+
+/**
+ * @brief Sets the function bpacket_send_data() uses to wait for the receiver to
+ * acknowledge bpackets when flow control has been negotiated
+ *
+ * @param receive_ack Returns TRUE and sets numBpacketsReceived to the most recent
+ * BPACKET_GEN_R_ACK, or FALSE if no ACK arrived in time
+ */
+void bpacket_set_ack_receiver(uint8_t (*receive_ack)(uint16_t* numBpacketsReceived));
+
+/**
+ * @brief Calculates the CRC-16/CCITT-FALSE of a block of data. Pass the result
+ * back in as the crc to continue the calculation over another block
+ *
+ * @param crc The CRC so far. Use 0xFFFF to start a new calculation
+ */
+uint16_t bpacket_crc16(uint16_t crc, uint8_t* data, uint32_t numBytes);
+
+/**
+ * @brief Calculates the CRC a checked bpacket would be sent with. This covers the
+ * addresses, request, code, length, sequence number and data
+ */
+uint16_t bpacket_checksum(bpacket_t* bpacket);
+
 uint8_t bpacket_create_p(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
                          uint8_t numDataBytes, uint8_t* data);
 
@@ -231,6 +386,32 @@ uint8_t bpacket_create_sp(bpacket_t* bpacket, uint8_t receiver, uint8_t sender,
 
 void bpacket_to_buffer(bpacket_t* bpacket, bpacket_buffer_t* packetBuffer);
 
+/**
+ * @brief Same as bpacket_to_buffer() except the bpacket is framed with its
+ * sequence number and a CRC trailer. Only use once CRCs have been negotiated
+ */
+void bpacket_to_checked_buffer(bpacket_t* bpacket, bpacket_buffer_t* packetBuffer);
+
+/**
+ * @brief Encodes the header and trailer of a bpacket around data owned by the
+ * caller. The data must stay valid until the frame has been transmitted
+ *
+ * @param checked TRUE to frame the bpacket with the sequence number and a CRC
+ */
+void bpacket_encode_frame(bpacket_frame_t* frame, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
+                          uint8_t* data, uint16_t numDataBytes, uint8_t checked, uint16_t sequence);
+
+/**
+ * @brief Same as bpacket_encode_frame() using the values and data of a bpacket
+ */
+void bpacket_to_frame(bpacket_t* bpacket, bpacket_frame_t* frame, uint8_t checked);
+
+/**
+ * @brief Passes the header, data and trailer of a frame to the transmit function
+ * in order
+ */
+void bpacket_transmit_frame(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), bpacket_frame_t* frame);
+
 void bpacket_data_to_string(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray);
 
 void bpacket_print_bytes(bpacket_t* bpacket);
@@ -244,9 +425,28 @@ void bpacket_get_error(uint8_t bpacketError, char* errorMsg);
 /* Bpacket helper functions */
 void bpacket_bytes_is_start_byte(void);
 
+/**
+ * @brief Splits the data into bpackets of the negotiated size and sends them
+ *
+ * @return uint8_t TRUE if the data was sent. FALSE if a checked transfer would need
+ * more than BPACKET_MAX_NUM_CHUNKS bpackets or a windowed transfer stopped being ACKed
+ */
 uint8_t bpacket_send_data(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), uint8_t receiver,
                           uint8_t sender, uint8_t request, uint8_t* data, uint32_t numBytesToSend);
 
+/**
+ * @brief Resends a single bpacket of data previously sent with bpacket_send_data().
+ * Used to answer a BPACKET_GEN_R_NACK. All the parameters must be the same as the
+ * original call
+ *
+ * @param sequence The sequence number of the bpacket to resend
+ * @return uint8_t TRUE if the bpacket was resent, FALSE if the sequence number
+ * is not part of the data
+ */
+uint8_t bpacket_resend_data(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), uint8_t receiver,
+                            uint8_t sender, uint8_t request, uint8_t* data, uint32_t numBytesToSend,
+                            uint16_t sequence);
+
 uint8_t bpacket_confirm_values(bpacket_t* bpacket, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
                                uint8_t numDataBytes, char* errMsg);
 
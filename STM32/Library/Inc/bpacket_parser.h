@@ -0,0 +1,72 @@
+/**
+ * @file bpacket_parser.h
+ * @author Gian Barta-Dougall
+ * @brief Incremental bpacket parser shared by the STM32, ESP32 and Maple. Bytes
+ * are passed in as spans of any size and completed bpackets are handed to a
+ * callback. Legacy, extended and checked framing are all supported
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef BPACKET_PARSER_H
+#define BPACKET_PARSER_H
+
+/* C Library Includes */
+#include "stdint.h"
+
+/* Personal Includes */
+#include "bpacket.h"
+
+typedef struct bpacket_parser_t {
+    uint8_t id;      // Passed to the callbacks so one set of callbacks can serve several parsers
+    uint8_t address; // Bpackets for any other address are forwarded if forward_bytes is set
+    uint8_t expectedByteId;
+    uint8_t startByteLower;
+    uint8_t forwarding; // TRUE while the bytes of the current bpacket are being forwarded
+    uint8_t receiver;
+    uint16_t numDataBytesExpected;
+    uint16_t numDataBytesReceived;
+    uint16_t crc;
+    bpacket_t* bpacket; // The bpacket being decoded into. Can be changed from bpacket_received()
+
+    // Called once a bpacket has been decoded. Bpackets larger than a bpacket_t on
+    // this node are dropped. Checked bpackets have their crcStatus set
+    void (*bpacket_received)(uint8_t id, bpacket_t* bpacket);
+
+    // Optional. Called with the raw bytes of bpackets addressed to another node
+    void (*forward_bytes)(uint8_t id, uint8_t receiver, uint8_t* data, uint32_t numBytes);
+
+    // Optional. Called with bytes found outside of a bpacket such as debug prints
+    void (*unframed_bytes)(uint8_t id, uint8_t* data, uint32_t numBytes);
+} bpacket_parser_t;
+
+/**
+ * @brief Initialises a parser. forward_bytes and unframed_bytes are set to NULL
+ * and can be set afterwards
+ *
+ * @param id Passed to the callbacks
+ * @param address The address of this node
+ * @param bpacket Where the first bpacket is decoded into
+ * @param bpacket_received Called every time a bpacket is decoded
+ */
+void bpacket_parser_init(bpacket_parser_t* parser, uint8_t id, uint8_t address, bpacket_t* bpacket,
+                         void (*bpacket_received)(uint8_t id, bpacket_t* bpacket));
+
+/**
+ * @brief Parses a span of received bytes. Parsing stops after the byte that
+ * completes a decoded bpacket so the caller can handle it before the next one is
+ * decoded into the same bpacket_t. Forwarded bpackets do not stop parsing
+ *
+ * @return uint32_t The number of bytes consumed. Call again with the remaining
+ * bytes if this is less than numBytes
+ */
+uint32_t bpacket_parser_parse(bpacket_parser_t* parser, uint8_t* data, uint32_t numBytes);
+
+/**
+ * @brief Discards the bpacket that is part way through being parsed
+ */
+void bpacket_parser_reset(bpacket_parser_t* parser);
+
+#endif // BPACKET_PARSER_H
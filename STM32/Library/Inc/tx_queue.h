@@ -0,0 +1,96 @@
+/**
+ * @file tx_queue.h
+ * @author Gian Barta-Dougall
+ * @brief Queue of byte spans waiting to be transmitted by a DMA channel (or
+ * anything else that sends a block of bytes and reports when it is done). Spans
+ * either point to bytes owned by the caller or to a copy in the queue's own TX
+ * ring. The queue does not touch any hardware so the same code runs on the host
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+/* C Library Includes */
+#include "stdint.h"
+
+#define TX_QUEUE_NUM_SPANS      32
+#define TX_QUEUE_MAX_SPAN_BYTES 65535 // Max number of bytes a DMA channel can send at once
+
+// Size of the ring copied bytes are kept in until they are sent. Must hold the largest
+// bpacket a node sends in one go
+#ifndef TX_QUEUE_BUFFER_SIZE
+#    define TX_QUEUE_BUFFER_SIZE 1024
+#endif
+
+typedef struct tx_span_t {
+    uint8_t* data;
+    uint16_t numBytes;
+    uint16_t numCopyBytes; // Bytes of the TX ring released once this span is sent
+} tx_span_t;
+
+typedef struct tx_queue_t {
+    uint8_t id; // Passed to start_transfer
+    tx_span_t spans[TX_QUEUE_NUM_SPANS];
+    volatile uint8_t head; // Where the next span is added. Only changed by the main loop
+    volatile uint8_t tail; // The span being sent. Only changed by tx_queue_transfer_complete()
+    volatile uint8_t busy; // TRUE while the span at the tail is being sent
+    uint8_t buffer[TX_QUEUE_BUFFER_SIZE];
+    uint16_t bufferIndex; // Where the next copied bytes go
+
+    // Kept as two counters so the main loop and the interrupt never write the same one
+    uint32_t copyNumBytesQueued;
+    volatile uint32_t copyNumBytesReleased;
+    uint32_t numBytesQueued; // Every byte queued, copied or not
+    volatile uint32_t numBytesSent;
+
+    // Starts sending a span. tx_queue_transfer_complete() must be called once it has been sent
+    void (*start_transfer)(uint8_t id, uint8_t* data, uint16_t numBytes);
+
+    // Optional. Called from tx_queue_transfer_complete() once a span queued with
+    // tx_queue_push() has been sent so the caller knows its bytes are free again
+    void (*span_sent)(uint8_t id, uint8_t* data, uint16_t numBytes);
+} tx_queue_t;
+
+void tx_queue_init(tx_queue_t* queue, uint8_t id, void (*start_transfer)(uint8_t id, uint8_t* data, uint16_t numBytes));
+
+/**
+ * @brief Queues bytes to be sent. The bytes are not copied so they must stay
+ * valid until they have been sent
+ *
+ * @return uint8_t TRUE if the bytes were queued, FALSE if the queue is full
+ */
+uint8_t tx_queue_push(tx_queue_t* queue, uint8_t* data, uint32_t numBytes);
+
+/**
+ * @brief Same as tx_queue_push() except the bytes are copied into the TX ring first
+ * so the caller can reuse them straight away
+ *
+ * @return uint8_t TRUE if the bytes were queued, FALSE if there is not enough room.
+ * Nothing is queued if there is not enough room for all of the bytes
+ */
+uint8_t tx_queue_push_copy(tx_queue_t* queue, uint8_t* data, uint16_t numBytes);
+
+/**
+ * @brief The number of bytes tx_queue_push_copy() can take right now
+ */
+uint16_t tx_queue_num_free_bytes(tx_queue_t* queue);
+
+/**
+ * @brief The number of bytes queued that have not finished sending, including
+ * the span being sent
+ */
+uint32_t tx_queue_num_pending_bytes(tx_queue_t* queue);
+
+/**
+ * @brief Releases the span that was just sent and starts sending the next one.
+ * Call from the transfer complete interrupt
+ */
+void tx_queue_transfer_complete(tx_queue_t* queue);
+
+uint8_t tx_queue_is_empty(tx_queue_t* queue);
+
+#endif // TX_QUEUE_H
@@ -8,6 +8,15 @@
  *
  * The packet data is structured as follows
  * [COMMAND][DATA]
+ *
+ * Extended bpackets (lower start byte 'x') have a two byte length field
+ * (upper byte first) so they can carry up to 4 KiB of data. They are only
+ * sent once both ends have agreed to it with BPACKET_GEN_R_EXT_FRAMING
+ *
+ * Checked bpackets (lower start byte 'c') are structured as follows
+ * [START BYTES][HEADER][LENGTH (2)][SEQUENCE (2)][DATA][CRC-16 (2)][STOP BYTES]
+ * The receiver can ask for any bpacket with a bad CRC or a missing sequence
+ * number to be sent again with BPACKET_GEN_R_NACK
  * @version 0.1
  * @date 2023-01-18
  *
@@ -22,6 +31,63 @@
 #include "bpacket.h"
 #include "chars.h"
 
+/* Private Variables */
+
+// The max number of data bytes to put in a single bpacket when sending data. This
+// stays at the legacy size until extended framing has been negotiated
+BPACKET_LINK_STATE uint16_t maxNumDataBytes = BPACKET_MAX_NUM_DATA_BYTES;
+BPACKET_LINK_STATE uint8_t crcEnabled       = FALSE;
+BPACKET_LINK_STATE uint8_t windowSize       = 0;
+
+// Used to wait for ACKs from the receiver when flow control is on
+BPACKET_LINK_STATE uint8_t (*bpacket_receive_ack)(uint16_t* numBpacketsReceived) = NULL;
+
+// CRC-16/CCITT-FALSE lookup table (polynomial 0x1021)
+static const uint16_t crc16Table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+/* Function Prototypes */
+static uint8_t bpacket_write_header(uint8_t* buffer, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
+                                    uint16_t numDataBytes, uint8_t checked, uint16_t sequence);
+static void bpacket_send_chunk(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), uint8_t receiver,
+                               uint8_t sender, uint8_t request, uint8_t* data, uint32_t numBytesToSend,
+                               uint32_t chunkIndex);
+static uint8_t bpacket_send_windowed_data(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes),
+                                          uint8_t receiver, uint8_t sender, uint8_t request, uint8_t* data,
+                                          uint32_t numBytesToSend);
+
 void bpacket_create_circular_buffer(bpacket_circular_buffer_t* bufferStruct, uint8_t* writeIndex, uint8_t* readIndex,
                                     bpacket_t* circularBuffer) {
     bufferStruct->writeIndex = writeIndex;
@@ -97,43 +163,153 @@ uint8_t bpacket_create_sp(bpacket_t* bpacket, uint8_t receiver, uint8_t sender,
     return TRUE;
 }
 
-void bpacket_to_buffer(bpacket_t* bpacket, bpacket_buffer_t* packetBuffer) {
+static uint8_t bpacket_write_header(uint8_t* buffer, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
+                                    uint16_t numDataBytes, uint8_t checked, uint16_t sequence) {
 
-    // Set the first two bytes to start bytes
-    packetBuffer->buffer[0] = BPACKET_START_BYTE_UPPER;
-    packetBuffer->buffer[1] = BPACKET_START_BYTE_LOWER;
+    // Set the first two bytes to start bytes. Extended framing is only used when the
+    // data will not fit in a legacy bpacket so older peers can still read everything else
+    buffer[0] = BPACKET_START_BYTE_UPPER;
+    buffer[1] = (numDataBytes > BPACKET_MAX_NUM_DATA_BYTES) ? BPACKET_START_BYTE_EXT_LOWER : BPACKET_START_BYTE_LOWER;
+
+    if (checked == TRUE) {
+        buffer[1] = BPACKET_START_BYTE_CRC_LOWER;
+    }
 
     // Set the sender and receiver bytes
-    packetBuffer->buffer[2] = bpacket->receiver;
-    packetBuffer->buffer[3] = bpacket->sender;
+    buffer[2] = receiver;
+    buffer[3] = sender;
 
     // Set the request and code
-    packetBuffer->buffer[4] = bpacket->request;
-    packetBuffer->buffer[5] = bpacket->code;
+    buffer[4] = request;
+    buffer[5] = code;
 
     // Set the length
-    packetBuffer->buffer[6] = bpacket->numBytes;
+    if (buffer[1] == BPACKET_START_BYTE_LOWER) {
+        buffer[6] = numDataBytes;
+        return BPACKET_NUM_NON_DATA_BYTES - 2;
+    }
+
+    buffer[6] = (numDataBytes >> 8) & 0xFF;
+    buffer[7] = numDataBytes & 0xFF;
+
+    if (buffer[1] == BPACKET_START_BYTE_EXT_LOWER) {
+        return BPACKET_EXT_NUM_NON_DATA_BYTES - 2;
+    }
+
+    // Set the sequence number
+    buffer[8] = (sequence >> 8) & 0xFF;
+    buffer[9] = sequence & 0xFF;
+
+    return BPACKET_CRC_NUM_NON_DATA_BYTES - 4;
+}
+
+uint16_t bpacket_crc16(uint16_t crc, uint8_t* data, uint32_t numBytes) {
+
+    for (uint32_t i = 0; i < numBytes; i++) {
+        crc = (crc << 8) ^ crc16Table[((crc >> 8) ^ data[i]) & 0xFF];
+    }
+
+    return crc;
+}
+
+uint16_t bpacket_checksum(bpacket_t* bpacket) {
+
+    uint8_t header[BPACKET_CRC_NUM_NON_DATA_BYTES - 4];
+    uint8_t numHeaderBytes = bpacket_write_header(header, bpacket->receiver, bpacket->sender, bpacket->request,
+                                                  bpacket->code, bpacket->numBytes, TRUE, bpacket->sequence);
+
+    // The start bytes are not part of the CRC
+    uint16_t crc = bpacket_crc16(0xFFFF, &header[2], numHeaderBytes - 2);
+
+    return bpacket_crc16(crc, bpacket->bytes, bpacket->numBytes);
+}
+
+void bpacket_to_buffer(bpacket_t* bpacket, bpacket_buffer_t* packetBuffer) {
+
+    uint8_t numHeaderBytes = bpacket_write_header(packetBuffer->buffer, bpacket->receiver, bpacket->sender,
+                                                  bpacket->request, bpacket->code, bpacket->numBytes, FALSE, 0);
 
     // Copy data into buffer
     int i;
     for (i = 0; i < bpacket->numBytes; i++) {
-        packetBuffer->buffer[i + 7] = bpacket->bytes[i];
+        packetBuffer->buffer[i + numHeaderBytes] = bpacket->bytes[i];
     }
 
     // Set the stop bytes at the end
-    packetBuffer->buffer[i + 7] = BPACKET_STOP_BYTE_UPPER;
-    packetBuffer->buffer[i + 8] = BPACKET_STOP_BYTE_LOWER;
+    packetBuffer->buffer[i + numHeaderBytes]     = BPACKET_STOP_BYTE_UPPER;
+    packetBuffer->buffer[i + numHeaderBytes + 1] = BPACKET_STOP_BYTE_LOWER;
 
-    packetBuffer->numBytes = bpacket->numBytes + BPACKET_NUM_NON_DATA_BYTES;
+    packetBuffer->numBytes = bpacket->numBytes + numHeaderBytes + 2;
+}
+
+void bpacket_to_checked_buffer(bpacket_t* bpacket, bpacket_buffer_t* packetBuffer) {
+
+    uint8_t numHeaderBytes =
+        bpacket_write_header(packetBuffer->buffer, bpacket->receiver, bpacket->sender, bpacket->request,
+                             bpacket->code, bpacket->numBytes, TRUE, bpacket->sequence);
+
+    // Copy data into buffer
+    int i;
+    for (i = 0; i < bpacket->numBytes; i++) {
+        packetBuffer->buffer[i + numHeaderBytes] = bpacket->bytes[i];
+    }
+
+    // Set the CRC and the stop bytes at the end
+    uint16_t crc                                 = bpacket_checksum(bpacket);
+    packetBuffer->buffer[i + numHeaderBytes]     = (crc >> 8) & 0xFF;
+    packetBuffer->buffer[i + numHeaderBytes + 1] = crc & 0xFF;
+    packetBuffer->buffer[i + numHeaderBytes + 2] = BPACKET_STOP_BYTE_UPPER;
+    packetBuffer->buffer[i + numHeaderBytes + 3] = BPACKET_STOP_BYTE_LOWER;
+
+    packetBuffer->numBytes = bpacket->numBytes + BPACKET_CRC_NUM_NON_DATA_BYTES;
+}
+
+void bpacket_encode_frame(bpacket_frame_t* frame, uint8_t receiver, uint8_t sender, uint8_t request, uint8_t code,
+                          uint8_t* data, uint16_t numDataBytes, uint8_t checked, uint16_t sequence) {
+
+    frame->numHeaderBytes =
+        bpacket_write_header(frame->header, receiver, sender, request, code, numDataBytes, checked, sequence);
+    frame->data            = data;
+    frame->numDataBytes    = numDataBytes;
+    frame->numTrailerBytes = 0;
+
+    if (checked == TRUE) {
+        uint16_t crc = bpacket_crc16(0xFFFF, &frame->header[2], frame->numHeaderBytes - 2);
+        crc          = bpacket_crc16(crc, data, numDataBytes);
+
+        frame->trailer[frame->numTrailerBytes++] = (crc >> 8) & 0xFF;
+        frame->trailer[frame->numTrailerBytes++] = crc & 0xFF;
+    }
+
+    frame->trailer[frame->numTrailerBytes++] = BPACKET_STOP_BYTE_UPPER;
+    frame->trailer[frame->numTrailerBytes++] = BPACKET_STOP_BYTE_LOWER;
+}
+
+void bpacket_to_frame(bpacket_t* bpacket, bpacket_frame_t* frame, uint8_t checked) {
+    bpacket_encode_frame(frame, bpacket->receiver, bpacket->sender, bpacket->request, bpacket->code, bpacket->bytes,
+                         bpacket->numBytes, checked, bpacket->sequence);
+}
+
+void bpacket_transmit_frame(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), bpacket_frame_t* frame) {
+
+    transmit_bpacket(frame->header, frame->numHeaderBytes);
+
+    if (frame->numDataBytes > 0) {
+        transmit_bpacket(frame->data, frame->numDataBytes);
+    }
+
+    transmit_bpacket(frame->trailer, frame->numTrailerBytes);
 }
 
 uint8_t bpacket_buffer_decode(bpacket_t* bpacket, uint8_t data[BPACKET_BUFFER_LENGTH_BYTES]) {
 
-    uint8_t receiver     = data[2];
-    uint8_t sender       = data[3];
-    uint8_t request      = data[4];
-    uint8_t code         = data[5];
-    uint8_t numDataBytes = data[6];
+    uint8_t receiver          = data[2];
+    uint8_t sender            = data[3];
+    uint8_t request           = data[4];
+    uint8_t code              = data[5];
+    uint16_t numDataBytes     = data[6];
+    uint16_t sequence         = 0;
+    uint8_t dataStartingIndex = BPACKET_NUM_NON_DATA_BYTES - 2;
 
     BPACKET_ASSERT_VALID_START_BYTE(data[0], data[1]);
     BPACKET_ASSERT_VALID_RECEIVER(receiver);
@@ -141,23 +317,113 @@ uint8_t bpacket_buffer_decode(bpacket_t* bpacket, uint8_t data[BPACKET_BUFFER_LE
     BPACKET_ASSERT_VALID_REQUEST(request);
     BPACKET_ASSERT_VALID_CODE(code);
 
-    bpacket->receiver = receiver;
-    bpacket->sender   = sender;
-    bpacket->request  = request;
-    bpacket->code     = code;
-    bpacket->numBytes = numDataBytes;
+    if (data[1] != BPACKET_START_BYTE_LOWER) {
+        numDataBytes      = (data[6] << 8) | data[7];
+        dataStartingIndex = BPACKET_EXT_NUM_NON_DATA_BYTES - 2;
+
+        if (numDataBytes > BPACKET_NODE_MAX_NUM_DATA_BYTES) {
+            return BPACKET_ERR_INVALID_NUM_DATA_BYTES;
+        }
+
+        // Extended framing is only used for bpackets that are too big for legacy framing
+        if ((data[1] == BPACKET_START_BYTE_EXT_LOWER) && (numDataBytes <= BPACKET_MAX_NUM_DATA_BYTES)) {
+            return BPACKET_ERR_INVALID_EXT_FRAMING;
+        }
+    }
+
+    if (data[1] == BPACKET_START_BYTE_CRC_LOWER) {
+        sequence          = (data[8] << 8) | data[9];
+        dataStartingIndex = BPACKET_CRC_NUM_NON_DATA_BYTES - 4;
+    }
+
+    bpacket->receiver  = receiver;
+    bpacket->sender    = sender;
+    bpacket->request   = request;
+    bpacket->code      = code;
+    bpacket->numBytes  = numDataBytes;
+    bpacket->sequence  = sequence;
+    bpacket->crcStatus = BPACKET_CRC_NONE;
 
     // Copy the data to the packet
     for (int i = 0; i < bpacket->numBytes; i++) {
-        bpacket->bytes[i] = data[i + 7]; // The data starts on the 8th byte thus adding 7 (starting from 1)
+        bpacket->bytes[i] = data[i + dataStartingIndex];
+    }
+
+    if (data[1] != BPACKET_START_BYTE_CRC_LOWER) {
+        return TRUE;
+    }
+
+    // Confirm the CRC matches the data that was received
+    uint16_t crc       = (data[dataStartingIndex + numDataBytes] << 8) | data[dataStartingIndex + numDataBytes + 1];
+    bpacket->crcStatus = (crc == bpacket_checksum(bpacket)) ? BPACKET_CRC_OK : BPACKET_CRC_FAILED;
+
+    if (bpacket->crcStatus != BPACKET_CRC_OK) {
+        return BPACKET_ERR_INVALID_CRC;
     }
 
     return TRUE;
 }
 
+uint16_t bpacket_negotiate_ext_framing(bpacket_t* bpacket) {
+
+    // A request without a size falls back to legacy framing
+    if (bpacket->numBytes < 2) {
+        maxNumDataBytes = BPACKET_MAX_NUM_DATA_BYTES;
+        crcEnabled      = FALSE;
+        windowSize      = 0;
+        return maxNumDataBytes;
+    }
+
+    // CRCs are only used if the receiver asked for them
+    crcEnabled = FALSE;
+    if ((bpacket->numBytes > 2) && ((bpacket->bytes[2] & BPACKET_EXT_FLAG_CRC) != 0)) {
+        crcEnabled = TRUE;
+    }
+
+    // Flow control needs sequence numbers so it is only used with CRCs
+    windowSize = 0;
+    if ((crcEnabled == TRUE) && (bpacket->numBytes > BPACKET_EXT_WINDOW_INDEX)) {
+        windowSize = bpacket->bytes[BPACKET_EXT_WINDOW_INDEX];
+    }
+
+    uint16_t requested = (bpacket->bytes[0] << 8) | bpacket->bytes[1];
+
+    if (requested > BPACKET_EXT_MAX_NUM_DATA_BYTES) {
+        requested = BPACKET_EXT_MAX_NUM_DATA_BYTES;
+    }
+
+    if (requested < BPACKET_MAX_NUM_DATA_BYTES) {
+        requested = BPACKET_MAX_NUM_DATA_BYTES;
+    }
+
+    maxNumDataBytes = requested;
+
+    return maxNumDataBytes;
+}
+
+uint16_t bpacket_get_max_num_data_bytes(void) {
+    return maxNumDataBytes;
+}
+
+uint8_t bpacket_crc_enabled(void) {
+    return crcEnabled;
+}
+
+uint8_t bpacket_get_window_size(void) {
+    return windowSize;
+}
+
+void bpacket_set_ack_receiver(uint8_t (*receive_ack)(uint16_t* numBpacketsReceived)) {
+    bpacket_receive_ack = receive_ack;
+}
+
 void bpacket_data_to_string(bpacket_t* bpacket, bpacket_char_array_t* bpacketCharArray) {
 
+    // Strings are only ever sent in legacy bpackets but clamp to be safe
     bpacketCharArray->numBytes = bpacket->numBytes;
+    if (bpacketCharArray->numBytes > BPACKET_MAX_NUM_DATA_BYTES) {
+        bpacketCharArray->numBytes = BPACKET_MAX_NUM_DATA_BYTES;
+    }
 
     if (bpacket->numBytes == 0) {
         bpacketCharArray->string[0] = '\0';
@@ -166,7 +432,7 @@ void bpacket_data_to_string(bpacket_t* bpacket, bpacket_char_array_t* bpacketCha
 
     // Copy the data to the packet.
     int i;
-    for (i = 0; i < bpacket->numBytes; i++) {
+    for (i = 0; i < bpacketCharArray->numBytes; i++) {
         bpacketCharArray->string[i] = bpacket->bytes[i];
     }
 
@@ -194,6 +460,12 @@ void bpacket_get_error(uint8_t bpacketError, char* errorMsg) {
         case BPACKET_ERR_INVALID_START_BYTE:
             sprintf(errorMsg, "Bpacket err: Invalid start byte\r\n");
             break;
+        case BPACKET_ERR_INVALID_EXT_FRAMING:
+            sprintf(errorMsg, "Bpacket err: Extended framing used for a legacy sized bpacket\r\n");
+            break;
+        case BPACKET_ERR_INVALID_CRC:
+            sprintf(errorMsg, "Bpacket err: CRC does not match\r\n");
+            break;
         default:
             sprintf(errorMsg, "Bpacket err: Unknown error code %i\r\n", bpacketError);
             break;
@@ -205,50 +477,108 @@ void bpacket_get_info(bpacket_t* bpacket, char* string) {
             bpacket->sender, bpacket->request, bpacket->code, bpacket->numBytes);
 }
 
+static void bpacket_send_chunk(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), uint8_t receiver,
+                               uint8_t sender, uint8_t request, uint8_t* data, uint32_t numBytesToSend,
+                               uint32_t chunkIndex) {
+
+    // The header, data and trailer are transmitted separately so the data never
+    // has to be copied and bpackets larger than a bpacket_t on this node can be sent
+    bpacket_frame_t frame;
+
+    uint32_t startIndex = chunkIndex * maxNumDataBytes;
+    uint32_t numBytes   = numBytesToSend - startIndex;
+    uint8_t code        = BPACKET_CODE_SUCCESS;
+
+    // Every bpacket except the last is marked as in progress
+    if (numBytes > maxNumDataBytes) {
+        numBytes = maxNumDataBytes;
+        code     = BPACKET_CODE_IN_PROGRESS;
+    }
+
+    bpacket_encode_frame(&frame, receiver, sender, request, code, data + startIndex, numBytes, crcEnabled, chunkIndex);
+    bpacket_transmit_frame(transmit_bpacket, &frame);
+}
+
 uint8_t bpacket_send_data(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), uint8_t receiver,
                           uint8_t sender, uint8_t request, uint8_t* data, uint32_t numBytesToSend) {
 
-    // Create the bpacket
-    bpacket_t bpacket;
+    BPACKET_ASSERT_VALID_RECEIVER(receiver);
+    BPACKET_ASSERT_VALID_SENDER(sender);
+    BPACKET_ASSERT_VALID_REQUEST(request);
 
-    if (bpacket_create_p(&bpacket, receiver, sender, request, BPACKET_CODE_IN_PROGRESS, 0, NULL) != TRUE) {
+    // The sequence numbers and ACKs would wrap and the receiver would put data in the wrong place
+    if ((crcEnabled == TRUE) && (numBytesToSend > ((uint32_t)BPACKET_MAX_NUM_CHUNKS * maxNumDataBytes))) {
         return FALSE;
     }
 
-    // Set the number of bytes to the maximum
-    bpacket.numBytes = BPACKET_MAX_NUM_DATA_BYTES;
-    bpacket_buffer_t bpacketBuffer;
+    if ((windowSize != 0) && (bpacket_receive_ack != NULL)) {
+        return bpacket_send_windowed_data(transmit_bpacket, receiver, sender, request, data, numBytesToSend);
+    }
 
-    uint32_t bytesSent = 0;
-    uint32_t index     = 0;
+    // Each bpacket is numbered so the receiver can NACK individual bpackets
+    for (uint32_t chunkIndex = 0; (chunkIndex * maxNumDataBytes) < numBytesToSend; chunkIndex++) {
+        bpacket_send_chunk(transmit_bpacket, receiver, sender, request, data, numBytesToSend, chunkIndex);
+    }
 
-    while (bytesSent < numBytesToSend) {
+    return TRUE;
+}
 
-        if (index < BPACKET_MAX_NUM_DATA_BYTES) {
-            bpacket.bytes[index++] = data[bytesSent++];
+static uint8_t bpacket_send_windowed_data(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes),
+                                          uint8_t receiver, uint8_t sender, uint8_t request, uint8_t* data,
+                                          uint32_t numBytesToSend) {
+
+    uint32_t numChunks      = (numBytesToSend + maxNumDataBytes - 1) / maxNumDataBytes;
+    uint32_t firstUnacked   = 0; // Every bpacket before this has been received in order
+    uint32_t nextChunk      = 0;
+    uint32_t lastRetransmit = numChunks; // Stops the same bpacket being resent for every duplicate ACK
+    uint8_t numTimeouts     = 0;
+    uint16_t numChunksAcked = 0;
+
+    while (firstUnacked < numChunks) {
+
+        // Keep the window full so the UART never sits idle waiting for an ACK
+        while ((nextChunk < numChunks) && (nextChunk < (firstUnacked + windowSize))) {
+            bpacket_send_chunk(transmit_bpacket, receiver, sender, request, data, numBytesToSend, nextChunk++);
+        }
+
+        // The ACKs stopped. Go back and send everything after the last ACK again
+        if (bpacket_receive_ack(&numChunksAcked) != TRUE) {
+
+            if (numTimeouts++ == BPACKET_WINDOW_MAX_NUM_TIMEOUTS) {
+                return FALSE;
+            }
+
+            nextChunk = firstUnacked;
             continue;
         }
 
-        // Send the bpacket
-        bpacket_to_buffer(&bpacket, &bpacketBuffer);
-        transmit_bpacket(bpacketBuffer.buffer, bpacketBuffer.numBytes);
+        numTimeouts = 0;
 
-        // Reset the index
-        index = 0;
+        if (numChunksAcked > firstUnacked) {
+            firstUnacked = (numChunksAcked > numChunks) ? numChunks : numChunksAcked;
+            continue;
+        }
+
+        // A duplicate ACK means the first unacknowledged bpacket was lost or corrupted
+        if ((numChunksAcked == firstUnacked) && (nextChunk > firstUnacked) && (lastRetransmit != firstUnacked)) {
+            bpacket_send_chunk(transmit_bpacket, receiver, sender, request, data, numBytesToSend, firstUnacked);
+            lastRetransmit = firstUnacked;
+        }
     }
 
-    // Send the last bpacket
-    if (index != 0) {
+    return TRUE;
+}
 
-        // Update bpacket info
-        bpacket.numBytes = index;
-        bpacket.code     = BPACKET_CODE_SUCCESS;
+uint8_t bpacket_resend_data(void (*transmit_bpacket)(uint8_t* data, uint16_t bufferNumBytes), uint8_t receiver,
+                            uint8_t sender, uint8_t request, uint8_t* data, uint32_t numBytesToSend,
+                            uint16_t sequence) {
 
-        // Send the bpacket
-        bpacket_to_buffer(&bpacket, &bpacketBuffer);
-        transmit_bpacket(bpacketBuffer.buffer, bpacketBuffer.numBytes);
+    if (((uint32_t)sequence * maxNumDataBytes) >= numBytesToSend) {
+        return FALSE;
     }
 
+    bpacket_send_chunk(transmit_bpacket, receiver, sender, request, data, numBytesToSend, sequence);
+
     return TRUE;
 }
 
@@ -0,0 +1,305 @@
+/**
+ * @file bpacket_parser.c
+ * @author Gian Barta-Dougall
+ * @brief Incremental bpacket parser. Rather than being fed one byte at a time,
+ * the parser is given whatever bytes have been received. The start byte is
+ * found with memchr() and the data of a bpacket is copied in one block, so the
+ * per byte state machine only runs over the header and trailer
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h> // Required for the use of NULL
+#include <string.h>
+
+/* Personal Includes */
+#include "bpacket_parser.h"
+#include "utilities.h"
+
+/* Function Prototypes */
+static void bpacket_parser_set_num_data_bytes(bpacket_parser_t* parser);
+static uint8_t bpacket_parser_complete(bpacket_parser_t* parser);
+
+void bpacket_parser_init(bpacket_parser_t* parser, uint8_t id, uint8_t address, bpacket_t* bpacket,
+                         void (*bpacket_received)(uint8_t id, bpacket_t* bpacket)) {
+    parser->id               = id;
+    parser->address          = address;
+    parser->bpacket          = bpacket;
+    parser->bpacket_received = bpacket_received;
+    parser->forward_bytes    = NULL;
+    parser->unframed_bytes   = NULL;
+
+    bpacket_parser_reset(parser);
+}
+
+void bpacket_parser_reset(bpacket_parser_t* parser) {
+    parser->expectedByteId       = BPACKET_START_BYTE_UPPER_ID;
+    parser->startByteLower       = BPACKET_START_BYTE_LOWER;
+    parser->forwarding           = FALSE;
+    parser->numDataBytesExpected = 0;
+    parser->numDataBytesReceived = 0;
+}
+
+uint32_t bpacket_parser_parse(bpacket_parser_t* parser, uint8_t* data, uint32_t numBytes) {
+
+    uint32_t i            = 0;
+    uint32_t forwardIndex = 0; // The first byte of the span that has not been forwarded yet
+    uint8_t bpacketDone   = FALSE;
+
+    while ((i < numBytes) && (bpacketDone == FALSE)) {
+
+        uint8_t byte = data[i];
+
+        switch (parser->expectedByteId) {
+
+            case BPACKET_START_BYTE_UPPER_ID:;
+                // Everything up to the next start byte is outside of a bpacket
+                uint8_t* startByte  = memchr(&data[i], BPACKET_START_BYTE_UPPER, numBytes - i);
+                uint32_t startIndex = (startByte == NULL) ? numBytes : (uint32_t)(startByte - data);
+
+                if ((startIndex > i) && (parser->unframed_bytes != NULL)) {
+                    parser->unframed_bytes(parser->id, &data[i], startIndex - i);
+                }
+
+                i = startIndex;
+
+                if (startByte != NULL) {
+                    parser->expectedByteId = BPACKET_START_BYTE_LOWER_ID;
+                    i++;
+                }
+                continue;
+
+            case BPACKET_START_BYTE_LOWER_ID:
+
+                if ((byte != BPACKET_START_BYTE_LOWER) && (byte != BPACKET_START_BYTE_EXT_LOWER) &&
+                    (byte != BPACKET_START_BYTE_CRC_LOWER)) {
+
+                    // Not a bpacket after all. Look for a start byte again from this byte
+                    uint8_t startByteUpper = BPACKET_START_BYTE_UPPER;
+                    if (parser->unframed_bytes != NULL) {
+                        parser->unframed_bytes(parser->id, &startByteUpper, 1);
+                    }
+
+                    parser->expectedByteId = BPACKET_START_BYTE_UPPER_ID;
+                    continue;
+                }
+
+                parser->startByteLower = byte;
+                parser->expectedByteId = BPACKET_RECEIVER_BYTE_ID;
+                break;
+
+            case BPACKET_RECEIVER_BYTE_ID:
+                parser->receiver       = byte;
+                parser->forwarding     = ((parser->forward_bytes != NULL) && (byte != parser->address)) ? TRUE : FALSE;
+                parser->expectedByteId = BPACKET_SENDER_BYTE_ID;
+
+                if (parser->forwarding == TRUE) {
+
+                    // The start bytes may have arrived in an earlier span so send them separately
+                    uint8_t header[3] = {BPACKET_START_BYTE_UPPER, parser->startByteLower, byte};
+                    parser->forward_bytes(parser->id, parser->receiver, header, 3);
+                    forwardIndex = i + 1;
+                    break;
+                }
+
+                parser->bpacket->receiver  = byte;
+                parser->bpacket->sequence  = 0;
+                parser->bpacket->crcStatus = BPACKET_CRC_NONE;
+                break;
+
+            case BPACKET_SENDER_BYTE_ID:
+                if (parser->forwarding != TRUE) {
+                    parser->bpacket->sender = byte;
+                }
+                parser->expectedByteId = BPACKET_REQUEST_BYTE_ID;
+                break;
+
+            case BPACKET_REQUEST_BYTE_ID:
+                if (parser->forwarding != TRUE) {
+                    parser->bpacket->request = byte;
+                }
+                parser->expectedByteId = BPACKET_CODE_BYTE_ID;
+                break;
+
+            case BPACKET_CODE_BYTE_ID:
+                if (parser->forwarding != TRUE) {
+                    parser->bpacket->code = byte;
+                }
+                parser->expectedByteId = BPACKET_NUM_BYTES_BYTE_ID;
+                break;
+
+            case BPACKET_NUM_BYTES_BYTE_ID:
+
+                // Extended and checked bpackets have a second length byte
+                if (parser->startByteLower != BPACKET_START_BYTE_LOWER) {
+                    parser->numDataBytesExpected = byte << 8;
+                    parser->expectedByteId       = BPACKET_NUM_BYTES_LOWER_ID;
+                    break;
+                }
+
+                parser->numDataBytesExpected = byte;
+                bpacket_parser_set_num_data_bytes(parser);
+                break;
+
+            case BPACKET_NUM_BYTES_LOWER_ID:
+                parser->numDataBytesExpected |= byte;
+
+                // Extended framing is only used for bpackets that are too big for legacy framing
+                if ((parser->startByteLower == BPACKET_START_BYTE_EXT_LOWER) &&
+                    (parser->numDataBytesExpected <= BPACKET_MAX_NUM_DATA_BYTES)) {
+                    if (parser->forwarding == TRUE) {
+                        parser->forward_bytes(parser->id, parser->receiver, &data[forwardIndex], i - forwardIndex);
+                    }
+                    bpacket_parser_reset(parser);
+                    break;
+                }
+
+                bpacket_parser_set_num_data_bytes(parser);
+                break;
+
+            case BPACKET_SEQUENCE_UPPER_ID:
+                if (parser->forwarding != TRUE) {
+                    parser->bpacket->sequence = byte << 8;
+                }
+                parser->expectedByteId = BPACKET_SEQUENCE_LOWER_ID;
+                break;
+
+            case BPACKET_SEQUENCE_LOWER_ID:
+                if (parser->forwarding != TRUE) {
+                    parser->bpacket->sequence |= byte;
+                }
+                parser->expectedByteId =
+                    (parser->numDataBytesExpected == 0) ? BPACKET_CRC_UPPER_ID : BPACKET_DATA_BYTE_ID;
+                break;
+
+            case BPACKET_DATA_BYTE_ID:;
+                // Take as much of the data as is in this span at once
+                uint32_t numDataBytes = parser->numDataBytesExpected - parser->numDataBytesReceived;
+                if (numDataBytes > (numBytes - i)) {
+                    numDataBytes = numBytes - i;
+                }
+
+                // Bpackets larger than a bpacket_t on this node are still read to the end so
+                // the next bpacket is found, but the extra bytes are dropped
+                if ((parser->forwarding != TRUE) && (parser->numDataBytesReceived < BPACKET_NODE_MAX_NUM_DATA_BYTES)) {
+                    uint32_t numBytesToCopy = BPACKET_NODE_MAX_NUM_DATA_BYTES - parser->numDataBytesReceived;
+                    if (numBytesToCopy > numDataBytes) {
+                        numBytesToCopy = numDataBytes;
+                    }
+
+                    memcpy(&parser->bpacket->bytes[parser->numDataBytesReceived], &data[i], numBytesToCopy);
+                }
+
+                parser->numDataBytesReceived += numDataBytes;
+                i += numDataBytes;
+
+                if (parser->numDataBytesReceived == parser->numDataBytesExpected) {
+                    parser->expectedByteId = (parser->startByteLower == BPACKET_START_BYTE_CRC_LOWER)
+                                                 ? BPACKET_CRC_UPPER_ID
+                                                 : BPACKET_STOP_BYTE_UPPER_ID;
+                }
+                continue;
+
+            case BPACKET_CRC_UPPER_ID:
+                parser->crc            = byte << 8;
+                parser->expectedByteId = BPACKET_CRC_LOWER_ID;
+                break;
+
+            case BPACKET_CRC_LOWER_ID:
+                parser->crc |= byte;
+                parser->expectedByteId = BPACKET_STOP_BYTE_UPPER_ID;
+                break;
+
+            case BPACKET_STOP_BYTE_UPPER_ID:
+                if (byte == BPACKET_STOP_BYTE_UPPER) {
+                    parser->expectedByteId = BPACKET_STOP_BYTE_LOWER_ID;
+                    break;
+                }
+
+                // Erraneous byte. Anything already forwarded is left for the receiver to discard
+                if (parser->forwarding == TRUE) {
+                    parser->forward_bytes(parser->id, parser->receiver, &data[forwardIndex], i - forwardIndex);
+                }
+                bpacket_parser_reset(parser);
+                break;
+
+            case BPACKET_STOP_BYTE_LOWER_ID:
+
+                if (byte != BPACKET_STOP_BYTE_LOWER) {
+                    if (parser->forwarding == TRUE) {
+                        parser->forward_bytes(parser->id, parser->receiver, &data[forwardIndex], i - forwardIndex);
+                    }
+                    bpacket_parser_reset(parser);
+                    break;
+                }
+
+                // Forwarded bpackets finish with the stop bytes so include this one
+                if (parser->forwarding == TRUE) {
+                    parser->forward_bytes(parser->id, parser->receiver, &data[forwardIndex], i + 1 - forwardIndex);
+                }
+
+                bpacketDone = bpacket_parser_complete(parser);
+                break;
+
+            default:
+                bpacket_parser_reset(parser);
+                break;
+        }
+
+        i++;
+    }
+
+    // Pass on the part of the bpacket that was in this span
+    if ((parser->forwarding == TRUE) && (i > forwardIndex)) {
+        parser->forward_bytes(parser->id, parser->receiver, &data[forwardIndex], i - forwardIndex);
+    }
+
+    return i;
+}
+
+static void bpacket_parser_set_num_data_bytes(bpacket_parser_t* parser) {
+
+    parser->numDataBytesReceived = 0;
+
+    if (parser->forwarding != TRUE) {
+        parser->bpacket->numBytes = parser->numDataBytesExpected;
+    }
+
+    // The sequence number of a checked bpacket comes before the data
+    if (parser->startByteLower == BPACKET_START_BYTE_CRC_LOWER) {
+        parser->expectedByteId = BPACKET_SEQUENCE_UPPER_ID;
+    } else if (parser->numDataBytesExpected == 0) {
+        parser->expectedByteId = BPACKET_STOP_BYTE_UPPER_ID;
+    } else {
+        parser->expectedByteId = BPACKET_DATA_BYTE_ID;
+    }
+}
+
+static uint8_t bpacket_parser_complete(bpacket_parser_t* parser) {
+
+    uint8_t forwarded      = parser->forwarding;
+    uint8_t startByteLower = parser->startByteLower;
+    bpacket_parser_reset(parser);
+
+    if (forwarded == TRUE) {
+        return FALSE;
+    }
+
+    // Some of the data was dropped so the bpacket can not be used
+    bpacket_t* bpacket = parser->bpacket;
+    if (bpacket->numBytes > BPACKET_NODE_MAX_NUM_DATA_BYTES) {
+        return FALSE;
+    }
+
+    if (startByteLower == BPACKET_START_BYTE_CRC_LOWER) {
+        bpacket->crcStatus = (parser->crc == bpacket_checksum(bpacket)) ? BPACKET_CRC_OK : BPACKET_CRC_FAILED;
+    }
+
+    parser->bpacket_received(parser->id, bpacket);
+
+    return TRUE;
+}
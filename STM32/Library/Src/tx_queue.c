@@ -0,0 +1,157 @@
+/**
+ * @file tx_queue.c
+ * @author Gian Barta-Dougall
+ * @brief Queue of byte spans waiting to be transmitted. Spans are added by the
+ * main loop and released by the transfer complete interrupt, which also starts
+ * the next span so the transmitter never waits on the main loop
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <string.h>
+
+/* Personal Includes */
+#include "tx_queue.h"
+#include "utilities.h"
+
+#define TX_QUEUE_NEXT_INDEX(index) (((index) + 1) % TX_QUEUE_NUM_SPANS)
+
+/* Function Prototypes */
+static uint8_t tx_queue_num_free_spans(tx_queue_t* queue);
+static void tx_queue_add_span(tx_queue_t* queue, uint8_t* data, uint16_t numBytes, uint16_t numCopyBytes);
+static void tx_queue_start_next(tx_queue_t* queue);
+
+void tx_queue_init(tx_queue_t* queue, uint8_t id,
+                   void (*start_transfer)(uint8_t id, uint8_t* data, uint16_t numBytes)) {
+    queue->id                   = id;
+    queue->head                 = 0;
+    queue->tail                 = 0;
+    queue->busy                 = FALSE;
+    queue->bufferIndex          = 0;
+    queue->copyNumBytesQueued   = 0;
+    queue->copyNumBytesReleased = 0;
+    queue->numBytesQueued       = 0;
+    queue->numBytesSent         = 0;
+    queue->start_transfer       = start_transfer;
+    queue->span_sent            = NULL;
+}
+
+uint8_t tx_queue_push(tx_queue_t* queue, uint8_t* data, uint32_t numBytes) {
+
+    // Spans larger than a single transfer are split up. Either all of them are queued or none are
+    uint32_t numSpans = (numBytes + TX_QUEUE_MAX_SPAN_BYTES - 1) / TX_QUEUE_MAX_SPAN_BYTES;
+
+    if (numSpans > tx_queue_num_free_spans(queue)) {
+        return FALSE;
+    }
+
+    while (numBytes > 0) {
+        uint16_t spanNumBytes = (numBytes > TX_QUEUE_MAX_SPAN_BYTES) ? TX_QUEUE_MAX_SPAN_BYTES : numBytes;
+        tx_queue_add_span(queue, data, spanNumBytes, 0);
+
+        data += spanNumBytes;
+        numBytes -= spanNumBytes;
+    }
+
+    return TRUE;
+}
+
+uint8_t tx_queue_push_copy(tx_queue_t* queue, uint8_t* data, uint16_t numBytes) {
+
+    if (numBytes == 0) {
+        return TRUE;
+    }
+
+    // Bytes that run past the end of the ring go at the start in a second span
+    uint16_t startIndex      = queue->bufferIndex;
+    uint16_t numBytesAtStart = (numBytes > (TX_QUEUE_BUFFER_SIZE - startIndex)) ? TX_QUEUE_BUFFER_SIZE - startIndex
+                                                                                 : numBytes;
+    uint16_t numBytesWrapped = numBytes - numBytesAtStart;
+    uint8_t numSpans         = (numBytesWrapped > 0) ? 2 : 1;
+
+    if ((numBytes > tx_queue_num_free_bytes(queue)) || (numSpans > tx_queue_num_free_spans(queue))) {
+        return FALSE;
+    }
+
+    memcpy(&queue->buffer[startIndex], data, numBytesAtStart);
+    memcpy(&queue->buffer[0], data + numBytesAtStart, numBytesWrapped);
+
+    queue->bufferIndex = (startIndex + numBytes) % TX_QUEUE_BUFFER_SIZE;
+    queue->copyNumBytesQueued += numBytes;
+
+    tx_queue_add_span(queue, &queue->buffer[startIndex], numBytesAtStart, numBytesAtStart);
+
+    if (numBytesWrapped > 0) {
+        tx_queue_add_span(queue, &queue->buffer[0], numBytesWrapped, numBytesWrapped);
+    }
+
+    return TRUE;
+}
+
+uint16_t tx_queue_num_free_bytes(tx_queue_t* queue) {
+    return TX_QUEUE_BUFFER_SIZE - (queue->copyNumBytesQueued - queue->copyNumBytesReleased);
+}
+
+uint32_t tx_queue_num_pending_bytes(tx_queue_t* queue) {
+    return queue->numBytesQueued - queue->numBytesSent;
+}
+
+void tx_queue_transfer_complete(tx_queue_t* queue) {
+
+    if (queue->busy != TRUE) {
+        return;
+    }
+
+    tx_span_t* span = &queue->spans[queue->tail];
+
+    if ((span->numCopyBytes == 0) && (queue->span_sent != NULL)) {
+        queue->span_sent(queue->id, span->data, span->numBytes);
+    }
+
+    queue->copyNumBytesReleased += span->numCopyBytes;
+    queue->numBytesSent += span->numBytes;
+    queue->tail = TX_QUEUE_NEXT_INDEX(queue->tail);
+
+    tx_queue_start_next(queue);
+}
+
+uint8_t tx_queue_is_empty(tx_queue_t* queue) {
+    return (queue->head == queue->tail) ? TRUE : FALSE;
+}
+
+static uint8_t tx_queue_num_free_spans(tx_queue_t* queue) {
+    // One slot is always left empty so a full queue can be told apart from an empty one
+    return (queue->tail + TX_QUEUE_NUM_SPANS - queue->head - 1) % TX_QUEUE_NUM_SPANS;
+}
+
+static void tx_queue_add_span(tx_queue_t* queue, uint8_t* data, uint16_t numBytes, uint16_t numCopyBytes) {
+
+    tx_span_t* span    = &queue->spans[queue->head];
+    span->data         = data;
+    span->numBytes     = numBytes;
+    span->numCopyBytes = numCopyBytes;
+    queue->numBytesQueued += numBytes;
+
+    // The span must be filled in before the interrupt can see it
+    queue->head = TX_QUEUE_NEXT_INDEX(queue->head);
+
+    // If the interrupt already finished the last span, nothing will start this one
+    if (queue->busy != TRUE) {
+        tx_queue_start_next(queue);
+    }
+}
+
+static void tx_queue_start_next(tx_queue_t* queue) {
+
+    if (queue->tail == queue->head) {
+        queue->busy = FALSE;
+        return;
+    }
+
+    queue->busy = TRUE;
+    queue->start_transfer(queue->id, queue->spans[queue->tail].data, queue->spans[queue->tail].numBytes);
+}
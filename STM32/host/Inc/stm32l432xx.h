@@ -0,0 +1,80 @@
+/**
+ * @file stm32l432xx.h
+ * @author Gian Barta-Dougall
+ * @brief Stands in for the CMSIS device header in host builds. Only has the
+ * registers and bits the host tested code uses. The peripherals are plain structs
+ * the tests can read and write, and interrupts are a flag
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef STM32L432XX_H
+#define STM32L432XX_H
+
+/* C Library Includes */
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t CR3;
+    volatile uint32_t BRR;
+    volatile uint32_t GTPR;
+    volatile uint32_t RTOR;
+    volatile uint32_t RQR;
+    volatile uint32_t ISR;
+    volatile uint32_t ICR;
+    volatile uint32_t RDR;
+    volatile uint32_t TDR;
+} USART_TypeDef;
+
+typedef struct {
+    volatile uint32_t CCR;
+    volatile uint32_t CNDTR;
+    volatile uint32_t CPAR;
+    volatile uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+#define USART_CR1_UE   (0x01 << 0)
+#define USART_ISR_RXNE (0x01 << 5)
+#define USART_ISR_TC   (0x01 << 6)
+#define USART_ISR_TXE  (0x01 << 7)
+#define DMA_CCR_EN     (0x01 << 0)
+
+// Defined by the test
+extern USART_TypeDef hostUsarts[2];
+extern DMA_Channel_TypeDef hostDmaChannels[7];
+extern uint32_t hostPrimask; // 1 while interrupts are disabled
+extern uint32_t SystemCoreClock;
+
+#define USART1 (&hostUsarts[0])
+#define USART2 (&hostUsarts[1])
+
+#define DMA1_Channel1 (&hostDmaChannels[0])
+#define DMA1_Channel2 (&hostDmaChannels[1])
+#define DMA1_Channel3 (&hostDmaChannels[2])
+#define DMA1_Channel4 (&hostDmaChannels[3])
+#define DMA1_Channel5 (&hostDmaChannels[4])
+#define DMA1_Channel6 (&hostDmaChannels[5])
+#define DMA1_Channel7 (&hostDmaChannels[6])
+
+static inline uint32_t __get_PRIMASK(void) {
+    return hostPrimask;
+}
+
+static inline void __set_PRIMASK(uint32_t priMask) {
+    hostPrimask = priMask;
+}
+
+static inline void __disable_irq(void) {
+    hostPrimask = 1;
+}
+
+static inline void __enable_irq(void) {
+    hostPrimask = 0;
+}
+
+#endif // STM32L432XX_H
@@ -0,0 +1,20 @@
+/**
+ * @file stm32l4xx_hal.h
+ * @author Gian Barta-Dougall
+ * @brief Stands in for the HAL in host builds. The tick is defined by the test
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef STM32L4XX_HAL_H
+#define STM32L4XX_HAL_H
+
+/* STM32 Includes */
+#include "stm32l432xx.h"
+
+uint32_t HAL_GetTick(void);
+
+#endif // STM32L4XX_HAL_H
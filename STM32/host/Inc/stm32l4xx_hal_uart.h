@@ -0,0 +1,18 @@
+/**
+ * @file stm32l4xx_hal_uart.h
+ * @author Gian Barta-Dougall
+ * @brief Stands in for the HAL UART driver in host builds. Nothing uses it
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef STM32L4XX_HAL_UART_H
+#define STM32L4XX_HAL_UART_H
+
+/* STM32 Includes */
+#include "stm32l4xx_hal.h"
+
+#endif // STM32L4XX_HAL_UART_H
@@ -0,0 +1,193 @@
+/**
+ * @file bpacket_parser_test.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the bpacket parser on the host and feeds it legacy, extended and
+ * checked bpackets. Checks extended bpackets small enough for legacy framing are
+ * rejected, both when they are decoded and when they are forwarded, without losing
+ * the bpacket after them
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Personal Includes */
+#include "bpacket.h"
+#include "bpacket_parser.h"
+#include "utilities.h"
+
+#define WIRE_SIZE    (BPACKET_EXT_MAX_NUM_DATA_BYTES * 2)
+#define TEST_REQUEST BPACKET_SPECIFIC_R_OFFSET
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            printf("%s:%i: check failed: %s\r\n", __FILE__, __LINE__, #condition); \
+            numFailures++;                                                      \
+        }                                                                       \
+    } while (0)
+
+/* Private Variables */
+static uint32_t numFailures;
+
+// Everything that would have been put on the UART
+static uint8_t wire[WIRE_SIZE];
+static uint32_t wireNumBytes;
+
+// Bpackets passed to bpacket_received()
+static bpacket_t bpacket;
+static uint32_t numBpacketsReceived;
+static uint16_t lastNumBytes;
+
+// Bytes passed to forward_bytes()
+static uint8_t forwarded[WIRE_SIZE];
+static uint32_t forwardedNumBytes;
+
+static void test_transmit(uint8_t* data, uint16_t numBytes) {
+    memcpy(&wire[wireNumBytes], data, numBytes);
+    wireNumBytes += numBytes;
+}
+
+static void test_bpacket_received(uint8_t id, bpacket_t* received) {
+    lastNumBytes = received->numBytes;
+    numBpacketsReceived++;
+}
+
+static void test_forward_bytes(uint8_t id, uint8_t receiver, uint8_t* data, uint32_t numBytes) {
+    memcpy(&forwarded[forwardedNumBytes], data, numBytes);
+    forwardedNumBytes += numBytes;
+}
+
+static void test_reset(void) {
+    wireNumBytes        = 0;
+    numBpacketsReceived = 0;
+    lastNumBytes        = 0;
+    forwardedNumBytes   = 0;
+}
+
+static void test_send(uint8_t receiver, uint16_t numBytes, uint8_t checked) {
+
+    static uint8_t data[BPACKET_EXT_MAX_NUM_DATA_BYTES];
+    for (uint32_t i = 0; i < numBytes; i++) {
+        data[i] = i & 0x3F; // Kept below the start bytes
+    }
+
+    bpacket_frame_t frame;
+    bpacket_encode_frame(&frame, receiver, BPACKET_ADDRESS_ESP32, TEST_REQUEST, BPACKET_CODE_SUCCESS, data, numBytes,
+                         checked, 0);
+    bpacket_transmit_frame(test_transmit, &frame);
+}
+
+// Extended frames are never encoded for legacy sized data so this one is built by hand
+static uint32_t test_send_small_extended(uint8_t receiver, uint16_t numBytes) {
+
+    uint32_t startIndex = wireNumBytes;
+    uint8_t header[8]   = {BPACKET_START_BYTE_UPPER,
+                           BPACKET_START_BYTE_EXT_LOWER,
+                           receiver,
+                           BPACKET_ADDRESS_ESP32,
+                           TEST_REQUEST,
+                           BPACKET_CODE_SUCCESS,
+                           (numBytes >> 8) & 0xFF,
+                           numBytes & 0xFF};
+    uint8_t trailer[2]  = {BPACKET_STOP_BYTE_UPPER, BPACKET_STOP_BYTE_LOWER};
+
+    test_transmit(header, sizeof(header));
+    memset(&wire[wireNumBytes], 0, numBytes);
+    wireNumBytes += numBytes;
+    test_transmit(trailer, sizeof(trailer));
+
+    return startIndex;
+}
+
+static void test_parse_wire(bpacket_parser_t* parser) {
+
+    uint32_t numBytesParsed = 0;
+    while (numBytesParsed < wireNumBytes) {
+        numBytesParsed += bpacket_parser_parse(parser, &wire[numBytesParsed], wireNumBytes - numBytesParsed);
+    }
+}
+
+static void test_valid_framing(void) {
+
+    bpacket_parser_t parser;
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_STM32, &bpacket, test_bpacket_received);
+
+    // Legacy, extended from one byte past the legacy size and checked of any size
+    uint16_t sizes[]  = {0, BPACKET_MAX_NUM_DATA_BYTES, BPACKET_MAX_NUM_DATA_BYTES + 1, 0, 10};
+    uint8_t checked[] = {FALSE, FALSE, FALSE, TRUE, TRUE};
+    uint32_t numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    for (uint32_t i = 0; i < numSizes; i++) {
+        test_reset();
+        test_send(BPACKET_ADDRESS_STM32, sizes[i], checked[i]);
+        test_parse_wire(&parser);
+
+        CHECK(numBpacketsReceived == 1);
+        CHECK(lastNumBytes == sizes[i]);
+    }
+}
+
+static void test_small_extended_rejected(void) {
+
+    bpacket_parser_t parser;
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_STM32, &bpacket, test_bpacket_received);
+
+    uint16_t sizes[]  = {0, 1, 200, BPACKET_MAX_NUM_DATA_BYTES};
+    uint32_t numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    for (uint32_t i = 0; i < numSizes; i++) {
+
+        // The bpacket straight after has to still be found
+        test_reset();
+        test_send_small_extended(BPACKET_ADDRESS_STM32, sizes[i]);
+        test_send(BPACKET_ADDRESS_STM32, 20, FALSE);
+        test_parse_wire(&parser);
+
+        CHECK(numBpacketsReceived == 1);
+        CHECK(lastNumBytes == 20);
+    }
+}
+
+static void test_small_extended_not_forwarded(void) {
+
+    bpacket_parser_t parser;
+    bpacket_parser_init(&parser, 0, BPACKET_ADDRESS_STM32, &bpacket, test_bpacket_received);
+    parser.forward_bytes = test_forward_bytes;
+
+    test_reset();
+    uint32_t badIndex = test_send_small_extended(BPACKET_ADDRESS_MAPLE, 200);
+    uint32_t okIndex  = wireNumBytes;
+    test_send(BPACKET_ADDRESS_MAPLE, 20, FALSE);
+    test_parse_wire(&parser);
+
+    // Only the start bytes, addresses, request, code and upper length byte are forwarded.
+    // The receiver drops them when the next start bytes arrive
+    uint32_t numBadBytesForwarded = 7;
+
+    CHECK(numBpacketsReceived == 0);
+    CHECK(forwardedNumBytes == (numBadBytesForwarded + (wireNumBytes - okIndex)));
+    CHECK(memcmp(forwarded, &wire[badIndex], numBadBytesForwarded) == 0);
+    CHECK(memcmp(&forwarded[numBadBytesForwarded], &wire[okIndex], wireNumBytes - okIndex) == 0);
+}
+
+int main(void) {
+
+    test_valid_framing();
+    test_small_extended_rejected();
+    test_small_extended_not_forwarded();
+
+    if (numFailures != 0) {
+        printf("bpacket_parser: %u checks failed\r\n", numFailures);
+        return 1;
+    }
+
+    printf("bpacket_parser: all checks passed\r\n");
+    return 0;
+}
@@ -0,0 +1,366 @@
+/**
+ * @file comms_test.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the STM32 comms and log code on the host against fake UART and DMA
+ * registers. The fake TX DMA sends whatever span its channel was last given and the
+ * fake RX DMA writes into the circular buffer the way the real one does. Checks bytes
+ * go out in order, comms_transmit_async() refuses bytes when the TX ring is full, the
+ * log never waits and forwarded bytes count as overflowed if they are written over
+ * before they are sent
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Personal Includes */
+#include "comms_stm32.h"
+#include "log.h"
+#include "tx_queue.h"
+#include "bpacket.h"
+#include "utilities.h"
+
+#define WIRE_SIZE     (RX_BUFFER_SIZE * 2)
+#define TEST_MSG_SIZE 100 // Large enough that the TX ring fills before the queue runs out of spans
+#define TEST_REQUEST  BPACKET_SPECIFIC_R_OFFSET
+#define TEST_NUM_MSGS 200
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            printf("%s:%i: check failed: %s\r\n", __FILE__, __LINE__, #condition); \
+            numFailures++;                                                      \
+        }                                                                       \
+    } while (0)
+
+/* Fake Hardware */
+USART_TypeDef hostUsarts[2];
+DMA_Channel_TypeDef hostDmaChannels[7];
+uint32_t hostPrimask;
+uint32_t SystemCoreClock = 80000000;
+
+/* Comms Variables */
+extern uint8_t rxBuffers[NUM_BUFFERS][RX_BUFFER_SIZE];
+
+/* Private Variables */
+static uint32_t numFailures;
+
+static DMA_Channel_TypeDef* txDma[NUM_BUFFERS] = {BUFFER_1_TX_DMA, BUFFER_2_TX_DMA};
+static DMA_Channel_TypeDef* rxDma[NUM_BUFFERS] = {BUFFER_1_RX_DMA, BUFFER_2_RX_DMA};
+
+// Everything the fake TX DMA channels have sent
+static uint8_t wires[NUM_BUFFERS][WIRE_SIZE];
+static uint32_t wireNumBytes[NUM_BUFFERS];
+static uint32_t numInPlaceTransfers; // Transfers sent straight out of an RX buffer
+
+uint32_t HAL_GetTick(void) {
+    return 0;
+}
+
+static void test_reset(void) {
+    memset(hostUsarts, 0, sizeof(hostUsarts));
+    memset(hostDmaChannels, 0, sizeof(hostDmaChannels));
+    memset(wireNumBytes, 0, sizeof(wireNumBytes));
+    hostPrimask         = 0;
+    numInPlaceTransfers = 0;
+    comms_stm32_init();
+}
+
+// The DMA only takes 32 bit addresses. The tests are linked with -no-pie so the
+// static buffers the comms code hands it are below 4GB
+static uint8_t* test_get_dma_address(DMA_Channel_TypeDef* channel) {
+    return (uint8_t*)(uintptr_t)channel->CMAR;
+}
+
+// Finishes the transfer being sent the way the transfer complete interrupt does.
+// Returns FALSE if nothing was being sent
+static uint8_t test_send_transfer(uint8_t bufferId) {
+
+    DMA_Channel_TypeDef* channel = txDma[bufferId];
+
+    if (((channel->CCR & DMA_CCR_EN) == 0) || (channel->CNDTR == 0)) {
+        return FALSE;
+    }
+
+    uint8_t* data = test_get_dma_address(channel);
+    if ((data >= rxBuffers[0]) && (data < (rxBuffers[0] + sizeof(rxBuffers)))) {
+        numInPlaceTransfers++;
+    }
+
+    memcpy(&wires[bufferId][wireNumBytes[bufferId]], data, channel->CNDTR);
+    wireNumBytes[bufferId] += channel->CNDTR;
+    channel->CNDTR = 0;
+
+    comms_stm32_tx_complete(bufferId);
+
+    return TRUE;
+}
+
+static void test_send_all(uint8_t bufferId) {
+    while (test_send_transfer(bufferId) == TRUE) {};
+}
+
+// Writes bytes into an RX buffer the way the circular RX DMA does
+static void test_receive(uint8_t bufferId, uint8_t* data, uint32_t numBytes) {
+
+    DMA_Channel_TypeDef* channel = rxDma[bufferId];
+    uint8_t* buffer              = test_get_dma_address(channel);
+
+    for (uint32_t i = 0; i < numBytes; i++) {
+        buffer[RX_BUFFER_SIZE - channel->CNDTR] = data[i];
+        channel->CNDTR                          = (channel->CNDTR == 1) ? RX_BUFFER_SIZE : channel->CNDTR - 1;
+    }
+}
+
+static void test_esp32_transmit(uint8_t* data, uint16_t numBytes) {
+    test_receive(BUFFER_1_ID, data, numBytes);
+}
+
+static void test_fill(uint8_t* data, uint32_t numBytes, uint8_t seed) {
+    for (uint32_t i = 0; i < numBytes; i++) {
+        data[i] = (i * 7) + seed;
+    }
+}
+
+// Bytes outside of a bpacket are skipped by the parser. The RX buffer is updated and
+// processed at least every half buffer, the same as the DMA interrupts do
+static void test_esp32_send_noise(uint32_t numBytes) {
+
+    static uint8_t noise[RX_BUFFER_SIZE / 4];
+    static bpacket_t bpacket;
+
+    while (numBytes > 0) {
+        uint32_t numNoiseBytes = (numBytes > sizeof(noise)) ? sizeof(noise) : numBytes;
+        test_receive(BUFFER_1_ID, noise, numNoiseBytes);
+        comms_stm32_rx_update(BUFFER_1_ID);
+        comms_process_rxbuffer(BUFFER_1_ID, &bpacket);
+        numBytes -= numNoiseBytes;
+    }
+}
+
+static uint32_t test_esp32_send_to_maple(void) {
+
+    static uint8_t data[200];
+    test_fill(data, sizeof(data), 5);
+
+    bpacket_frame_t frame;
+    bpacket_encode_frame(&frame, BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_ESP32, TEST_REQUEST, BPACKET_CODE_SUCCESS,
+                         data, sizeof(data), FALSE, 0);
+    bpacket_transmit_frame(test_esp32_transmit, &frame);
+
+    return frame.numHeaderBytes + frame.numDataBytes + frame.numTrailerBytes;
+}
+
+static void test_async_in_order(void) {
+
+    test_reset();
+
+    static uint8_t expected[WIRE_SIZE];
+    uint32_t expectedNumBytes = 0;
+
+    // Enough messages to wrap the TX ring several times. The DMA sends a transfer for
+    // every message after the first few so new bytes are always queued behind others
+    for (uint32_t i = 0; i < TEST_NUM_MSGS; i++) {
+
+        uint8_t msg[50];
+        uint16_t numBytes = (i % sizeof(msg)) + 1;
+        test_fill(msg, numBytes, i);
+
+        CHECK(comms_transmit_async(BUFFER_2_ID, msg, numBytes) == TRUE);
+        CHECK(hostPrimask == 0);
+
+        memcpy(&expected[expectedNumBytes], msg, numBytes);
+        expectedNumBytes += numBytes;
+
+        if (i >= 2) {
+            test_send_transfer(BUFFER_2_ID);
+        }
+    }
+
+    test_send_all(BUFFER_2_ID);
+
+    CHECK(wireNumBytes[BUFFER_2_ID] == expectedNumBytes);
+    CHECK(memcmp(wires[BUFFER_2_ID], expected, expectedNumBytes) == 0);
+    CHECK(wireNumBytes[BUFFER_1_ID] == 0);
+    CHECK(comms_tx_is_idle(BUFFER_2_ID) == TRUE);
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == TX_QUEUE_BUFFER_SIZE);
+}
+
+static void test_async_back_pressure(void) {
+
+    test_reset();
+
+    static uint8_t data[TX_QUEUE_BUFFER_SIZE];
+    test_fill(data, sizeof(data), 3);
+
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == TX_QUEUE_BUFFER_SIZE);
+
+    // The first transfer starts straight away but its bytes are held until it is sent
+    CHECK(comms_transmit_async(BUFFER_2_ID, data, 1000) == TRUE);
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == (TX_QUEUE_BUFFER_SIZE - 1000));
+
+    // Nothing is queued if everything does not fit
+    CHECK(comms_transmit_async(BUFFER_2_ID, &data[1000], 25) == FALSE);
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == (TX_QUEUE_BUFFER_SIZE - 1000));
+    CHECK(hostPrimask == 0);
+
+    CHECK(comms_transmit_async(BUFFER_2_ID, &data[1000], 24) == TRUE);
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == 0);
+    CHECK(comms_transmit_async(BUFFER_2_ID, data, 1) == FALSE);
+
+    // Sending the first transfer frees its bytes
+    CHECK(test_send_transfer(BUFFER_2_ID) == TRUE);
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == 1000);
+    CHECK(comms_transmit_async(BUFFER_2_ID, data, 25) == TRUE);
+
+    test_send_all(BUFFER_2_ID);
+
+    CHECK(wireNumBytes[BUFFER_2_ID] == 1049);
+    CHECK(memcmp(wires[BUFFER_2_ID], data, 1024) == 0);
+    CHECK(memcmp(&wires[BUFFER_2_ID][1024], data, 25) == 0);
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) == TX_QUEUE_BUFFER_SIZE);
+}
+
+static void test_log_never_waits(void) {
+
+    test_reset();
+
+    char msg[TEST_MSG_SIZE + 1];
+    memset(msg, 'a', TEST_MSG_SIZE - 2);
+    strcpy(&msg[TEST_MSG_SIZE - 2], "\r\n");
+
+    // The DMA is stalled so the TX ring fills. The log has to drop whole messages
+    // rather than wait for room
+    uint32_t msgNumBytes = strlen(msg);
+    for (uint32_t i = 0; i < TEST_NUM_MSGS; i++) {
+        log_prints(msg);
+    }
+
+    CHECK(comms_tx_num_free_bytes(BUFFER_2_ID) < msgNumBytes);
+    CHECK(hostPrimask == 0);
+
+    // The UART is never written to directly
+    CHECK(hostUsarts[1].TDR == 0);
+
+    test_send_all(BUFFER_2_ID);
+
+    CHECK(wireNumBytes[BUFFER_2_ID] == ((TX_QUEUE_BUFFER_SIZE / msgNumBytes) * msgNumBytes));
+    for (uint32_t i = 0; i < wireNumBytes[BUFFER_2_ID]; i += msgNumBytes) {
+        CHECK(memcmp(&wires[BUFFER_2_ID][i], msg, msgNumBytes) == 0);
+    }
+
+    // There is room again once the messages have been sent
+    char* colored = "\x1b[36mhello\x1b[37m";
+    log_message("hello");
+    test_send_all(BUFFER_2_ID);
+
+    CHECK(wireNumBytes[BUFFER_2_ID] == (((TX_QUEUE_BUFFER_SIZE / msgNumBytes) * msgNumBytes) + strlen(colored)));
+    CHECK(memcmp(&wires[BUFFER_2_ID][wireNumBytes[BUFFER_2_ID] - strlen(colored)], colored, strlen(colored)) == 0);
+}
+
+static void test_forward_in_order(void) {
+
+    test_reset();
+
+    static uint8_t data[200];
+    static uint8_t expected[WIRE_SIZE];
+    static bpacket_t bpacket;
+    uint32_t expectedNumBytes = 0;
+
+    test_fill(data, sizeof(data), 4);
+
+    // A log message queued before the bpacket arrives has to go out before it
+    log_prints("before\r\n");
+    memcpy(expected, "before\r\n", 8);
+    expectedNumBytes += 8;
+
+    // Send a bpacket for Maple from the ESP32
+    bpacket_frame_t frame;
+    bpacket_encode_frame(&frame, BPACKET_ADDRESS_MAPLE, BPACKET_ADDRESS_ESP32, TEST_REQUEST, BPACKET_CODE_SUCCESS,
+                         data, sizeof(data), FALSE, 0);
+    bpacket_transmit_frame(test_esp32_transmit, &frame);
+
+    memcpy(&expected[expectedNumBytes], frame.header, frame.numHeaderBytes);
+    expectedNumBytes += frame.numHeaderBytes;
+    memcpy(&expected[expectedNumBytes], frame.data, frame.numDataBytes);
+    expectedNumBytes += frame.numDataBytes;
+    memcpy(&expected[expectedNumBytes], frame.trailer, frame.numTrailerBytes);
+    expectedNumBytes += frame.numTrailerBytes;
+
+    comms_stm32_rx_update(BUFFER_1_ID);
+
+    // The bpacket is not for the STM32 so it is forwarded rather than received
+    CHECK(comms_process_rxbuffer(BUFFER_1_ID, &bpacket) == FALSE);
+    CHECK(comms_stm32_request_pending(BUFFER_1_ID) == FALSE);
+
+    log_prints("after\r\n");
+    memcpy(&expected[expectedNumBytes], "after\r\n", 7);
+    expectedNumBytes += 7;
+
+    test_send_all(BUFFER_2_ID);
+
+    CHECK(wireNumBytes[BUFFER_2_ID] == expectedNumBytes);
+    CHECK(memcmp(wires[BUFFER_2_ID], expected, expectedNumBytes) == 0);
+    CHECK(wireNumBytes[BUFFER_1_ID] == 0);
+    CHECK(numInPlaceTransfers > 0);
+    CHECK(hostPrimask == 0);
+}
+
+static void test_forward_overflow(void) {
+
+    test_reset();
+
+    static bpacket_t bpacket;
+    comms_rx_stats_t stats;
+
+    // Forward a bpacket to Maple and hold it in the RX buffer by stalling the DMA to Maple
+    uint32_t numFrameBytes = test_esp32_send_to_maple();
+    comms_stm32_rx_update(BUFFER_1_ID);
+    comms_process_rxbuffer(BUFFER_1_ID, &bpacket);
+
+    // Everything is processed as it arrives but the RX DMA has to stop short of the bytes
+    // that are still waiting to be sent
+    test_esp32_send_noise(RX_BUFFER_SIZE - numFrameBytes);
+    comms_stm32_get_rx_stats(BUFFER_1_ID, &stats);
+    CHECK(stats.numOverflows == 0);
+
+    test_esp32_send_noise(numFrameBytes);
+    comms_stm32_get_rx_stats(BUFFER_1_ID, &stats);
+    CHECK(stats.numOverflows > 0);
+
+    // Sending the bytes first releases them
+    test_reset();
+
+    numFrameBytes = test_esp32_send_to_maple();
+    comms_stm32_rx_update(BUFFER_1_ID);
+    comms_process_rxbuffer(BUFFER_1_ID, &bpacket);
+    test_send_all(BUFFER_2_ID);
+
+    test_esp32_send_noise(RX_BUFFER_SIZE + numFrameBytes);
+    comms_stm32_get_rx_stats(BUFFER_1_ID, &stats);
+    CHECK(stats.numOverflows == 0);
+    CHECK(numInPlaceTransfers > 0);
+}
+
+int main(void) {
+
+    test_async_in_order();
+    test_async_back_pressure();
+    test_log_never_waits();
+    test_forward_in_order();
+    test_forward_overflow();
+
+    if (numFailures != 0) {
+        printf("comms: %u checks failed\r\n", numFailures);
+        return 1;
+    }
+
+    printf("comms: all checks passed\r\n");
+    return 0;
+}
@@ -0,0 +1,357 @@
+/**
+ * @file tx_queue_test.c
+ * @author Gian Barta-Dougall
+ * @brief Builds the TX queue on the host and drives it with a fake DMA channel that
+ * sends whichever span it was last given. Checks the bytes come out in order when
+ * the TX ring wraps, the queue fills up and large spans are split
+ * @version 0.1
+ * @date 2023-03-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/* C Library Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Personal Includes */
+#include "tx_queue.h"
+#include "utilities.h"
+
+#define WIRE_SIZE ((TX_QUEUE_MAX_SPAN_BYTES * 3) + TX_QUEUE_BUFFER_SIZE)
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            printf("%s:%i: check failed: %s\r\n", __FILE__, __LINE__, #condition); \
+            numFailures++;                                                      \
+        }                                                                       \
+    } while (0)
+
+/* Private Variables */
+static uint32_t numFailures;
+
+// The span the fake DMA channel is sending
+static uint8_t* dmaData;
+static uint16_t dmaNumBytes;
+static uint32_t numTransfersStarted;
+
+// Everything the fake DMA channel has sent
+static uint8_t wire[WIRE_SIZE];
+static uint32_t wireNumBytes;
+
+// Spans passed to span_sent()
+static uint8_t* sentData;
+static uint32_t sentNumBytes;
+static uint32_t numSpansSent;
+static uint32_t numSpansOutOfOrder; // Spans that did not carry on from the one before
+
+static void test_start_transfer(uint8_t id, uint8_t* data, uint16_t numBytes) {
+    dmaData     = data;
+    dmaNumBytes = numBytes;
+    numTransfersStarted++;
+}
+
+static void test_span_sent(uint8_t id, uint8_t* data, uint16_t numBytes) {
+
+    if (numSpansSent == 0) {
+        sentData = data;
+    } else if (data != (sentData + sentNumBytes)) {
+        numSpansOutOfOrder++;
+    }
+
+    sentNumBytes += numBytes;
+    numSpansSent++;
+}
+
+static void test_reset(tx_queue_t* queue) {
+    tx_queue_init(queue, 0, test_start_transfer);
+    queue->span_sent    = test_span_sent;
+    dmaData             = NULL;
+    dmaNumBytes         = 0;
+    numTransfersStarted = 0;
+    wireNumBytes        = 0;
+    sentData            = NULL;
+    sentNumBytes        = 0;
+    numSpansSent        = 0;
+    numSpansOutOfOrder  = 0;
+}
+
+// Finishes the span being sent the way the transfer complete interrupt does
+static void test_send_span(tx_queue_t* queue) {
+    memcpy(&wire[wireNumBytes], dmaData, dmaNumBytes);
+    wireNumBytes += dmaNumBytes;
+    tx_queue_transfer_complete(queue);
+}
+
+static void test_send_all(tx_queue_t* queue) {
+    while (tx_queue_is_empty(queue) != TRUE) {
+        test_send_span(queue);
+    }
+}
+
+static void test_fill(uint8_t* data, uint32_t numBytes, uint8_t seed) {
+    for (uint32_t i = 0; i < numBytes; i++) {
+        data[i] = (i * 7) + seed;
+    }
+}
+
+static void test_copies_in_order(void) {
+
+    static tx_queue_t queue;
+    test_reset(&queue);
+
+    uint8_t first[100];
+    uint8_t second[200];
+    test_fill(first, sizeof(first), 1);
+    test_fill(second, sizeof(second), 2);
+
+    CHECK(tx_queue_push_copy(&queue, first, sizeof(first)) == TRUE);
+    CHECK(tx_queue_push_copy(&queue, second, sizeof(second)) == TRUE);
+
+    // The caller can reuse its bytes as soon as they are copied
+    memset(first, 0, sizeof(first));
+
+    CHECK(numTransfersStarted == 1);
+    CHECK(tx_queue_num_free_bytes(&queue) == (TX_QUEUE_BUFFER_SIZE - 300));
+    CHECK(tx_queue_num_pending_bytes(&queue) == 300);
+
+    test_send_all(&queue);
+    test_fill(first, sizeof(first), 1);
+
+    CHECK(wireNumBytes == 300);
+    CHECK(memcmp(wire, first, sizeof(first)) == 0);
+    CHECK(memcmp(&wire[100], second, sizeof(second)) == 0);
+    CHECK(tx_queue_num_free_bytes(&queue) == TX_QUEUE_BUFFER_SIZE);
+    CHECK(tx_queue_num_pending_bytes(&queue) == 0);
+    CHECK(numSpansSent == 0);
+
+    // Nothing is queued for no bytes
+    CHECK(tx_queue_push_copy(&queue, first, 0) == TRUE);
+    CHECK(tx_queue_is_empty(&queue) == TRUE);
+}
+
+static void test_copy_wraps(void) {
+
+    static tx_queue_t queue;
+    test_reset(&queue);
+
+    uint8_t data[TX_QUEUE_BUFFER_SIZE];
+    test_fill(data, sizeof(data), 3);
+
+    // Leave 100 bytes before the end of the ring
+    CHECK(tx_queue_push_copy(&queue, data, TX_QUEUE_BUFFER_SIZE - 100) == TRUE);
+    test_send_all(&queue);
+    wireNumBytes = 0;
+
+    uint32_t numStarted = numTransfersStarted;
+    CHECK(tx_queue_push_copy(&queue, data, 300) == TRUE);
+
+    // The bytes are split in two spans at the end of the ring
+    CHECK(dmaNumBytes == 100);
+    CHECK(dmaData == &queue.buffer[TX_QUEUE_BUFFER_SIZE - 100]);
+    test_send_span(&queue);
+    CHECK(dmaNumBytes == 200);
+    CHECK(dmaData == &queue.buffer[0]);
+    test_send_span(&queue);
+
+    CHECK(numTransfersStarted == (numStarted + 2));
+    CHECK(wireNumBytes == 300);
+    CHECK(memcmp(wire, data, 300) == 0);
+    CHECK(tx_queue_num_free_bytes(&queue) == TX_QUEUE_BUFFER_SIZE);
+}
+
+static void test_ring_full(void) {
+
+    static tx_queue_t queue;
+    test_reset(&queue);
+
+    uint8_t data[TX_QUEUE_BUFFER_SIZE + 1];
+    test_fill(data, sizeof(data), 4);
+
+    CHECK(tx_queue_push_copy(&queue, data, TX_QUEUE_BUFFER_SIZE + 1) == FALSE);
+    CHECK(tx_queue_is_empty(&queue) == TRUE);
+
+    CHECK(tx_queue_push_copy(&queue, data, TX_QUEUE_BUFFER_SIZE - 10) == TRUE);
+    CHECK(tx_queue_num_free_bytes(&queue) == 10);
+
+    // Nothing is queued if there is not room for every byte
+    CHECK(tx_queue_push_copy(&queue, data, 11) == FALSE);
+    CHECK(tx_queue_num_pending_bytes(&queue) == (TX_QUEUE_BUFFER_SIZE - 10));
+
+    CHECK(tx_queue_push_copy(&queue, &data[TX_QUEUE_BUFFER_SIZE - 10], 10) == TRUE);
+    CHECK(tx_queue_num_free_bytes(&queue) == 0);
+
+    test_send_all(&queue);
+    CHECK(wireNumBytes == TX_QUEUE_BUFFER_SIZE);
+    CHECK(memcmp(wire, data, TX_QUEUE_BUFFER_SIZE) == 0);
+}
+
+static void test_spans_full(void) {
+
+    static tx_queue_t queue;
+    test_reset(&queue);
+
+    static uint8_t data[TX_QUEUE_NUM_SPANS * 4];
+    test_fill(data, sizeof(data), 5);
+
+    // One span is always left empty
+    for (uint32_t i = 0; i < (TX_QUEUE_NUM_SPANS - 1); i++) {
+        CHECK(tx_queue_push(&queue, &data[i * 4], 4) == TRUE);
+    }
+
+    CHECK(tx_queue_push(&queue, &data[(TX_QUEUE_NUM_SPANS - 1) * 4], 4) == FALSE);
+    CHECK(tx_queue_push_copy(&queue, data, 1) == FALSE);
+
+    // Sending one span makes room for one more
+    test_send_span(&queue);
+    CHECK(tx_queue_push(&queue, &data[(TX_QUEUE_NUM_SPANS - 1) * 4], 4) == TRUE);
+
+    test_send_all(&queue);
+    CHECK(wireNumBytes == sizeof(data));
+    CHECK(memcmp(wire, data, sizeof(data)) == 0);
+
+    // Every span was the caller's so every one was handed back, in order
+    CHECK(numSpansSent == TX_QUEUE_NUM_SPANS);
+    CHECK(numSpansOutOfOrder == 0);
+    CHECK(sentData == data);
+    CHECK(sentNumBytes == sizeof(data));
+
+    // A copy that wraps needs two spans so it is turned down with one free
+    static uint8_t ring[TX_QUEUE_BUFFER_SIZE];
+    test_reset(&queue);
+    CHECK(tx_queue_push_copy(&queue, ring, TX_QUEUE_BUFFER_SIZE - 2) == TRUE);
+    test_send_all(&queue);
+
+    for (uint32_t i = 0; i < (TX_QUEUE_NUM_SPANS - 2); i++) {
+        CHECK(tx_queue_push(&queue, data, 1) == TRUE);
+    }
+
+    CHECK(tx_queue_push_copy(&queue, data, 4) == FALSE);
+    CHECK(tx_queue_push_copy(&queue, data, 2) == TRUE);
+    test_send_all(&queue);
+}
+
+static void test_split_span(void) {
+
+    static tx_queue_t queue;
+    test_reset(&queue);
+
+    uint32_t numBytes = (TX_QUEUE_MAX_SPAN_BYTES * 2) + 10;
+    uint8_t* data     = malloc(numBytes);
+    test_fill(data, numBytes, 6);
+
+    CHECK(tx_queue_push(&queue, data, numBytes) == TRUE);
+    CHECK(tx_queue_num_pending_bytes(&queue) == numBytes);
+
+    CHECK(dmaNumBytes == TX_QUEUE_MAX_SPAN_BYTES);
+    test_send_span(&queue);
+    CHECK(dmaNumBytes == TX_QUEUE_MAX_SPAN_BYTES);
+    test_send_span(&queue);
+    CHECK(dmaNumBytes == 10);
+    test_send_span(&queue);
+
+    CHECK(tx_queue_is_empty(&queue) == TRUE);
+    CHECK(wireNumBytes == numBytes);
+    CHECK(memcmp(wire, data, numBytes) == 0);
+    CHECK(numSpansSent == 3);
+    CHECK(numSpansOutOfOrder == 0);
+    CHECK(sentData == data);
+    CHECK(sentNumBytes == numBytes);
+
+    // Either every part of a split span is queued or none of them are
+    test_reset(&queue);
+    for (uint32_t i = 0; i < (TX_QUEUE_NUM_SPANS - 3); i++) {
+        CHECK(tx_queue_push(&queue, data, 1) == TRUE);
+    }
+
+    CHECK(tx_queue_push(&queue, data, numBytes) == FALSE);
+    CHECK(tx_queue_num_pending_bytes(&queue) == (TX_QUEUE_NUM_SPANS - 3));
+
+    test_send_span(&queue);
+    CHECK(tx_queue_push(&queue, data, numBytes) == TRUE);
+    test_send_all(&queue);
+    CHECK(wireNumBytes == ((TX_QUEUE_NUM_SPANS - 3) + numBytes));
+
+    free(data);
+}
+
+static void test_mixed(void) {
+
+    static tx_queue_t queue;
+    test_reset(&queue);
+
+    static uint8_t expected[TX_QUEUE_BUFFER_SIZE * 8];
+    static uint8_t held[TX_QUEUE_BUFFER_SIZE * 4];
+    uint32_t expectedNumBytes = 0;
+    uint32_t heldIndex        = 0;
+    test_fill(held, sizeof(held), 7);
+
+    // Copied and held bytes interleaved, with the DMA falling behind and catching up
+    for (uint32_t i = 0; i < 2000; i++) {
+
+        uint16_t numBytes = ((i * 37) % 200) + 1;
+        uint8_t data[200];
+        test_fill(data, numBytes, i);
+
+        if ((i % 3) == 0) {
+            if ((heldIndex + numBytes) > sizeof(held)) {
+                heldIndex = 0;
+            }
+
+            while (tx_queue_push(&queue, &held[heldIndex], numBytes) != TRUE) {
+                test_send_span(&queue);
+            }
+
+            memcpy(&expected[expectedNumBytes], &held[heldIndex], numBytes);
+            heldIndex += numBytes;
+        } else {
+            while (tx_queue_push_copy(&queue, data, numBytes) != TRUE) {
+                test_send_span(&queue);
+            }
+
+            memcpy(&expected[expectedNumBytes], data, numBytes);
+        }
+
+        expectedNumBytes += numBytes;
+
+        if ((i % 5) == 0) {
+            test_send_span(&queue);
+        }
+
+        // Check what has gone out so far every so often so the buffers do not overflow
+        if (expectedNumBytes > (sizeof(expected) - 200)) {
+            test_send_all(&queue);
+            CHECK(wireNumBytes == expectedNumBytes);
+            CHECK(memcmp(wire, expected, expectedNumBytes) == 0);
+            wireNumBytes     = 0;
+            expectedNumBytes = 0;
+        }
+    }
+
+    test_send_all(&queue);
+    CHECK(wireNumBytes == expectedNumBytes);
+    CHECK(memcmp(wire, expected, expectedNumBytes) == 0);
+    CHECK(tx_queue_num_free_bytes(&queue) == TX_QUEUE_BUFFER_SIZE);
+    CHECK(tx_queue_num_pending_bytes(&queue) == 0);
+}
+
+int main(void) {
+
+    test_copies_in_order();
+    test_copy_wraps();
+    test_ring_full();
+    test_spans_full();
+    test_split_span();
+    test_mixed();
+
+    if (numFailures != 0) {
+        printf("tx_queue: %u checks failed\r\n", numFailures);
+        return 1;
+    }
+
+    printf("tx_queue: all checks passed\r\n");
+    return 0;
+}